@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+#
+# alloc.sh
+#   fib と二重ループの実行時間を測る
+#
+#   usage: bench/alloc.sh [metro...]
+#
+#   複数の metro を渡すと並べて比較する。
+#   fib はオブジェクトをほとんど作らず、
+#   二重ループは内側で文字列とベクタを作っては捨てる。
+#   それぞれ 5 回実行して、最も速いものを出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+BENCH_RUNS=5
+
+if (($# == 0)); then
+  set -- ./metro
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/fib.metro" << 'EOF'
+fn fib(n: int) -> int {
+  if n < 2 {
+    return n;
+  }
+  fib(n - 1) + fib(n - 2)
+}
+println(fib(25));
+EOF
+
+cat > "$TMP/nested.metro" << 'EOF'
+let n = 0;
+for i in 0..1000 {
+  for j in 0..300 {
+    let s = "x";
+    let v = [i, j];
+    n = n + 1;
+  }
+}
+println(n);
+EOF
+
+printf "%-24s %10s %10s\n" "metro" "fib (ms)" "nested (ms)"
+
+for metro in "$@"; do
+  printf "%-24s %10d %10d\n" "$metro" \
+    $(best_ms "$metro" "$TMP/fib.metro") \
+    $(best_ms "$metro" "$TMP/nested.metro")
+done
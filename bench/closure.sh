@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+#
+# closure.sh
+#   構文木を直接評価するものと、クロージャに変換したものを比べる
+#
+#   usage: bench/closure.sh [metro] [n]
+#
+#   fib は関数呼び出し、arith は int の式、index は
+#   ベクタの読み出しが中心のループ。
+#   それぞれ 3 回実行して、最も速いものを出す。
+#   (参考に vm も出す)
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-1000000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/fib.metro" << EOF2
+fn fib(n: int) -> int {
+  if n < 2 {
+    return n;
+  }
+  fib(n - 1) + fib(n - 2)
+}
+println(fib(27));
+EOF2
+
+cat > "$TMP/arith.metro" << EOF2
+let s = 0;
+for i in 0..$N {
+  s = s + i * 2 - i / 3;
+}
+println(s);
+EOF2
+
+cat > "$TMP/index.metro" << EOF2
+let v = [1, 2, 3, 4, 5, 6, 7, 8];
+let s = 0;
+let k = 0;
+while k < $N / 8 {
+  for j in 0..len(v) {
+    s = s + v[j];
+  }
+  k = k + 1;
+}
+println(s);
+EOF2
+
+printf "%-8s %12s %14s %12s\n" "" "ast (ms)" "closure (ms)" "vm (ms)"
+
+for kind in fib arith index; do
+  printf "%-8s %12d %14d %12d\n" "$kind" \
+    $(best_ms "$METRO" "$TMP/$kind.metro") \
+    $(best_ms "$METRO" -engine=closure "$TMP/$kind.metro") \
+    $(best_ms "$METRO" -engine=vm "$TMP/$kind.metro")
+done
@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+#
+# common.sh
+#   ベンチマークのスクリプトで共通に使う関数
+#
+#   source "$(dirname "$0")/common.sh"
+#
+
+#
+# best_ms <command> [args...]
+#   BENCH_RUNS 回 (既定は 3 回) 実行して、最も速いものを
+#   ミリ秒で出す。標準出力は捨てる。
+#
+best_ms() {
+  local best=0 begin end ms
+
+  for ((r = 0; r < ${BENCH_RUNS:-3}; r++)); do
+    begin=$(date +%s%N)
+    "$@" > /dev/null
+    end=$(date +%s%N)
+
+    ms=$(((end - begin) / 1000000))
+
+    if ((best == 0 || ms < best)); then
+      best=$ms
+    fi
+  done
+
+  echo $best
+}
@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+#
+# cow.sh
+#   大きなベクタ・辞書を関数に渡すコストを測る
+#
+#   usage: bench/cow.sh [metro] [iterations]
+#
+#   N 要素のベクタと辞書を、3 段の関数呼び出しで渡して
+#   先頭の要素を読むループを回す。
+#   ループなしの実行時間を差し引いて、1 回あたりの時間を出す。
+#   中身を共有するので、N が大きくなっても ns/iter はほぼ一定になる。
+#
+
+METRO=${1:-./metro}
+ITER=${2:-10000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# $1 = vector | dict, $2 = N, $3 = ループ回数
+gen() {
+  local type elems="" i
+
+  if [[ $1 == vector ]]; then
+    type="vector<int>"
+
+    for ((i = 0; i < $2; i++)); do
+      elems+="${elems:+, }$i"
+    done
+
+    echo "let c = [$elems];"
+  else
+    type="dict<int, int>"
+
+    for ((i = 0; i < $2; i++)); do
+      elems+="${elems:+, }$i: $i"
+    done
+
+    echo "let c = {$elems};"
+  fi
+
+  echo "fn f3(c: $type) -> int { c[0] }"
+  echo "fn f2(c: $type) -> int { f3(c) }"
+  echo "fn f1(c: $type) -> int { f2(c) }"
+
+  echo "let s = 0;"
+  echo "for i in 0..$3 {"
+  echo "  s = s + f1(c);"
+  echo "}"
+  echo "println(s);"
+}
+
+elapsed_ns() {
+  local begin end
+
+  begin=$(date +%s%N)
+  "$METRO" "$1" > /dev/null
+  end=$(date +%s%N)
+
+  echo $((end - begin))
+}
+
+printf "%8s %8s %12s\n" "type" "size" "ns/iter"
+
+for type in vector dict; do
+  for n in 10 1000 10000; do
+    gen "$type" "$n" 0 > "$TMP/base.metro"
+    gen "$type" "$n" "$ITER" > "$TMP/loop.metro"
+
+    base=$(elapsed_ns "$TMP/base.metro")
+    loop=$(elapsed_ns "$TMP/loop.metro")
+
+    printf "%8s %8d %12d\n" "$type" "$n" \
+      $(((loop - base) / ITER))
+  done
+done
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+#
+# dict.sh
+#   辞書の読み書きの時間を測る
+#
+#   usage: bench/dict.sh [metro...]
+#
+#   N 個のキーに 4N 回加算してから全部のキーを読み、
+#   最後に全部のキーを削除する。
+#   キーの位置はハッシュ値で引くので、
+#   N を 10 倍にすると時間もおよそ 10 倍になる。
+#   それぞれ 3 回実行して、最も速いものを出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+if (($# == 0)); then
+  set -- ./metro
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# $1 = N
+gen() {
+  echo "let d = {0: 0};"
+  echo "for i in 0..$(($1 * 4)) {"
+  echo "  let k = i * 7919 - i * 7919 / $1 * $1;"
+  echo "  d[k] = get_or(d, k, 0) + 1;"
+  echo "}"
+  echo "let s = 0;"
+  echo "for k in 0..$1 {"
+  echo "  if contains(d, k) {"
+  echo "    s = s + d[k];"
+  echo "  }"
+  echo "}"
+  echo "println(s);"
+  echo "for k in 0..$1 {"
+  echo "  remove(d, k);"
+  echo "}"
+  echo "println(len(d));"
+}
+
+printf "%-24s %8s %10s\n" "metro" "size" "time (ms)"
+
+for metro in "$@"; do
+  for n in 1000 10000 100000; do
+    gen "$n" > "$TMP/dict.metro"
+
+    printf "%-24s %8d %10d\n" "$metro" "$n" \
+      $(best_ms "$metro" "$TMP/dict.metro")
+  done
+done
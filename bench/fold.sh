@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+#
+# fold.sh
+#   定数の畳み込みのあり・なしを比べる
+#
+#   usage: bench/fold.sh [metro] [n]
+#
+#   ループの中で 60 * 60 * 24 のような定数の式と、
+#   リテラルで初期化した let を使う。
+#   各エンジンで 3 回実行して、最も速いものを出す。
+#   最後に畳み込んだ構文木の数を出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-1000000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/const.metro" << EOF2
+let day = 60 * 60 * 24;
+let week = day * 7;
+let debug = 1 > 2;
+let s = 0;
+for i in 0..$N {
+  if debug {
+    println("i = ", i);
+  }
+  s = s + (i & 1023) * (1000 / 10) + week / day - 7;
+}
+println(s, " ", "sec" + "onds");
+EOF2
+
+printf "%-8s %14s %10s\n" "" "no-fold (ms)" "fold (ms)"
+
+for engine in ast closure vm ir; do
+  printf "%-8s %14d %10d\n" "$engine" \
+    $(best_ms "$METRO" -engine=$engine -no-fold "$TMP/const.metro") \
+    $(best_ms "$METRO" -engine=$engine "$TMP/const.metro")
+done
+
+echo
+"$METRO" -fold-stats "$TMP/const.metro" 2>&1 > /dev/null
@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+#
+# forin.sh
+#   ベクタの要素を回すコストを、インデックスと for-in で比べる
+#
+#   usage: bench/forin.sh [metro] [size] [repeat]
+#
+#   N 個の文字列を持つベクタを、index は v[i] で読み、
+#   for-in は for s in v で回して、"x" と等しいものを数える。
+#   for-in は要素を複製せず、範囲の検査もしない。
+#   それぞれ 3 回実行して、最も速いものを出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-10000}
+REPEAT=${3:-300}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+elems=""
+
+for ((i = 0; i < N; i++)); do
+  elems+="${elems:+, }\"s$i\""
+done
+
+cat > "$TMP/index.metro" << EOF2
+let v = [$elems];
+let n = 0;
+for r in 0..$REPEAT {
+  for i in 0..$N {
+    if v[i] == "x" { n = n + 1; }
+  }
+}
+println(n);
+EOF2
+
+cat > "$TMP/forin.metro" << EOF2
+let v = [$elems];
+let n = 0;
+for r in 0..$REPEAT {
+  for s in v {
+    if s == "x" { n = n + 1; }
+  }
+}
+println(n);
+EOF2
+
+printf "%-10s %12s %12s\n" "" "ast (ms)" "vm (ms)"
+
+for kind in index forin; do
+  printf "%-10s %12d %12d\n" "$kind" \
+    $(best_ms "$METRO" "$TMP/$kind.metro") \
+    $(best_ms "$METRO" -engine=vm "$TMP/$kind.metro")
+done
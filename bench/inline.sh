@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+#
+# inline.sh
+#   小さい関数の展開のあり・なしを比べる
+#
+#   usage: bench/inline.sh [metro] [n]
+#
+#   ループの中で、式だけの関数と、途中で return する
+#   関数を呼ぶ。定数の引数は展開した後に畳み込まれる。
+#   各エンジンで 3 回実行して、最も速いものを出す。
+#   最後に展開した呼び出しの数を出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-1000000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/calls.metro" << EOF2
+fn sq(x: int) -> int { x * x }
+
+fn clamp(x: int, lo: int, hi: int) -> int {
+  if x < lo {
+    return lo;
+  }
+
+  if x > hi {
+    return hi;
+  }
+
+  return x;
+}
+
+let s = 0;
+for i in 0..$N {
+  s = s + clamp(sq(i & 63) - 100, 0, 1000) + sq(3);
+}
+println(s);
+EOF2
+
+printf "%-8s %16s %12s\n" "" "no-inline (ms)" "inline (ms)"
+
+for engine in ast closure vm ir; do
+  printf "%-8s %16d %12d\n" "$engine" \
+    $(best_ms "$METRO" -engine=$engine -no-inline "$TMP/calls.metro") \
+    $(best_ms "$METRO" -engine=$engine "$TMP/calls.metro")
+done
+
+echo
+"$METRO" -inline-stats "$TMP/calls.metro" 2>&1 > /dev/null
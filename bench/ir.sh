@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+#
+# ir.sh
+#   構文木を直接評価するものと、SSA 形式の IR を
+#   実行するもの (-engine=ir) を比べる
+#
+#   usage: bench/ir.sh [metro] [n]
+#
+#   fib は関数呼び出し、arith は int の式、words は
+#   文字列とベクタ。
+#   それぞれ 3 回実行して、最も速いものを出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-300000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/fib.metro" << EOF2
+fn fib(n: int) -> int {
+  if n < 2 {
+    return n;
+  }
+  fib(n - 1) + fib(n - 2)
+}
+println(fib(25));
+EOF2
+
+cat > "$TMP/arith.metro" << EOF2
+let s = 0;
+for i in 0..$N {
+  s = s + i * 2 - i / 3;
+}
+println(s);
+EOF2
+
+cat > "$TMP/words.metro" << EOF2
+let words = ["a", "bb", "ccc"];
+let n = 0;
+let i = 0;
+while i < $N / 10 {
+  for w in words {
+    let t = w + "!";
+    n = n + len(t);
+  }
+  i = i + 1;
+}
+println(n);
+EOF2
+
+printf "%-8s %12s %12s\n" "" "ast (ms)" "ir (ms)"
+
+for kind in fib arith words; do
+  printf "%-8s %12d %12d\n" "$kind" \
+    $(best_ms "$METRO" "$TMP/$kind.metro") \
+    $(best_ms "$METRO" -engine=ir "$TMP/$kind.metro")
+done
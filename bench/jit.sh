@@ -0,0 +1,67 @@
+#!/usr/bin/env bash
+#
+# jit.sh
+#   int, float だけの関数を機械語にしたとき (-jit) と
+#   インタプリタ・VM を比べる
+#
+#   usage: bench/jit.sh [metro] [n]
+#
+#   fib は再帰呼び出し、mandel は float のループ
+#   (トップレベルはインタプリタのまま実行する)。
+#   それぞれ 3 回実行して、最も速いものを出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-200}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/fib.metro" << EOF2
+fn fib(n: int) -> int {
+  if n < 2 {
+    return n;
+  }
+  return fib(n - 1) + fib(n - 2);
+}
+println(fib(30));
+EOF2
+
+cat > "$TMP/mandel.metro" << EOF2
+fn iterate(cr: float, ci: float) -> int {
+  let x = 0.0;
+  let y = 0.0;
+  let i = 0;
+  while i < 100 && x * x + y * y < 4.0 {
+    let t = x * x - y * y + cr;
+    y = 2.0 * x * y + ci;
+    x = t;
+    i = i + 1;
+  }
+  i
+}
+
+fn mandel(n: int) -> int {
+  let total = 0;
+  for py in 0 .. n {
+    for px in 0 .. n {
+      let cr = cast<float>(px) * 3.0 / cast<float>(n) - 2.0;
+      let ci = cast<float>(py) * 3.0 / cast<float>(n) - 1.5;
+      total = total + iterate(cr, ci);
+    }
+  }
+  total
+}
+println(mandel($N));
+EOF2
+
+printf "%-8s %10s %10s %10s\n" "" "ast (ms)" "vm (ms)" "jit (ms)"
+
+for kind in fib mandel; do
+  printf "%-8s %10d %10d %10d\n" "$kind" \
+    $(best_ms "$METRO" "$TMP/$kind.metro") \
+    $(best_ms "$METRO" -engine=vm "$TMP/$kind.metro") \
+    $(best_ms "$METRO" -jit "$TMP/$kind.metro")
+done
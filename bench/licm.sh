@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+#
+# licm.sh
+#   ループの中で変わらない式を出すあり・なしを比べる
+#
+#   usage: bench/licm.sh [metro] [n]
+#
+#   while の条件の len(v) - 1 と、ループの中で
+#   書き換えない構造体のメンバをたどる式を使う。
+#   各エンジンで 3 回実行して、最も速いものを出す。
+#   最後にループの外に出した式の数を出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-1000000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/loop.metro" << EOF2
+struct Scale { k: int, d: int }
+struct Conf { scale: Scale, bias: int }
+
+let c = Conf{ scale: Scale{ k: 3, d: 7 }, bias: 11 };
+let v = [1, 2, 3, 4, 5, 6, 7, 8];
+
+let s = 0;
+let i = 0;
+while i < $N * len(v) - 1 {
+  s = s + (i & 7) * (c.scale.k * c.scale.d + c.bias);
+  i = i + 1;
+}
+println(s);
+EOF2
+
+printf "%-8s %16s %12s\n" "" "no-hoist (ms)" "hoist (ms)"
+
+for engine in ast closure vm ir; do
+  printf "%-8s %16d %12d\n" "$engine" \
+    $(best_ms "$METRO" -engine=$engine -no-hoist "$TMP/loop.metro") \
+    $(best_ms "$METRO" -engine=$engine "$TMP/loop.metro")
+done
+
+echo
+"$METRO" -hoist-stats "$TMP/loop.metro" 2>&1 > /dev/null
@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+#
+# quicken.sh
+#   構文木の特殊化 (quickening) のあり・なしを比べる
+#
+#   usage: bench/quicken.sh [metro] [n]
+#
+#   fib は if a < b と return f(..) + g(..)、sum は
+#   x = x + y と v[i] が中心のループ。
+#   それぞれ 3 回実行して、最も速いものを出す。
+#   最後に特殊化した構文木の数を出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-1000000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/fib.metro" << EOF2
+fn fib(n: int) -> int {
+  if n < 2 {
+    return n;
+  }
+  return fib(n - 1) + fib(n - 2);
+}
+println(fib(27));
+EOF2
+
+cat > "$TMP/sum.metro" << EOF2
+let v = [1, 2, 3, 4, 5, 6, 7, 8];
+let s = 0;
+for i in 0..$N {
+  s = s + v[i & 7];
+}
+println(s);
+EOF2
+
+printf "%-8s %16s %14s\n" "" "no-quicken (ms)" "quicken (ms)"
+
+for kind in fib sum; do
+  printf "%-8s %16d %14d\n" "$kind" \
+    $(best_ms "$METRO" -no-quicken "$TMP/$kind.metro") \
+    $(best_ms "$METRO" "$TMP/$kind.metro")
+done
+
+echo
+"$METRO" -quicken-stats "$TMP/fib.metro" "$TMP/sum.metro" \
+  2>&1 > /dev/null
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+#
+# range.sh
+#   範囲の for ループの実行時間と、オブジェクトを作った回数を測る
+#
+#   usage: bench/range.sh [metro] [size]
+#
+#   N x N 回の二重ループで int の計算だけをする。
+#   up は 0..N、step は by 2、down は N..0 by -1 で回す。
+#   allocs は -slab-stats の allocs の合計で、
+#   内側のループで範囲やカウンタを作らなければ 0 になる。
+#   時間は 3 回実行して、最も速いものを出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-1000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# $1 = 内側のループの範囲
+gen() {
+  echo "let s = 0;"
+  echo "for i in 0..$N {"
+  echo "  for j in $1 {"
+  echo "    s = s + i * j;"
+  echo "  }"
+  echo "}"
+}
+
+gen "0..$N" > "$TMP/up.metro"
+gen "0..$N by 2" > "$TMP/step.metro"
+gen "$N..0 by -1" > "$TMP/down.metro"
+
+allocs() {
+  "$METRO" -slab-stats "$@" 2>&1 > /dev/null |
+    sed -n 's/.*: \([0-9]*\) allocs.*/\1/p' |
+    awk '{ n += $1 } END { print n + 0 }'
+}
+
+printf "%-6s %10s %10s %10s %10s\n" "" "ast (ms)" "allocs" \
+  "vm (ms)" "allocs"
+
+for kind in up step down; do
+  printf "%-6s %10d %10d %10d %10d\n" "$kind" \
+    $(best_ms "$METRO" "$TMP/$kind.metro" 2> /dev/null) \
+    $(allocs "$TMP/$kind.metro") \
+    $(best_ms "$METRO" -engine=vm "$TMP/$kind.metro" \
+      2> /dev/null) \
+    $(allocs -engine=vm "$TMP/$kind.metro")
+done
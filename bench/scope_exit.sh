@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+#
+# scope_exit.sh
+#   ライブヒープの大きさを変えながら、スコープを抜けるコストを測る
+#
+#   usage: bench/scope_exit.sh [metro] [iterations]
+#
+#   ヒープには 10000 x K 個の別々の文字列を生かしたまま、
+#   一時オブジェクトを作るループを回す。
+#   live objects は -slab-stats で数えた、ループなしのときの
+#   生きているオブジェクトの最大数。
+#   ループなしの実行時間を差し引いて、1 回あたりの時間を出す。
+#   ヒープが大きくなっても ns/iter はほぼ一定になる。
+#
+
+METRO=${1:-./metro}
+ITER=${2:-1000000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# $1 = 生かしておく文字列の数 / 10000, $2 = ループ回数
+#  文字列は一つずつ作る (リテラルを並べると COW で共有される)
+gen() {
+  echo "let c: dict<int, string>;"
+  echo "for i in 0..$(($1 * 10000)) {"
+  echo "  c[i] = to_string(i);"
+  echo "}"
+
+  echo "for i in 0..$2 {"
+  echo "  let s = \"t\";"
+  echo "  let u = [s, s];"
+  echo "}"
+}
+
+# -slab-stats の live の最大値の合計
+live_objects() {
+  "$METRO" -slab-stats "$1" 2>&1 > /dev/null |
+    sed -n 's/.* live (peak \([0-9]*\)).*/\1/p' |
+    awk '{ n += $1 } END { print n + 0 }'
+}
+
+elapsed_ns() {
+  local begin end
+
+  begin=$(date +%s%N)
+  "$METRO" "$1" > /dev/null
+  end=$(date +%s%N)
+
+  echo $((end - begin))
+}
+
+printf "%12s %12s\n" "live objects" "ns/iter"
+
+for k in 0 1 10 100; do
+  gen "$k" 0 > "$TMP/base.metro"
+  gen "$k" "$ITER" > "$TMP/loop.metro"
+
+  base=$(elapsed_ns "$TMP/base.metro")
+  loop=$(elapsed_ns "$TMP/loop.metro")
+
+  printf "%12d %12d\n" $(live_objects "$TMP/base.metro") \
+    $(((loop - base) / ITER))
+done
@@ -0,0 +1,44 @@
+#!/usr/bin/env bash
+#
+# vector.sh
+#   数値ベクタの計算を、for ループと組み込み関数で比べる
+#
+#   usage: bench/vector.sh [metro] [size]
+#
+#   N 要素の vector<float> について a * b + 1 の合計を求める。
+#   loop は要素ごとにインデックスで読み、builtin は
+#   vmul / vadd / sum でまとめて計算する。
+#   それぞれ 3 回実行して、最も速いものを出す。
+#
+
+source "$(dirname "$0")/common.sh"
+
+METRO=${1:-./metro}
+N=${2:-1000000}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+cat > "$TMP/loop.metro" << EOF2
+let a = fill($N, 0.5);
+let b = fill($N, 2.0);
+let s = 0.0;
+for i in 0..$N {
+  s = s + a[i] * b[i] + 1.0;
+}
+println(s);
+EOF2
+
+cat > "$TMP/builtin.metro" << EOF2
+let a = fill($N, 0.5);
+let b = fill($N, 2.0);
+println(sum(vadd(vmul(a, b), 1.0)));
+EOF2
+
+printf "%-10s %12s %12s\n" "" "ast (ms)" "vm (ms)"
+
+for kind in loop builtin; do
+  printf "%-10s %12d %12d\n" "$kind" \
+    $(best_ms "$METRO" "$TMP/$kind.metro") \
+    $(best_ms "$METRO" -engine=vm "$TMP/$kind.metro")
+done
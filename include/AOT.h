@@ -0,0 +1,7 @@
+// ---------------------------------------------
+//  Ahead-of-time compiler (C++ に変換する)
+// ---------------------------------------------
+#pragma once
+
+#include "AOT/Emitter.h"
+#include "AOT/Driver.h"
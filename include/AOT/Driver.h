@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+#include "AST.h"
+
+namespace AOT {
+
+/**
+ * @brief C++ のソースをファイルに書き出す (-emit-cpp)
+ *
+ * @return 書き出せなければ false
+ */
+bool write_source(AST::Scope* root,
+                  std::string const& path);
+
+/**
+ * @brief 実行ファイルを作る (-aot)
+ *
+ * @note コンパイラは METRO_CXX (なければ c++) を使い、
+ *       ビルドしたときの include と libmetro-rt.a を使う
+ *
+ * @return コンパイルに失敗したら false
+ */
+bool build_executable(AST::Scope* root,
+                      std::string const& path);
+
+}  // namespace AOT
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "AST.h"
+
+namespace AOT {
+
+// ---------------------------------------------
+//  Emitter
+//   Sema でチェック済みの構文木を C++ のソースにする
+//   (AOT/Runtime.h を使い、libmetro-rt.a とリンクする)
+//
+//   int, float などの変数は C++ の型のまま持ち、
+//   それ以外は Value で持つ
+//   評価の順番、参照カウント、スコープを抜けるときの
+//   回収は Evaluator と同じにする
+//   途中で文が必要な式は ({ ... }) (GNU の文式) にする
+//
+//   対応していない構文があればエラーにする
+// ---------------------------------------------
+class Emitter {
+  //
+  // スコープの変数
+  struct Variable {
+    std::string_view name;
+    std::string code;  // C++ での名前
+    TypeInfo type;
+  };
+
+  using VarList = std::vector<Variable>;
+
+  //
+  // スコープの最後の式の値を入れる変数
+  //  (name が空なら捨てる)
+  struct Dest {
+    std::string name;
+    TypeKind kind;  // {} なら TYPE_None
+  };
+
+public:
+  explicit Emitter(AST::Scope* root);
+
+  //
+  // C++ のソース全体
+  std::string emit();
+
+private:
+  //
+  // Sema で決まった型
+  static TypeInfo type_of(AST::Base* ast);
+
+  //
+  // C++ での型の名前
+  static std::string cpp_type(TypeKind kind);
+
+  static bool is_scalar(TypeKind kind);
+
+  //
+  // 副作用があるか (実行時エラーも含む)
+  //  ないものどうしは、評価の順番を気にしなくてよい
+  static bool has_effects(AST::Base* ast);
+
+  static bool is_constant(AST::Base* ast);
+
+  //
+  // Value に入れる・Value から取り出す
+  static std::string box(std::string const& code,
+                         TypeKind kind);
+  static std::string unbox(std::string const& code,
+                           TypeKind kind);
+
+  static std::string convert(std::string const& code,
+                             TypeKind from, TypeKind to);
+
+  [[noreturn]] static void unsupported(AST::Base* ast);
+
+  //
+  // ScopeGuard が必要か
+  //  (オブジェクトを作らないスコープでは回収しない)
+  static bool needs_guard(AST::Base* ast);
+
+  // --------------------------------------------------------
+  //  出力
+  // --------------------------------------------------------
+  void line(std::string const& str);
+  std::string indent() const;
+  std::string temp();
+
+  /**
+   * @brief 文式 ({ ... }) を作る
+   *
+   * @param fn 文を出力して、最後の式を返す
+   * @return 文がなければ最後の式だけ
+   */
+  std::string block(std::function<std::string()> const& fn);
+
+  //
+  // 前から順に評価する (必要なら一時変数に入れる)
+  //  block() の中で使うこと
+  std::vector<std::string> sequence(
+      std::vector<AST::Base*> const& asts);
+
+  // --------------------------------------------------------
+  //  表
+  // --------------------------------------------------------
+
+  //
+  // 実行時エラーの位置の表示
+  std::string site(AST::Base* ast);
+  std::string site(Token const& token);
+
+  //
+  // TypeInfo::intern した記述子
+  std::string type_ptr(TypeInfo const& type);
+  std::string type_expr(TypeInfo const& type);
+
+  std::string string_literal(AST::Value* ast);
+
+  // --------------------------------------------------------
+  //  変数
+  // --------------------------------------------------------
+  Variable const& find_var(AST::Variable* ast);
+
+  std::string declare(std::string_view name,
+                      TypeInfo const& type, bool is_global);
+
+  // --------------------------------------------------------
+  //  式
+  // --------------------------------------------------------
+  std::string expr(AST::Base* ast);
+
+  //
+  // 読むだけのとき (変数は複製しない)
+  std::string borrow(AST::Base* ast);
+
+  //
+  // 書き込み先 (Value* の式)
+  std::string lvalue(AST::Base* ast);
+
+  std::string literal(AST::Value* ast);
+  std::string call(AST::CallFunc* ast);
+  std::string call_builtin(AST::CallFunc* ast);
+  std::string index(AST::IndexRef* ast);
+  std::string member(AST::IndexRef* ast);
+  std::string arith(AST::Expr* ast);
+  std::string concat(AST::Expr* ast);
+  std::string compare(AST::Compare* ast);
+  std::string assign(AST::Assign* ast);
+
+  //
+  // 値が必要な文 (if, スコープ)
+  std::string value_of(AST::Base* ast);
+
+  // --------------------------------------------------------
+  //  文
+  // --------------------------------------------------------
+  void stmt(AST::Base* ast, Dest const& dest = {});
+
+  void scope(AST::Base* ast, Dest const& dest,
+             std::string const& head,
+             std::string const& tail = "");
+
+  void let(AST::VariableDeclaration* ast);
+  void if_stmt(AST::If* ast, Dest const& dest,
+               std::string const& prefix = "");
+  void switch_stmt(AST::Switch* ast);
+  void for_stmt(AST::For* ast);
+
+  void function(AST::Function* ast);
+  std::string signature(AST::Function* ast);
+
+  AST::Scope* root;
+
+  //
+  // 出力中の文
+  std::string code;
+  size_t depth = 0;
+  size_t temp_count = 0;
+
+  std::vector<VarList> scopes;
+
+  //
+  // 今出力している関数 (トップレベルなら nullptr)
+  AST::Function* cur_func = nullptr;
+
+  //
+  // 関数から参照されるトップレベルの変数の名前
+  //  (これだけ static な変数にする)
+  std::set<std::string_view> global_names;
+
+  std::map<std::string_view, size_t> name_count;
+
+  //
+  // 出力する宣言と、init() の中身
+  std::vector<std::string> structs;
+  std::vector<std::string> globals;
+  std::vector<std::string> functions;
+  std::vector<std::string> init;
+
+  std::map<std::string, std::string> sites;
+  std::map<std::string, std::string> types;
+  std::map<AST::Value*, std::string> strings;
+};
+
+}  // namespace AOT
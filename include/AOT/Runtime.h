@@ -0,0 +1,337 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "AST.h"
+#include "Arith.h"
+#include "GC.h"
+#include "Object.h"
+
+// ---------------------------------------------
+//  AOT Runtime
+//   -emit-cpp で生成した C++ から使う処理
+//   (libmetro-rt.a にまとめてリンクする)
+//
+//   int, float などはそのまま C++ の型で持ち、
+//   それ以外は Value で持つ
+//   参照カウントと ZCT の扱いは Evaluator と同じで、
+//   スコープを抜けるときに collect() で回収する
+// ---------------------------------------------
+namespace AOT {
+
+/**
+ * @brief 実行時エラーを表示して終了する
+ *
+ * @param site Error::emit の位置の表示 (生成時に作っておく)
+ * @param message
+ */
+[[noreturn]] void error(char const* site,
+                        std::string const& message);
+
+//
+// 構造体の定義と型
+//  (ObjUserType::to_string が名前を使う)
+AST::Struct* make_struct(
+    char const* name,
+    std::initializer_list<char const*> members);
+
+TypeInfo make_type(
+    AST::Struct* ast,
+    std::initializer_list<TypeInfo::member_pair_t> members);
+
+//
+// 文字列の即値 (参照を一つ持ったままにする)
+Value make_string(std::wstring&& value);
+
+//
+// Evaluator::default_constructor と同じ
+Value default_value(TypeInfo const& type,
+                    bool construct_member = true);
+
+Value new_vector(TypeInfo const* type);
+Value new_dict(TypeInfo const* type);
+
+void append(Value const& vec, Value const& value);
+void append(Value const& dict, Value const& key,
+            Value const& value);
+
+void add_member(Value const& obj, Value const& value);
+
+//
+// 範囲の by (0 ならエラー)
+int64_t range_step(int64_t step, char const* site);
+
+/**
+ * @brief obj[index] を読む
+ *
+ * @param tmp 詰めて持っている要素や、辞書のデフォルト値を
+ *            置く場所
+ * @return 要素 (obj か tmp の中)
+ */
+Value const& at(Value const& obj, Value const& index,
+                Value& tmp, bool check, char const* site);
+
+//
+// obj[index] (書き込み先)
+//  辞書になければ追加する
+Value& step(Value& obj, Value const& index, bool check,
+            char const* site);
+
+//
+// obj[index] = value
+//  value の参照は呼び出す側で増やしておく
+Value store(Value& obj, Value const& index,
+            Value const& value, bool check,
+            char const* site);
+
+/**
+ * @brief 組み込み関数を呼ぶ
+ *
+ * @note 引数の参照は呼び出す側で増やしておき、ここで減らす
+ *
+ * @param index BuiltinFunc::get_builtin_list() の位置
+ */
+Value call_builtin(size_t index, std::vector<Value>& args,
+                   char const* site);
+
+inline size_t to_index(Value const& value)
+{
+  return value.kind == TYPE_USize ? value.v_usize
+                                  : (size_t)value.v_int;
+}
+
+//
+// Value の中身を C++ の型で取り出す
+template <class T>
+T scalar(Value const& value)
+{
+  if constexpr (std::is_same_v<T, int64_t>)
+    return value.v_int;
+  else if constexpr (std::is_same_v<T, size_t>)
+    return value.v_usize;
+  else if constexpr (std::is_same_v<T, float>)
+    return value.v_float;
+  else if constexpr (std::is_same_v<T, bool>)
+    return value.v_bool;
+  else
+    return value.v_char;
+}
+
+//
+// C++ の型の値を Value にする
+template <class T>
+Value box(T value)
+{
+  if constexpr (std::is_same_v<T, int64_t>)
+    return Value::from_int(value);
+  else if constexpr (std::is_same_v<T, size_t>)
+    return Value::from_usize(value);
+  else if constexpr (std::is_same_v<T, float>)
+    return Value::from_float(value);
+  else if constexpr (std::is_same_v<T, bool>)
+    return Value::from_bool(value);
+  else
+    return Value::from_char(value);
+}
+
+//
+// vector<int>, vector<float> などの v[i] (bool 以外)
+//  詰めて持っていなければ (要素の型がない [] から作ったもの)
+//  at() で読む
+template <class T>
+T get(Value const& vec, size_t index, bool check,
+      char const* site)
+{
+  auto obj = (ObjVector*)vec.v_obj;
+
+  if (!obj->is_packed()) {
+    Value tmp;
+
+    return scalar<T>(at(vec, Value::from_usize(index), tmp,
+                        check, site));
+  }
+
+  auto const& elements = obj->get_packed<T>();
+
+  if (check && index >= elements.size())
+    error(site, "index out of range");
+
+  return elements[index];
+}
+
+//
+// vector<int>, vector<float> などの v[i] = value (bool 以外)
+template <class T>
+T set(Value& vec, size_t index, T value, bool check,
+      char const* site)
+{
+  auto obj = (ObjVector*)vec.v_obj;
+
+  if (!obj->is_packed()) {
+    store(vec, Value::from_usize(index), box(value), check,
+          site);
+
+    return value;
+  }
+
+  if (check && index >= obj->size())
+    error(site, "index out of range");
+
+  return obj->get_mut_packed<T>()[index] = value;
+}
+
+inline Value const& member(Value const& obj, size_t index)
+{
+  return ((ObjUserType*)obj.v_obj)->get_members()[index];
+}
+
+inline Value& member_mut(Value& obj, size_t index)
+{
+  auto obj_struct = (ObjUserType*)obj.v_obj;
+
+  return obj_struct->get_mut_members()[index];
+}
+
+//
+// 変数への代入
+inline Value const& assign(Value& dest, Value const& value)
+{
+  value.inc_ref();
+  dest.dec_ref();
+
+  return dest = value;
+}
+
+//
+// a + b (string)
+inline void concat(Value& dest, Value const& right)
+{
+  ((ObjString*)dest.v_obj)->get_mut_value() +=
+      ((ObjString*)right.v_obj)->get_value();
+}
+
+template <class T>
+T divide(T a, T b, char const* site)
+{
+  if (b == 0)
+    error(site, "division by zero");
+
+  if constexpr (std::is_same_v<T, int64_t>)
+    return Arith::div(a, b);
+
+  return a / b;
+}
+
+inline size_t mark()
+{
+  return GarbageCollector::get_mark();
+}
+
+//
+// スコープを抜けるときに、mark から後の参照されていない
+// オブジェクトを削除する (結果・戻り値は残す)
+inline void collect(size_t mark, Value const& result = {},
+                    Value const& ret = {})
+{
+  GarbageCollector::collect(
+      mark, {result.is_heap() ? result.v_obj : nullptr,
+             ret.is_heap() ? ret.v_obj : nullptr});
+}
+
+// ---------------------------------------------
+//  Var
+//   スタックに置く変数 (string, vector など)
+//   参照を一つ持ち、スコープを抜けるときに手放す
+// ---------------------------------------------
+struct Var : Value {
+  explicit Var(Value const& value)
+      : Value(value)
+  {
+    this->inc_ref();
+  }
+
+  Var(Var const&) = delete;
+
+  ~Var()
+  {
+    this->dec_ref();
+  }
+};
+
+// ---------------------------------------------
+//  ScopeGuard
+//   Evaluator::leave_scope と同じ
+//   変数 (Var) を手放したあとに回収する
+//   result と ret は残す (スコープの結果、関数の戻り値)
+// ---------------------------------------------
+struct ScopeGuard {
+  size_t mark;
+  Value const* result;
+  Value const* ret;
+
+  explicit ScopeGuard(Value const* result = nullptr,
+                      Value const* ret = nullptr)
+      : mark(GarbageCollector::get_mark()),
+        result(result),
+        ret(ret)
+  {
+  }
+
+  ScopeGuard(ScopeGuard const&) = delete;
+
+  ~ScopeGuard()
+  {
+    if (GarbageCollector::get_mark() == this->mark)
+      return;
+
+    collect(this->mark,
+            this->result ? *this->result : Value(),
+            this->ret ? *this->ret : Value());
+  }
+};
+
+//
+// for-in で回すもの (ベクタ、辞書、文字列)
+//  書き換えるたびに version が増える
+uint32_t iter_version(Value const& obj);
+size_t iter_size(Value const& obj);
+
+//
+// index 番目の文字、要素、キー (複製しない)
+Value iter_get(Value const& obj, size_t index);
+
+//
+// 回している間に書き換えられていればエラー
+void iter_check(Value const& obj, uint32_t version,
+                char const* site);
+
+// ---------------------------------------------
+//  ForIn
+//   for x in (ベクタ、辞書、文字列)
+//   要素は複製せずに返す
+//   途中で書き換えられたら next() でエラーにする
+//   (回している間は参照を持っておく)
+// ---------------------------------------------
+struct ForIn {
+  Value obj;
+  size_t index;
+  uint32_t version;
+
+  explicit ForIn(Value const& obj);
+
+  ForIn(ForIn const&) = delete;
+
+  ~ForIn();
+
+  size_t size() const;
+
+  Value get() const;
+
+  void next(char const* site);
+};
+
+}  // namespace AOT
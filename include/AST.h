@@ -22,4 +22,6 @@
 #include "AST/Struct.h"
 #include "AST/Function.h"
 
-#include "AST/Impl.h"
\ No newline at end of file
+#include "AST/Impl.h"
+
+#include "AST/Walk.h"
\ No newline at end of file
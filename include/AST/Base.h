@@ -2,6 +2,7 @@
 
 #include <list>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 namespace AST {
@@ -13,6 +14,9 @@ struct Base {
 
   bool is_left;
 
+  // Evaluator で選んだ特殊化
+  QuickKind quick;
+
   virtual ~Base();
 
   virtual std::string to_string() const;
@@ -39,14 +43,26 @@ protected:
 template <class Kind, ASTKind _self_kind>
 struct ExprBase : Base {
   struct Element {
+    //
+    // 演算の関数 (Operators.h)
+    using Kernel = std::conditional_t<
+        std::is_same_v<Kind, CmpKind>,
+        bool (*)(::Value const& left, ::Value const& right),
+        void (*)(::Value& dest, ::Value const& right,
+                 Token const& op)>;
+
     Kind kind;
     Token const& op;
     Base* ast;
 
+    // Sema で両辺の型から選ぶ
+    Kernel kernel;
+
     explicit Element(Kind kind, Token const& op, Base* ast)
         : kind(kind),
           op(op),
-          ast(ast)
+          ast(ast),
+          kernel(nullptr)
     {
     }
 
@@ -7,14 +7,19 @@ struct ConstKeyword : Base {
 };
 
 struct Value : Base {
+  // Evaluator::immediate_objects の中の位置
+  //  (まだ作っていなければ SIZE_MAX)
+  size_t object_index;
+
   std::string to_string() const;
 
   Value(Token const& tok);
 };
 
 struct Variable : Base {
-  size_t step;
+  size_t slot;  // フレーム内の位置
   size_t index;
+  bool is_global;
   std::string_view name;
 
   Variable(Token const& tok);
@@ -104,6 +109,17 @@ struct IndexRef : ListBase {
   Base* expr;
   ASTVector indexes;
 
+  // indexes[0] が範囲内だと Sema で分かっている
+  //  (bounds-check elimination)
+  bool is_in_bounds;
+
+  //
+  // index の範囲を実行時に調べる必要があるか
+  bool needs_bounds_check(Base const* index) const
+  {
+    return !this->is_in_bounds || index != this->indexes[0];
+  }
+
   bool is_empty() const override
   {
     return this->indexes.empty();
@@ -121,6 +137,7 @@ struct IndexRef : ListBase {
 struct Range : Base {
   Base* begin;
   Base* end;
+  Base* step;  // by (なければ nullptr)
 
   Range(Token const& token);
   ~Range();
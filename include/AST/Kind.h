@@ -61,6 +61,33 @@ enum ASTKind : uint8_t {
   AST_Impl,
 };
 
+//
+// 評価するときに選ぶ特殊化 (quickening)
+//  最初に評価したときに Evaluator::quicken が決めて、
+//  次からは kind ではなくこれで分岐する
+#define AST_QUICK_LIST(_)                                       \
+  _(None)              /* まだ評価していない             */ \
+  _(Generic)           /* 特殊化しない                   */ \
+  _(VariableScalar)    /* 変数 (int, float など)         */ \
+  _(IndexRefVectorInt) /* v[i] (ベクタの変数, int 添字)   */ \
+  _(CallUserFuncFixedArity) /* ユーザー定義関数          */ \
+  _(CallBuiltin)       /* 組み込み関数                   */ \
+  _(ExprInt)           /* int だけの式                   */ \
+  _(CompareInt)        /* a < b (int)                    */ \
+  _(AssignScalar)      /* x = y (int, float など)        */ \
+                                                             \
+  /* 複数の構文をまとめたもの                             */ \
+  _(AssignAddInt)      /* x = x + y (int)                */ \
+  _(IfCompareInt)      /* if a < b { } (int)             */ \
+  _(ReturnAddCalls)    /* return f(..) + g(..) (int)     */
+
+enum QuickKind : uint8_t {
+#define _AST_QUICK_ENUM(name) QUICK_##name,
+  AST_QUICK_LIST(_AST_QUICK_ENUM)
+#undef _AST_QUICK_ENUM
+      QUICK_Max
+};
+
 namespace AST {
 
 enum CmpKind : uint8_t {
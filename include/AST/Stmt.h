@@ -9,6 +9,8 @@ struct VariableDeclaration : Base {
   Type* type;
   Base* init;
 
+  size_t slot;
+
   VariableDeclaration(Token const& token);
   ~VariableDeclaration();
 };
@@ -28,6 +30,16 @@ struct Scope : ListBase {
   ASTVector list;
   bool return_last_expr;
 
+  //
+  // このスコープで定義される変数の位置 [slot_begin, slot_end)
+  size_t slot_begin;
+  size_t slot_end;
+
+  //
+  // 関数 (またはトップレベル) のフレームの大きさ
+  // それ以外のスコープでは 0
+  size_t frame_size;
+
   bool is_empty() const override
   {
     return this->list.empty();
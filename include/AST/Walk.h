@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <set>
+#include <string_view>
+
+namespace AST {
+
+/**
+ * @brief 子の構文木を順にたどる
+ *
+ * @note 置き換えられるように参照で渡す
+ *       関数の引数やキャスト先などの型と、
+ *       メンバアクセスのメンバ名はたどらない
+ *       ないもの (else など) は nullptr で呼ぶ
+ */
+void children(Base* ast,
+              std::function<void(Base*&)> const& fn);
+
+/**
+ * @brief 構文木を前から順にたどる
+ *
+ * @note メンバアクセスのメンバ名 (Variable) はたどらない
+ *
+ * @param ast nullptr なら何もしない
+ * @param fn 親を先に呼ぶ
+ */
+void walk(Base* ast, std::function<void(Base*)> const& fn);
+
+/**
+ * @brief 関数から参照されるトップレベルの変数の名前を集める
+ *
+ * @note IR と AOT はこの名前の変数だけをグローバルにする
+ *       (Inliner はこの名前の let をトップレベルに展開しない)
+ *
+ * @param root
+ */
+std::set<std::string_view> global_names(Scope* root);
+
+}  // namespace AST
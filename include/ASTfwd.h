@@ -3,6 +3,7 @@
 #include <cstdint>
 
 struct Token;
+struct Value;
 struct Object;
 struct BuiltinFunc;
 
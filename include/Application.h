@@ -8,6 +8,62 @@
 class ScriptFileContext;
 class Application {
 public:
+  //
+  // 実行エンジン
+  enum EngineKind {
+    ENGINE_AST,  // 構文木を直接評価する
+    ENGINE_VM,  // バイトコードにコンパイルして実行する
+    ENGINE_Closure,  // 構文木をクロージャに変換して実行する
+    ENGINE_IR,  // SSA 形式の IR に変換して実行する
+  };
+
+  //
+  // コマンドラインオプション
+  struct Options {
+    EngineKind engine = ENGINE_AST;
+
+    bool dump_bytecode = false;  // -dump-bytecode
+    bool dump_bce = false;  // -dump-bce
+    bool dump_ir = false;  // -dump-ir
+
+    // -gc-max-pause-us=<n>
+    //  GC の一回の停止時間の上限 (0 ならデフォルト)
+    //  指定すると終了時に停止時間のヒストグラムを表示する
+    size_t gc_max_pause_us = 0;
+
+    bool slab_stats = false;  // -slab-stats
+
+    //
+    // 構文木の特殊化 (quickening)
+    bool no_quicken = false;  // -no-quicken
+    bool quicken_stats = false;  // -quicken-stats
+
+    //
+    // 定数の畳み込み
+    bool no_fold = false;  // -no-fold
+    bool fold_stats = false;  // -fold-stats
+
+    //
+    // 小さい関数の呼び出しの展開
+    bool no_inline = false;  // -no-inline
+    bool inline_stats = false;  // -inline-stats
+
+    //
+    // ループの中で変わらない式をループの前に出す
+    bool no_hoist = false;  // -no-hoist
+    bool hoist_stats = false;  // -hoist-stats
+
+    //
+    // int, float だけの関数を機械語にする (ast, closure)
+    bool jit = false;  // -jit
+
+    //
+    // 実行せずに C++ に変換する
+    std::string emit_cpp;  // -emit-cpp=<file>
+    bool aot = false;  // -aot[=<exe>]
+    std::string aot_output;  // 空ならスクリプトの名前から
+  };
+
   Application();
   ~Application();
 
@@ -20,11 +76,15 @@ public:
 
   ScriptFileContext const* get_current_context() const;
 
+  Options const& get_options() const;
+
   static void initialize();
 
   static Application* get_instance();
 
 private:
+  Options _options;
+
   ScriptFileContext const* _cur_ctx;
   std::vector<ScriptFileContext> _contexts;
 };
@@ -0,0 +1,74 @@
+// ---------------------------------------------
+//  Arith
+// ---------------------------------------------
+#pragma once
+
+#include <cstdint>
+
+//
+// int の演算
+//  全てのエンジン、組み込み関数、定数の畳み込みで同じ結果にする
+//  - 桁あふれは 2 の補数で巻き戻す
+//  - 最小値 / -1 は最小値 (巻き戻した符号反転)、% -1 は 0
+//  - シフトの量は下位 6 ビットだけ使う (x86 と同じ)
+//  0 で割るかどうかは呼び出す側で調べる
+namespace Arith {
+
+inline int64_t add(int64_t a, int64_t b)
+{
+  return (int64_t)((uint64_t)a + (uint64_t)b);
+}
+
+inline int64_t sub(int64_t a, int64_t b)
+{
+  return (int64_t)((uint64_t)a - (uint64_t)b);
+}
+
+inline int64_t mul(int64_t a, int64_t b)
+{
+  return (int64_t)((uint64_t)a * (uint64_t)b);
+}
+
+inline int64_t neg(int64_t a)
+{
+  return (int64_t)(0 - (uint64_t)a);
+}
+
+inline int64_t div(int64_t a, int64_t b)
+{
+  return b == -1 ? neg(a) : a / b;
+}
+
+inline int64_t mod(int64_t a, int64_t b)
+{
+  return b == -1 ? 0 : a % b;
+}
+
+inline int64_t shl(int64_t a, int64_t b)
+{
+  return (int64_t)((uint64_t)a << (b & 63));
+}
+
+inline int64_t shr(int64_t a, int64_t b)
+{
+  return a >> (b & 63);
+}
+
+//
+// 範囲の for で i を step 進める
+//  次の値が end に届く (越える) ときは進めずに false
+//  i + step は桁あふれするので、end までの残りと比べる
+inline bool range_next(int64_t& i, int64_t end,
+                       int64_t step)
+{
+  if (step > 0 ? i >= end || (uint64_t)end - (uint64_t)i <=
+                                 (uint64_t)step
+               : i <= end || (uint64_t)i - (uint64_t)end <=
+                                 0 - (uint64_t)step)
+    return false;
+
+  i += step;
+  return true;
+}
+
+}  // namespace Arith
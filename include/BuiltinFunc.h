@@ -1,18 +1,23 @@
 #pragma once
 
 #include <functional>
+#include <optional>
 #include <string>
 #include <vector>
 #include "TypeInfo.h"
-
-struct Object;
+#include "Value.h"
 
 // ---------------------------------------------
 //  BuiltinFunc
 // ---------------------------------------------
 struct BuiltinFunc {
   using Implementation =
-      std::function<Object*(std::vector<Object*> const&)>;
+      std::function<Value(std::vector<Value> const&)>;
+
+  // 引数の型が合わなければ std::nullopt を返す
+  using ResultTypeFunc =
+      std::function<std::optional<TypeInfo>(
+          std::vector<TypeInfo> const& arg_types)>;
 
   std::string name;  // 関数名
 
@@ -23,6 +28,34 @@ struct BuiltinFunc {
 
   Implementation impl;  // 処理
 
+  // 引数の型から戻り値の型を決める (なければ result_type)
+  //  テンプレート引数どうしの対応もここで調べる
+  ResultTypeFunc get_result_type = nullptr;
+
+  //
+  // 引数の渡し方
+  enum ArgPassing {
+    ARG_Copy,  // 複製して渡す
+    ARG_Borrow,  // 複製せずに渡す (どれも読むだけ)
+    ARG_Ref,  // 最初の引数は左辺値で、書き換える
+              // (残りは ARG_Borrow と同じ)
+  };
+
+  ArgPassing arg_passing = ARG_Copy;
+
+  //
+  // 副作用がなく、実行時エラーにもならない
+  //  (同じ引数なら同じ値を返す)
+  //  ループの外に出してもよい (Optimizer::Hoister)
+  bool is_pure = false;
+
+  //
+  // impl の中で実行時エラーにするときに投げる
+  //  呼び出した側で位置をつけて表示する
+  struct RuntimeError {
+    std::string message;
+  };
+
   // BuiltinFunc();
 
   static std::vector<BuiltinFunc> const& get_builtin_list();
@@ -0,0 +1,79 @@
+// ---------------------------------------------
+//  Cow
+// ---------------------------------------------
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+//
+// copy-on-write で共有する中身
+//  コピーすると中身を共有し、書き換えるときに
+//  共有していれば複製する
+template <class T>
+class Cow {
+  struct Block {
+    size_t owners;
+    T data;
+  };
+
+  Block* block;
+
+public:
+  Cow()
+      : block(new Block{1, T{}})
+  {
+  }
+
+  explicit Cow(T&& data)
+      : block(new Block{1, std::move(data)})
+  {
+  }
+
+  Cow(Cow const& other)
+      : block(other.block)
+  {
+    this->block->owners++;
+  }
+
+  Cow& operator=(Cow const&) = delete;
+
+  ~Cow()
+  {
+    if (--this->block->owners == 0)
+      delete this->block;
+  }
+
+  bool is_shared() const
+  {
+    return this->block->owners > 1;
+  }
+
+  T const& get() const
+  {
+    return this->block->data;
+  }
+
+  //
+  // 書き換えるときに使う
+  //  共有していれば copy(data) で複製したものに付け替える
+  template <class F>
+  T& get_mut(F&& copy)
+  {
+    if (this->is_shared()) {
+      auto block = new Block{1, copy(this->block->data)};
+
+      this->block->owners--;
+      this->block = block;
+    }
+
+    return this->block->data;
+  }
+
+  //
+  // 共有したまま書き換える (GC で参照を切るときだけ使う)
+  T& get_shared()
+  {
+    return this->block->data;
+  }
+};
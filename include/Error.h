@@ -4,6 +4,7 @@
 #pragma once
 
 #include <memory>
+#include <ostream>
 #include "AST.h"
 
 enum ErrorKind {
@@ -77,12 +78,17 @@ public:
 
   [[noreturn]] void exit(int code = 1);
 
+  //
+  // emit() が std::cerr に出す位置の表示
+  //  (-emit-cpp では生成するコードに埋め込んでおく)
+  std::string get_location() const;
+
   static bool was_emitted();
 
 private:
   std::pair<Token const*, Token const*> get_token_range()
       const;
-  void show_error_lines();
+  void show_error_lines(std::ostream& os) const;
 
   ErrorKind _kind;
   ErrorLocation _loc;
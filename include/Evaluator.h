@@ -4,84 +4,136 @@
 
 #pragma once
 
+#include <functional>
+#include <iosfwd>
 #include <map>
+#include <optional>
 #include "AST.h"
+#include "Value.h"
 #include "GC.h"
 
+namespace JIT {
+struct Function;
+}
+
 class Evaluator {
-  friend struct Object;
+  //
+  // 値スタックの大きさ
+  static constexpr size_t STACK_SIZE = 1 << 18;
 
   struct FunctionStack {
     AST::Function const* ast;
 
-    Object* result;
+    Value result;
 
     // if "result" was returned by return-statement,
     // this is true
     bool is_returned;
 
+    // 呼び出し元のフレーム
+    size_t saved_base;
+    size_t saved_end;
+
     explicit FunctionStack(AST::Function const* ast)
         : ast(ast),
-          result(nullptr),
-          is_returned(false)
-    {
-    }
-  };
-
-  struct var_storage {
-    std::vector<Object*> lvar_list;
-
-    bool is_skipped = 0;
-
-    Object*& get_lvar(size_t index)
-    {
-      return this->lvar_list[index];
-    }
-
-    Object*& append_lvar(Object* obj = nullptr)
+          is_returned(false),
+          saved_base(0),
+          saved_end(0)
     {
-      return this->lvar_list.emplace_back(obj);
     }
   };
 
   struct LoopStack {
-    var_storage& vs;
     bool is_breaked;
     bool is_continued;
 
-    LoopStack(var_storage& vs)
-        : vs(vs),
-          is_breaked(false),
+    LoopStack()
+        : is_breaked(false),
           is_continued(false)
     {
     }
   };
 
 public:
+  //
+  // 構文木を変換したクロージャ (-engine=closure)
+  using Closure = std::function<Value()>;
+
   Evaluator();
   ~Evaluator();
 
-  Object* evaluate(AST::Base* ast);
+  Value evaluate(AST::Base* ast);
+
+  //
+  // 構文木をクロージャに変換してから実行する
+  Value evaluate_compiled(AST::Scope* root);
+
+  //
+  // 特殊化した構文木の数を表示する (-quicken-stats)
+  static void print_quicken_statistics(std::ostream& os);
+
+  //
+  // 値を持たない文の場合は std::nullopt
+  std::optional<Value> eval_stmt(AST::Base* ast);
+
+  Value& eval_left(AST::Base* ast);
+
+  //
+  // 関数呼び出し
+  Value call_builtin(AST::CallFunc* ast);
+  Value call_user_func(AST::CallFunc* ast);
+
+  //
+  // 機械語にした関数 (-jit)
+  Value call_jit(AST::CallFunc* ast, JIT::Function const* func);
+
+  //
+  // 評価した値を代入する
+  Value assign(AST::Assign* ast, Value value);
+
+  //
+  // index-ref (書き込み先)
+  Value& eval_index_ref(Value& obj, AST::IndexRef* ast);
+
+  //
+  // 要素を一つたどる
+  //  check_bounds = false なら範囲を調べない (Sema で分かっている)
+  Value& eval_index_step(Value& obj, AST::Base* index_ast,
+                         bool check_bounds = true);
+
+  Value& eval_member_access(Value& obj, AST::IndexRef* ast);
+
+  //
+  // 範囲の by (なければ 1, 0 ならエラー)
+  int64_t eval_range_step(AST::Range* ast);
 
-  Object* eval_stmt(AST::Base* ast);
+  //
+  // for-range
+  //  body はループの中身を評価する
+  void eval_range_loop(AST::For* ast, int64_t begin, int64_t end,
+                       int64_t step, Closure const& body);
 
-  Object*& eval_left(AST::Base* ast);
+  //
+  // for (範囲のオブジェクト、コンテナ)
+  void eval_for(AST::For* ast, Closure const& body);
 
   //
-  // index-ref
-  Object*& eval_index_ref(Object*& obj, AST::IndexRef* ast);
-  Object*& eval_member_access(Object*& obj,
-                              AST::IndexRef* ast);
+  // index-ref (読み込み)
+  Value eval_index(Value const& obj, AST::IndexRef* ast);
+  Value eval_member(Value const& obj, AST::IndexRef* ast);
 
   //
   // element in expr
   void eval_expr_elem(AST::Expr::Element const& elem,
-                      Object* dest);
+                      Value& dest);
 
   //
-  // compare
-  static bool compute_compare(AST::CmpKind kind,
-                              Object* left, Object* right);
+  // スカラー値の型変換
+  static Value cast_value(Value const& value, TypeKind kind);
+
+  //
+  // インデックス (int, usize) を size_t にする
+  static size_t to_index(Value const& value);
 
 private:
   /**
@@ -90,18 +142,29 @@ private:
    * @note すでに作成済みであればそれを返す
    *
    * @param ast
-   * @return Object*
+   * @return Value
    */
-  Object* create_object(AST::Value* ast);
+  Value create_object(AST::Value* ast);
 
   /**
    * @brief 型情報から初期値を作成する
    *
    * @param type
-   * @return Object*
+   * @return Value
+   */
+  Value default_constructor(TypeInfo const& type,
+                            bool construct_member = true);
+
+  /**
+   * @brief 関数を呼び出せるだけのスタックがあるか調べる
+   *
+   * @note 値スタックかネイティブのスタックが足りなければ
+   *       "stack overflow" で終了する
+   *
+   * @param ast 呼び出し (エラーの位置)
+   * @param frame_size 呼び出す関数のフレームの大きさ
    */
-  Object* default_constructor(TypeInfo const& type,
-                              bool construct_member = true);
+  void check_stack(AST::Base* ast, size_t frame_size);
 
   /**
    * @brief
@@ -111,6 +174,54 @@ private:
    */
   FunctionStack& enter_function(AST::Function* func);
 
+  /**
+   * @brief 初めて評価する構文木の特殊化を選ぶ (quickening)
+   *
+   * @note Sema で決まった型から選び、ast->quick に書き込む
+   *       (-no-quicken のときは常に QUICK_Generic)
+   *
+   * @param ast
+   */
+  void quicken(AST::Base* ast);
+
+  /**
+   * @brief 特殊化した構文木を評価する
+   *
+   * @param ast quick が QUICK_None, QUICK_Generic 以外のもの
+   * @return Value
+   */
+  Value eval_quick(AST::Base* ast);
+
+  static QuickKind select_quick(AST::Base* ast);
+
+  //
+  // Sema で決まった型 (なければ TYPE_None)
+  static TypeKind type_of(AST::Base* ast);
+
+  /**
+   * @brief 構文木をクロージャに変換する
+   *
+   * @note 対応していないものは evaluate() で評価する
+   *
+   * @param ast
+   * @return Closure
+   */
+  Closure compile(AST::Base* ast);
+
+  Closure compile_scope(AST::Scope* ast);
+  Closure compile_expr(AST::Expr* ast);
+  Closure compile_index(AST::IndexRef* ast);
+  Closure compile_call(AST::CallFunc* ast);
+  Closure compile_for(AST::For* ast);
+
+  /**
+   * @brief 関数の中身を変換する (一度だけ)
+   *
+   * @param func
+   * @return Closure const& compiled_functions の要素
+   */
+  Closure const& compile_function(AST::Function* func);
+
   /**
    * @brief
    *
@@ -125,23 +236,40 @@ private:
    */
   FunctionStack& get_current_func_stack();
 
-  void delete_object(Object* p);
-
-  void clean_obj();
+  /**
+   * @brief スタック上の [begin, end) にある変数を破棄する
+   *
+   * @param begin
+   * @param end
+   */
+  void release_slots(size_t begin, size_t end);
 
-  var_storage& push_vst()
-  {
-    return this->vst_list.emplace_back();
-  }
+  /**
+   * @brief スタック・即値・戻り値・一時オブジェクトを
+   *        ルートにして GC を進める
+   *
+   * @note スコープを抜けるとき (セーフポイント) にだけ呼ぶ
+   */
+  void collect_garbage();
 
-  void pop_vst()
-  {
-    this->vst_list.pop_back();
-  }
+  /**
+   * @brief スコープを抜ける
+   *        (変数を破棄して、スコープ内で不要になったものを回収する)
+   *
+   * @param ast
+   * @param gc_mark スコープに入ったときの GarbageCollector::get_mark()
+   * @param result スコープの値 (回収しない)
+   */
+  void leave_scope(AST::Scope* ast, size_t gc_mark,
+                   Value const& result);
 
-  var_storage& get_vst()
+  //
+  // 実行中の関数で return したか
+  //  (ループを抜ける)
+  bool is_returned()
   {
-    return *this->vst_list.rbegin();
+    return !this->call_stack.empty() &&
+           this->get_current_func_stack().is_returned;
   }
 
   LoopStack* get_cur_loop()
@@ -152,23 +280,33 @@ private:
     return &*this->loop_stack.begin();
   }
 
-  Object*& get_var(AST::Variable* ast)
+  Value& get_var(AST::Variable* ast)
   {
-    auto it = this->vst_list.rbegin();
+    if (ast->is_global)
+      return this->stack[ast->slot];
 
-    for (size_t i = 0; i < ast->step; i++)
-      it++;
-
-    return it->get_lvar(ast->index);
+    return this->stack[this->frame_base + ast->slot];
   }
 
   static void gc_stop();
   static void gc_resume();
 
   //
-  // オブジェクトスタック
+  // 値スタック
   // 変数・引数で使う
-  std::vector<Object*> object_stack;
+  //  大きさは固定 (参照が無効にならないように)
+  std::vector<Value> stack;
+
+  //
+  // 現在のフレーム [frame_base, frame_end)
+  size_t frame_base;
+  size_t frame_end;
+
+  //
+  // ネイティブのスタックの下限
+  //  評価は C++ の再帰なので、深い呼び出しでは
+  //  値スタックより先にこちらが尽きる
+  uintptr_t stack_limit;
 
   //
   // コールスタック
@@ -177,11 +315,26 @@ private:
 
   //
   // 即値・リテラル
-  std::map<AST::Value*, Object*> immediate_objects;
+  //  AST::Value::object_index で引く
+  std::vector<Value> immediate_objects;
+
+  //
+  // 評価中の一時オブジェクト (GC のルート)
+  //  参照カウントを増やしたまま C++ 側で持っているもの
+  std::vector<Value> temp_roots;
 
-  std::list<var_storage> vst_list;
   std::list<LoopStack> loop_stack;
-  std::map<Object*, AST::Base*> return_binds;
 
-  static std::map<Object*, bool> allocated_objects;
+  //
+  // 変換した関数の中身
+  //  (再帰呼び出しで参照していても無効にならないよう std::map)
+  std::map<AST::Function*, Closure> compiled_functions;
+
+  //
+  // 関数を機械語にして呼び出す (-jit)
+  bool use_jit;
+
+  //
+  // 特殊化の種類ごとの数 (quicken で選んだもの)
+  static size_t quicken_counts[QUICK_Max];
 };
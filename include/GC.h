@@ -1,55 +1,356 @@
 #pragma once
 
+#include <cstdint>
+#include <deque>
 #include <vector>
+#include <ostream>
+#include <initializer_list>
+#include "TypeInfo.h"
 
 // ---------------------------------------------
 //  Garbage Collector
+//
+//   遅延参照カウント
+//   参照カウントが 0 になったオブジェクトだけを
+//   ゼロカウントテーブル (ZCT) に記録しておき、
+//   スコープを抜けるときにその中から削除する
+//
+//   mark-sweep (世代別)
+//   参照カウントでは回収できない循環参照はトレースして回収する
+//    - minor: 前回の GC 以降に作られた若いオブジェクトだけを調べ、
+//             生き残ったものは old に昇格する
+//             young の数は max_pause_us で調べきれるだけに抑え、
+//             それでも間に合わなければ調べずに昇格する
+//             young は世代番号で分けるだけで、専用の領域はない
+//             (オブジェクトは動かさないので、old と同じスラブに置く)
+//    - major: old が増えたら全体を調べる
+//             三色マーキングで、一度に max_pause_us までしか
+//             止まらないように少しずつ進める (インクリメンタル)
+//             マーク中は参照が増えたオブジェクトを灰色にする
+//             (Dijkstra のライトバリア)
+//
+//   スラブ
+//   オブジェクトは型ごとのチャンクから確保する
+//   以前の型を問わないナーサリのチャンクの代わりになるもので、
+//   空きリストがなければチャンクの中をポインタを進めて確保し、
+//   確保中のチャンクが空になれば先頭に巻き戻す
+//   削除されたスロットはチャンクごとの空きリストで再利用し、
+//   空になったチャンクは他の型でも使い回す
+//   使い回す分より多く空いたチャンクは madvise で物理メモリを返す
 // ---------------------------------------------
 
+struct Value;
 struct Object;
 class GarbageCollector {
 public:
   /**
-   * @brief 起動
+   * @brief 型ごとのスラブからメモリを確保する
+   *
+   * @param size
+   * @param kind
+   * @return void*
+   */
+  static void* allocate(size_t size, TypeKind kind);
+
+  /**
+   * @brief allocate() で確保したメモリを解放する
+   *
+   * @param p
+   * @param size
+   */
+  static void deallocate(void* p, size_t size);
+
+  /**
+   * @brief オブジェクトを若い世代のリストに追加
+   *
+   * @param obj
+   */
+  static void add(Object* obj);
+
+  /**
+   * @brief オブジェクトを世代のリストから削除
+   *
+   * @param obj
+   */
+  static void remove(Object* obj);
+
+  /**
+   * @brief mark-sweep を実行するべきか
+   *
+   * @note YOUNG_SIZE バイト確保するか、young が minor_budget 個に
+   *       なるごとに minor、
+   *       old のオブジェクト数が前回の major の後の 2 倍
+   *       (最低 MIN_MAJOR_OBJECTS) を超えたら major
    */
-  static void execute();
+  static bool is_requested()
+  {
+    return phase != PHASE_Idle ||
+           allocated_bytes >= YOUNG_SIZE ||
+           young_count >= minor_budget ||
+           old_count >= major_threshold;
+  }
 
   /**
-   * @brief 終了
+   * @brief ルートが必要か
+   *
+   * @note minor と major の開始時だけ必要
+   *       (major のマーク中はライトバリアで追跡する)
    */
-  static void final();
+  static bool is_roots_needed()
+  {
+    return phase == PHASE_Idle;
+  }
 
   /**
-   * @brief
+   * @brief ルートとして登録する
    *
+   * @param value
    */
-  static void set_object_list(std::vector<Object*>* vec);
+  static void mark_root(Value const& value);
 
   /**
-   * @brief 使用されていないオブジェクトを削除する
+   * @brief GC を一段階進める
+   *
+   * @note minor: mark_root() で与えたものに加えて、
+   *       ヒープの外から参照されているもの、ZCT にあるもの、
+   *       no_delete のものもルートとして扱う
+   *       old から young への参照も参照カウントに
+   *       含まれているので、ライトバリアは必要ない
+   *       max_pause_us までに終わらなければ、調べずに昇格する
+   *
+   *       major: mark_root() で与えたものと ZCT にあるものを
+   *       ルートにして、max_pause_us ごとに区切ってマーク・スイープする
+   *       ZCT もマークの途中で少しずつ調べる
+   *
+   * @return 削除した数
    */
-  static void clean();
+  static size_t execute();
 
   /**
-   * @brief オブジェクトを追加
+   * @brief ライトバリア
+   *        マーク中なら、参照されたオブジェクトを灰色にする
    *
    * @param obj
-   * @return すでに追加されている場合は、false
    */
-  static bool add(Object* obj);
+  static void write_barrier(Object* obj)
+  {
+    if (phase == PHASE_Mark)
+      mark_object(obj, true);
+  }
 
   /**
-   * @brief オブジェクトを削除
+   * @brief 子要素を調べ直させる
+   *        マーク中に黒で作られたオブジェクトが
+   *        他のオブジェクトと中身を共有したときに使う
    *
    * @param obj
-   * @return 追加されていない場合は、false
    */
-  static bool remove(Object* obj);
+  static void rescan(Object* obj);
 
   /**
-   * @brief 全てのオブジェクトを取得する
+   * @brief 子要素の位置が変わったことを知らせる
+   *
+   * @note 途中まで調べていたコンテナなら最後まで調べる
+   *       (調べた位置より前に移ったものを見落とさない)
+   *
+   * @param obj
+   */
+  static void moved_children(Object* obj);
+
+  /**
+   * @brief 一回の停止時間の上限を設定する
+   *
+   * @param us マイクロ秒
+   */
+  static void set_max_pause(size_t us)
+  {
+    max_pause_us = us;
+  }
+
+  /**
+   * @brief 停止時間のヒストグラムなどを出力する
+   *
+   * @param os
+   */
+  static void print_statistics(std::ostream& os);
+
+  /**
+   * @brief スラブの使用状況を出力する
+   *
+   * @param os
+   */
+  static void print_slab_statistics(std::ostream& os);
+
+  /**
+   * @brief 参照カウントが 0 になったオブジェクトを追加
+   *
+   * @param obj
+   */
+  static void add_zero(Object* obj);
+
+  /**
+   * @brief ZCT の現在の位置を取得する
+   *
+   * @note スコープに入るときに記録しておき、
+   *       抜けるときに collect() に渡す
    *
-   * @return std::vector<Object*> const&
+   * @return size_t
    */
-  static std::vector<Object*> const& get_objects();
+  static size_t get_mark()
+  {
+    return zct.size();
+  }
+
+  /**
+   * @brief mark 以降に追加されたオブジェクトのうち、
+   *        参照されていないものを削除する
+   *
+   * @note 削除できなかったもの (no_delete, keep) は
+   *       テーブルに残り、外側のスコープで再び調べられる
+   *
+   * @param mark
+   * @param keep 削除しないオブジェクト (スコープの結果など)
+   * @return 削除した数
+   */
+  static size_t collect(size_t mark,
+                        std::initializer_list<Object*> keep);
+
+private:
+  enum Phase {
+    PHASE_Idle,
+    PHASE_Mark,  // major のマーク中
+    PHASE_Sweep,  // major のスイープ中
+  };
+
+  struct Chunk;
+  struct Slab;
+
+  static Chunk* take_chunk(Slab& slab);
+  static void release_chunk(Chunk* chunk);
+
+  // 使用状況を統計に加える
+  static void sample_slabs();
+
+  static void mark_object(Object* obj, bool full);
+
+  // 間に合わなければ途中でやめて、全て昇格する
+  static size_t collect_minor(size_t deadline_us);
+
+  // 途中までの minor の印を消す
+  static void abandon_minor();
+
+  // 前回の minor にかかった時間から minor_budget を決める
+  static void update_minor_budget(size_t count, size_t us);
+
+  // young を全て old にする
+  static void promote();
+
+  static bool is_old(Object const* obj);
+
+  static void start_major();
+  static bool mark_slice(size_t deadline_us);
+  static size_t sweep_slice(size_t deadline_us);
+
+  // 回収するオブジェクトを削除する
+  static void free_garbage(Object* obj, bool full);
+
+  static void record_pause(std::vector<size_t>& histogram,
+                           size_t us);
+
+  static void print_histogram(
+      std::ostream& os, char const* name,
+      std::vector<size_t> const& histogram);
+
+  // これより大きいものはスラブを使わない
+  static constexpr size_t MAX_SMALL_SIZE = 512;
+
+  static constexpr size_t SLAB_COUNT = TYPE_Template + 1;
+
+  static constexpr size_t CHUNK_SIZE = 64 << 10;
+
+  // young として確保するバイト数 (これを超えたら minor)
+  static constexpr size_t YOUNG_SIZE = 1 << 20;
+
+  // 空きチャンクをそのまま持っておく数
+  static constexpr size_t MAX_FREE_CHUNKS = 16;
+
+  // madvise したチャンクを持っておく数
+  static constexpr size_t MAX_PURGED_CHUNKS = 256;
+
+  static constexpr size_t MIN_MAJOR_OBJECTS = 1 << 16;
+
+  // minor_budget の範囲 (最初は MAX_MINOR_OBJECTS)
+  static constexpr size_t MIN_MINOR_OBJECTS = 1 << 8;
+  static constexpr size_t MAX_MINOR_OBJECTS = 1 << 14;
+
+  static constexpr size_t DEFAULT_MAX_PAUSE_US = 1000;
+
+  // 一度に調べる子要素の数
+  //  (これごとに停止時間の上限を確かめる)
+  static constexpr size_t SCAN_STEP = 64;
+
+  // zero-count table
+  static std::vector<Object*> zct;
+
+  // 世代ごとのオブジェクトのリスト
+  static Object* young;
+  static Object* young_tail;
+  static Object* old;
+
+  // 現在の世代番号
+  //  これより小さいものは old
+  static uint32_t epoch;
+
+  static size_t young_count;
+  static size_t old_count;
+  static size_t major_threshold;
+
+  // 一度の minor で調べる young の数の上限
+  //  (これの 2 倍より多ければ、調べずに昇格する)
+  static size_t minor_budget;
+
+  static std::vector<Object*> roots;
+
+  // 大きくなっても一度に移し替えないよう deque にする
+  //  (vector の再確保はそれだけで停止時間の上限を超える)
+  static std::deque<Object*> gray;
+
+  static Phase phase;
+
+  // 次にマークする ZCT の位置
+  static size_t zct_cursor;
+
+  // 途中まで子要素を調べたオブジェクトと、次に調べる位置
+  //  gray より先に続きを調べるので、同時に一つしかない
+  static Object* scanning;
+  static size_t scan_cursor;
+
+  // 次にスイープするオブジェクト
+  static Object* sweep_cursor;
+  static bool sweeping_old;
+
+  static size_t max_pause_us;
+
+  // 停止時間のヒストグラム (minor と major で分ける)
+  //  [i] = 2^(i-1) us 以上 2^i us 未満
+  static std::vector<size_t> minor_pauses;
+  static std::vector<size_t> major_pauses;
+  static size_t max_pause_observed;
+  static size_t minor_count;
+  static size_t major_count;
+  static size_t promoted_count;
+
+  // 調べずに昇格した回数
+  static size_t bulk_promote_count;
+
+  // スラブ (TypeKind ごと)
+  static Slab slabs[SLAB_COUNT];
+
+  static Chunk* free_chunks;
+  static Chunk* purged_chunks;
+  static size_t free_chunk_count;
+  static size_t purged_chunk_count;
+
+  // 前回の GC 以降に確保したバイト数
+  static size_t allocated_bytes;
 };
@@ -0,0 +1,9 @@
+// ---------------------------------------------
+//  SSA 形式の中間表現
+// ---------------------------------------------
+#pragma once
+
+#include "IR/Module.h"
+#include "IR/Builder.h"
+#include "IR/Verifier.h"
+#include "IR/Interpreter.h"
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "AST.h"
+#include "IR/Module.h"
+
+namespace IR {
+
+// ---------------------------------------------
+//  Builder
+//   Sema でチェック済みの構文木から SSA 形式の IR を作る
+//
+//   変数は基本ブロックごとの定義をたどって phi を置く
+//   (Braun et al., "Simple and Efficient Construction
+//    of Static Single Assignment Form")
+//   関数から参照されるトップレベルの変数だけは
+//   大域変数 (LoadGlobal / StoreGlobal) にする
+//
+//   参照カウントとスコープを抜けるときの回収は
+//   Evaluator と同じ順番で Retain, Release, Collect にする
+// ---------------------------------------------
+class Builder {
+  struct Variable {
+    std::string_view name;
+    TypeInfo type;
+  };
+
+  //
+  // 名前から引いたもの
+  struct Binding {
+    bool is_global;
+    size_t index;  // 変数か大域変数の番号
+  };
+
+  struct Scope {
+    Instr* mark;  // nullptr なら回収しない
+
+    //
+    // 抜けるときに手放すもの
+    std::vector<size_t> vars;
+    Instr* retained;  // for-in で回しているコンテナ
+
+    std::vector<std::pair<std::string_view, Binding>> names;
+
+    explicit Scope(Instr* mark = nullptr)
+        : mark(mark),
+          retained(nullptr)
+    {
+    }
+  };
+
+  struct Loop {
+    Block* break_to;
+    Block* continue_to;
+
+    //
+    // ループの中のスコープの始まり (scopes の位置)
+    size_t depth;
+  };
+
+public:
+  Builder();
+  ~Builder();
+
+  /**
+   * @brief スクリプト全体を IR にする
+   *
+   * @note 対応していない構文があればエラーにする
+   */
+  Module build(AST::Scope* root);
+
+private:
+  void build_function(AST::Function* ast);
+
+  //
+  // 関数の IR を作り終えたあとの整理
+  void finish();
+
+  // --------------------------------------------------------
+  //  命令の追加
+  // --------------------------------------------------------
+  Instr* emit(OpCode op, TypeInfo const& type,
+              std::vector<Instr*> const& operands = {},
+              AST::Base* ast = nullptr);
+
+  Instr* constant(Value const& value, TypeInfo const& type);
+
+  //
+  // 基本ブロックの先頭 (phi の後ろ) に置く
+  Instr* insert_front(Block* block, Instr* instr);
+  Instr* new_phi(Block* block, TypeInfo const& type);
+
+  void jump(Block* to);
+  void branch(Instr* cond, Block* if_true, Block* if_false);
+
+  //
+  // 行き先の基本ブロックに移る
+  //  (終わっていれば、到達しない基本ブロックを作る)
+  void set_block(Block* block);
+  void terminate();
+
+  static void add_edge(Block* from, Block* to);
+
+  // --------------------------------------------------------
+  //  変数 (SSA)
+  // --------------------------------------------------------
+  size_t new_variable(std::string_view name,
+                      TypeInfo const& type);
+
+  void write_var(size_t var, Block* block, Instr* value);
+  Instr* read_var(size_t var, Block* block);
+  Instr* read_var_recursive(size_t var, Block* block);
+  void add_phi_operands(size_t var, Instr* phi);
+
+  //
+  // 前の基本ブロックがすべて決まった
+  void seal(Block* block);
+
+  //
+  // 余分な phi (すべて同じ値) を置き換えて消す
+  void remove_trivial_phis();
+
+  Binding find(AST::Base* ast);
+  TypeInfo const& type_of_binding(Binding const& b) const;
+
+  void declare(std::string_view name, size_t var);
+
+  // --------------------------------------------------------
+  //  スコープ
+  // --------------------------------------------------------
+  void enter_scope(bool mark);
+
+  /**
+   * @brief depth までのスコープを抜けるときの処理を出力する
+   *
+   * @note スコープは残したまま (break, return で使う)
+   *
+   * @param keep 回収しない値 (スコープの結果、戻り値)
+   */
+  void leave_scopes(size_t depth, Instr* keep);
+
+  void leave_scope(Instr* keep = nullptr);
+
+  // --------------------------------------------------------
+  //  式
+  // --------------------------------------------------------
+  Instr* expr(AST::Base* ast);
+
+  //
+  // 読むだけのとき (変数は複製しない)
+  Instr* borrow(AST::Base* ast);
+
+  //
+  // 書き込み先のコンテナ (複製しない)
+  Instr* lvalue(AST::Base* ast);
+
+  Instr* literal(AST::Value* ast);
+  Instr* call(AST::CallFunc* ast);
+  Instr* call_builtin(AST::CallFunc* ast);
+  Instr* index(AST::IndexRef* ast);
+  Instr* member(AST::IndexRef* ast);
+  Instr* arith(AST::Expr* ast);
+  Instr* concat(AST::Expr* ast);
+  Instr* compare(AST::Compare* ast);
+  Instr* assign(AST::Assign* ast);
+  Instr* assign_var(Binding const& b, Instr* value);
+  Instr* read(Binding const& b);
+
+  //
+  // && と || (右辺は必要なときだけ評価する)
+  Instr* short_circuit(Instr* left, AST::ExprKind kind,
+                       AST::Base* right);
+
+  Instr* new_container(AST::Base* ast);
+  Instr* range(AST::Range* ast);
+
+  // --------------------------------------------------------
+  //  文
+  // --------------------------------------------------------
+
+  /**
+   * @brief 文を出力する
+   *
+   * @param want 値が必要か (スコープの最後)
+   * @return 値 (なければ nullptr)
+   */
+  Instr* stmt(AST::Base* ast, bool want = false);
+
+  Instr* scope(AST::Base* ast, bool want);
+  Instr* if_stmt(AST::If* ast, bool want);
+
+  void let(AST::VariableDeclaration* ast);
+  void switch_stmt(AST::Switch* ast);
+  void for_stmt(AST::For* ast);
+  void for_range(AST::For* ast);
+  void for_in(AST::For* ast);
+  void while_stmt(AST::While* ast);
+  void do_while(AST::DoWhile* ast);
+  void loop_stmt(AST::Loop* ast);
+  void return_stmt(AST::Return* ast);
+  void loop_control(AST::Base* ast, bool is_break);
+
+  //
+  // 本体を出力して、continue の行き先に移る
+  void loop_body(AST::Base* body, Block* break_to,
+                 Block* continue_to);
+
+  // --------------------------------------------------------
+  //  その他
+  // --------------------------------------------------------
+  static TypeInfo type_of(AST::Base* ast);
+  static bool is_scalar(TypeKind kind);
+
+  //
+  // 添字で取り出す要素の型
+  static TypeInfo element_type(TypeInfo const& type);
+
+  //
+  // 評価しても何も起きない (GC が動かない) 式
+  static bool is_simple(AST::Base* ast);
+
+  //
+  // 実行時エラーの位置の表示
+  static std::string location(AST::Base* ast);
+
+  [[noreturn]] static void unsupported(AST::Base* ast);
+
+  Module module;
+
+  Function* func;
+  Block* cur;
+
+  std::vector<Variable> vars;
+
+  std::map<std::pair<Block*, size_t>, Instr*> defs;
+  std::map<Block*, std::vector<std::pair<size_t, Instr*>>>
+      incomplete_phis;
+  std::set<Block*> sealed;
+
+  std::vector<Scope> scopes;
+  std::vector<Loop> loops;
+
+  //
+  // 関数の本体のスコープの始まり (return で抜ける所まで)
+  size_t func_depth;
+
+  std::map<AST::Function*, Function*> functions;
+
+  //
+  // 関数から参照されるトップレベルの変数の名前
+  std::set<std::string_view> global_names;
+
+  //
+  // 関数の中から見える大域変数 (後から定義したものが優先)
+  std::map<std::string_view, size_t> visible_globals;
+
+  std::map<AST::Value*, Value> strings;
+};
+
+}  // namespace IR
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ASTfwd.h"
+#include "TypeInfo.h"
+#include "Value.h"
+
+struct Token;
+
+namespace IR {
+
+//
+// 命令の一覧
+//
+//  a, b, c は operands の順番
+//  参照カウントは Retain / Release で明示的に増減する
+//  (Clone は中身を共有した新しいオブジェクトを作る)
+#define IR_OPCODE_LIST(_)                                    \
+  _(Undef)      /* 到達しない経路の値                */      \
+  _(Const)      /* imm                              */       \
+  _(Param)      /* args[index]                      */       \
+  _(Phi)        /* [pred: value], ...               */       \
+  _(LoadGlobal) /* globals[index]                   */       \
+  _(StoreGlobal) /* globals[index] = a              */       \
+                                                             \
+  _(Binary)     /* a <kind> b (AST::ExprKind)       */       \
+  _(Compare)    /* a <kind> b (AST::CmpKind)        */       \
+  _(Neg)        /* -a                               */       \
+  _(Cast)       /* (type)a                          */       \
+  _(Select)     /* a ? b : c                        */       \
+  _(Concat)     /* a.clone() + b + ... (string)     */       \
+                                                             \
+  _(Clone)      /* a.clone()                        */       \
+  _(Retain)     /* a.inc_ref()                      */       \
+  _(Release)    /* a.dec_ref()                      */       \
+  _(Mark)       /* GC の位置                        */       \
+  _(Collect)    /* a から後を回収 (b, c は残す)     */       \
+  _(NoDelete)   /* a.no_delete = index              */       \
+                                                             \
+  _(Default)    /* default(desc)                    */       \
+  _(NewVector)  /* vector(desc)                     */       \
+  _(NewDict)    /* dict(desc)                       */       \
+  _(NewStruct)  /* desc{} (メンバなし)              */       \
+  _(Append)     /* a.append(b) / a.append(b, c)     */       \
+  _(AddMember)  /* a.add_member(b)                  */       \
+  _(NewRange)   /* a .. b by c                      */       \
+  _(RangeStep)  /* a (0 ならエラー)                 */       \
+  _(RangeField) /* a.begin, end, step (index)       */       \
+  _(RangeNext)  /* a + c (b を越えるなら b)         */       \
+                                                             \
+  _(Index)      /* a[b] (読むだけ)                  */       \
+  _(IndexRef)   /* &a[b] (辞書になければ追加)       */       \
+  _(Store)      /* a[b] = c                         */       \
+  _(Member)     /* a.members[index]                 */       \
+                                                             \
+  _(Call)       /* callee(a, b, ...)                */       \
+  _(CallBuiltin) /* builtins[index](a, b, ...)      */       \
+                                                             \
+  /* for-in: 書き換えられたら IterCheck でエラー         */ \
+  _(IterSize)   /* len(a)                           */       \
+  _(IterGet)    /* a の b 番目 (文字, 要素, キー)   */       \
+  _(IterVersion) /* a の書き換えた回数              */       \
+  _(IterCheck)  /* a の書き換えた回数が b か        */       \
+                                                             \
+  _(Jump)       /* goto targets[0]                  */       \
+  _(Branch)     /* a ? targets[0] : targets[1]      */       \
+  _(Return)     /* return a                         */
+
+enum OpCode : uint8_t {
+#define _IR_OPCODE_ENUM(name) OP_##name,
+  IR_OPCODE_LIST(_IR_OPCODE_ENUM)
+#undef _IR_OPCODE_ENUM
+      OP_Max
+};
+
+struct Block;
+struct Function;
+
+struct Instr {
+  OpCode op;
+
+  //
+  // 結果の型 (値がなければ none)
+  TypeInfo type;
+
+  //
+  // 関数の中での番号 (%id)
+  //  Function::renumber() で振り直す
+  size_t id;
+
+  std::vector<Instr*> operands;
+
+  //
+  // Jump, Branch の行き先
+  //  Phi では operands と同じ順番の前の基本ブロック
+  std::vector<Block*> targets;
+
+  //
+  // 命令ごとの補助情報
+  //  AST::ExprKind, AST::CmpKind, 引数・大域変数の位置、
+  //  組み込み関数の位置、メンバの位置など
+  int64_t index;
+
+  Value imm;  // Const
+
+  //
+  // Default, NewVector, NewDict, NewStruct
+  //  (TypeInfo::intern で作ったもの)
+  TypeInfo const* desc;
+
+  Function* callee;  // Call
+
+  //
+  // 範囲の検査 (Index, IndexRef, Store)
+  bool check;
+
+  //
+  // エラーの位置
+  //  site は Error::emit と同じ表示 (実行時エラーで使う)
+  AST::Base* ast;
+  Token const* token;
+  std::string site;
+
+  Block* parent;
+
+  //
+  // 構築中に不要になった phi の置き換え先
+  Instr* replaced_by;
+
+  Instr(OpCode op, TypeInfo const& type)
+      : op(op),
+        type(type),
+        id(0),
+        index(0),
+        desc(nullptr),
+        callee(nullptr),
+        check(false),
+        ast(nullptr),
+        token(nullptr),
+        parent(nullptr),
+        replaced_by(nullptr)
+  {
+  }
+
+  bool is_terminator() const
+  {
+    return this->op == OP_Jump || this->op == OP_Branch ||
+           this->op == OP_Return;
+  }
+
+  //
+  // 結果がない命令
+  bool is_void() const
+  {
+    switch (this->op) {
+      case OP_StoreGlobal:
+      case OP_Retain:
+      case OP_Release:
+      case OP_Collect:
+      case OP_NoDelete:
+      case OP_Append:
+      case OP_AddMember:
+      case OP_IterCheck:
+      case OP_Jump:
+      case OP_Branch:
+      case OP_Return:
+        return true;
+    }
+
+    return false;
+  }
+
+  std::string to_string() const;
+
+  static char const* get_name(OpCode op);
+};
+
+// ---------------------------------------------
+//  Block
+//   基本ブロック
+//   Phi は先頭に並び、最後は Jump, Branch, Return
+// ---------------------------------------------
+struct Block {
+  size_t id;
+
+  std::vector<Instr*> instrs;
+  std::vector<Block*> preds;
+
+  Function* parent;
+
+  Block(size_t id, Function* parent)
+      : id(id),
+        parent(parent)
+  {
+  }
+
+  Instr* terminator() const
+  {
+    if (this->instrs.empty() ||
+        !this->instrs.back()->is_terminator())
+      return nullptr;
+
+    return this->instrs.back();
+  }
+
+  std::vector<Block*> succs() const
+  {
+    if (auto term = this->terminator(); term)
+      return term->targets;
+
+    return {};
+  }
+};
+
+}  // namespace IR
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "IR/Module.h"
+
+namespace IR {
+
+// ---------------------------------------------
+//  Interpreter
+//   IR をそのまま実行する (-engine=ir)
+//
+//   値は命令の番号ごとのレジスタに置き、
+//   基本ブロックを移るときに phi をまとめて入れる
+//   実行時エラーは Evaluator と同じ表示にする
+// ---------------------------------------------
+class Interpreter {
+public:
+  explicit Interpreter(Module const& module);
+
+  void run();
+
+private:
+  Value call(Function const* func,
+             std::vector<Value> const& args);
+
+  void execute(Instr const* x, std::vector<Value>& regs,
+               std::vector<Value> const& args);
+
+  Module const& module;
+
+  std::vector<Value> globals;
+
+  size_t depth;
+};
+
+}  // namespace IR
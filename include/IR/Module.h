@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IR/Instruction.h"
+
+namespace IR {
+
+struct Function {
+  std::string name;
+
+  AST::Function* ast;  // nullptr: top-level
+
+  std::vector<TypeInfo> params;
+  TypeInfo result;
+
+  //
+  // [0] が入口
+  std::vector<std::unique_ptr<Block>> blocks;
+  std::vector<std::unique_ptr<Instr>> instrs;
+
+  //
+  // renumber() で数えた値の数 (レジスタの数)
+  size_t num_values;
+
+  Function(std::string const& name, AST::Function* ast)
+      : name(name),
+        ast(ast),
+        num_values(0)
+  {
+  }
+
+  Block* entry() const
+  {
+    return this->blocks[0].get();
+  }
+
+  Block* new_block();
+  Instr* new_instr(OpCode op, TypeInfo const& type);
+
+  //
+  // 到達しない基本ブロックを消して、番号を振り直す
+  void cleanup();
+
+  void renumber();
+
+  std::string dump() const;
+};
+
+struct Global {
+  std::string_view name;
+  TypeInfo type;
+};
+
+struct Module {
+  //
+  // [0] は top-level のコード
+  std::vector<std::unique_ptr<Function>> functions;
+
+  std::vector<Global> globals;
+
+  //
+  // 文字列の即値 (参照を一つ持ったままにする)
+  std::vector<Value> constants;
+
+  std::string dump() const;
+};
+
+}  // namespace IR
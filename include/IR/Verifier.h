@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "IR/Module.h"
+
+namespace IR {
+
+/**
+ * @brief IR が正しいか調べる
+ *
+ * @note 基本ブロックのつながり、phi の位置と入力、
+ *       オペランドの数と型、定義が使う場所を支配しているか
+ *
+ * @return 見つかった問題 (なければ空)
+ */
+std::vector<std::string> verify(Module const& module);
+
+}  // namespace IR
@@ -0,0 +1,8 @@
+// ---------------------------------------------
+//  x86-64 JIT
+// ---------------------------------------------
+#pragma once
+
+#include "JIT/Assembler.h"
+#include "JIT/CodeGen.h"
+#include "JIT/CodeCache.h"
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace JIT {
+
+//
+// 汎用レジスタ (番号は命令の符号化と同じ)
+enum Reg : uint8_t {
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+};
+
+//
+// xmm レジスタ
+enum XReg : uint8_t {
+  XMM0,
+  XMM1,
+  XMM2,
+  XMM3,
+  XMM4,
+  XMM5,
+  XMM6,
+  XMM7,
+  XMM8,
+  XMM9,
+  XMM10,
+  XMM11,
+  XMM12,
+  XMM13,
+  XMM14,
+  XMM15,
+};
+
+//
+// 条件 (jcc の下位 4 ビット)
+enum Cond : uint8_t {
+  CC_O,
+  CC_NO,
+  CC_B,  // unsigned <  (CF=1)
+  CC_AE,  // unsigned >= (CF=0)
+  CC_E,
+  CC_NE,
+  CC_BE,  // unsigned <= (CF=1 or ZF=1)
+  CC_A,  // unsigned >  (CF=0 and ZF=0)
+  CC_S,
+  CC_NS,
+  CC_P,  // parity (ucomiss で比べられない)
+  CC_NP,
+  CC_L,
+  CC_GE,
+  CC_LE,
+  CC_G,
+};
+
+//
+// 逆の条件
+inline Cond negate(Cond cc)
+{
+  return (Cond)(cc ^ 1);
+}
+
+// ---------------------------------------------
+//  Assembler
+//   x86-64 の機械語を書き出す
+//   必要な命令だけを、64 ビットのオペランドで符号化する
+//   メモリは常に [base + disp32] の形
+// ---------------------------------------------
+class Assembler {
+  struct LabelInfo {
+    int64_t position = -1;
+
+    // rel32 を書き込む場所
+    std::vector<size_t> fixups;
+  };
+
+public:
+  //
+  // ジャンプ先
+  using Label = size_t;
+
+  //
+  // 整数の二項演算 (op r/m64, r64 のオペコード)
+  enum AluOp : uint8_t {
+    ALU_Add = 0x01,
+    ALU_Or = 0x09,
+    ALU_And = 0x21,
+    ALU_Sub = 0x29,
+    ALU_Xor = 0x31,
+    ALU_Cmp = 0x39,
+    ALU_Test = 0x85,
+  };
+
+  //
+  // スカラー単精度の演算 (F3 0F xx)
+  enum SseOp : uint8_t {
+    SSE_Add = 0x58,
+    SSE_Mul = 0x59,
+    SSE_Sub = 0x5C,
+    SSE_Div = 0x5E,
+  };
+
+  Label new_label();
+  void bind(Label label);
+
+  //
+  // 書き出した機械語 (ラベルはすべて解決済み)
+  std::vector<uint8_t> const& finish();
+
+  size_t size() const
+  {
+    return this->buf.size();
+  }
+
+  //
+  // 後から埋める 32 ビット値
+  void patch32(size_t position, int32_t value);
+
+  //
+  // 整数
+  void push(Reg r);
+  void pop(Reg r);
+  void mov(Reg dst, Reg src);
+  void mov_imm(Reg dst, int64_t imm);
+  void mov_imm32(Reg dst, uint32_t imm);  // 上位は 0
+  void load(Reg dst, Reg base, int32_t disp);
+  void store(Reg base, int32_t disp, Reg src);
+  void lea(Reg dst, Reg base, int32_t disp);
+  void alu(AluOp op, Reg dst, Reg src);
+  void cmp_mem(Reg r, Reg base, int32_t disp);  // cmp r, [mem]
+
+  // 即値との演算 (dst op imm32)
+  void add_imm(Reg dst, int32_t imm);
+  void sub_imm(Reg dst, int32_t imm);
+  void cmp_imm(Reg dst, int32_t imm);
+
+  //
+  // 埋める位置を返す (sub rsp, imm32)
+  size_t sub_imm_patchable(Reg dst);
+
+  void imul(Reg dst, Reg src);
+  void cqo();
+  void idiv(Reg src);
+  void neg(Reg r);
+  void shl_cl(Reg r);
+  void sar_cl(Reg r);
+
+  //
+  // 制御
+  void jmp(Label label);
+  void jcc(Cond cc, Label label);
+  void call(Reg r);
+  void call_mem(Reg base, int32_t disp);
+  void ret();
+
+  //
+  // 浮動小数点 (float)
+  void movss_load(XReg dst, Reg base, int32_t disp);
+  void movss_store(Reg base, int32_t disp, XReg src);
+  void movaps(XReg dst, XReg src);
+  void sse(SseOp op, XReg dst, XReg src);
+  void ucomiss(XReg a, XReg b);
+  void xorps(XReg dst, XReg src);
+  void cvtsi2ss(XReg dst, Reg src);
+  void cvttss2si(Reg dst, XReg src);
+  void movd(XReg dst, Reg src);
+
+private:
+  void emit(uint8_t byte);
+  void emit32(int32_t value);
+  void emit64(int64_t value);
+
+  //
+  // REX プレフィックス (不要なら出さない)
+  void rex(bool w, int reg, int rm);
+
+  void modrm_reg(int reg, int rm);
+  void modrm_mem(int reg, Reg base, int32_t disp);
+
+  void jump_to(Label label);
+
+  std::vector<uint8_t> buf;
+  std::vector<LabelInfo> labels;
+};
+
+}  // namespace JIT
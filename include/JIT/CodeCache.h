@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AST.h"
+#include "Value.h"
+
+namespace JIT {
+
+// ---------------------------------------------
+//  機械語にした関数
+// ---------------------------------------------
+struct Function {
+  AST::Function* ast = nullptr;
+
+  //
+  // 本体 (System V の呼び出し規約)
+  //  機械語からはこの場所を経由して呼び出す
+  //  nullptr なら機械語にできない関数
+  void* code = nullptr;
+
+  //
+  // インタプリタからの入口 (CodeGen::compile_entry)
+  void (*entry)(uint64_t* io) = nullptr;
+
+  std::vector<TypeKind> arg_types;
+  TypeKind result_type = TYPE_None;
+
+  //
+  // 引数は arg_types の型の値
+  Value call(Value const* args) const;
+};
+
+/**
+ * @brief 関数を機械語にして返す (一度だけ生成する)
+ *
+ * @note 呼び出す関数もすべて機械語にできるときだけ生成し、
+ *       /tmp/perf-<pid>.map に書き出す
+ *
+ * @param func
+ * @return 機械語にできなければ nullptr
+ */
+Function const* find_function(AST::Function* func);
+
+//
+// ネイティブのスタックの下限 (これより下に伸びたらエラー)
+extern uintptr_t stack_limit;
+
+//
+// 生成したコードから呼ぶ実行時エラー (戻らない)
+[[noreturn]] void error_at_token(Token const* token,
+                                 char const* message);
+
+[[noreturn]] void error_at_ast(AST::Base const* ast,
+                               char const* message);
+
+}  // namespace JIT
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "AST.h"
+#include "JIT/Assembler.h"
+
+namespace JIT {
+
+//
+// 引数の数の上限 (レジスタで渡せる数)
+static constexpr size_t MAX_INT_ARGS = 6;
+static constexpr size_t MAX_FLOAT_ARGS = 8;
+static constexpr size_t MAX_ARGS = MAX_INT_ARGS + MAX_FLOAT_ARGS;
+
+// ---------------------------------------------
+//  CodeGen
+//   Sema でチェック済みの関数を x86-64 の機械語にする
+//
+//   int, float, bool の値だけを扱う関数が対象
+//   (System V の呼び出し規約で、引数と戻り値はレジスタ)
+//   対応していない構文が一つでもあれば、関数ごと
+//   インタプリタに任せる
+//
+//   変数 (フレームのスロット) は、生存区間から
+//   線形走査でレジスタに割り当てる
+//   あふれたものと、式の途中の値はスタックに置く
+// ---------------------------------------------
+class CodeGen {
+  using Label = Assembler::Label;
+
+  //
+  // 変数の置き場所
+  struct SlotInfo {
+    bool used = false;
+    bool is_float = false;
+
+    //
+    // 生存区間 [begin, end] (構文木を前順にたどった番号)
+    size_t begin = 0;
+    size_t end = 0;
+
+    int reg = -1;  // Reg か XReg (-1 ならスタック)
+    int32_t offset = 0;  // rbp からの位置
+  };
+
+  struct LoopLabels {
+    Label break_to;
+    Label continue_to;
+  };
+
+  //
+  // 関数の外に出す処理 (実行時エラー)
+  struct Stub {
+    Label label;
+    void const* location;  // Token か構文木
+    bool is_token;
+    char const* message;
+  };
+
+public:
+  //
+  // 呼び出す関数の機械語のアドレスが入る場所
+  using SlotResolver = std::function<void* const*(AST::Function*)>;
+
+  explicit CodeGen(AST::Function* func);
+
+  //
+  // Sema で決まった型 (なければ TYPE_None)
+  static TypeKind type_of(AST::Base* ast);
+
+  /**
+   * @brief 機械語にできるか調べて、変数の生存区間を集める
+   *
+   * @note 呼び出す関数の中身は調べない (get_callees を使う)
+   *
+   * @return 対応していない構文があれば false
+   */
+  bool analyze();
+
+  //
+  // 呼び出しているユーザー定義関数 (analyze で集める)
+  std::vector<AST::Function*> const& get_callees() const
+  {
+    return this->callees;
+  }
+
+  /**
+   * @brief 関数の本体を生成する
+   *
+   * @note analyze が成功してから呼ぶ
+   *
+   * @param as
+   * @param resolve
+   */
+  void compile(Assembler& as, SlotResolver const& resolve);
+
+  /**
+   * @brief 引数を配列で受け取る入口を生成する
+   *
+   *  void entry(uint64_t* io)
+   *    io[i] に引数を入れて呼び出し、io[0] に戻り値が入る
+   *
+   * @param as
+   * @param body 本体のアドレスが入る場所
+   */
+  void compile_entry(Assembler& as, void* const* body);
+
+private:
+  bool analyze(AST::Base* ast);
+  bool analyze_expr(AST::Expr* ast);
+  bool analyze_compare(AST::Compare* ast);
+
+  bool touch(size_t slot, TypeKind type);
+  bool touch_variable(AST::Base* ast, TypeKind type);
+
+  //
+  // 線形走査でレジスタを割り当てる
+  void allocate_registers();
+
+  //
+  // 値を rax (int, bool) か xmm0 (float) に置く
+  //  値がなければ TYPE_None
+  TypeKind gen(AST::Base* ast);
+
+  TypeKind gen_scope(AST::Scope* ast);
+  TypeKind gen_expr(AST::Expr* ast);
+  TypeKind gen_call(AST::CallFunc* ast);
+  TypeKind gen_cast(AST::Cast* ast);
+  TypeKind gen_if(AST::If* ast);
+  void gen_for(AST::For* ast);
+
+  //
+  // 条件が when のとき target に飛ぶ
+  void branch(AST::Base* ast, Label target, bool when);
+  void branch_logical(AST::Expr* ast, size_t count, Label target,
+                      bool when);
+  void branch_compare(AST::Compare* ast, Label target, bool when);
+
+  void emit_compare_jump(AST::CmpKind kind, TypeKind type,
+                         Label target, bool when);
+
+  //
+  // bool の値を rax に置く (branch を使う)
+  void gen_bool(AST::Base* ast);
+
+  //
+  // rax/xmm0 op= rcx/xmm1
+  void emit_int_op(AST::Expr::Element const& elem);
+  void emit_float_op(AST::Expr::Element const& elem);
+
+  //
+  // rax, xmm0 にある値の型を変える
+  void convert(TypeKind from, TypeKind to);
+
+  //
+  // rax/xmm0 (from) を rcx/xmm1 (to) に移す
+  void move_to_rhs(TypeKind from, TypeKind to);
+
+  //
+  // 変数・即値 (レジスタを使わずに読めるもの)
+  bool is_simple(AST::Base* ast) const;
+
+  //
+  // to の型で reg (int, bool) か xreg (float) に置く
+  void load_simple(AST::Base* ast, TypeKind to, Reg reg,
+                   XReg xreg);
+
+  void load_var(size_t slot, Reg reg, XReg xreg);
+
+  // rax か xmm0 を書き込む
+  void store_var(size_t slot);
+
+  //
+  // 式の途中の値 (スタック)
+  size_t push_temp(TypeKind type);
+  void load_temp(size_t index, TypeKind type, Reg reg,
+                 XReg xreg);
+  void pop_temp();
+  int32_t temp_offset(size_t index) const;
+
+  void load_float_imm(XReg dst, float value);
+
+  Label add_stub(void const* location, bool is_token,
+                 char const* message);
+
+  AST::Function* func;
+  std::vector<AST::Function*> callees;
+
+  std::vector<SlotInfo> slots;
+  std::vector<std::pair<size_t, size_t>> loops;
+
+  size_t position;
+  bool has_calls;
+
+  //
+  // 生成中の状態
+  Assembler* as;
+  SlotResolver const* resolve;
+
+  std::vector<Reg> saved_regs;  // 使う callee-saved レジスタ
+  size_t spill_count;
+  size_t temp_depth;
+  size_t max_temp_depth;
+
+  std::vector<LoopLabels> loop_labels;
+  std::vector<Stub> stubs;
+
+  Label return_label;
+};
+
+}  // namespace JIT
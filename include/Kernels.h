@@ -0,0 +1,57 @@
+// ---------------------------------------------
+//  Kernels
+// ---------------------------------------------
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// 数値の配列をまとめて計算する
+//  AVX2 が使えれば使い、なければ同じ順番で計算する
+//  スカラーの処理に切り替える
+//  (float の合計は 8 本に分けて足すので、どちらでも結果は同じ)
+namespace Kernels {
+
+enum Operator {
+  OP_Add,
+  OP_Sub,
+  OP_Mul,
+  OP_Div,  // 0 で割らないこと (呼び出す側で調べる)
+};
+
+//
+// 実行中の CPU で AVX2 が使えるか
+bool has_avx2();
+
+//
+// dst[i] = a[i] op b[i]
+template <class T>
+void apply(Operator op, T* dst, T const* a, T const* b, size_t n);
+
+//
+// dst[i] = a[i] op b
+template <class T>
+void apply_scalar(Operator op, T* dst, T const* a, T b, size_t n);
+
+int64_t sum(int64_t const* a, size_t n);
+float sum(float const* a, size_t n);
+
+int64_t dot(int64_t const* a, int64_t const* b, size_t n);
+float dot(float const* a, float const* b, size_t n);
+
+//
+// n > 0 であること
+template <class T>
+T min(T const* a, size_t n);
+
+template <class T>
+T max(T const* a, size_t n);
+
+template <class T>
+void cumsum(T* dst, T const* a, size_t n);
+
+template <class T>
+void clamp(T* dst, T const* a, T lo, T hi, size_t n);
+
+}  // namespace Kernels
@@ -3,330 +3,528 @@
 // ---------------------------------------------
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <variant>
+#include "Cow.h"
 #include "TypeInfo.h"
-
+#include "Value.h"
+
+//
+// コンテナ、文字列、構造体の中身は copy-on-write で共有する
+//  clone() は中身を共有した新しいオブジェクトを作り、
+//  get_mut_*() で書き換えるときに共有していれば複製する
+//  (要素のオブジェクトも clone() するので、
+//   一つのオブジェクトを指すのは常に一か所だけ)
 struct Object {
-  TypeInfo type;
+  using TraceFunction = std::function<void(Value&)>;
+
+  // TypeInfo::intern で作った記述子
+  TypeInfo const* type;
+
   size_t ref_count;
   bool no_delete;
 
-  virtual Object* clone() const = 0;
-  virtual std::string to_string() const = 0;
-
-  virtual bool is_numeric() const
-  {
-    return false;
-  }
+  // ゼロカウントテーブルに入っているか
+  bool in_zct;
 
-  bool equals(Object* object) const;
+  //
+  // mark-sweep 用
+  bool gc_marked;
+  uint32_t gc_epoch;  // 作られたときの世代番号
+  int64_t gc_refs;  // ヒープの外からの参照数
+  size_t gc_gray;  // gray スタック内の位置 + 1 (0 ならない)
 
-  virtual ~Object();
+  // 全オブジェクトのリスト
+  Object* gc_prev;
+  Object* gc_next;
 
-protected:
-  Object(TypeInfo type);
-};
+  virtual Object* clone() const = 0;
+  virtual std::string to_string() const = 0;
 
-struct ObjUserType : Object {
-  std::vector<Object*> members;
+  //
+  // equals() で等しいものは同じ値になる
+  virtual size_t hash() const = 0;
 
-  std::string to_string() const;
-  ObjUserType* clone() const;
+  //
+  // 参照している子要素を列挙する
+  virtual void trace(TraceFunction const& fn)
+  {
+    (void)fn;
+  }
 
-  Object*& add_member(Object* obj)
+  //
+  // 子要素を begin 番目から count 個まで列挙する
+  //  (大きいコンテナのマークを途中で区切るときに使う)
+  //  全て列挙したら 0、残っていれば次の位置を返す
+  virtual size_t trace_part(size_t begin, size_t count,
+                            TraceFunction const& fn)
   {
-    auto& ret = this->members.emplace_back(obj);
+    (void)begin;
+    (void)count;
 
-    ret->ref_count++;
+    this->trace(fn);
 
-    return ret;
+    return 0;
   }
 
-  explicit ObjUserType(TypeInfo const& type)
-      : Object(type)
+  //
+  // 子要素を他のオブジェクトと共有しているか
+  virtual bool is_shared() const
   {
+    return false;
   }
-};
 
-struct ObjNone : Object {
-  std::string to_string() const;
-  ObjNone* clone() const;
+  bool equals(Object* object) const;
 
-  explicit ObjNone()
-      : Object(TYPE_None)
-  {
-  }
+  virtual ~Object();
+
+  //
+  // スラブに返す
+  static void operator delete(void* p, size_t size);
+
+protected:
+  Object(TypeInfo const* type);
+
+  //
+  // 型ごとのスラブから確保する
+  //  (派生クラスの operator new から呼ぶ)
+  static void* allocate(size_t size, TypeKind kind);
 };
 
-struct ObjLong : Object {
-  int64_t value;
+struct ObjUserType : Object {
+  Cow<std::vector<Value>> members;
 
   std::string to_string() const;
-  ObjLong* clone() const;
+  ObjUserType* clone() const;
+  size_t hash() const;
 
-  bool is_numeric() const
+  static void* operator new(size_t size)
   {
-    return true;
+    return Object::allocate(size, TYPE_UserDef);
   }
 
-  bool equals(ObjLong* x) const
+  void trace(TraceFunction const& fn)
   {
-    return this->value == x->value;
+    for (auto&& member : this->members.get_shared())
+      fn(member);
   }
 
-  explicit ObjLong(int64_t value = 0)
-      : Object(TYPE_Int),
-        value(value)
+  bool is_shared() const
   {
+    return this->members.is_shared();
   }
-};
-
-struct ObjUSize : Object {
-  size_t value;
-
-  std::string to_string() const;
-  ObjUSize* clone() const;
 
-  bool is_numeric() const
+  std::vector<Value> const& get_members() const
   {
-    return true;
+    return this->members.get();
   }
 
-  bool equals(ObjUSize* x) const
-  {
-    return this->value == x->value;
-  }
+  std::vector<Value>& get_mut_members();
 
-  ObjUSize(size_t value = 0)
-      : Object(TYPE_USize),
-        value(value)
+  //
+  // 同じ型なので、メンバの数も同じ
+  bool equals(ObjUserType* x) const
   {
-  }
-};
+    auto const& members = this->get_members();
+    auto const& x_members = x->get_members();
 
-struct ObjFloat : Object {
-  float value;
-
-  std::string to_string() const;
-  ObjFloat* clone() const;
+    for (size_t i = 0; i < members.size(); i++) {
+      if (!members[i].equals(x_members[i]))
+        return false;
+    }
 
-  bool is_numeric() const
-  {
     return true;
   }
 
-  bool equals(ObjFloat* x) const
+  Value& add_member(Value const& value)
   {
-    return this->value == x->value;
-  }
-
-  explicit ObjFloat(float value = 0)
-      : Object(TYPE_Float),
-        value(value)
-  {
-  }
-};
+    auto& ret = this->get_mut_members().emplace_back(value);
 
-struct ObjBool : Object {
-  bool value;
+    ret.inc_ref();
 
-  std::string to_string() const
-  {
-    return value ? "true" : "false";
+    return ret;
   }
 
-  ObjBool* clone() const
+  explicit ObjUserType(TypeInfo const* type)
+      : Object(type)
   {
-    return new ObjBool(this->value);
   }
 
-  bool equals(ObjBool* x) const
-  {
-    return this->value == x->value;
-  }
+  ObjUserType(ObjUserType const& other);
 
-  explicit ObjBool(bool value = 0)
-      : Object(TYPE_Bool),
-        value(value)
-  {
-  }
+  ~ObjUserType();
 };
 
-struct ObjChar : Object {
-  wchar_t value;
+struct ObjString : Object {
+  Cow<std::wstring> value;
+
+  // 中身を書き換えるたびに増やす
+  //  (for-in の途中で書き換えられたことを調べる)
+  uint32_t version = 0;
 
   std::string to_string() const;
-  ObjChar* clone() const;
+  ObjString* clone() const;
+  size_t hash() const;
 
-  bool equals(ObjChar* x) const
+  static void* operator new(size_t size)
   {
-    return this->value == x->value;
+    return Object::allocate(size, TYPE_String);
   }
 
-  explicit ObjChar(wchar_t ch = 0)
-      : Object(TYPE_Char),
-        value(ch)
+  bool equals(ObjString* x) const
   {
+    return this->get_value() == x->get_value();
   }
-};
 
-struct ObjString : Object {
-  std::wstring value;
-
-  std::string to_string() const;
-  ObjString* clone() const;
-
-  bool equals(ObjString* x) const
+  std::wstring const& get_value() const
   {
-    return this->value == x->value;
+    return this->value.get();
   }
 
+  std::wstring& get_mut_value();
+
   ObjString(std::wstring const& value = L"")
-      : Object(TYPE_String),
-        value(value)
+      : Object(TypeInfo::intern(TYPE_String)),
+        value(std::wstring(value))
   {
   }
 
   ObjString(std::wstring&& value)
-      : Object(TYPE_String),
+      : Object(TypeInfo::intern(TYPE_String)),
         value(std::move(value))
   {
   }
+
+  ObjString(ObjString const& other);
 };
 
+//
+// 範囲
+//  step > 0 なら begin から end の手前まで増やし、
+//  step < 0 なら end の手前まで減らす (0 にはならない)
 struct ObjRange : Object {
   int64_t begin;
   int64_t end;
+  int64_t step;
 
   std::string to_string() const;
   ObjRange* clone() const;
+  size_t hash() const;
+
+  static void* operator new(size_t size)
+  {
+    return Object::allocate(size, TYPE_Range);
+  }
 
   bool equals(ObjRange* x) const
   {
-    return this->begin == x->begin && this->end == x->end;
+    return this->begin == x->begin && this->end == x->end &&
+           this->step == x->step;
   }
 
-  ObjRange(int64_t begin, int64_t end)
-      : Object(TYPE_Range),
+  ObjRange(int64_t begin, int64_t end, int64_t step = 1)
+      : Object(TypeInfo::intern(TYPE_Range)),
         begin(begin),
-        end(end)
+        end(end),
+        step(step)
   {
   }
 };
 
+//
+// 辞書
+//  追加した順に並べた items と、キーのハッシュ値から
+//  items の位置を引く表 (オープンアドレス法) を持つ
+//  要素が少ないうちは表を作らずに items を順に調べる
 struct ObjDict : Object {
   struct Item {
-    Object* key;
-    Object* value;
+    Value key;
+    Value value;
+    size_t hash;  // key.hash()
+
+    // remove() で削除した跡 (key と value は none)
+    bool is_removed = false;
 
-    Item(Object* k, Object* v)
+    Item(Value const& k, Value const& v, size_t hash)
         : key(k),
-          value(v)
+          value(v),
+          hash(hash)
     {
     }
   };
 
-  std::vector<Item> items;
+  struct Table {
+    std::vector<Item> items;
+
+    // items の位置 + 1 (0 は空き)
+    //  大きさは 2 の累乗
+    std::vector<uint32_t> index;
+
+    // items に残っている削除の跡の数
+    size_t removed = 0;
+  };
+
+  Cow<Table> table;
+
+  // 中身を書き換えるたびに増やす
+  //  (for-in の途中で書き換えられたことを調べる)
+  uint32_t version = 0;
 
   std::string to_string() const;
   ObjDict* clone() const;
+  size_t hash() const;
 
-  bool equals(ObjDict* x) const
+  static void* operator new(size_t size)
   {
-    if (this->items.size() != x->items.size())
-      return false;
+    return Object::allocate(size, TYPE_Dict);
+  }
 
-    for (auto xx = x->items.begin();
-         auto&& aa : this->items) {
-      if (!aa.key->equals(xx->key) ||
-          !aa.value->equals(xx->value))
-        return false;
-      xx++;
+  void trace(TraceFunction const& fn)
+  {
+    for (auto&& item : this->table.get_shared().items) {
+      fn(item.key);
+      fn(item.value);
     }
+  }
 
-    return true;
+  size_t trace_part(size_t begin, size_t count,
+                    TraceFunction const& fn)
+  {
+    auto& items = this->table.get_shared().items;
+    auto end = std::min(begin + count, items.size());
+
+    for (auto i = begin; i < end; i++) {
+      fn(items[i].key);
+      fn(items[i].value);
+    }
+
+    return end < items.size() ? end : 0;
   }
 
-  Item& append(Object* key, Object* value)
+  bool is_shared() const
   {
-    auto& item = this->items.emplace_back(key, value);
+    return this->table.is_shared();
+  }
 
-    item.key->ref_count++;
-    item.value->ref_count++;
+  //
+  // 削除の跡があれば先に詰める
+  //  (中身は変わらないので、共有していても詰めてよい)
+  std::vector<Item> const& get_items() const
+  {
+    if (this->table.get().removed != 0)
+      const_cast<ObjDict*>(this)->compact();
 
-    return item;
+    return this->table.get().items;
   }
 
-  ObjDict()
-      : Object(TYPE_Dict)
+  //
+  // 要素の数 (削除の跡は数えない)
+  size_t size() const
   {
+    auto const& table = this->table.get();
+
+    return table.items.size() - table.removed;
   }
 
-  ObjDict(std::vector<Item>&& _items)
-      : Object(TYPE_Dict),
-        items(std::move(_items))
+  bool equals(ObjDict* x) const
   {
-    for (auto&& item : this->items) {
-      item.key->ref_count++;
-      item.value->ref_count++;
+    auto const& items = this->get_items();
+    auto const& x_items = x->get_items();
+
+    if (items.size() != x_items.size())
+      return false;
+
+    for (auto xx = x_items.begin(); auto&& aa : items) {
+      if (!aa.key.equals(xx->key) ||
+          !aa.value.equals(xx->value))
+        return false;
+      xx++;
     }
+
+    return true;
   }
 
-  ~ObjDict()
+  //
+  // キーを探す (なければ nullptr)
+  Item const* find(Value const& key) const;
+
+  //
+  // 書き換えるためにキーを探す
+  //  中身を共有していれば複製する
+  Value* find_mut(Value const& key);
+
+  //
+  // 追加する (key はまだないこと)
+  Item& append(Value const& key, Value const& value);
+
+  //
+  // 削除する
+  //  跡を残しておき、半分を超えたらまとめて詰める
+  bool remove(Value const& key);
+
+  ObjDict()
+      : Object(TypeInfo::intern(TYPE_Dict))
   {
-    for (auto&& item : this->items) {
-      item.key->ref_count--;
-      item.value->ref_count--;
-    }
   }
+
+  ObjDict(ObjDict const& other);
+
+  ~ObjDict();
+
+private:
+  // key の items での位置 (なければ -1)
+  static int64_t find_position(Table const& table,
+                               Value const& key, size_t hash);
+
+  // index を作り直す
+  static void rebuild_index(Table& table);
+
+  // 削除の跡を取り除いて、index を作り直す
+  void compact();
+
+  Table& get_mut_table();
 };
 
+//
+// ベクタ
+//  要素が int, usize, float, bool, char のときは
+//  Value にせず、その型の配列に詰めて持つ
+//  (要素の型は作るときに type から決まる)
 struct ObjVector : Object {
-  std::vector<Object*> elements;
+  using Elements =
+      std::variant<std::vector<Value>,  // その他の型
+                   std::vector<int64_t>,  // int
+                   std::vector<size_t>,  // usize
+                   std::vector<float>,  // float
+                   std::vector<uint8_t>,  // bool
+                   std::vector<wchar_t>  // char
+                   >;
+
+  Cow<Elements> elements;
+
+  // 中身を書き換えるたびに増やす
+  //  (for-in の途中で書き換えられたことを調べる)
+  uint32_t version = 0;
 
   std::string to_string() const;
   ObjVector* clone() const;
+  size_t hash() const;
 
-  bool equals(ObjVector* x) const
+  static void* operator new(size_t size)
   {
-    if (this->elements.size() != x->elements.size())
-      return false;
+    return Object::allocate(size, TYPE_Vector);
+  }
 
-    for (auto y = x->elements.begin();
-         auto&& e : this->elements) {
-      if (!e->equals(*y))
-        return false;
+  void trace(TraceFunction const& fn)
+  {
+    auto values =
+        std::get_if<0>(&this->elements.get_shared());
+
+    if (values) {
+      for (auto&& elem : *values)
+        fn(elem);
     }
+  }
 
-    return true;
+  size_t trace_part(size_t begin, size_t count,
+                    TraceFunction const& fn)
+  {
+    auto values =
+        std::get_if<0>(&this->elements.get_shared());
+
+    if (!values)
+      return 0;
+
+    auto end = std::min(begin + count, values->size());
+
+    for (auto i = begin; i < end; i++)
+      fn((*values)[i]);
+
+    return end < values->size() ? end : 0;
   }
 
-  Object*& append(Object* obj)
+  bool is_shared() const
   {
-    auto& ret = this->elements.emplace_back(obj);
+    return this->elements.is_shared();
+  }
 
-    ret->ref_count++;
+  //
+  // 要素を詰めて持っているか
+  bool is_packed() const
+  {
+    return this->elements.get().index() != 0;
+  }
 
-    return ret;
+  //
+  // 詰めて持っていないときだけ使える
+  std::vector<Value> const& get_elements() const
+  {
+    return std::get<0>(this->elements.get());
   }
 
-  ObjVector()
-      : Object(TYPE_Vector)
+  std::vector<Value>& get_mut_elements();
+
+  //
+  // 詰めて持っているときだけ使える
+  template <class T>
+  std::vector<T> const& get_packed() const
   {
+    return std::get<std::vector<T>>(this->elements.get());
   }
 
-  ObjVector(std::vector<Object*>&& elems)
-      : Object(TYPE_Vector),
-        elements(std::move(elems))
+  template <class T>
+  std::vector<T>& get_mut_packed()
   {
-    for (auto&& e : this->elements) {
-      e->ref_count++;
-    }
+    return std::get<std::vector<T>>(this->get_mut());
+  }
+
+  size_t size() const
+  {
+    return std::visit([](auto&& v) { return v.size(); },
+                      this->elements.get());
   }
 
-  ~ObjVector()
+  //
+  // i 番目の要素 (詰めているものは Value にする)
+  Value at(size_t i) const
   {
-    for (auto&& elem : this->elements) {
-      elem->ref_count--;
+    auto const& elements = this->elements.get();
+
+    switch (elements.index()) {
+      case 1:
+        return Value::from_int(std::get<1>(elements)[i]);
+
+      case 2:
+        return Value::from_usize(std::get<2>(elements)[i]);
+
+      case 3:
+        return Value::from_float(std::get<3>(elements)[i]);
+
+      case 4:
+        return Value::from_bool(std::get<4>(elements)[i]);
+
+      case 5:
+        return Value::from_char(std::get<5>(elements)[i]);
     }
+
+    return std::get<0>(elements)[i];
   }
+
+  //
+  // i 番目の要素を書き換える
+  void set(size_t i, Value const& value);
+
+  void append(Value const& value);
+
+  bool equals(ObjVector* x) const;
+
+  explicit ObjVector(TypeInfo const* type);
+
+  ObjVector(ObjVector const& other);
+
+  ~ObjVector();
+
+private:
+  Elements& get_mut();
 };
@@ -0,0 +1,42 @@
+// ---------------------------------------------
+//  Operators
+// ---------------------------------------------
+#pragma once
+
+#include "AST.h"
+#include "Value.h"
+
+//
+// 二項演算・比較の処理
+//  (演算子, 左辺の型, 右辺の型) の組み合わせごとに
+//  テンプレートで関数を作り、表から選ぶ
+//  Sema で型が決まったときに式の要素に結びつけておき、
+//  評価するときは型を調べずに呼び出す
+namespace Operators {
+
+//
+// dest = dest op right
+//  op はエラーの場所 (0 で割ったとき)
+using ExprKernel = AST::Expr::Element::Kernel;
+
+//
+// left op right
+using CompareKernel = AST::Compare::Element::Kernel;
+
+ExprKernel get_expr_kernel(AST::ExprKind kind, TypeKind lhs,
+                           TypeKind rhs);
+
+CompareKernel get_compare_kernel(AST::CmpKind kind, TypeKind lhs,
+                                 TypeKind rhs);
+
+//
+// 左辺だけで結果が決まるか (&&, ||)
+//  右辺は評価しない
+inline bool is_short_circuit(AST::ExprKind kind,
+                             Value const& left)
+{
+  return (kind == AST::EX_And && !left.v_bool) ||
+         (kind == AST::EX_Or && left.v_bool);
+}
+
+}  // namespace Operators
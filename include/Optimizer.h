@@ -0,0 +1,8 @@
+// ---------------------------------------------
+//  構文木の最適化
+// ---------------------------------------------
+#pragma once
+
+#include "Optimizer/Folder.h"
+#include "Optimizer/Hoister.h"
+#include "Optimizer/Inliner.h"
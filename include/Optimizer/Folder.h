@@ -0,0 +1,144 @@
+#pragma once
+
+#include <iosfwd>
+#include <list>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "AST.h"
+#include "Value.h"
+
+namespace Optimizer {
+
+// ---------------------------------------------
+//  Folder
+//   Sema でチェック済みの構文木で定数を畳み込む
+//
+//   60 * 60 * 24      => 86400
+//   "ab" + "cd"       => "abcd"
+//   1 < 2             => true
+//   if true { A }     => { A }
+//
+//   変更されないスカラーの let は、使う場所を
+//   リテラルに置き換えてから続けて畳み込む
+//
+//   結果はリテラルの構文木にするので、
+//   どの実行エンジンもそのまま使える
+// ---------------------------------------------
+class Folder {
+  //
+  // 名前から引いたもの
+  //  (let 以外の変数は decl が nullptr)
+  struct Binding {
+    std::string_view name;
+    AST::VariableDeclaration* decl;
+  };
+
+  struct Scope {
+    std::vector<Binding> names;
+
+    // 関数の中からは外の変数を伝播しない
+    bool is_function;
+  };
+
+public:
+  //
+  // 畳み込んだ構文木の種類 (-fold-stats)
+  enum FoldKind {
+    FOLD_Expr,  // 式, 比較, 単項演算, キャスト
+    FOLD_Variable,  // 伝播した変数
+    FOLD_Branch,  // 条件が定数の if
+    FOLD_Max
+  };
+
+  /**
+   * @param tokens 作ったリテラルのトークンの置き場所
+   * @param texts トークンの文字列の置き場所
+   *
+   * @note どちらも構文木より長く残すこと
+   */
+  Folder(std::list<Token>& tokens,
+         std::list<std::string>& texts);
+
+  ~Folder();
+
+  /**
+   * @brief スクリプト全体を畳み込む
+   *
+   * @param root Sema でチェック済みの構文木
+   */
+  void fold(AST::Scope* root);
+
+  /**
+   * @brief 畳み込んだ構文木の数を表示する
+   */
+  static void print_statistics(std::ostream& os);
+
+private:
+  //
+  // 変数の参照先と、書き換えられる let を調べる
+  void resolve(AST::Base* ast);
+  void resolve_left(AST::Base* ast);
+
+  Binding const* find(std::string_view name);
+
+  //
+  // 畳み込む (ast を置き換えることがある)
+  void fold(AST::Base*& ast);
+  void fold_left(AST::Base*& ast);
+
+  void fold_expr(AST::Base*& ast);
+  void fold_compare(AST::Base*& ast);
+  void fold_if(AST::Base*& ast);
+
+  /**
+   * @brief ast を to で置き換えて、古いほうを削除する
+   */
+  void replace(AST::Base*& ast, AST::Base* to,
+               FoldKind kind);
+
+  //
+  // リテラルを作る (from の位置を使う)
+  AST::Base* make_literal(::Value const& value,
+                          AST::Base* from);
+
+  AST::Base* make_string(std::string_view str,
+                         AST::Base* from);
+
+  Token const& make_token(TokenKind kind, std::string text,
+                          AST::Base* from);
+
+  static TypeKind kind_of(AST::Base* ast);
+
+  //
+  // 数値・真偽値のリテラルの値
+  //  (Evaluator::create_object と同じ変換)
+  static std::optional<::Value> literal_value(
+      AST::Base* ast);
+
+  static bool is_string(AST::Base* ast);
+
+  std::list<Token>& tokens;
+  std::list<std::string>& texts;
+
+  std::vector<Scope> scopes;
+
+  //
+  // 読んでいる変数の定義
+  std::map<AST::Variable*, AST::VariableDeclaration*> defs;
+
+  std::vector<AST::VariableDeclaration*> lets;
+  std::set<AST::VariableDeclaration*> mutated;
+
+  // 関数の中で書き換えられる外の変数の名前
+  std::set<std::string_view> written_outer;
+
+  //
+  // 伝播する let の値 (初期化式のリテラル)
+  std::map<AST::VariableDeclaration*, AST::Base*> constants;
+};
+
+}  // namespace Optimizer
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <iosfwd>
+#include <list>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AST.h"
+
+namespace Optimizer {
+
+// ---------------------------------------------
+//  Hoister
+//   ループの中で値が変わらない式を、ループの前で
+//   一度だけ計算する (loop-invariant code motion)
+//
+//   while i < len(v) - 1 {     { let 0_hoisted = len(v) - 1;
+//     s = s + p.q.x * i;   =>    let 1_hoisted = p.q.x;
+//     ...                        while i < 0_hoisted { ... }
+//   }                          }
+//
+//   動かすのは、副作用もエラーもない式で、
+//   ループの中で書き換えられる変数を使わないもの
+//   (ループが一度も回らなくても結果は変わらない)
+//
+//   値を持つ変数の読み出しは複製になるので、
+//   結果がスカラーか文字列の式だけを動かす
+// ---------------------------------------------
+class Hoister {
+  //
+  // 変数 (is_global, slot)
+  using VarKey = std::pair<bool, size_t>;
+
+  //
+  // ループの中で値が変わる変数
+  struct LoopInfo {
+    std::set<VarKey> variant;
+
+    // ユーザー定義関数を呼んでいる
+    //  (関数の中で書き換えるグローバル変数も変わる)
+    bool has_call = false;
+  };
+
+public:
+  /**
+   * @param tokens 作った変数の名前のトークンの置き場所
+   * @param texts トークンの文字列の置き場所
+   *
+   * @note どちらも構文木より長く残すこと
+   */
+  Hoister(std::list<Token>& tokens,
+          std::list<std::string>& texts);
+
+  ~Hoister();
+
+  /**
+   * @brief スクリプト全体のループから式を出す
+   *
+   * @param root Sema でチェック済みの構文木
+   */
+  void hoist(AST::Scope* root);
+
+  /**
+   * @brief ループの外に出した式の数を表示する
+   */
+  static void print_statistics(std::ostream& os);
+
+private:
+  //
+  // ループをたどる (ast を置き換えることがある)
+  void visit(AST::Base*& ast);
+
+  /**
+   * @brief ループの外に出せる式を、一時変数に置き換える
+   *
+   * @return 一時変数の let を前に置いたスコープ
+   *         (出すものがなければ nullptr)
+   */
+  AST::Scope* hoist_loop(AST::Base* loop);
+
+  void scan(AST::Base* ast, LoopInfo& info);
+  void scan_write(AST::Base* dest, LoopInfo& info);
+
+  bool is_invariant(AST::Base* ast,
+                    LoopInfo const& info) const;
+
+  void replace(AST::Base*& ast, LoopInfo const& info,
+               std::vector<AST::Base*>& lets);
+
+  Token const& make_token(AST::Base* from);
+
+  std::list<Token>& tokens;
+  std::list<std::string>& texts;
+
+  //
+  // 一時変数を置くフレーム (関数またはトップレベルのスコープ)
+  AST::Scope* frame;
+  bool in_function;
+
+  //
+  // 関数の中で書き換えられるグローバル変数のスロット
+  std::set<size_t> written_globals;
+};
+
+}  // namespace Optimizer
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <string_view>
+#include <vector>
+
+#include "AST.h"
+
+namespace Optimizer {
+
+// ---------------------------------------------
+//  Inliner
+//   小さいユーザー定義関数の呼び出しを、
+//   関数の中身で置き換える
+//
+//   fn sq(x: int) -> int { x * x }
+//   sq(a + 1)   => { let x = a + 1; x * x }
+//
+//   途中の return は残りを else に移してから
+//   最後の式にする
+//
+//   fn f(x: int) -> int {    { let x = ..;
+//     if x < 0 {               if x < 0 { 0 }
+//       return 0;     =>       else { x * 2 }
+//     }                      }
+//     return x * 2;
+//   }
+//
+//   Folder より前に行い、定数の引数も畳み込めるようにする
+// ---------------------------------------------
+class Inliner {
+  //
+  // 呼び出し元で見える変数
+  struct Binding {
+    std::string_view name;
+    size_t slot;
+    bool is_global;
+  };
+
+public:
+  //
+  // 展開する関数の大きさ (構文木の数) の上限
+  static constexpr size_t max_size = 40;
+
+  //
+  // 展開した中をさらに展開する深さの上限
+  static constexpr size_t max_depth = 4;
+
+  Inliner();
+  ~Inliner();
+
+  /**
+   * @brief スクリプト全体の呼び出しを展開する
+   *
+   * @param root Sema でチェック済みの構文木
+   */
+  void inline_calls(AST::Scope* root);
+
+  /**
+   * @brief 展開した呼び出しの数を表示する
+   */
+  static void print_statistics(std::ostream& os);
+
+private:
+  //
+  // 展開できる関数か
+  bool is_inlinable(AST::Function* func);
+  bool is_recursive(AST::Function* func);
+
+  //
+  // 呼び出しをたどって展開する (ast を置き換えることがある)
+  void visit(AST::Base*& ast);
+
+  /**
+   * @brief この場所で展開しても名前の参照が変わらないか
+   *
+   * @note VM などは変数を名前で探す
+   */
+  bool can_expand(AST::CallFunc* call);
+
+  /**
+   * @brief 呼び出しを関数の中身のスコープに置き換える
+   */
+  AST::Scope* expand(AST::CallFunc* call);
+
+  void bind(std::string_view name, size_t slot);
+
+  Binding const* find(std::string_view name) const;
+
+  // 展開先のフレーム (関数またはトップレベルのスコープ)
+  AST::Scope* frame;
+  bool in_function;
+
+  std::vector<std::vector<Binding>> scopes;
+
+  size_t depth;
+
+  //
+  // 関数の呼び出し先
+  std::map<AST::Function*, std::vector<AST::Function*>>
+      callees;
+
+  std::map<AST::Function*, bool> inlinable;
+
+  //
+  // 関数から参照されるトップレベルの変数の名前
+  //  (IR, AOT はこの名前の let をグローバルにする)
+  std::set<std::string_view> global_names;
+};
+
+}  // namespace Optimizer
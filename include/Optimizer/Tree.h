@@ -0,0 +1,46 @@
+#pragma once
+
+#include "AST.h"
+#include "TypeInfo.h"
+
+namespace Optimizer {
+
+// ---------------------------------------------
+//  Tree
+//   最適化で構文木を書き換えるときの道具
+//
+//   Sema でつけた型 (value_type_cache) も
+//   一緒に消したり写したりする
+// ---------------------------------------------
+class Tree {
+public:
+  /**
+   * @brief 構文木を削除する (value_type_cache からも消す)
+   */
+  static void erase(AST::Base* ast);
+
+  /**
+   * @brief 構文木を複製する
+   *
+   * @param slot_offset 関数の中の変数のスロットに足す数
+   * @param to_global 関数の中の変数をトップレベルに移す
+   *
+   * @return 複製できない構文木 (関数の定義など) があれば
+   *         nullptr
+   */
+  static AST::Base* clone(AST::Base* ast,
+                          size_t slot_offset,
+                          bool to_global);
+
+  //
+  // Sema でつけた型
+  static TypeInfo type_of(AST::Base* ast);
+
+  static void set_type(AST::Base* ast,
+                       TypeInfo const& type);
+
+  // 型がついていれば to にも写す
+  static void copy_type(AST::Base* from, AST::Base* to);
+};
+
+}  // namespace Optimizer
@@ -51,6 +51,9 @@ private:
 
   bool is_ended_with_scope(AST::Base* ast);
 
+  bool is_type_parameters();
+  bool is_type_constructor();
+
   token_iter expect_identifier();
 
   AST::Variable* new_variable();
@@ -37,7 +37,8 @@ public:
   bool lex();
   bool parse();
   bool check();
-  Object* evaluate();
+  void optimize();
+  Value evaluate();
 
   void execute_full();
 
@@ -72,6 +73,12 @@ private:
   std::list<Token> _token_list;
   AST::Scope* _ast;
 
+  //
+  // 最適化で作ったトークン
+  //  (畳み込んだリテラル、ループの外に出した変数の名前)
+  std::list<Token> _opt_tokens;
+  std::list<std::string> _opt_text;
+
   //
   // if other file importing this, the pointer to that file
   ScriptFileContext const* _owner;
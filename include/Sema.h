@@ -14,15 +14,45 @@
 #include "TypeInfo.h"
 
 class Evaluator;
+
+namespace VM {
+class Compiler;
+}
+
+namespace JIT {
+class CodeGen;
+}
+
+namespace AOT {
+class Emitter;
+}
+
+namespace IR {
+class Builder;
+}
+
+namespace Optimizer {
+class Folder;
+class Tree;
+}
+
 class Sema {
   friend class Evaluator;
+  friend class VM::Compiler;
+  friend class JIT::CodeGen;
+  friend class AOT::Emitter;
+  friend class IR::Builder;
+  friend class Optimizer::Folder;
+  friend class Optimizer::Tree;
 
   struct LocalVar {
     TypeInfo type;
     std::string_view name;
 
-    size_t step;
-    size_t index;
+    // フレーム内の位置
+    //  関数の中ではフレームの先頭から、
+    //  トップレベルではスタックの先頭からの位置
+    size_t slot;
 
     bool is_global = 0;
 
@@ -30,8 +60,7 @@ class Sema {
                       std::string_view name)
         : type(type),
           name(name),
-          step(0),
-          index(0)
+          slot(0)
     {
     }
   };
@@ -59,12 +88,16 @@ class Sema {
     AST::Base* ast;
     LocalVarList lvar;
 
+    // 入った時点での slot_count
+    size_t slot_begin;
+
     bool is_loop;
     bool is_breakable;
     bool is_continueable;
 
     SemaScope(AST::Base* ast)
         : ast(ast),
+          slot_begin(0),
           is_loop(false),
           is_breakable(false),
           is_continueable(false)
@@ -154,6 +187,16 @@ public:
   std::optional<TypeInfo> get_type_from_name(
       std::string_view name);
 
+  /**
+   * @brief 範囲の検査を省いたインデックス参照の一覧
+   *
+   * @return std::vector<AST::IndexRef*> const&
+   */
+  std::vector<AST::IndexRef*> const& get_in_bounds_refs() const
+  {
+    return this->in_bounds_refs;
+  }
+
 private:
   using CaptureFunction = std::function<void(AST::Base*)>;
   using ReturnCaptureFunction =
@@ -181,30 +224,85 @@ private:
 
   SemaScope& enter_scope(AST::Scope* ast)
   {
-    return this->scope_list.emplace_front(ast);
+    auto& scope = this->scope_list.emplace_front(ast);
+
+    scope.slot_begin = this->slot_count;
+
+    return scope;
   }
 
+  //
+  // スコープを抜けると、そのスコープの変数の位置は
+  // 後続のスコープで再利用される
   void leave_scope()
   {
+    this->slot_count = this->get_cur_scope().slot_begin;
     this->scope_list.pop_front();
   }
 
+  /**
+   * @brief 現在のスコープに変数を追加し、フレーム内の位置を割り当てる
+   *
+   * @param type
+   * @param name
+   * @return LocalVar&
+   */
+  LocalVar& append_lvar(TypeInfo const& type,
+                        std::string_view name);
+
   // 今いる関数を返す
   // 関数の中にいなければ nullptr を返す
   AST::Function* get_cur_func();
 
   TypeInfo expect(TypeInfo const& type, AST::Base* ast);
 
+  /**
+   * @brief 左辺値の元になっている変数を求める
+   *
+   * @param ast 左辺値 (v[i].x など)
+   * @return AST::Base* 変数 (v)
+   */
+  static AST::Base* get_root_variable(AST::Base* ast);
+
+  /**
+   * @brief for i in a .. len(v) の v を求める
+   *
+   * @note a は 0 以上の整数リテラル、by は正の整数リテラルであること
+   *
+   * @param ast
+   * @return AST::Variable* 見つからなければ nullptr
+   */
+  AST::Variable* get_bce_vector(AST::For* ast);
+
+  /**
+   * @brief ループの中の v[i] を範囲内として印をつける
+   *
+   * @note v と i が書き換えられる場合は何もしない
+   *
+   * @param ast ループ
+   * @param vec get_bce_vector の結果
+   * @param nodes ループの中で検査した構文木
+   */
+  void eliminate_bounds_checks(
+      AST::For* ast, AST::Variable* vec,
+      std::vector<AST::Base*> const& nodes);
+
   AST::Scope* root;
 
   std::list<SemaScope> scope_list;
   std::list<AST::Function*> function_history;
 
-  size_t variable_stack_offs = 0;
+  //
+  // 現在のフレームで使用中の変数の数と、その最大値
+  size_t slot_count = 0;
+  size_t frame_size = 0;
 
   // captures
   std::vector<CaptureContext> captures;
   std::vector<ReturnCaptureFunction> return_captures;
 
+  // 範囲の検査を省いたもの (-dump-bce)
+  std::vector<AST::IndexRef*> in_bounds_refs;
+
   static std::map<AST::Base*, TypeInfo> value_type_cache;
 };
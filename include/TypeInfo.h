@@ -61,7 +61,8 @@ struct TypeInfo {
            bool is_const = false)
       : kind(kind),
         is_const(is_const),
-        type_params(list)
+        type_params(list),
+        userdef_struct(nullptr)
   {
   }
 
@@ -74,6 +75,13 @@ struct TypeInfo {
   static std::optional<TypeKind> get_kind_from_name(
       std::string_view const& name);
 
+  //
+  // 同じ型には同じアドレスの記述子を返す
+  //  オブジェクトはこれを指すので、ポインタで比較できる
+  //  is_const は変数の性質なので含めない
+  static TypeInfo const* intern(TypeInfo const& type);
+  static TypeInfo const* intern(TypeKind kind);
+
   int find_member(std::string_view const& name)
   {
     for (int i = 0; auto&& [n, t] : this->members) {
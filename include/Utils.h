@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -20,4 +21,8 @@ std::string to_str(std::wstring const& str);
 
 }  // namespace String
 
+//
+// ネイティブのスタックの下限 (これより下に伸びたらエラー)
+uintptr_t native_stack_limit();
+
 }  // namespace Utils
@@ -0,0 +1,9 @@
+// ---------------------------------------------
+//  Bytecode VM
+// ---------------------------------------------
+#pragma once
+
+#include "VM/Instruction.h"
+#include "VM/Program.h"
+#include "VM/Compiler.h"
+#include "VM/Machine.h"
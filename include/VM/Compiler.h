@@ -0,0 +1,178 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "AST.h"
+#include "VM/Program.h"
+
+namespace VM {
+
+// ---------------------------------------------
+//  Compiler
+//   Sema でチェック済みの構文木からバイトコードを生成する
+// ---------------------------------------------
+class Compiler {
+  //
+  // 式の評価結果が入っているレジスタ
+  struct Operand {
+    int32_t reg;
+
+    //
+    // true: 一時レジスタ (所有している)
+    // false: 変数などから借りている
+    bool is_temp;
+
+    Operand(int32_t reg = -1, bool is_temp = false)
+        : reg(reg),
+          is_temp(is_temp)
+    {
+    }
+  };
+
+  struct LocalVar {
+    std::string_view name;
+    int32_t reg;
+    TypeInfo type;
+  };
+
+  struct LoopContext {
+    std::vector<size_t> breaks;
+    std::vector<size_t> continues;
+  };
+
+  struct FunctionState {
+    Function* func;
+
+    std::vector<std::vector<LocalVar>> scopes;
+    std::vector<LoopContext> loops;
+
+    int32_t free_reg;
+
+    bool is_toplevel;
+
+    FunctionState(Function* func, bool is_toplevel)
+        : func(func),
+          free_reg(0),
+          is_toplevel(is_toplevel)
+    {
+    }
+  };
+
+public:
+  Compiler();
+  ~Compiler();
+
+  /**
+   * @brief スクリプト全体をコンパイルする
+   *
+   * @param root
+   * @return Program
+   */
+  Program compile(AST::Scope* root);
+
+private:
+  void compile_function(AST::Function* ast);
+
+  void compile_stmt(AST::Base* ast);
+
+  /**
+   * @brief 式をコンパイルする
+   *
+   * @note 変数の場合はそのレジスタをそのまま返す
+   *
+   * @param hint 結果を置きたいレジスタ (-1: 任意)
+   * @return Operand
+   */
+  Operand compile_expr(AST::Base* ast, int32_t hint = -1);
+
+  /**
+   * @brief 式の値を dest に格納する
+   *
+   * @note 借りているオブジェクトは複製する
+   */
+  void compile_to(int32_t dest, AST::Base* ast);
+
+  Operand compile_arith(AST::Expr* ast, int32_t hint);
+  Operand compile_compare(AST::Compare* ast, int32_t hint);
+  Operand compile_call(AST::CallFunc* ast, int32_t hint);
+  Operand compile_index(AST::IndexRef* ast, int32_t hint);
+  Operand compile_member(AST::IndexRef* ast, int32_t hint);
+  Operand compile_cast(AST::Cast* ast, int32_t hint);
+
+  Operand compile_assign(AST::Assign* ast, int32_t hint);
+  void compile_let(AST::VariableDeclaration* ast);
+
+  void compile_scope(AST::Scope* ast, int32_t dest);
+  void compile_if(AST::If* ast, int32_t dest);
+  void compile_switch(AST::Switch* ast, int32_t dest);
+  void compile_for(AST::For* ast);
+  void compile_for_in(AST::For* ast);
+  void compile_while(AST::While* ast);
+  void compile_do_while(AST::DoWhile* ast);
+  void compile_loop(AST::Loop* ast);
+  void compile_return(AST::Return* ast);
+
+  /**
+   * @brief 条件式を評価して、偽ならジャンプする
+   *
+   * @return ジャンプ命令の位置 (後で patch する)
+   */
+  size_t compile_branch_if_false(AST::Base* cond);
+
+  //
+  // 左辺値のコンテナまでのレジスタを求める
+  Operand compile_container_ref(AST::Base* ast, TypeInfo& type);
+
+  Operand compile_ref_step(Operand cont, TypeInfo& type,
+                           AST::Base* index, bool is_member);
+
+  //
+  // 型変換
+  Operand convert(Operand opr, TypeKind from, TypeKind to,
+                  AST::Base* ast);
+
+  //
+  // 命令の追加
+  size_t emit(Instruction const& inst,
+              AST::Base const* ast = nullptr,
+              Token const* token = nullptr);
+
+  void patch(size_t at, size_t target);
+  size_t here() const;
+
+  int32_t alloc_reg();
+  void free_to(int32_t reg);
+
+  int32_t add_constant(Register reg);
+  int32_t add_desc(TypeInfo const& type);
+
+  //
+  // local variables
+  void enter_scope();
+  void leave_scope();
+
+  LocalVar& declare(std::string_view name, int32_t reg,
+                    TypeInfo const& type);
+
+  LocalVar* find_local(std::string_view name);
+  LocalVar* find_global(std::string_view name);
+
+  static TypeInfo const& type_of(AST::Base* ast);
+
+  static bool is_heap_type(TypeKind kind);
+
+  FunctionState& cur()
+  {
+    return *this->state;
+  }
+
+  Program program;
+
+  FunctionState* state;
+  FunctionState* toplevel;
+
+  std::map<AST::Function*, int32_t> function_index;
+};
+
+}  // namespace VM
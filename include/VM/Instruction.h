@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace VM {
+
+//
+// 命令の一覧
+//
+//  a, b, c はフレーム相対のレジスタ番号
+//  (ジャンプ命令では c がジャンプ先)
+#define VM_OPCODE_LIST(_)                                    \
+  _(Nop)        /*                                  */       \
+  _(Todo)       /* not implemented                  */       \
+  _(Halt)       /* end of program                   */       \
+                                                             \
+  _(Move)       /* a = b                            */       \
+  _(Clone)      /* a = b->clone()                   */       \
+  _(LoadK)      /* a = constants[b]                 */       \
+  _(LoadBool)   /* a = (bool)b                      */       \
+  _(LoadNone)   /* a = none                         */       \
+  _(GetGlobal)  /* a = globals[b]                   */       \
+  _(SetGlobal)  /* globals[a] = b                   */       \
+                                                             \
+  _(AddI) _(SubI) _(MulI) _(DivI) _(ModI)                    \
+  _(ShlI) _(ShrI) _(BAndI) _(BXorI) _(BOrI)                  \
+  _(AddU) _(SubU) _(MulU) _(DivU) _(ModU)                    \
+  _(AddF) _(SubF) _(MulF) _(DivF)                            \
+  _(Append)     /* b += c; a = b (string)           */       \
+  _(NegI) _(NegF)                                            \
+                                                             \
+  _(IntToFloat) _(FloatToInt) _(IntToBool)                   \
+  _(BoolToInt) _(FloatToBool) _(BoolToFloat)                 \
+  _(IntToChar) _(IntToUSize) _(USizeToInt)                   \
+  _(USizeToFloat)                                            \
+                                                             \
+  /* compare: kind = AST::CmpKind                       */   \
+  _(CmpI) _(CmpU) _(CmpF) _(CmpB) _(CmpC) _(CmpO)            \
+                                                             \
+  _(Jmp)        /* goto c                           */       \
+  _(JmpIf)      /* if a: goto c                     */       \
+  _(JmpIfNot)   /* if !a: goto c                    */       \
+  _(JmpCmpI)    /* if !(a <kind> b): goto c         */       \
+                                                             \
+  _(Call)       /* a = functions[b](c, c+1, ...)    */       \
+  _(CallBuiltin) /* a = builtins[b](c, c+1, ...)    */       \
+  _(Return)     /* return a                         */       \
+  _(ReturnNone) /* return                           */       \
+                                                             \
+  _(NewVector)  /* a = [a, a+1, ...] (b 個, desc c) */       \
+  _(NewDict)    /* a = {a: a+1, ...} (b 個, desc c) */       \
+  _(NewStruct)  /* a = T{a, a+1, ...} (b 個, desc c)*/       \
+  _(NewRange)   /* a = b .. c                       */       \
+  _(Default)    /* a = default(descs[b])            */       \
+  _(RangeStep)  /* a.step = b                       */       \
+  _(UnpackRange) /* a, a+1, a+2 = b.begin, end, step */      \
+                                                             \
+  _(GetIndexV)  /* a = b[c] (vector)                */       \
+  _(GetIndexD)  /* a = b[c] (dict)                  */       \
+  _(RefIndexV)  /* a = &b[c] (vector, unshare)      */       \
+  _(RefIndexD)  /* a = &b[c] (dict, insert)         */       \
+  _(SetIndexV)  /* a[b] = c (vector)                */       \
+  _(SetIndexD)  /* a[b] = c (dict)                  */       \
+  _(GetMember)  /* a = b.members[c]                 */       \
+  _(RefMember)  /* a = &b.members[c] (unshare)      */       \
+  _(SetMember)  /* a.members[b] = c                 */       \
+                                                             \
+  _(ForPrep)    /* if !(a < a+1): goto c            */       \
+  _(ForLoop)    /* if ++a < a+1: goto c             */       \
+  _(ForPrepS)   /* if !(a <> a+1): goto c (by a+2)  */       \
+  _(ForLoopS)   /* if (a += a+2) <> a+1: goto c     */       \
+                                                             \
+  /* for-in: a+1 = index, a+2 = version, a+3 = a[a+1]    */ \
+  _(IterPrep)   /* if a is empty: goto c            */       \
+  _(IterLoop)   /* if ++(a+1) < len(a): goto c      */
+
+enum OpCode : uint8_t {
+#define _VM_OPCODE_ENUM(name) OP_##name,
+  VM_OPCODE_LIST(_VM_OPCODE_ENUM)
+#undef _VM_OPCODE_ENUM
+      OP_Max
+};
+
+struct Instruction {
+  //
+  // direct-threaded dispatch:
+  //  Machine がロード時にハンドラのアドレスを埋める
+  void const* handler;
+
+  OpCode op;
+
+  //
+  // 命令ごとの補助情報
+  //  型 (TypeKind), 比較の種類 (AST::CmpKind) など
+  uint8_t kind;
+
+  int32_t a;
+  int32_t b;
+  int32_t c;
+
+  Instruction(OpCode op, int32_t a = 0, int32_t b = 0,
+              int32_t c = 0, uint8_t kind = 0)
+      : handler(nullptr),
+        op(op),
+        kind(kind),
+        a(a),
+        b(b),
+        c(c)
+  {
+  }
+
+  std::string to_string() const;
+
+  static char const* get_name(OpCode op);
+};
+
+}  // namespace VM
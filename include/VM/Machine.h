@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "GC.h"
+#include "VM/Program.h"
+
+namespace VM {
+
+// ---------------------------------------------
+//  Machine
+//   レジスタマシン (direct-threaded dispatch)
+//
+//   レジスタには型のタグがないので、オブジェクトを入れた
+//   レジスタごとに owners で参照を一つ持つ
+//   (上書きしたとき、フレームを抜けたときに手放す)
+//   参照されなくなった一時オブジェクトは、ループの
+//   後方ジャンプと関数呼び出し (セーフポイント) で回収する
+// ---------------------------------------------
+class Machine {
+  struct Frame {
+    Function const* func;
+
+    Instruction const* return_pc;
+
+    size_t base;
+
+    int32_t dest;  // caller-relative register of result
+  };
+
+public:
+  explicit Machine(Program& program);
+  ~Machine();
+
+  void run();
+
+private:
+  //
+  // Instruction::handler を埋める
+  void link(void* const* labels);
+
+  //
+  // スタックの拡張
+  Register* ensure_registers(size_t base, size_t count);
+
+  //
+  // index 番目のレジスタに入れたオブジェクトの参照を持つ
+  //  前に持っていたものは手放す
+  void hold(size_t index, Object* obj)
+  {
+    if (this->owners[index] != obj)
+      this->change_owner(index, obj);
+  }
+
+  void change_owner(size_t index, Object* obj);
+
+  //
+  // [begin, end) のレジスタの参照を手放す
+  void release(size_t begin, size_t end);
+
+  //
+  // セーフポイント
+  //  ループの後方ジャンプと関数呼び出しで通る
+  //  オブジェクトを作ると必ず ZCT に入るので、
+  //  ZCT が変わっていなければ何もしない
+  void safepoint()
+  {
+    if (GarbageCollector::get_mark() != this->gc_mark)
+      this->collect_garbage();
+  }
+
+  //
+  // ZCT の回収と mark-sweep
+  void collect_garbage();
+
+  [[noreturn]] void runtime_error(Function const* func,
+                                  Instruction const* pc,
+                                  std::string const& msg);
+
+  Program& program;
+
+  std::vector<Register> registers;
+  std::vector<Frame> frames;
+
+  // registers と同じ長さ
+  //  オブジェクトを入れていなければ nullptr
+  //  (整数などで上書きされたものは、次に手放すまで持っておく)
+  std::vector<Object*> owners;
+
+  // 前回のセーフポイントの後の ZCT の位置
+  size_t gc_mark;
+};
+
+}  // namespace VM
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ASTfwd.h"
+#include "TypeInfo.h"
+#include "VM/Instruction.h"
+
+struct Object;
+struct Token;
+struct BuiltinFunc;
+
+namespace VM {
+
+//
+// レジスタ
+//  型はコンパイル時に Sema の結果から決まっているので、
+//  タグは持たない
+union Register {
+  int64_t v_int;
+  size_t v_usize;
+  float v_float;
+  bool v_bool;
+  wchar_t v_char;
+  Object* v_obj;
+};
+
+//
+// エラー表示用の位置情報
+struct SourceLocation {
+  AST::Base const* ast;
+  Token const* token;
+
+  SourceLocation(AST::Base const* ast = nullptr,
+                 Token const* token = nullptr)
+      : ast(ast),
+        token(token)
+  {
+  }
+};
+
+//
+// 組み込み関数の呼び出し箇所
+//  引数の型を覚えておき、呼び出し時にボックス化する
+struct BuiltinCallSite {
+  BuiltinFunc const* func;
+
+  std::vector<TypeKind> arg_kinds;
+  TypeKind result_kind;
+};
+
+struct Function {
+  std::string name;
+
+  AST::Function const* ast;  // nullptr: top-level
+
+  size_t num_args;
+  size_t num_regs;
+
+  std::vector<Instruction> code;
+  std::vector<SourceLocation> locations;  // code と同じ長さ
+
+  Function(std::string const& name, AST::Function const* ast)
+      : name(name),
+        ast(ast),
+        num_args(0),
+        num_regs(0)
+  {
+  }
+
+  std::string dump() const;
+};
+
+struct Program {
+  //
+  // [0] は top-level のコード
+  std::vector<Function> functions;
+
+  std::vector<Register> constants;
+  std::vector<Object*> constant_objects;
+
+  //
+  // 型の記述子
+  //  NewVector, NewDict, NewStruct, Default で使う
+  //  (TypeInfo::intern で作ったもの)
+  std::vector<TypeInfo const*> descs;
+
+  std::vector<BuiltinCallSite> builtin_calls;
+
+  bool is_linked;
+
+  Program()
+      : is_linked(false)
+  {
+  }
+
+  Program(Program&&) = default;
+  Program(Program const&) = delete;
+
+  ~Program();
+
+  std::string dump() const;
+};
+
+}  // namespace VM
@@ -0,0 +1,121 @@
+// ---------------------------------------------
+//  Value
+// ---------------------------------------------
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "TypeInfo.h"
+
+struct Object;
+
+//
+// 値
+//  int, usize, float, bool, char, none はそのまま持ち、
+//  それ以外 (string, range, vector, dict, struct) は
+//  ヒープ上のオブジェクトを指す
+struct Value {
+  TypeKind kind;
+
+  union {
+    int64_t v_int;
+    size_t v_usize;
+    float v_float;
+    bool v_bool;
+    wchar_t v_char;
+    Object* v_obj;
+  };
+
+  Value()
+      : kind(TYPE_None),
+        v_int(0)
+  {
+  }
+
+  Value(Object* obj);
+
+  static Value from_int(int64_t v)
+  {
+    Value ret{TYPE_Int};
+    ret.v_int = v;
+    return ret;
+  }
+
+  static Value from_usize(size_t v)
+  {
+    Value ret{TYPE_USize};
+    ret.v_usize = v;
+    return ret;
+  }
+
+  static Value from_float(float v)
+  {
+    Value ret{TYPE_Float};
+    ret.v_float = v;
+    return ret;
+  }
+
+  static Value from_bool(bool v)
+  {
+    Value ret{TYPE_Bool};
+    ret.v_bool = v;
+    return ret;
+  }
+
+  static Value from_char(wchar_t v)
+  {
+    Value ret{TYPE_Char};
+    ret.v_char = v;
+    return ret;
+  }
+
+  bool is_heap() const
+  {
+    return Value::is_heap_kind(this->kind);
+  }
+
+  //
+  // 型情報
+  //  ヒープの場合はオブジェクトが持っているもの
+  TypeInfo get_type() const;
+
+  std::string to_string() const;
+
+  bool equals(Value const& other) const;
+
+  //
+  // 辞書のキーに使う
+  size_t hash() const;
+
+  //
+  // ヒープの場合は複製する
+  Value clone() const;
+
+  //
+  // 参照カウント (ヒープのみ)
+  void inc_ref() const;
+  void dec_ref() const;
+
+  static bool is_heap_kind(TypeKind kind)
+  {
+    switch (kind) {
+      case TYPE_String:
+      case TYPE_Range:
+      case TYPE_Vector:
+      case TYPE_Dict:
+      case TYPE_UserDef:
+        return true;
+    }
+
+    return false;
+  }
+
+private:
+  explicit Value(TypeKind kind)
+      : kind(kind),
+        v_int(0)
+  {
+  }
+};
+
+static_assert(sizeof(Value) == 16);
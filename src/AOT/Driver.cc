@@ -0,0 +1,94 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+#include "Utils.h"
+
+#include "AOT/Emitter.h"
+#include "AOT/Driver.h"
+
+// Makefile で定義する
+#ifndef METRO_INCLUDE_DIR
+#define METRO_INCLUDE_DIR "include"
+#endif
+
+#ifndef METRO_RUNTIME_LIB
+#define METRO_RUNTIME_LIB "build/libmetro-rt.a"
+#endif
+
+namespace AOT {
+
+//
+// シェルに渡す引数
+static std::string shell_quote(std::string const& str)
+{
+  std::string ret = "'";
+
+  for (auto c : str) {
+    if (c == '\'')
+      ret += "'\\''";
+    else
+      ret += c;
+  }
+
+  return ret + "'";
+}
+
+bool write_source(AST::Scope* root, std::string const& path)
+{
+  auto source = Emitter(root).emit();
+
+  std::ofstream ofs{path};
+
+  if (!(ofs << source)) {
+    std::cerr << "fatal: cannot write '" << path << "'"
+              << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+bool build_executable(AST::Scope* root,
+                      std::string const& path)
+{
+  namespace fs = std::filesystem;
+
+  auto source =
+      fs::temp_directory_path() /
+      Utils::format("metro-aot-%d.cc", (int)getpid());
+
+  if (!write_source(root, source.string()))
+    return false;
+
+  std::string cxx = "c++";
+
+  if (auto env = std::getenv("METRO_CXX"); env && *env)
+    cxx = env;
+
+  // 整数の桁あふれと float の計算は Evaluator と同じにする
+  auto command =
+      cxx + " -std=gnu++20 -O2 -fwrapv -ffp-contract=off" +
+      " -I" + shell_quote(METRO_INCLUDE_DIR) + " " +
+      shell_quote(source.string()) + " " +
+      shell_quote(METRO_RUNTIME_LIB) + " -o " +
+      shell_quote(path);
+
+  auto status = std::system(command.c_str());
+
+  fs::remove(source);
+
+  if (status != 0) {
+    std::cerr << "fatal: failed to compile '" << path << "'"
+              << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace AOT
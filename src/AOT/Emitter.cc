@@ -0,0 +1,1888 @@
+#include <limits>
+#include <stdexcept>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Error.h"
+#include "Sema.h"
+#include "BuiltinFunc.h"
+#include "AOT/Emitter.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+namespace AOT {
+
+static char const* kind_names[] = {
+    "TYPE_None",   "TYPE_Int",  "TYPE_USize",
+    "TYPE_Float",  "TYPE_Bool", "TYPE_Char",
+    "TYPE_String", "TYPE_Range", "TYPE_Vector",
+    "TYPE_Dict",   "TYPE_Args", "TYPE_UserDef",
+    "TYPE_Template",
+};
+
+static char const* expr_ops[] = {
+    "+", "-", "*", "/", "%", "<<", ">>", "&", "^", "|",
+};
+
+// int の演算 (Arith の関数、nullptr はそのまま C++ の演算子)
+static char const* int_ops[] = {
+    "add", "sub", "mul",   "div",   "mod",
+    "shl", "shr", nullptr, nullptr, nullptr,
+};
+
+static char const* compare_ops[] = {
+    ">", "<", ">=", "<=", "==", "!=",
+};
+
+static bool is_numeric(TypeKind kind)
+{
+  return kind == TYPE_Int || kind == TYPE_USize ||
+         kind == TYPE_Float;
+}
+
+//
+// 詰めて持っているベクタの要素の型 (bool 以外)
+static bool is_packed_kind(TypeKind kind)
+{
+  return is_numeric(kind) || kind == TYPE_Char;
+}
+
+//
+// 0 ではない数値のリテラル (割っても 0 除算にならない)
+static bool is_nonzero_literal(AST::Base* ast)
+{
+  if (ast->kind != AST_Value)
+    return false;
+
+  switch (ast->token.kind) {
+    case TOK_Int:
+    case TOK_USize:
+    case TOK_Float:
+      try {
+        return std::stod(std::string(ast->token.str)) != 0;
+      }
+      catch (std::exception const&) {
+      }
+  }
+
+  return false;
+}
+
+//
+// Operators の result_kind と同じ
+static TypeKind result_kind(AST::ExprKind kind, TypeKind L,
+                            TypeKind R)
+{
+  if (kind == AST::EX_Sub && L != R && L != TYPE_Float)
+    return R;
+
+  return L;
+}
+
+//
+// C++ の文字列リテラル
+//  8 進数のエスケープは 3 桁で終わるので、
+//  後ろの文字とつながらない
+static bool is_plain_char(int c)
+{
+  return c >= 0x20 && c < 0x7f && c != '"' && c != '\\' &&
+         c != '?';
+}
+
+static std::string quote(std::string const& str)
+{
+  std::string ret = "\"";
+
+  for (unsigned char c : str) {
+    if (is_plain_char(c))
+      ret += (char)c;
+    else
+      ret += Utils::format("\\%03o", c);
+  }
+
+  return ret + "\"";
+}
+
+static std::string quote(std::wstring const& str)
+{
+  std::string ret = "L\"";
+
+  for (wchar_t c : str) {
+    auto code = (uint32_t)c;
+
+    if (is_plain_char(c))
+      ret += (char)c;
+    else if (code < 0x80)
+      ret += Utils::format("\\%03o", code);
+    else if (code <= 0x10ffff &&
+             (code < 0xd800 || code > 0xdfff))
+      ret += Utils::format("\\U%08X", code);
+    else
+      ret += Utils::format("\\x%X\" L\"", code);
+  }
+
+  return ret + "\"";
+}
+
+static std::string join(
+    std::vector<std::string> const& list)
+{
+  std::string ret;
+
+  for (auto&& s : list) {
+    if (!ret.empty())
+      ret += ", ";
+
+    ret += s;
+  }
+
+  return ret;
+}
+
+Emitter::Emitter(AST::Scope* root)
+    : root(root)
+{
+}
+
+std::string Emitter::emit()
+{
+  this->global_names = AST::global_names(this->root);
+
+  std::vector<std::string> prototypes;
+
+  for (auto&& item : this->root->list) {
+    switch (item->kind) {
+      case AST_Struct: {
+        auto ast = (AST::Struct*)item;
+        auto name = std::string(ast->name);
+
+        std::vector<std::string> members;
+
+        for (auto&& m : ast->members)
+          members.emplace_back(quote(std::string(m.name)));
+
+        this->structs.emplace_back(
+            "static AST::Struct* s_" + name + ";");
+
+        this->init.emplace_back(
+            "s_" + name + " = AOT::make_struct(" +
+            quote(name) + ", {" + join(members) + "});");
+
+        break;
+      }
+
+      case AST_Function:
+        prototypes.emplace_back(
+            this->signature((AST::Function*)item) + ";");
+
+        break;
+    }
+  }
+
+  this->depth = 1;
+  this->scope(this->root, {}, "");
+
+  auto main_code = std::move(this->code);
+
+  std::string out =
+      "//\n"
+      "// generated by metro -emit-cpp\n"
+      "//\n"
+      "\n"
+      "#include <vector>\n"
+      "\n"
+      "#include \"AOT/Runtime.h\"\n";
+
+  for (auto&& list :
+       {&this->structs, &this->globals, &prototypes}) {
+    if (list->empty())
+      continue;
+
+    out += "\n";
+
+    for (auto&& s : *list)
+      out += s + "\n";
+  }
+
+  for (auto&& func : this->functions)
+    out += "\n" + func;
+
+  out += "\nstatic void init()\n{\n";
+
+  for (auto&& s : this->init)
+    out += "  " + s + "\n";
+
+  out += "}\n\nint main()\n{\n  init();\n\n" + main_code +
+         "\n  return 0;\n}\n";
+
+  return out;
+}
+
+// --------------------------------------------------------
+//  型
+// --------------------------------------------------------
+
+TypeInfo Emitter::type_of(AST::Base* ast)
+{
+  switch (ast->kind) {
+    case AST_TypeConstructor:
+      return ((AST::TypeConstructor*)ast)->typeinfo;
+
+    // else があると、Sema は型を残さずに返る
+    case AST_If:
+      if (auto x = (AST::If*)ast; x->if_false)
+        return type_of(x->if_true);
+
+      break;
+  }
+
+  auto it = Sema::value_type_cache.find(ast);
+
+  if (it == Sema::value_type_cache.end())
+    return TYPE_None;
+
+  return it->second;
+}
+
+std::string Emitter::cpp_type(TypeKind kind)
+{
+  switch (kind) {
+    case TYPE_Int:
+      return "int64_t";
+
+    case TYPE_USize:
+      return "size_t";
+
+    case TYPE_Float:
+      return "float";
+
+    case TYPE_Bool:
+      return "bool";
+
+    case TYPE_Char:
+      return "wchar_t";
+  }
+
+  return "Value";
+}
+
+bool Emitter::is_scalar(TypeKind kind)
+{
+  return kind >= TYPE_Int && kind <= TYPE_Char;
+}
+
+bool Emitter::has_effects(AST::Base* _ast)
+{
+  switch (_ast->kind) {
+    case AST_None:
+    case AST_True:
+    case AST_False:
+    case AST_Value:
+    case AST_Variable:
+      return false;
+
+    case AST_UnaryMinus:
+    case AST_UnaryPlus:
+      return has_effects(((AST::UnaryOp*)_ast)->expr);
+
+    case AST_Cast:
+      return has_effects(((AST::Cast*)_ast)->expr);
+
+    case AST_MemberAccess:
+      return has_effects(((AST::IndexRef*)_ast)->expr);
+
+    case AST_Expr: {
+      astdef(Expr);
+
+      if (has_effects(ast->first))
+        return true;
+
+      for (auto&& elem : ast->elements) {
+        if (has_effects(elem.ast))
+          return true;
+
+        // 0 で割るとエラーになる
+        if ((elem.kind == AST::EX_Div ||
+             elem.kind == AST::EX_Mod) &&
+            !is_nonzero_literal(elem.ast))
+          return true;
+      }
+
+      return false;
+    }
+
+    case AST_Compare: {
+      astdef(Compare);
+
+      if (has_effects(ast->first))
+        return true;
+
+      for (auto&& elem : ast->elements) {
+        if (has_effects(elem.ast))
+          return true;
+      }
+
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool Emitter::is_constant(AST::Base* ast)
+{
+  switch (ast->kind) {
+    case AST_None:
+    case AST_True:
+    case AST_False:
+    case AST_Value:
+      return true;
+
+    case AST_UnaryMinus:
+    case AST_UnaryPlus:
+      return is_constant(((AST::UnaryOp*)ast)->expr);
+  }
+
+  return false;
+}
+
+std::string Emitter::box(std::string const& code,
+                         TypeKind kind)
+{
+  if (!is_scalar(kind))
+    return code;
+
+  return "AOT::box<" + cpp_type(kind) + ">(" + code + ")";
+}
+
+std::string Emitter::unbox(std::string const& code,
+                           TypeKind kind)
+{
+  if (!is_scalar(kind))
+    return code;
+
+  return "AOT::scalar<" + cpp_type(kind) + ">(" + code +
+         ")";
+}
+
+std::string Emitter::convert(std::string const& code,
+                             TypeKind from, TypeKind to)
+{
+  if (from == to)
+    return code;
+
+  return "static_cast<" + cpp_type(to) + ">(" + code + ")";
+}
+
+void Emitter::unsupported(AST::Base* ast)
+{
+  Error(ast, "cannot compile this to C++").emit().exit();
+}
+
+bool Emitter::needs_guard(AST::Base* ast)
+{
+  bool ret = false;
+
+  AST::walk(ast, [&ret](AST::Base* x) {
+    if (x->kind == AST_CallFunc &&
+        ((AST::CallFunc*)x)->is_builtin)
+      ret = true;
+    else if (auto kind = type_of(x).kind;
+             kind != TYPE_None && !is_scalar(kind))
+      ret = true;
+  });
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  出力
+// --------------------------------------------------------
+
+void Emitter::line(std::string const& str)
+{
+  this->code += this->indent() + str + "\n";
+}
+
+std::string Emitter::indent() const
+{
+  return std::string(this->depth * 2, ' ');
+}
+
+std::string Emitter::temp()
+{
+  return "_t" + std::to_string(this->temp_count++);
+}
+
+std::string Emitter::block(
+    std::function<std::string()> const& fn)
+{
+  auto saved = std::move(this->code);
+
+  this->code.clear();
+  this->depth++;
+
+  auto result = fn();
+
+  this->depth--;
+
+  auto body = std::move(this->code);
+
+  this->code = std::move(saved);
+
+  if (body.empty())
+    return result;
+
+  return "({\n" + body + this->indent() + "  " + result +
+         ";\n" + this->indent() + "})";
+}
+
+std::vector<std::string> Emitter::sequence(
+    std::vector<AST::Base*> const& asts)
+{
+  std::vector<std::string> ret;
+
+  for (size_t i = 0; i < asts.size(); i++) {
+    auto ast = asts[i];
+    auto code = this->expr(ast);
+
+    bool later_effects = false;
+    bool later_reads = false;
+
+    for (size_t j = i + 1; j < asts.size(); j++) {
+      later_effects |= has_effects(asts[j]);
+      later_reads |= !is_constant(asts[j]);
+    }
+
+    // 後ろの式より先に評価しておく
+    if (!is_constant(ast) &&
+        (later_effects ||
+         (has_effects(ast) && later_reads))) {
+      auto tmp = this->temp();
+
+      this->line(cpp_type(type_of(ast).kind) + " " + tmp +
+                 " = " + code + ";");
+
+      code = tmp;
+    }
+
+    ret.emplace_back(code);
+  }
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  表
+// --------------------------------------------------------
+
+std::string Emitter::site(AST::Base* ast)
+{
+  // 終わりの位置がなければ、最初の字句だけ表示する
+  if (ast->end_token == std::list<Token>::const_iterator())
+    return this->site(ast->token);
+
+  auto text = Error(ast, "").get_location();
+
+  auto [it, inserted] = this->sites.try_emplace(
+      text, "e_" + std::to_string(this->sites.size()));
+
+  if (inserted) {
+    this->globals.emplace_back("static char const " +
+                               it->second +
+                               "[] = " + quote(text) + ";");
+  }
+
+  return it->second;
+}
+
+std::string Emitter::site(Token const& token)
+{
+  auto text = Error(token, "").get_location();
+
+  auto [it, inserted] = this->sites.try_emplace(
+      text, "e_" + std::to_string(this->sites.size()));
+
+  if (inserted) {
+    this->globals.emplace_back("static char const " +
+                               it->second +
+                               "[] = " + quote(text) + ";");
+  }
+
+  return it->second;
+}
+
+std::string Emitter::type_ptr(TypeInfo const& type)
+{
+  auto expr = this->type_expr(type);
+
+  auto [it, inserted] = this->types.try_emplace(
+      expr, "t_" + std::to_string(this->types.size()));
+
+  if (inserted) {
+    this->globals.emplace_back("static TypeInfo const* " +
+                               it->second + ";");
+
+    this->init.emplace_back(it->second +
+                            " = TypeInfo::intern(" + expr +
+                            ");");
+  }
+
+  return it->second;
+}
+
+std::string Emitter::type_expr(TypeInfo const& type)
+{
+  if (type.kind == TYPE_UserDef) {
+    std::vector<std::string> members;
+
+    for (auto&& [name, member] : type.members) {
+      members.emplace_back("{" + quote(std::string(name)) +
+                           ", " + this->type_expr(member) +
+                           "}");
+    }
+
+    return "AOT::make_type(s_" +
+           std::string(type.userdef_struct->name) + ", {" +
+           join(members) + "})";
+  }
+
+  std::string ret = "TypeInfo(";
+
+  ret += kind_names[type.kind];
+
+  if (!type.type_params.empty()) {
+    std::vector<std::string> params;
+
+    for (auto&& param : type.type_params)
+      params.emplace_back(this->type_expr(param));
+
+    ret += ", {" + join(params) + "}";
+  }
+
+  return ret + ")";
+}
+
+std::string Emitter::string_literal(AST::Value* ast)
+{
+  auto [it, inserted] = this->strings.try_emplace(
+      ast, "k_" + std::to_string(this->strings.size()));
+
+  if (inserted) {
+    auto ws =
+        Utils::String::to_wstr(std::string(ast->token.str));
+
+    // remove double quotation
+    ws.erase(ws.begin());
+    ws.pop_back();
+
+    this->globals.emplace_back("static Value " +
+                               it->second + ";");
+
+    this->init.emplace_back(it->second +
+                            " = AOT::make_string(" +
+                            quote(ws) + ");");
+  }
+
+  return it->second;
+}
+
+// --------------------------------------------------------
+//  変数
+// --------------------------------------------------------
+
+Emitter::Variable const& Emitter::find_var(
+    AST::Variable* ast)
+{
+  for (auto s = this->scopes.rbegin();
+       s != this->scopes.rend(); s++) {
+    for (auto v = s->rbegin(); v != s->rend(); v++) {
+      if (v->name == ast->token.str)
+        return *v;
+    }
+  }
+
+  panic("undefined variable");
+}
+
+std::string Emitter::declare(std::string_view name,
+                             TypeInfo const& type,
+                             bool is_global)
+{
+  auto count = ++this->name_count[name];
+
+  auto code = std::string(is_global ? "g_" : "v_") +
+              std::string(name);
+
+  // 同じ名前の変数は番号をつけて区別する
+  if (count > 1)
+    code += "_" + std::to_string(count);
+
+  if (is_global) {
+    this->globals.emplace_back("static " +
+                               cpp_type(type.kind) + " " +
+                               code + "{};");
+  }
+
+  this->scopes.back().push_back({name, code, type});
+
+  return code;
+}
+
+// --------------------------------------------------------
+//  式
+// --------------------------------------------------------
+
+std::string Emitter::expr(AST::Base* _ast)
+{
+  switch (_ast->kind) {
+    case AST_None:
+      return "Value()";
+
+    case AST_True:
+      return "true";
+
+    case AST_False:
+      return "false";
+
+    case AST_Value:
+      return this->literal((AST::Value*)_ast);
+
+    case AST_Variable: {
+      auto const& var =
+          this->find_var((AST::Variable*)_ast);
+
+      if (is_scalar(var.type.kind))
+        return var.code;
+
+      return var.code + ".clone()";
+    }
+
+    case AST_UnaryPlus:
+      return this->expr(((AST::UnaryOp*)_ast)->expr);
+
+    case AST_UnaryMinus: {
+      astdef(UnaryOp);
+
+      auto kind = type_of(ast->expr).kind;
+
+      if (kind != TYPE_Int && kind != TYPE_Float)
+        unsupported(ast);
+
+      if (kind == TYPE_Int)
+        return "Arith::neg(" + this->expr(ast->expr) + ")";
+
+      return "(-(" + this->expr(ast->expr) + "))";
+    }
+
+    case AST_Cast: {
+      astdef(Cast);
+
+      return convert(this->expr(ast->expr),
+                     type_of(ast->expr).kind,
+                     type_of(ast->cast_to).kind);
+    }
+
+    case AST_Vector: {
+      astdef(Vector);
+
+      auto type = this->type_ptr(type_of(ast));
+
+      return this->block([&] {
+        auto vec = this->temp();
+        bool protect = false;
+
+        for (auto&& e : ast->elements)
+          protect |= has_effects(e);
+
+        this->line("Value " + vec + " = AOT::new_vector(" +
+                   type + ");");
+
+        // 要素を評価している間に削除されないようにする
+        if (protect)
+          this->line(vec + ".v_obj->no_delete = true;");
+
+        for (auto&& e : ast->elements) {
+          this->line("AOT::append(" + vec + ", " +
+                     box(this->expr(e), type_of(e).kind) +
+                     ");");
+        }
+
+        if (protect)
+          this->line(vec + ".v_obj->no_delete = false;");
+
+        return vec;
+      });
+    }
+
+    case AST_Dict: {
+      astdef(Dict);
+
+      auto type = this->type_ptr(type_of(ast));
+
+      return this->block([&] {
+        auto dict = this->temp();
+        bool protect = false;
+
+        for (auto&& elem : ast->elements)
+          protect |= has_effects(elem.key) ||
+                     has_effects(elem.value);
+
+        this->line("Value " + dict + " = AOT::new_dict(" +
+                   type + ");");
+
+        if (protect)
+          this->line(dict + ".v_obj->no_delete = true;");
+
+        for (auto&& elem : ast->elements) {
+          auto key = this->temp();
+
+          this->line("Value " + key + " = " +
+                     box(this->expr(elem.key),
+                         type_of(elem.key).kind) +
+                     ";");
+
+          this->line("AOT::append(" + dict + ", " + key +
+                     ", " +
+                     box(this->expr(elem.value),
+                         type_of(elem.value).kind) +
+                     ");");
+        }
+
+        if (protect)
+          this->line(dict + ".v_obj->no_delete = false;");
+
+        return dict;
+      });
+    }
+
+    case AST_TypeConstructor: {
+      astdef(TypeConstructor);
+
+      auto type = this->type_ptr(ast->typeinfo);
+
+      return this->block([&] {
+        auto obj = this->temp();
+
+        this->line("Value " + obj +
+                   " = AOT::default_value(*" + type +
+                   ", false);");
+
+        this->line(obj + ".v_obj->no_delete = true;");
+
+        // 書いた順に追加する (Evaluator と同じ)
+        for (auto&& elem : ast->elements) {
+          this->line("AOT::add_member(" + obj + ", " +
+                     box(this->expr(elem.value),
+                         type_of(elem.value).kind) +
+                     ");");
+        }
+
+        this->line(obj + ".v_obj->no_delete = false;");
+
+        return obj;
+      });
+    }
+
+    case AST_Range: {
+      astdef(Range);
+
+      return this->block([&] {
+        auto begin = this->temp();
+        auto end = this->temp();
+
+        this->line("int64_t " + begin + " = " +
+                   this->expr(ast->begin) + ";");
+
+        this->line("int64_t " + end + " = " +
+                   this->expr(ast->end) + ";");
+
+        std::string step = "1";
+
+        if (ast->step) {
+          step = "AOT::range_step(" +
+                 this->expr(ast->step) + ", " +
+                 this->site(ast->step) + ")";
+        }
+
+        return "Value(new ObjRange(" + begin + ", " + end +
+               ", " + step + "))";
+      });
+    }
+
+    case AST_CallFunc:
+      return this->call((AST::CallFunc*)_ast);
+
+    case AST_IndexRef:
+      return this->index((AST::IndexRef*)_ast);
+
+    case AST_MemberAccess:
+      return this->member((AST::IndexRef*)_ast);
+
+    case AST_Expr:
+      return this->arith((AST::Expr*)_ast);
+
+    case AST_Compare:
+      return this->compare((AST::Compare*)_ast);
+
+    case AST_Assign:
+      return this->assign((AST::Assign*)_ast);
+
+    case AST_If:
+    case AST_Scope:
+      return this->value_of(_ast);
+
+    case AST_Switch:
+    case AST_For:
+    case AST_While:
+    case AST_DoWhile:
+    case AST_Loop:
+      return this->block([&] {
+        this->stmt(_ast);
+        return "Value()";
+      });
+  }
+
+  unsupported(_ast);
+}
+
+std::string Emitter::borrow(AST::Base* ast)
+{
+  if (ast->kind == AST_Variable)
+    return this->find_var((AST::Variable*)ast).code;
+
+  return this->expr(ast);
+}
+
+std::string Emitter::lvalue(AST::Base* _ast)
+{
+  switch (_ast->kind) {
+    case AST_Variable:
+      return "&" +
+             this->find_var((AST::Variable*)_ast).code;
+
+    case AST_MemberAccess: {
+      astdef(IndexRef);
+
+      auto code = "*" + this->lvalue(ast->expr);
+
+      for (auto&& m : ast->indexes) {
+        auto index = ((AST::Variable*)m)->index;
+
+        code = "AOT::member_mut(" + code + ", " +
+               std::to_string(index) + ")";
+      }
+
+      return "&" + code;
+    }
+
+    case AST_IndexRef: {
+      astdef(IndexRef);
+
+      return this->block([&] {
+        auto ptr = this->temp();
+
+        this->line("Value* " + ptr + " = " +
+                   this->lvalue(ast->expr) + ";");
+
+        for (auto&& index : ast->indexes) {
+          auto check = ast->needs_bounds_check(index);
+
+          this->line(
+              ptr + " = &AOT::step(*" + ptr + ", " +
+              box(this->expr(index), type_of(index).kind) +
+              ", " + (check ? "true, " + this->site(index)
+                            : "false, nullptr") +
+              ");");
+        }
+
+        return ptr;
+      });
+    }
+  }
+
+  unsupported(_ast);
+}
+
+std::string Emitter::literal(AST::Value* ast)
+{
+  auto str = std::string(ast->token.str);
+
+  try {
+    switch (type_of(ast).kind) {
+      case TYPE_Int: {
+        auto value = std::stoll(str);
+
+        // 最小値は C++ のリテラルで書けない
+        if (value == std::numeric_limits<int64_t>::min())
+          return "(int64_t(-9223372036854775807) - 1)";
+
+        return "int64_t(" + std::to_string(value) + ")";
+      }
+
+      case TYPE_USize:
+        return "size_t(" +
+               std::to_string(std::stoull(str)) + "u)";
+
+      case TYPE_Float:
+        return Utils::format("%af", std::stof(str));
+
+      case TYPE_String:
+        return this->string_literal(ast);
+    }
+  }
+  catch (std::exception const&) {
+  }
+
+  unsupported(ast);
+}
+
+std::string Emitter::call(AST::CallFunc* ast)
+{
+  if (ast->is_builtin)
+    return this->call_builtin(ast);
+
+  return this->block([&] {
+    auto args = this->sequence(
+        std::vector<AST::Base*>(ast->args.begin(),
+                                ast->args.end()));
+
+    return "f_" + std::string(ast->name) + "(" +
+           join(args) + ")";
+  });
+}
+
+std::string Emitter::call_builtin(AST::CallFunc* ast)
+{
+  auto func = ast->builtin_func;
+  auto passing = func->arg_passing;
+
+  auto index =
+      func - BuiltinFunc::get_builtin_list().data();
+
+  auto result = this->block([&] {
+    auto args = this->temp();
+
+    this->line("std::vector<Value> " + args + ";");
+    this->line(args + ".reserve(" +
+               std::to_string(ast->args.size()) + ");");
+
+    for (auto&& arg : ast->args) {
+      std::string code;
+
+      // 複製せずに渡す
+      if (passing == BuiltinFunc::ARG_Ref &&
+          arg == ast->args[0])
+        code = "*" + this->lvalue(arg);
+      else if (passing != BuiltinFunc::ARG_Copy &&
+               arg->kind == AST_Variable)
+        code = box(this->borrow(arg), type_of(arg).kind);
+      else
+        code = box(this->expr(arg), type_of(arg).kind);
+
+      this->line(args + ".emplace_back(" + code +
+                 ").inc_ref();");
+    }
+
+    return "AOT::call_builtin(" + std::to_string(index) +
+           ", " + args + ", " + this->site(ast) + ")";
+  });
+
+  return unbox(result, type_of(ast).kind);
+}
+
+std::string Emitter::index(AST::IndexRef* ast)
+{
+  auto kind = type_of(ast).kind;
+
+  // v[i] (int, float などのベクタの変数)
+  if (ast->expr->kind == AST_Variable &&
+      ast->indexes.size() == 1 && is_packed_kind(kind) &&
+      !has_effects(ast->indexes[0])) {
+    auto const& var =
+        this->find_var((AST::Variable*)ast->expr);
+
+    if (var.type.kind == TYPE_Vector) {
+      auto index = ast->indexes[0];
+      auto check = ast->needs_bounds_check(index);
+
+      return "AOT::get<" + cpp_type(kind) + ">(" +
+             var.code + ", (size_t)(" + this->expr(index) +
+             "), " +
+             (check ? "true, " + this->site(index)
+                    : "false, nullptr") +
+             ")";
+    }
+  }
+
+  return this->block([&] {
+    auto ptr = this->temp();
+
+    if (ast->expr->kind == AST_Variable) {
+      this->line("Value const* " + ptr + " = &" +
+                 this->borrow(ast->expr) + ";");
+    }
+    else {
+      auto base = this->temp();
+
+      this->line("Value " + base + " = " +
+                 this->expr(ast->expr) + ";");
+
+      this->line("Value const* " + ptr + " = &" + base +
+                 ";");
+    }
+
+    for (auto&& index : ast->indexes) {
+      auto tmp = this->temp();
+      auto check = ast->needs_bounds_check(index);
+
+      this->line("Value " + tmp + ";");
+
+      this->line(ptr + " = &AOT::at(*" + ptr + ", " +
+                 box(this->borrow(index),
+                     type_of(index).kind) +
+                 ", " + tmp + ", " +
+                 (check ? "true, " + this->site(index)
+                        : "false, nullptr") +
+                 ");");
+    }
+
+    if (is_scalar(kind))
+      return unbox("*" + ptr, kind);
+
+    return ptr + "->clone()";
+  });
+}
+
+std::string Emitter::member(AST::IndexRef* ast)
+{
+  auto code = this->borrow(ast->expr);
+
+  for (auto&& m : ast->indexes) {
+    code = "AOT::member(" + code + ", " +
+           std::to_string(((AST::Variable*)m)->index) + ")";
+  }
+
+  if (auto kind = type_of(ast).kind; is_scalar(kind))
+    return unbox(code, kind);
+
+  return code + ".clone()";
+}
+
+std::string Emitter::arith(AST::Expr* ast)
+{
+  auto first_kind = type_of(ast->first).kind;
+
+  if (first_kind == TYPE_String)
+    return this->concat(ast);
+
+  //
+  // 副作用がなければ、そのまま C++ の式にする
+  //  (0 で割るかもしれない割り算は一つまで)
+  bool is_pure = !has_effects(ast->first);
+  size_t divs = 0;
+
+  auto L = first_kind;
+
+  for (auto&& elem : ast->elements) {
+    auto R = type_of(elem.ast).kind;
+
+    switch (elem.kind) {
+      case AST::EX_And:
+      case AST::EX_Or:
+        if (L != TYPE_Bool || R != TYPE_Bool)
+          unsupported(ast);
+
+        break;
+
+      case AST::EX_Mod:
+        unsupported(ast);
+
+      case AST::EX_LShift:
+      case AST::EX_RShift:
+      case AST::EX_BitAND:
+      case AST::EX_BitXOR:
+      case AST::EX_BitOR:
+        if (L != TYPE_Int || R != TYPE_Int)
+          unsupported(ast);
+
+        break;
+
+      case AST::EX_Add:
+        if (L != R)
+          unsupported(ast);
+
+        [[fallthrough]];
+
+      default:
+        if (!is_numeric(L) || !is_numeric(R))
+          unsupported(ast);
+    }
+
+    is_pure &= !has_effects(elem.ast);
+
+    if (elem.kind == AST::EX_Div &&
+        !is_nonzero_literal(elem.ast))
+      divs++;
+
+    L = result_kind(elem.kind, L, R);
+  }
+
+  auto apply = [&](AST::Expr::Element const& elem,
+                   std::string const& left, TypeKind L,
+                   std::string const& right, TypeKind R) {
+    auto res = result_kind(elem.kind, L, R);
+
+    auto a = convert(left, L, res);
+    auto b = convert(right, R, res);
+
+    if (elem.kind == AST::EX_Div &&
+        !is_nonzero_literal(elem.ast)) {
+      return "AOT::divide<" + cpp_type(res) + ">(" + a +
+             ", " + b + ", " + this->site(elem.op) + ")";
+    }
+
+    //
+    // int は桁あふれを巻き戻す (C++ の式のままだと未定義)
+    if (res == TYPE_Int && int_ops[elem.kind])
+      return std::string("Arith::") + int_ops[elem.kind] +
+             "(" + a + ", " + b + ")";
+
+    return "(" + a + " " + expr_ops[elem.kind] + " " + b +
+           ")";
+  };
+
+  if (is_pure && divs <= 1) {
+    auto acc = this->expr(ast->first);
+
+    L = first_kind;
+
+    for (auto&& elem : ast->elements) {
+      auto R = type_of(elem.ast).kind;
+      auto right = this->expr(elem.ast);
+
+      if (elem.kind == AST::EX_And)
+        acc = "(" + acc + " && " + right + ")";
+      else if (elem.kind == AST::EX_Or)
+        acc = "(" + acc + " || " + right + ")";
+      else
+        acc = apply(elem, acc, L, right, R);
+
+      L = result_kind(elem.kind, L, R);
+    }
+
+    return acc;
+  }
+
+  //
+  // 左から順に一時変数に入れる
+  return this->block([&] {
+    auto acc = this->temp();
+
+    L = first_kind;
+
+    this->line(cpp_type(L) + " " + acc + " = " +
+               this->expr(ast->first) + ";");
+
+    for (auto&& elem : ast->elements) {
+      auto R = type_of(elem.ast).kind;
+
+      // && と || は、左辺で決まらなかったときだけ右辺を評価する
+      if (elem.kind == AST::EX_And ||
+          elem.kind == AST::EX_Or) {
+        std::string test =
+            elem.kind == AST::EX_And ? acc : "!" + acc;
+
+        this->line("if (" + test + ") {");
+
+        this->depth++;
+        this->line(acc + " = " + this->expr(elem.ast) +
+                   ";");
+        this->depth--;
+
+        this->line("}");
+        continue;
+      }
+
+      auto next = this->temp();
+      auto res = result_kind(elem.kind, L, R);
+
+      auto right = this->expr(elem.ast);
+
+      this->line(cpp_type(res) + " " + next + " = " +
+                 apply(elem, acc, L, right, R) + ";");
+
+      acc = next;
+      L = res;
+    }
+
+    return acc;
+  });
+}
+
+std::string Emitter::concat(AST::Expr* ast)
+{
+  bool protect = false;
+
+  for (auto&& elem : ast->elements) {
+    if (elem.kind != AST::EX_Add)
+      unsupported(ast);
+
+    protect |= has_effects(elem.ast);
+  }
+
+  return this->block([&] {
+    auto str = this->temp();
+
+    this->line("Value " + str + " = " +
+               this->borrow(ast->first) + ".clone();");
+
+    if (protect)
+      this->line(str + ".v_obj->no_delete = true;");
+
+    for (auto&& elem : ast->elements) {
+      this->line("AOT::concat(" + str + ", " +
+                 this->borrow(elem.ast) + ");");
+    }
+
+    if (protect)
+      this->line(str + ".v_obj->no_delete = false;");
+
+    return str;
+  });
+}
+
+std::string Emitter::compare(AST::Compare* ast)
+{
+  auto apply = [&](AST::CmpKind kind, std::string const& a,
+                   TypeKind L, std::string const& b,
+                   TypeKind R) -> std::string {
+    // 文字列、コンテナなど
+    if (!is_scalar(L) || !is_scalar(R)) {
+      if (L == TYPE_None || R == TYPE_None)
+        unsupported(ast);
+
+      auto eq = "(" + a + ").equals(" + b + ")";
+
+      return kind == AST::CMP_NotEqual ? "!" + eq : eq;
+    }
+
+    // 整数どうしは int にして比べる
+    auto common = L == R ? L
+                  : L == TYPE_Float || R == TYPE_Float
+                      ? TYPE_Float
+                      : TYPE_Int;
+
+    return "(" + convert(a, L, common) + " " +
+           compare_ops[kind] + " " + convert(b, R, common) +
+           ")";
+  };
+
+  auto L = type_of(ast->first).kind;
+
+  if (ast->elements.size() == 1) {
+    auto const& elem = ast->elements[0];
+
+    return this->block([&] {
+      auto operands =
+          this->sequence({ast->first, elem.ast});
+
+      return apply(elem.kind, operands[0], L, operands[1],
+                   type_of(elem.ast).kind);
+    });
+  }
+
+  //
+  // a < b < c
+  //  左から順に比べて、偽になったら残りは評価しない
+  return this->block([&] {
+    auto result = this->temp();
+    auto left = this->temp();
+
+    this->line("bool " + result + " = false;");
+    this->line(cpp_type(L) + " " + left + " = " +
+               this->expr(ast->first) + ";");
+
+    for (auto&& elem : ast->elements) {
+      auto R = type_of(elem.ast).kind;
+      auto right = this->temp();
+
+      this->line(cpp_type(R) + " " + right + " = " +
+                 this->expr(elem.ast) + ";");
+
+      auto cond = apply(elem.kind, left, L, right, R);
+
+      this->line("if " + cond + " {");
+
+      this->depth++;
+
+      left = right;
+      L = R;
+    }
+
+    this->line(result + " = true;");
+
+    for (size_t i = 0; i < ast->elements.size(); i++) {
+      this->depth--;
+      this->line("}");
+    }
+
+    return result;
+  });
+}
+
+std::string Emitter::assign(AST::Assign* ast)
+{
+  auto kind = type_of(ast).kind;
+
+  switch (ast->dest->kind) {
+    case AST_Variable: {
+      auto const& var =
+          this->find_var((AST::Variable*)ast->dest);
+
+      if (is_scalar(kind))
+        return "(" + var.code + " = " +
+               this->expr(ast->expr) + ")";
+
+      return "AOT::assign(" + var.code + ", " +
+             this->expr(ast->expr) + ")";
+    }
+
+    case AST_IndexRef: {
+      auto ref = (AST::IndexRef*)ast->dest;
+      auto last = ref->indexes.back();
+      auto check = ref->needs_bounds_check(last);
+
+      // v[i] = x (int, float などのベクタの変数)
+      if (ref->expr->kind == AST_Variable &&
+          ref->indexes.size() == 1 &&
+          is_packed_kind(kind) && !has_effects(last)) {
+        auto const& var =
+            this->find_var((AST::Variable*)ref->expr);
+
+        if (var.type.kind == TYPE_Vector) {
+          return this->block([&] {
+            auto value = this->expr(ast->expr);
+
+            // 値を先に評価する
+            if (has_effects(ast->expr)) {
+              auto tmp = this->temp();
+
+              this->line(cpp_type(kind) + " " + tmp +
+                         " = " + value + ";");
+
+              value = tmp;
+            }
+
+            return "AOT::set<" + cpp_type(kind) + ">(" +
+                   var.code + ", (size_t)(" +
+                   this->expr(last) + "), " + value + ", " +
+                   (check ? "true, " + this->site(last)
+                          : "false, nullptr") +
+                   ")";
+          });
+        }
+      }
+
+      auto result = this->block([&] {
+        auto value = this->temp();
+        auto ptr = this->temp();
+
+        // 書き込み先をたどる間に削除されないよう、先に増やす
+        this->line("Value " + value + " = " +
+                   box(this->expr(ast->expr), kind) + ";");
+
+        this->line(value + ".inc_ref();");
+
+        this->line("Value* " + ptr + " = " +
+                   this->lvalue(ref->expr) + ";");
+
+        for (auto&& index : ref->indexes) {
+          if (index == last)
+            break;
+
+          auto check = ref->needs_bounds_check(index);
+
+          this->line(
+              ptr + " = &AOT::step(*" + ptr + ", " +
+              box(this->expr(index), type_of(index).kind) +
+              ", " + (check ? "true, " + this->site(index)
+                            : "false, nullptr") +
+              ");");
+        }
+
+        return "AOT::store(*" + ptr + ", " +
+               box(this->expr(last), type_of(last).kind) +
+               ", " + value + ", " +
+               (check ? "true, " + this->site(last)
+                      : "false, nullptr") +
+               ")";
+      });
+
+      return unbox(result, kind);
+    }
+
+    case AST_MemberAccess: {
+      auto result = this->block([&] {
+        auto value = this->temp();
+
+        this->line("Value " + value + " = " +
+                   box(this->expr(ast->expr), kind) + ";");
+
+        return "AOT::assign(*" + this->lvalue(ast->dest) +
+               ", " + value + ")";
+      });
+
+      return unbox(result, kind);
+    }
+  }
+
+  unsupported(ast);
+}
+
+std::string Emitter::value_of(AST::Base* ast)
+{
+  auto kind = type_of(ast).kind;
+
+  return this->block([&] {
+    auto result = this->temp();
+
+    this->line(cpp_type(kind) + " " + result + "{};");
+
+    if (ast->kind == AST_If)
+      this->if_stmt((AST::If*)ast, {result, kind});
+    else
+      this->scope(ast, {result, kind}, "");
+
+    return result;
+  });
+}
+
+// --------------------------------------------------------
+//  文
+// --------------------------------------------------------
+
+void Emitter::stmt(AST::Base* _ast, Dest const& dest)
+{
+  switch (_ast->kind) {
+    case AST_None:
+    case AST_Struct:
+      return;
+
+    case AST_Impl:
+      unsupported(_ast);
+
+    case AST_Function:
+      this->function((AST::Function*)_ast);
+      return;
+
+    case AST_Let:
+      this->let((AST::VariableDeclaration*)_ast);
+      return;
+
+    case AST_Return: {
+      astdef(Return);
+
+      if (ast->expr)
+        this->line("return _ret = " +
+                   this->expr(ast->expr) + ";");
+      else
+        this->line("return _ret;");
+
+      return;
+    }
+
+    case AST_Break:
+      this->line("break;");
+      return;
+
+    case AST_Continue:
+      this->line("continue;");
+      return;
+
+    case AST_If:
+      this->if_stmt((AST::If*)_ast, dest);
+      return;
+
+    case AST_Scope:
+      this->scope(_ast, dest, "");
+      return;
+
+    case AST_Switch:
+      this->switch_stmt((AST::Switch*)_ast);
+      return;
+
+    case AST_For:
+      this->for_stmt((AST::For*)_ast);
+      return;
+
+    case AST_While: {
+      astdef(While);
+
+      this->scope(ast->code, {},
+                  "while (" + this->expr(ast->cond) + ") ");
+
+      return;
+    }
+
+    case AST_DoWhile: {
+      astdef(DoWhile);
+
+      this->scope(
+          ast->code, {}, "do ",
+          " while (" + this->expr(ast->cond) + ");");
+
+      return;
+    }
+
+    case AST_Loop:
+      this->scope(((AST::Loop*)_ast)->code, {},
+                  "while (true) ");
+      return;
+  }
+
+  auto code = this->expr(_ast);
+
+  if (dest.name.empty()) {
+    this->line(code + ";");
+    return;
+  }
+
+  auto kind = type_of(_ast).kind;
+
+  if (kind == dest.kind)
+    this->line(dest.name + " = " + code + ";");
+  else if (!is_scalar(dest.kind))
+    this->line(dest.name + " = " + box(code, kind) + ";");
+  else
+    this->line(code + ";");
+}
+
+void Emitter::scope(AST::Base* ast, Dest const& dest,
+                    std::string const& head,
+                    std::string const& tail)
+{
+  this->line(head + "{");
+  this->depth++;
+  this->scopes.emplace_back();
+
+  if (ast->kind != AST_Scope) {
+    this->stmt(ast, dest);
+  }
+  else if (auto x = (AST::Scope*)ast; !x->list.empty()) {
+    if (needs_guard(x)) {
+      std::string result = "nullptr";
+      std::string ret = "nullptr";
+
+      if (!dest.name.empty() && !is_scalar(dest.kind))
+        result = "&" + dest.name;
+
+      // 関数の戻り値も回収しない
+      if (auto func = this->cur_func;
+          func && func->result_type &&
+          !is_scalar(type_of(func->result_type).kind))
+        ret = "&_ret";
+
+      this->line("AOT::ScopeGuard _scope(" + result + ", " +
+                 ret + ");");
+    }
+
+    for (auto&& item : x->list)
+      this->stmt(item,
+                 item == x->list.back() ? dest : Dest{});
+  }
+
+  this->scopes.pop_back();
+  this->depth--;
+  this->line("}" + tail);
+}
+
+void Emitter::let(AST::VariableDeclaration* ast)
+{
+  auto type =
+      ast->type ? type_of(ast->type) : type_of(ast->init);
+  auto kind = type.kind;
+
+  // 初期化式の中では、まだ新しい変数は見えない
+  std::string init;
+
+  if (ast->init)
+    init = this->expr(ast->init);
+  else if (is_scalar(kind))
+    init = cpp_type(kind) + "()";
+  else
+    init = "AOT::default_value(*" + this->type_ptr(type) +
+           ")";
+
+  auto is_global = !this->cur_func &&
+                   this->global_names.contains(ast->name);
+
+  auto name = this->declare(ast->name, type, is_global);
+
+  if (is_global) {
+    if (is_scalar(kind))
+      this->line(name + " = " + init + ";");
+    else
+      this->line("AOT::assign(" + name + ", " + init +
+                 ");");
+  }
+  else if (is_scalar(kind))
+    this->line(cpp_type(kind) + " " + name + " = " + init +
+               ";");
+  else
+    this->line("AOT::Var " + name + "(" + init + ");");
+}
+
+void Emitter::if_stmt(AST::If* ast, Dest const& dest,
+                      std::string const& prefix)
+{
+  this->scope(ast->if_true, dest,
+              prefix + "if (" + this->expr(ast->condition) +
+                  ") ");
+
+  if (!ast->if_false)
+    return;
+
+  if (ast->if_false->kind == AST_If)
+    this->if_stmt((AST::If*)ast->if_false, dest, "else ");
+  else
+    this->scope(ast->if_false, dest, "else ");
+}
+
+void Emitter::switch_stmt(AST::Switch* ast)
+{
+  auto kind = type_of(ast->expr).kind;
+  auto item = this->temp();
+
+  this->line("{");
+  this->depth++;
+
+  this->line(cpp_type(kind) + " " + item + " = " +
+             this->expr(ast->expr) + ";");
+
+  std::string prefix = "if (";
+
+  for (auto&& c : ast->cases) {
+    auto cond_kind = type_of(c->cond).kind;
+    auto cond = this->expr(c->cond);
+
+    std::string match;
+
+    // false なら飛ばし、true なら値と比べる
+    //  (bool でない値とは一致しない)
+    if (cond_kind == TYPE_Bool) {
+      match = kind == TYPE_Bool
+                  ? "(" + cond + ") && " + item
+                  : "((void)(" + cond + "), false)";
+    }
+    else if (is_scalar(cond_kind))
+      match = "(" + cond + ") == " + item;
+    else
+      match = "(" + cond + ").equals(" + item + ")";
+
+    this->scope(c->scope, {}, prefix + match + ") ");
+
+    prefix = "else if (";
+  }
+
+  this->depth--;
+  this->line("}");
+}
+
+void Emitter::for_stmt(AST::For* ast)
+{
+  if (ast->iter->kind != AST_Variable)
+    unsupported(ast->iter);
+
+  auto iter = (AST::Variable*)ast->iter;
+  auto iterable = type_of(ast->iterable);
+
+  this->line("{");
+  this->depth++;
+  this->scopes.emplace_back();
+
+  //
+  // 範囲
+  if (iterable.kind == TYPE_Range) {
+    auto begin = this->temp();
+    auto end = this->temp();
+
+    std::string step;
+
+    // a .. b (by c) と書いたもの
+    if (ast->iterable->kind == AST_Range) {
+      auto range = (AST::Range*)ast->iterable;
+
+      this->line("int64_t " + begin + " = " +
+                 this->expr(range->begin) + ";");
+
+      this->line("int64_t " + end + " = " +
+                 this->expr(range->end) + ";");
+
+      if (!range->step)
+        step = "1";
+      else if (is_nonzero_literal(range->step))
+        step = this->expr(range->step);
+      else {
+        step = this->temp();
+
+        this->line("int64_t " + step +
+                   " = AOT::range_step(" +
+                   this->expr(range->step) + ", " +
+                   this->site(range->step) + ");");
+      }
+    }
+    else {
+      auto obj = this->temp();
+
+      step = this->temp();
+
+      this->line("auto " + obj + " = (ObjRange*)(" +
+                 this->borrow(ast->iterable) + ").v_obj;");
+
+      this->line("int64_t " + begin + " = " + obj +
+                 "->begin;");
+      this->line("int64_t " + end + " = " + obj + "->end;");
+      this->line("int64_t " + step + " = " + obj +
+                 "->step;");
+    }
+
+    auto var =
+        this->declare(iter->token.str, TYPE_Int, false);
+
+    std::string cond;
+
+    // 向きが分かっていれば、比べる方向を決めておく
+    //  (負のリテラルは定数の畳み込みでできる)
+    if (step.starts_with("int64_t(-"))
+      cond = var + " > " + end;
+    else if (step.starts_with("int64_t(") || step == "1")
+      cond = var + " < " + end;
+    else {
+      cond = "(" + step + " > 0 ? " + var + " < " + end +
+             " : " + var + " > " + end + ")";
+    }
+
+    // 次の値が end を越えるなら end にして抜ける
+    //  (i + step は桁あふれすることがある)
+    auto next = "Arith::range_next(" + var + ", " + end +
+                ", " + step + ") || (" + var + " = " + end +
+                ")";
+
+    this->scope(ast->code, {},
+                "for (int64_t " + var + " = " + begin +
+                    "; " + cond + "; " + next + ") ");
+  }
+
+  //
+  // 文字列、ベクタ、辞書
+  //  変数には要素をそのまま入れる (複製しない)
+  else if (iterable.is_iterable()) {
+    auto it = this->temp();
+    auto obj = this->borrow(ast->iterable);
+    auto site = this->site(ast->iterable);
+
+    auto type = iterable.kind == TYPE_String
+                    ? TypeInfo(TYPE_Char)
+                    : iterable.type_params[0];
+
+    auto var = this->declare(iter->token.str, type, false);
+
+    this->line("for (AOT::ForIn " + it + "(" + obj + "); " +
+               it + ".index < " + it + ".size(); " + it +
+               ".next(" + site + ")) {");
+
+    this->depth++;
+
+    if (is_scalar(type.kind))
+      this->line(cpp_type(type.kind) + " " + var + " = " +
+                 unbox(it + ".get()", type.kind) + ";");
+    else
+      this->line("Value " + var + " = " + it + ".get();");
+
+    this->scope(ast->code, {}, "");
+
+    this->depth--;
+    this->line("}");
+  }
+  else {
+    unsupported(ast->iterable);
+  }
+
+  this->scopes.pop_back();
+  this->depth--;
+  this->line("}");
+}
+
+void Emitter::function(AST::Function* ast)
+{
+  auto saved_code = std::move(this->code);
+  auto saved_depth = this->depth;
+
+  this->code.clear();
+  this->depth = 0;
+  this->cur_func = ast;
+
+  auto result = ast->result_type ? type_of(ast->result_type)
+                                 : TypeInfo(TYPE_None);
+
+  this->line(this->signature(ast));
+  this->line("{");
+  this->depth++;
+
+  this->line(cpp_type(result.kind) + " _ret{};");
+
+  this->scopes.emplace_back();
+
+  // 引数は関数の中で参照を持つ
+  for (size_t i = 0; auto&& arg : ast->args) {
+    auto type = type_of(arg->type);
+    auto name = this->declare(arg->name, type, false);
+    auto param = "_p" + std::to_string(i++);
+
+    if (is_scalar(type.kind))
+      this->line(cpp_type(type.kind) + " " + name + " = " +
+                 param + ";");
+    else
+      this->line("AOT::Var " + name + "(" + param + ");");
+  }
+
+  this->scope(ast->code,
+              ast->code->return_last_expr
+                  ? Dest{"_ret", result.kind}
+                  : Dest{},
+              "");
+
+  this->scopes.pop_back();
+
+  this->line("return _ret;");
+  this->depth--;
+  this->line("}");
+
+  this->functions.emplace_back(std::move(this->code));
+
+  this->code = std::move(saved_code);
+  this->depth = saved_depth;
+  this->cur_func = nullptr;
+}
+
+std::string Emitter::signature(AST::Function* ast)
+{
+  auto result = ast->result_type ? type_of(ast->result_type)
+                                 : TypeInfo(TYPE_None);
+
+  std::vector<std::string> params;
+
+  for (size_t i = 0; auto&& arg : ast->args) {
+    params.emplace_back(cpp_type(type_of(arg->type).kind) +
+                        " _p" + std::to_string(i++));
+  }
+
+  return "static " + cpp_type(result.kind) + " f_" +
+         std::string(ast->name.str) + "(" + join(params) +
+         ")";
+}
+
+}  // namespace AOT
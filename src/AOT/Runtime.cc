@@ -0,0 +1,357 @@
+//
+// -emit-cpp で生成したプログラムから使う処理
+//  Evaluator の同じ名前の処理と結果が同じになるようにする
+//  (Evaluator はリンクしないので、必要なものだけ持っておく)
+//
+
+#include <cstdlib>
+#include <iostream>
+
+#include "Utils.h"
+#include "color.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Object.h"
+#include "BuiltinFunc.h"
+#include "AOT/Runtime.h"
+
+namespace AOT {
+
+void error(char const* site, std::string const& message)
+{
+  std::cout << COL_BOLD COL_RED "error: " << COL_WHITE
+            << message;
+  std::cerr << site;
+
+  std::exit(1);
+}
+
+static Token const& make_token(char const* str)
+{
+  auto token = new Token(TOK_Ident);
+
+  token->str = str;
+
+  return *token;
+}
+
+AST::Struct* make_struct(
+    char const* name,
+    std::initializer_list<char const*> members)
+{
+  auto ast = new AST::Struct(make_token(name));
+
+  ast->name = name;
+
+  for (auto&& member : members)
+    ast->append(make_token(member), nullptr);
+
+  return ast;
+}
+
+TypeInfo make_type(
+    AST::Struct* ast,
+    std::initializer_list<TypeInfo::member_pair_t> members)
+{
+  TypeInfo ret{TYPE_UserDef};
+
+  ret.userdef_struct = ast;
+  ret.members = members;
+
+  return ret;
+}
+
+Value make_string(std::wstring&& value)
+{
+  Value ret = new ObjString(std::move(value));
+
+  ret.inc_ref();
+
+  return ret;
+}
+
+Value default_value(TypeInfo const& type,
+                    bool construct_member)
+{
+  switch (type.kind) {
+    case TYPE_Int:
+      return Value::from_int(0);
+
+    case TYPE_USize:
+      return Value::from_usize(0);
+
+    case TYPE_Float:
+      return Value::from_float(0);
+
+    case TYPE_Bool:
+      return Value::from_bool(false);
+
+    case TYPE_Char:
+      return Value::from_char(0);
+
+    case TYPE_String:
+      return new ObjString;
+
+    case TYPE_Dict:
+      return new_dict(TypeInfo::intern(type));
+
+    case TYPE_Vector:
+      return new_vector(TypeInfo::intern(type));
+
+    case TYPE_UserDef: {
+      auto ret = new ObjUserType(TypeInfo::intern(type));
+
+      if (construct_member) {
+        for (auto&& member : type.members)
+          ret->add_member(default_value(member.second));
+      }
+
+      return ret;
+    }
+  }
+
+  return {};
+}
+
+Value new_vector(TypeInfo const* type)
+{
+  return new ObjVector(type);
+}
+
+Value new_dict(TypeInfo const* type)
+{
+  auto ret = new ObjDict();
+
+  ret->type = type;
+
+  return ret;
+}
+
+void append(Value const& vec, Value const& value)
+{
+  ((ObjVector*)vec.v_obj)->append(value);
+}
+
+void append(Value const& dict, Value const& key,
+            Value const& value)
+{
+  ((ObjDict*)dict.v_obj)->append(key, value);
+}
+
+void add_member(Value const& obj, Value const& value)
+{
+  ((ObjUserType*)obj.v_obj)->add_member(value);
+}
+
+int64_t range_step(int64_t step, char const* site)
+{
+  if (step == 0)
+    error(site, "range step must not be zero");
+
+  return step;
+}
+
+//
+// Evaluator::eval_index の一段分
+Value const& at(Value const& obj, Value const& index,
+                Value& tmp, bool check, char const* site)
+{
+  switch (obj.kind) {
+    case TYPE_Vector: {
+      auto vec = (ObjVector*)obj.v_obj;
+      auto i = to_index(index);
+
+      if (check && i >= vec->size())
+        error(site, "index out of range");
+
+      if (vec->is_packed())
+        return tmp = vec->at(i);
+
+      return vec->get_elements()[i];
+    }
+
+    case TYPE_Dict: {
+      auto dict = (ObjDict*)obj.v_obj;
+
+      if (auto item = dict->find(index); item)
+        return item->value;
+
+      tmp = default_value(dict->type->type_params[1]);
+
+      return tmp;
+    }
+  }
+
+  panic("no index");
+}
+
+//
+// Evaluator::eval_index_step と同じ
+Value& step(Value& obj, Value const& index, bool check,
+            char const* site)
+{
+  switch (obj.kind) {
+    case TYPE_Vector: {
+      auto& elements =
+          ((ObjVector*)obj.v_obj)->get_mut_elements();
+
+      auto i = to_index(index);
+
+      if (check && i >= elements.size())
+        error(site, "index out of range");
+
+      return elements[i];
+    }
+
+    case TYPE_Dict: {
+      auto dict = (ObjDict*)obj.v_obj;
+
+      if (auto value = dict->find_mut(index); value)
+        return *value;
+
+      auto value =
+          default_value(dict->type->type_params[1]);
+
+      return dict->append(index, value).value;
+    }
+  }
+
+  panic("no index");
+}
+
+//
+// Evaluator::assign の最後の添字
+Value store(Value& obj, Value const& index,
+            Value const& value, bool check,
+            char const* site)
+{
+  // 詰めて持っているベクタには直接書き込む
+  if (obj.kind == TYPE_Vector &&
+      ((ObjVector*)obj.v_obj)->is_packed()) {
+    auto vec = (ObjVector*)obj.v_obj;
+    auto i = to_index(index);
+
+    if (check && i >= vec->size())
+      error(site, "index out of range");
+
+    vec->set(i, value);
+
+    return value;
+  }
+
+  auto& dest = step(obj, index, check, site);
+
+  dest.dec_ref();
+
+  return dest = value;
+}
+
+Value call_builtin(size_t index, std::vector<Value>& args,
+                   char const* site)
+{
+  Value result;
+
+  try {
+    auto const& list = BuiltinFunc::get_builtin_list();
+
+    result = list[index].impl(args);
+  }
+  catch (BuiltinFunc::RuntimeError const& err) {
+    error(site, err.message);
+  }
+
+  for (auto&& arg : args)
+    arg.dec_ref();
+
+  return result;
+}
+
+// --------------------------------------------------------
+//  ForIn
+// --------------------------------------------------------
+
+uint32_t iter_version(Value const& obj)
+{
+  switch (obj.kind) {
+    case TYPE_String:
+      return ((ObjString*)obj.v_obj)->version;
+
+    case TYPE_Vector:
+      return ((ObjVector*)obj.v_obj)->version;
+  }
+
+  return ((ObjDict*)obj.v_obj)->version;
+}
+
+size_t iter_size(Value const& obj)
+{
+  switch (obj.kind) {
+    case TYPE_String: {
+      auto str = (ObjString*)obj.v_obj;
+
+      return str->get_value().size();
+    }
+
+    case TYPE_Vector:
+      return ((ObjVector*)obj.v_obj)->size();
+  }
+
+  return ((ObjDict*)obj.v_obj)->get_items().size();
+}
+
+Value iter_get(Value const& obj, size_t index)
+{
+  switch (obj.kind) {
+    case TYPE_String: {
+      auto const& str =
+          ((ObjString*)obj.v_obj)->get_value();
+
+      return Value::from_char(str[index]);
+    }
+
+    case TYPE_Vector:
+      return ((ObjVector*)obj.v_obj)->at(index);
+  }
+
+  return ((ObjDict*)obj.v_obj)->get_items()[index].key;
+}
+
+void iter_check(Value const& obj, uint32_t version,
+                char const* site)
+{
+  if (iter_version(obj) != version)
+    error(site, "container modified during iteration");
+}
+
+ForIn::ForIn(Value const& obj)
+    : obj(obj),
+      index(0),
+      version(iter_version(obj))
+{
+  this->obj.inc_ref();
+}
+
+ForIn::~ForIn()
+{
+  this->obj.dec_ref();
+}
+
+size_t ForIn::size() const
+{
+  return iter_size(this->obj);
+}
+
+Value ForIn::get() const
+{
+  return iter_get(this->obj, this->index);
+}
+
+void ForIn::next(char const* site)
+{
+  iter_check(this->obj, this->version, site);
+
+  this->index++;
+}
+
+}  // namespace AOT
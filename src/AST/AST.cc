@@ -6,7 +6,8 @@ Base::Base(ASTKind kind, Token const& token)
     : kind(kind),
       token(token),
       end_token(nullptr),
-      is_left(false)
+      is_left(false),
+      quick(QUICK_None)
 {
 }
 
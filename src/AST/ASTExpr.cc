@@ -8,14 +8,16 @@ ConstKeyword::ConstKeyword(ASTKind kind, Token const& token)
 }
 
 Value::Value(Token const& tok)
-    : Base(AST_Value, tok)
+    : Base(AST_Value, tok),
+      object_index(SIZE_MAX)
 {
 }
 
 Variable::Variable(Token const& tok)
     : Base(AST_Variable, tok),
-      step(0),
+      slot(0),
       index(0),
+      is_global(false),
       name(tok.str)
 {
   this->is_left = true;
@@ -96,7 +98,8 @@ Vector::Vector(Token const& token)
 
 IndexRef::IndexRef(Token const& t)
     : ListBase(AST_IndexRef, t),
-      expr(nullptr)
+      expr(nullptr),
+      is_in_bounds(false)
 {
 }
 
@@ -108,7 +111,8 @@ IndexRef::~IndexRef()
 Range::Range(Token const& token)
     : Base(AST_Range, token),
       begin(nullptr),
-      end(nullptr)
+      end(nullptr),
+      step(nullptr)
 {
 }
 
@@ -116,6 +120,7 @@ Range::~Range()
 {
   delete begin;
   delete end;
+  delete step;
 }
 
 Assign::Assign(Token const& assign_op)
@@ -5,7 +5,8 @@ namespace AST {
 VariableDeclaration::VariableDeclaration(Token const& token)
     : Base(AST_Let, token),
       type(nullptr),
-      init(nullptr)
+      init(nullptr),
+      slot(0)
 {
 }
 
@@ -38,7 +39,10 @@ LoopController ::LoopController(Token const& token,
 
 Scope::Scope(Token const& token)
     : ListBase(AST_Scope, token),
-      return_last_expr(false)
+      return_last_expr(false),
+      slot_begin(0),
+      slot_end(0),
+      frame_size(0)
 {
 }
 
@@ -0,0 +1,188 @@
+#include "AST.h"
+
+#define astdef(T) auto ast = (T*)_ast
+
+namespace AST {
+
+void children(Base* _ast,
+              std::function<void(Base*&)> const& fn)
+{
+  // Scope* などで持っているもの
+  auto sub = [&fn](auto*& x) {
+    Base* tmp = x;
+
+    fn(tmp);
+    x = (std::remove_reference_t<decltype(x)>)tmp;
+  };
+
+  auto expr = [&fn](auto* ast) {
+    fn(ast->first);
+
+    for (auto&& elem : ast->elements)
+      fn(elem.ast);
+  };
+
+  switch (_ast->kind) {
+    case AST_UnaryMinus:
+    case AST_UnaryPlus:
+      fn(((UnaryOp*)_ast)->expr);
+      break;
+
+    case AST_Cast:
+      fn(((Cast*)_ast)->expr);
+      break;
+
+    case AST_Vector:
+      for (auto&& x : ((Vector*)_ast)->elements)
+        fn(x);
+
+      break;
+
+    case AST_Dict:
+    case AST_TypeConstructor:
+      for (auto&& elem : ((Dict*)_ast)->elements) {
+        fn(elem.key);
+        fn(elem.value);
+      }
+
+      break;
+
+    case AST_CallFunc:
+      for (auto&& x : ((CallFunc*)_ast)->args)
+        fn(x);
+
+      break;
+
+    case AST_IndexRef: {
+      astdef(IndexRef);
+
+      fn(ast->expr);
+
+      for (auto&& x : ast->indexes)
+        fn(x);
+
+      break;
+    }
+
+    // メンバの名前はたどらない
+    case AST_MemberAccess:
+      fn(((IndexRef*)_ast)->expr);
+      break;
+
+    case AST_Range: {
+      astdef(Range);
+
+      fn(ast->begin);
+      fn(ast->end);
+      fn(ast->step);
+
+      break;
+    }
+
+    case AST_Assign:
+      fn(((Assign*)_ast)->dest);
+      fn(((Assign*)_ast)->expr);
+      break;
+
+    case AST_Expr:
+      expr((Expr*)_ast);
+      break;
+
+    case AST_Compare:
+      expr((Compare*)_ast);
+      break;
+
+    case AST_Let:
+      fn(((VariableDeclaration*)_ast)->init);
+      break;
+
+    case AST_Return:
+      fn(((Return*)_ast)->expr);
+      break;
+
+    case AST_Scope:
+      for (auto&& x : ((Scope*)_ast)->list)
+        fn(x);
+
+      break;
+
+    case AST_If: {
+      astdef(If);
+
+      fn(ast->condition);
+      fn(ast->if_true);
+      fn(ast->if_false);
+      break;
+    }
+
+    case AST_Switch: {
+      astdef(Switch);
+
+      fn(ast->expr);
+
+      for (auto&& c : ast->cases) {
+        fn(c->cond);
+        sub(c->scope);
+      }
+
+      break;
+    }
+
+    case AST_For: {
+      astdef(For);
+
+      fn(ast->iter);
+      fn(ast->iterable);
+      fn(ast->code);
+      break;
+    }
+
+    case AST_While:
+      fn(((While*)_ast)->cond);
+      sub(((While*)_ast)->code);
+      break;
+
+    case AST_DoWhile:
+      sub(((DoWhile*)_ast)->code);
+      fn(((DoWhile*)_ast)->cond);
+      break;
+
+    case AST_Loop:
+      fn(((Loop*)_ast)->code);
+      break;
+
+    case AST_Function:
+      sub(((Function*)_ast)->code);
+      break;
+  }
+}
+
+void walk(Base* ast, std::function<void(Base*)> const& fn)
+{
+  if (!ast)
+    return;
+
+  fn(ast);
+
+  children(ast, [&fn](Base*& x) { walk(x, fn); });
+}
+
+std::set<std::string_view> global_names(Scope* root)
+{
+  std::set<std::string_view> names;
+
+  for (auto&& item : root->list) {
+    if (item->kind != AST_Function)
+      continue;
+
+    walk(item, [&names](Base* x) {
+      if (x->kind == AST_Variable &&
+          ((Variable*)x)->is_global)
+        names.emplace(((Variable*)x)->name);
+    });
+  }
+
+  return names;
+}
+
+}  // namespace AST
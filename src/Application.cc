@@ -12,6 +12,9 @@
 #include "ScriptFileContext.h"
 #include "Application.h"
 #include "Error.h"
+#include "GC.h"
+#include "Evaluator.h"
+#include "Optimizer.h"
 
 static Application* _g_inst;
 
@@ -35,7 +38,127 @@ int Application::main(int argc, char** argv)
     std::string arg = argv[i];
 
     if (arg == "-help") {
-      std::cout << "usage: metro <input file>\n";
+      std::cout << "usage: metro [options] <input file>\n"
+                   "options:\n"
+                   "  -engine=<ast|vm|closure|ir>\n"
+                   "                    select execution engine\n"
+                   "  -dump-bytecode    print compiled bytecode\n"
+                   "  -dump-bce         print index accesses proven\n"
+                   "                    in bounds\n"
+                   "  -dump-ir          print the SSA IR\n"
+                   "  -gc-max-pause-us=<n>\n"
+                   "                    limit each GC pause to n us\n"
+                   "                    and print pause histogram\n"
+                   "  -slab-stats       print slab occupancy at exit\n"
+                   "  -no-quicken       do not specialize AST nodes\n"
+                   "  -quicken-stats    print specialized AST nodes\n"
+                   "                    at exit\n"
+                   "  -no-fold          do not fold constant\n"
+                   "                    expressions\n"
+                   "  -fold-stats       print folded AST nodes\n"
+                   "                    at exit\n"
+                   "  -no-inline        do not inline small\n"
+                   "                    functions\n"
+                   "  -inline-stats     print inlined call sites\n"
+                   "                    at exit\n"
+                   "  -no-hoist         do not hoist loop-invariant\n"
+                   "                    expressions\n"
+                   "  -hoist-stats      print hoisted expressions\n"
+                   "                    at exit\n"
+                   "  -jit              compile int/float functions\n"
+                   "                    to x86-64 machine code\n"
+                   "  -emit-cpp=<file>  write the script as C++\n"
+                   "  -aot[=<exe>]      compile the script to a native\n"
+                   "                    executable\n";
+    }
+    else if (arg.starts_with("-engine=")) {
+      auto name = arg.substr(8);
+
+      if (name == "ast") {
+        this->_options.engine = ENGINE_AST;
+      }
+      else if (name == "vm") {
+        this->_options.engine = ENGINE_VM;
+      }
+      else if (name == "closure") {
+        this->_options.engine = ENGINE_Closure;
+      }
+      else if (name == "ir") {
+        this->_options.engine = ENGINE_IR;
+      }
+      else {
+        std::cerr << "fatal: unknown engine: " << name
+                  << std::endl;
+
+        return -1;
+      }
+    }
+    else if (arg == "-dump-bytecode") {
+      this->_options.dump_bytecode = true;
+    }
+    else if (arg == "-dump-bce") {
+      this->_options.dump_bce = true;
+    }
+    else if (arg == "-dump-ir") {
+      this->_options.dump_ir = true;
+    }
+    else if (arg.starts_with("-gc-max-pause-us=")) {
+      auto value = arg.substr(17);
+
+      if (value.empty() ||
+          value.find_first_not_of("0123456789") !=
+              std::string::npos ||
+          std::stoul(value) == 0) {
+        std::cerr << "fatal: invalid pause time: " << value
+                  << std::endl;
+
+        return -1;
+      }
+
+      this->_options.gc_max_pause_us = std::stoul(value);
+
+      GarbageCollector::set_max_pause(
+          this->_options.gc_max_pause_us);
+    }
+    else if (arg == "-slab-stats") {
+      this->_options.slab_stats = true;
+    }
+    else if (arg == "-no-quicken") {
+      this->_options.no_quicken = true;
+    }
+    else if (arg == "-quicken-stats") {
+      this->_options.quicken_stats = true;
+    }
+    else if (arg == "-no-fold") {
+      this->_options.no_fold = true;
+    }
+    else if (arg == "-fold-stats") {
+      this->_options.fold_stats = true;
+    }
+    else if (arg == "-no-inline") {
+      this->_options.no_inline = true;
+    }
+    else if (arg == "-inline-stats") {
+      this->_options.inline_stats = true;
+    }
+    else if (arg == "-no-hoist") {
+      this->_options.no_hoist = true;
+    }
+    else if (arg == "-hoist-stats") {
+      this->_options.hoist_stats = true;
+    }
+    else if (arg == "-jit") {
+      this->_options.jit = true;
+    }
+    else if (arg.starts_with("-emit-cpp=")) {
+      this->_options.emit_cpp = arg.substr(10);
+    }
+    else if (arg == "-aot") {
+      this->_options.aot = true;
+    }
+    else if (arg.starts_with("-aot=")) {
+      this->_options.aot = true;
+      this->_options.aot_output = arg.substr(5);
     }
     else if (arg.ends_with(".metro")) {
       if (!std::ifstream(arg).good()) {
@@ -67,6 +190,24 @@ int Application::main(int argc, char** argv)
     script.execute_full();
   }
 
+  if (this->_options.gc_max_pause_us != 0)
+    GarbageCollector::print_statistics(std::cerr);
+
+  if (this->_options.slab_stats)
+    GarbageCollector::print_slab_statistics(std::cerr);
+
+  if (this->_options.quicken_stats)
+    Evaluator::print_quicken_statistics(std::cerr);
+
+  if (this->_options.fold_stats)
+    Optimizer::Folder::print_statistics(std::cerr);
+
+  if (this->_options.inline_stats)
+    Optimizer::Inliner::print_statistics(std::cerr);
+
+  if (this->_options.hoist_stats)
+    Optimizer::Hoister::print_statistics(std::cerr);
+
   return 0;
 }
 
@@ -89,6 +230,11 @@ ScriptFileContext const* Application::get_current_context() const
   return this->_cur_ctx;
 }
 
+Application::Options const& Application::get_options() const
+{
+  return this->_options;
+}
+
 // 初期化
 void Application::initialize()
 {
@@ -1,24 +1,315 @@
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 
 #include "Utils.h"
 #include "debug/alert.h"
 
 #include "Object.h"
+#include "Kernels.h"
 #include "BuiltinFunc.h"
 
-static Object* print_impl(std::vector<Object*> const& args)
+static Value print_impl(std::vector<Value> const& args)
 {
   size_t len = 0;
 
   for (auto&& arg : args) {
-    auto s = arg->to_string();
+    auto s = arg.to_string();
 
     std::cout << s;
 
     len += s.length();
   }
 
-  return new ObjLong(len);
+  return Value::from_int(len);
+}
+
+//
+// 辞書のキーまたは値をベクタにする
+static Value dict_to_vector(Value const& dict, size_t index)
+{
+  auto obj = (ObjDict*)dict.v_obj;
+  auto vec = new ObjVector(TypeInfo::intern(TypeInfo(
+      TYPE_Vector, {obj->type->type_params[index]})));
+
+  for (auto&& item : obj->get_items()) {
+    vec->append((index == 0 ? item.key : item.value).clone());
+  }
+
+  return vec;
+}
+
+//
+// (dict<K, V>, K, ...) の K が一致しているか
+static bool is_dict_key(std::vector<TypeInfo> const& arg_types)
+{
+  return arg_types[0].type_params[0].equals(arg_types[1]);
+}
+
+// --------------------------------------------------------
+//  数値ベクタ
+//   vector<int>, vector<float> は詰めて持っているので、
+//   Kernels でまとめて計算する
+// --------------------------------------------------------
+
+using ArgTypes = std::vector<TypeInfo>;
+
+//
+// vector<int>, vector<float> の要素の型 (それ以外は TYPE_None)
+static TypeKind numeric_element(TypeInfo const& type)
+{
+  if (type.kind != TYPE_Vector || type.type_params.empty())
+    return TYPE_None;
+
+  auto kind = type.type_params[0].kind;
+
+  return kind == TYPE_Int || kind == TYPE_Float ? kind
+                                                : TYPE_None;
+}
+
+template <class T>
+static T scalar_of(Value const& value)
+{
+  if constexpr (std::is_same_v<T, float>)
+    return value.v_float;
+  else
+    return value.v_int;
+}
+
+template <class T>
+static Value value_of(T x)
+{
+  if constexpr (std::is_same_v<T, float>)
+    return Value::from_float(x);
+  else
+    return Value::from_int(x);
+}
+
+template <class T>
+static std::vector<T> const& packed_of(Value const& value)
+{
+  return ((ObjVector*)value.v_obj)->get_packed<T>();
+}
+
+//
+// 要素の型に合わせて fn<int64_t> か fn<float> を呼ぶ
+#define dispatch_numeric(vec, fn, ...)                     \
+  (((ObjVector*)(vec).v_obj)->type->type_params[0].kind == \
+           TYPE_Int                                        \
+       ? fn<int64_t>(__VA_ARGS__)                          \
+       : fn<float>(__VA_ARGS__))
+
+//
+// 要素の数が同じか
+static void check_same_size(Value const& a, Value const& b)
+{
+  if (((ObjVector*)a.v_obj)->size() !=
+      ((ObjVector*)b.v_obj)->size())
+    throw BuiltinFunc::RuntimeError{"vector sizes differ"};
+}
+
+//
+// 結果を入れるベクタ (a と同じ型で、要素は n 個)
+template <class T>
+static std::pair<ObjVector*, T*> new_packed(
+    TypeInfo const* type, size_t n)
+{
+  auto ret = new ObjVector(type);
+  auto& elements = ret->get_mut_packed<T>();
+
+  elements.resize(n);
+
+  return {ret, elements.data()};
+}
+
+//
+// a op b (b はベクタかスカラー)
+template <class T>
+static Value apply_impl(Kernels::Operator op, Value const& a,
+                        Value const& b)
+{
+  auto const& x = packed_of<T>(a);
+  auto [ret, dst] = new_packed<T>(a.v_obj->type, x.size());
+
+  if (b.kind == TYPE_Vector) {
+    check_same_size(a, b);
+
+    auto const& y = packed_of<T>(b);
+
+    if (op == Kernels::OP_Div &&
+        std::find(y.begin(), y.end(), T(0)) != y.end())
+      throw BuiltinFunc::RuntimeError{"division by zero"};
+
+    Kernels::apply(op, dst, x.data(), y.data(), x.size());
+  }
+  else {
+    auto y = scalar_of<T>(b);
+
+    if (op == Kernels::OP_Div && y == 0)
+      throw BuiltinFunc::RuntimeError{"division by zero"};
+
+    Kernels::apply_scalar(op, dst, x.data(), y, x.size());
+  }
+
+  return ret;
+}
+
+//
+// vadd, vsub, vmul, vdiv
+//  (vector<T>, vector<T>) または (vector<T>, T)
+static BuiltinFunc elementwise(char const* name,
+                               Kernels::Operator op)
+{
+  return BuiltinFunc{
+      .name = name,
+      .is_template = true,
+      .result_type = TYPE_Template,
+      .arg_types = {TYPE_Template, TYPE_Template},
+      .impl =
+          [op](std::vector<Value> const& args) -> Value {
+        return dispatch_numeric(args[0], apply_impl, op, args[0],
+                                args[1]);
+      },
+      .get_result_type =
+          [](ArgTypes const& arg_types) -> std::optional<TypeInfo> {
+        auto kind = numeric_element(arg_types[0]);
+
+        if (kind == TYPE_None ||
+            (!arg_types[1].equals(arg_types[0]) &&
+             !arg_types[1].equals(kind)))
+          return std::nullopt;
+
+        return arg_types[0];
+      },
+      .arg_passing = BuiltinFunc::ARG_Borrow};
+}
+
+template <class T>
+static Value sum_impl(Value const& a)
+{
+  auto const& x = packed_of<T>(a);
+
+  return value_of<T>(Kernels::sum(x.data(), x.size()));
+}
+
+template <class T>
+static Value mean_impl(Value const& a)
+{
+  auto const& x = packed_of<T>(a);
+
+  if (x.empty())
+    throw BuiltinFunc::RuntimeError{"empty vector"};
+
+  return Value::from_float(
+      (double)Kernels::sum(x.data(), x.size()) / x.size());
+}
+
+template <class T>
+static Value minmax_impl(Value const& a, bool is_max)
+{
+  auto const& x = packed_of<T>(a);
+
+  if (x.empty())
+    throw BuiltinFunc::RuntimeError{"empty vector"};
+
+  return value_of<T>(is_max ? Kernels::max(x.data(), x.size())
+                            : Kernels::min(x.data(), x.size()));
+}
+
+template <class T>
+static Value dot_impl(Value const& a, Value const& b)
+{
+  check_same_size(a, b);
+
+  auto const& x = packed_of<T>(a);
+
+  return value_of<T>(
+      Kernels::dot(x.data(), packed_of<T>(b).data(), x.size()));
+}
+
+template <class T>
+static Value cumsum_impl(Value const& a)
+{
+  auto const& x = packed_of<T>(a);
+  auto [ret, dst] = new_packed<T>(a.v_obj->type, x.size());
+
+  Kernels::cumsum(dst, x.data(), x.size());
+
+  return ret;
+}
+
+template <class T>
+static Value clamp_impl(Value const& a, Value const& lo,
+                        Value const& hi)
+{
+  auto const& x = packed_of<T>(a);
+  auto [ret, dst] = new_packed<T>(a.v_obj->type, x.size());
+
+  Kernels::clamp(dst, x.data(), scalar_of<T>(lo),
+                 scalar_of<T>(hi), x.size());
+
+  return ret;
+}
+
+//
+// (vector<T>) -> R
+//  空のベクタでエラーになるものは is_pure = false
+static BuiltinFunc reduction(
+    char const* name, BuiltinFunc::Implementation impl,
+    std::function<TypeInfo(TypeKind)> result_of,
+    bool is_pure = true)
+{
+  return BuiltinFunc{
+      .name = name,
+      .is_template = true,
+      .result_type = TYPE_Template,
+      .arg_types = {TYPE_Template},
+      .impl = impl,
+      .get_result_type =
+          [result_of](
+              ArgTypes const& arg_types) -> std::optional<TypeInfo> {
+        auto kind = numeric_element(arg_types[0]);
+
+        if (kind == TYPE_None)
+          return std::nullopt;
+
+        return result_of(kind);
+      },
+      .arg_passing = BuiltinFunc::ARG_Borrow,
+      .is_pure = is_pure};
+}
+
+static TypeInfo element_type(TypeKind kind)
+{
+  return kind;
+}
+
+static TypeInfo vector_type(TypeKind kind)
+{
+  return TypeInfo(TYPE_Vector, {kind});
+}
+
+//
+// 長さが負ならエラー
+static size_t to_length(Value const& value)
+{
+  if (value.v_int < 0)
+    throw BuiltinFunc::RuntimeError{"negative length"};
+
+  return value.v_int;
+}
+
+template <class T>
+static Value fill_impl(Value const& n, Value const& x)
+{
+  auto type = TypeInfo::intern(
+      vector_type(std::is_same_v<T, float> ? TYPE_Float : TYPE_Int));
+
+  auto [ret, dst] = new_packed<T>(type, to_length(n));
+
+  std::fill(dst, dst + ret->size(), scalar_of<T>(x));
+
+  return ret;
 }
 
 static std::vector<BuiltinFunc> const _builtin_functions{
@@ -26,11 +317,11 @@ static std::vector<BuiltinFunc> const _builtin_functions{
     BuiltinFunc{
         .name = "id",
         .is_template = true,
-        .result_type = TYPE_Int,
+        .result_type = TYPE_String,
         .arg_types = {TYPE_Template},
-        .impl = [](std::vector<Object*> const& args) -> Object* {
+        .impl = [](std::vector<Value> const& args) -> Value {
           return new ObjString(Utils::String::to_wstr(
-              Utils::format("%p", args[0])));
+              Utils::format("%p", args[0].v_obj)));
         }},
 
     // print
@@ -46,11 +337,11 @@ static std::vector<BuiltinFunc> const _builtin_functions{
         .is_template = false,
         .result_type = TYPE_Int,
         .arg_types = {TYPE_Args},
-        .impl = [](std::vector<Object*> const& args) -> Object* {
+        .impl = [](std::vector<Value> const& args) -> Value {
           auto ret = print_impl(args);
 
           std::cout << "\n";
-          ((ObjLong*)ret)->value += 1;
+          ret.v_int += 1;
 
           return ret;
         }},
@@ -60,7 +351,7 @@ static std::vector<BuiltinFunc> const _builtin_functions{
         .is_template = false,
         .result_type = TYPE_String,
         .arg_types = {},
-        .impl = [](std::vector<Object*> const& args) -> Object* {
+        .impl = [](std::vector<Value> const& args) -> Value {
           (void)args;
 
           std::string input;
@@ -77,20 +368,180 @@ static std::vector<BuiltinFunc> const _builtin_functions{
         .result_type = TYPE_None,
         .arg_types = {TypeInfo(TYPE_Vector, {TYPE_Template}),
                       TYPE_Template},
-        .impl = [](std::vector<Object*> const& args) -> Object* {
-          return ((ObjVector*)args[0])->append(args[1]);
+        .impl = [](std::vector<Value> const& args) -> Value {
+          ((ObjVector*)args[0].v_obj)->append(args[1]);
+
+          return {};
         }},
 
+    // len
+    //  ベクタ・辞書の要素数、文字列の長さ
+    BuiltinFunc{
+        .name = "len",
+        .is_template = true,
+        .result_type = TYPE_Int,
+        .arg_types = {TYPE_Template},
+        .impl = [](std::vector<Value> const& args) -> Value {
+          auto obj = args[0].v_obj;
+
+          switch (args[0].kind) {
+            case TYPE_String:
+              return Value::from_int(
+                  ((ObjString*)obj)->get_value().length());
+
+            case TYPE_Vector:
+              return Value::from_int(((ObjVector*)obj)->size());
+          }
+
+          return Value::from_int(
+              ((ObjDict*)obj)->size());
+        },
+        .get_result_type =
+            [](std::vector<TypeInfo> const& arg_types)
+            -> std::optional<TypeInfo> {
+          switch (arg_types[0].kind) {
+            case TYPE_String:
+            case TYPE_Vector:
+            case TYPE_Dict:
+              return TYPE_Int;
+          }
+
+          return std::nullopt;
+        },
+        .arg_passing = BuiltinFunc::ARG_Borrow,
+        .is_pure = true},
+
+    // contains
+    BuiltinFunc{
+        .name = "contains",
+        .is_template = true,
+        .result_type = TYPE_Bool,
+        .arg_types = {TypeInfo(TYPE_Dict,
+                               {TYPE_Template, TYPE_Template}),
+                      TYPE_Template},
+        .impl = [](std::vector<Value> const& args) -> Value {
+          return Value::from_bool(
+              ((ObjDict*)args[0].v_obj)->find(args[1]) !=
+              nullptr);
+        },
+        .get_result_type =
+            [](std::vector<TypeInfo> const& arg_types)
+            -> std::optional<TypeInfo> {
+          if (!is_dict_key(arg_types))
+            return std::nullopt;
+
+          return TYPE_Bool;
+        },
+        .arg_passing = BuiltinFunc::ARG_Borrow,
+        .is_pure = true},
+
+    // remove
+    //  呼び出し元の辞書から削除する
+    BuiltinFunc{
+        .name = "remove",
+        .is_template = true,
+        .result_type = TYPE_Bool,
+        .arg_types = {TypeInfo(TYPE_Dict,
+                               {TYPE_Template, TYPE_Template}),
+                      TYPE_Template},
+        .impl =
+            [](std::vector<Value> const& args) -> Value {
+          return Value::from_bool(
+              ((ObjDict*)args[0].v_obj)->remove(args[1]));
+        },
+        .get_result_type =
+            [](std::vector<TypeInfo> const& arg_types)
+            -> std::optional<TypeInfo> {
+          if (!is_dict_key(arg_types))
+            return std::nullopt;
+
+          return TYPE_Bool;
+        },
+        .arg_passing = BuiltinFunc::ARG_Ref},
+
+    // keys
+    BuiltinFunc{
+        .name = "keys",
+        .is_template = true,
+        .result_type = TypeInfo(TYPE_Vector, {TYPE_Template}),
+        .arg_types = {TypeInfo(TYPE_Dict,
+                               {TYPE_Template, TYPE_Template})},
+        .impl =
+            [](std::vector<Value> const& args) -> Value {
+          return dict_to_vector(args[0], 0);
+        },
+        .get_result_type =
+            [](std::vector<TypeInfo> const& arg_types)
+            -> std::optional<TypeInfo> {
+          return TypeInfo(TYPE_Vector,
+                          {arg_types[0].type_params[0]});
+        },
+        .arg_passing = BuiltinFunc::ARG_Borrow,
+        .is_pure = true},
+
+    // values
+    BuiltinFunc{
+        .name = "values",
+        .is_template = true,
+        .result_type = TypeInfo(TYPE_Vector, {TYPE_Template}),
+        .arg_types = {TypeInfo(TYPE_Dict,
+                               {TYPE_Template, TYPE_Template})},
+        .impl =
+            [](std::vector<Value> const& args) -> Value {
+          return dict_to_vector(args[0], 1);
+        },
+        .get_result_type =
+            [](std::vector<TypeInfo> const& arg_types)
+            -> std::optional<TypeInfo> {
+          return TypeInfo(TYPE_Vector,
+                          {arg_types[0].type_params[1]});
+        },
+        .arg_passing = BuiltinFunc::ARG_Borrow,
+        .is_pure = true},
+
+    // get_or
+    //  キーがなければ 3 番目の引数を返す
+    BuiltinFunc{
+        .name = "get_or",
+        .is_template = true,
+        .result_type = TYPE_Template,
+        .arg_types = {TypeInfo(TYPE_Dict,
+                               {TYPE_Template, TYPE_Template}),
+                      TYPE_Template, TYPE_Template},
+        .impl =
+            [](std::vector<Value> const& args) -> Value {
+          auto item = ((ObjDict*)args[0].v_obj)->find(args[1]);
+
+          if (!item)
+            return args[2].clone();
+
+          return item->value.clone();
+        },
+        .get_result_type =
+            [](std::vector<TypeInfo> const& arg_types)
+            -> std::optional<TypeInfo> {
+          auto const& value_type = arg_types[0].type_params[1];
+
+          if (!is_dict_key(arg_types) ||
+              !value_type.equals(arg_types[2]))
+            return std::nullopt;
+
+          return value_type;
+        },
+        .arg_passing = BuiltinFunc::ARG_Borrow,
+        .is_pure = true},
+
     // to_string
     BuiltinFunc{
         .name = "to_string",
         .is_template = true,
         .result_type = TYPE_String,
         .arg_types = {TYPE_Template},
-        .impl = [](std::vector<Object*> const& args) -> Object* {
+        .impl = [](std::vector<Value> const& args) -> Value {
           return new ObjString(
-              Utils::String::to_wstr(args[0]->to_string()));
-        }},
+              Utils::String::to_wstr(args[0].to_string()));
+        },
+        .is_pure = true},
 
     // type
     BuiltinFunc{
@@ -98,9 +549,142 @@ static std::vector<BuiltinFunc> const _builtin_functions{
         .is_template = true,
         .result_type = TYPE_String,
         .arg_types = {TYPE_Template},
-        .impl = [](std::vector<Object*> const& args) -> Object* {
-          return new ObjString(
-              Utils::String::to_wstr(args[0]->type.to_string()));
+        .impl = [](std::vector<Value> const& args) -> Value {
+          return new ObjString(Utils::String::to_wstr(
+              args[0].get_type().to_string()));
+        },
+        .is_pure = true},
+
+    //
+    // 数値ベクタ
+    elementwise("vadd", Kernels::OP_Add),
+    elementwise("vsub", Kernels::OP_Sub),
+    elementwise("vmul", Kernels::OP_Mul),
+    elementwise("vdiv", Kernels::OP_Div),
+
+    reduction(
+        "sum",
+        [](std::vector<Value> const& args) -> Value {
+          return dispatch_numeric(args[0], sum_impl, args[0]);
+        },
+        element_type),
+
+    reduction(
+        "mean",
+        [](std::vector<Value> const& args) -> Value {
+          return dispatch_numeric(args[0], mean_impl, args[0]);
+        },
+        [](TypeKind) -> TypeInfo { return TYPE_Float; },
+        false),
+
+    reduction(
+        "min",
+        [](std::vector<Value> const& args) -> Value {
+          return dispatch_numeric(args[0], minmax_impl, args[0],
+                                  false);
+        },
+        element_type, false),
+
+    reduction(
+        "max",
+        [](std::vector<Value> const& args) -> Value {
+          return dispatch_numeric(args[0], minmax_impl, args[0],
+                                  true);
+        },
+        element_type, false),
+
+    reduction(
+        "cumsum",
+        [](std::vector<Value> const& args) -> Value {
+          return dispatch_numeric(args[0], cumsum_impl, args[0]);
+        },
+        vector_type),
+
+    // dot
+    BuiltinFunc{
+        .name = "dot",
+        .is_template = true,
+        .result_type = TYPE_Template,
+        .arg_types = {TYPE_Template, TYPE_Template},
+        .impl =
+            [](std::vector<Value> const& args) -> Value {
+          return dispatch_numeric(args[0], dot_impl, args[0],
+                                  args[1]);
+        },
+        .get_result_type =
+            [](ArgTypes const& arg_types)
+            -> std::optional<TypeInfo> {
+          auto kind = numeric_element(arg_types[0]);
+
+          if (kind == TYPE_None || !arg_types[1].equals(arg_types[0]))
+            return std::nullopt;
+
+          return TypeInfo(kind);
+        },
+        .arg_passing = BuiltinFunc::ARG_Borrow},
+
+    // clamp(v, lo, hi)
+    BuiltinFunc{
+        .name = "clamp",
+        .is_template = true,
+        .result_type = TYPE_Template,
+        .arg_types = {TYPE_Template, TYPE_Template, TYPE_Template},
+        .impl =
+            [](std::vector<Value> const& args) -> Value {
+          return dispatch_numeric(args[0], clamp_impl, args[0],
+                                  args[1], args[2]);
+        },
+        .get_result_type =
+            [](ArgTypes const& arg_types)
+            -> std::optional<TypeInfo> {
+          auto kind = numeric_element(arg_types[0]);
+
+          if (kind == TYPE_None || !arg_types[1].equals(kind) ||
+              !arg_types[2].equals(kind))
+            return std::nullopt;
+
+          return arg_types[0];
+        },
+        .arg_passing = BuiltinFunc::ARG_Borrow},
+
+    // fill(n, x) -> [x, x, ...]
+    BuiltinFunc{
+        .name = "fill",
+        .is_template = true,
+        .result_type = TYPE_Template,
+        .arg_types = {TYPE_Int, TYPE_Template},
+        .impl =
+            [](std::vector<Value> const& args) -> Value {
+          if (args[1].kind == TYPE_Float)
+            return fill_impl<float>(args[0], args[1]);
+
+          return fill_impl<int64_t>(args[0], args[1]);
+        },
+        .get_result_type =
+            [](ArgTypes const& arg_types)
+            -> std::optional<TypeInfo> {
+          auto kind = arg_types[1].kind;
+
+          if (kind != TYPE_Int && kind != TYPE_Float)
+            return std::nullopt;
+
+          return vector_type(kind);
+        }},
+
+    // iota(n) -> [0, 1, ..., n - 1]
+    BuiltinFunc{
+        .name = "iota",
+        .is_template = false,
+        .result_type = TypeInfo(TYPE_Vector, {TYPE_Int}),
+        .arg_types = {TYPE_Int},
+        .impl = [](std::vector<Value> const& args) -> Value {
+          auto [ret, dst] = new_packed<int64_t>(
+              TypeInfo::intern(vector_type(TYPE_Int)),
+              to_length(args[0]));
+
+          std::iota(dst, dst + ret->size(), 0);
+
+          return ret;
         }},
 
     // exit
@@ -109,8 +693,8 @@ static std::vector<BuiltinFunc> const _builtin_functions{
         .is_template = false,
         .result_type = TYPE_None,
         .arg_types = {TYPE_Int},
-        .impl = [](std::vector<Object*> const& args) -> Object* {
-          std::exit((int)((ObjLong*)args[0])->value);
+        .impl = [](std::vector<Value> const& args) -> Value {
+          std::exit((int)args[0].v_int);
         }},
 
 };
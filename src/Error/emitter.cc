@@ -1,4 +1,5 @@
 #include <iostream>
+#include <sstream>
 #include <cassert>
 
 #include "Utils.h"
@@ -11,8 +12,6 @@
 
 Error& Error::emit(ErrorLevel level)
 {
-  auto line_num = this->_loc._line_num;
-
   // レベルによって最初の表示を変える
   switch (level) {
       // エラー
@@ -34,16 +33,7 @@ Error& Error::emit(ErrorLevel level)
       break;
   }
 
-  // エラーが起きたファイルと行番号
-  std::cerr << std::endl
-            << COL_GREEN "    --> " << _RGB(0, 255, 255)
-            << this->_pContext->get_path() << ":" << line_num
-            << COL_DEFAULT << std::endl;
-
-  // エラーが起きた行
-  this->show_error_lines();
-
-  std::cerr << std::endl << std::endl;
+  std::cerr << this->get_location();
 
   if (level == EL_Error) {
     _count++;
@@ -77,7 +67,25 @@ std::pair<Token const*, Token const*> Error::get_token_range()
   return {begin, end};
 }
 
-void Error::show_error_lines()
+std::string Error::get_location() const
+{
+  std::ostringstream os;
+
+  // エラーが起きたファイルと行番号
+  os << std::endl
+     << COL_GREEN "    --> " << _RGB(0, 255, 255)
+     << this->_pContext->get_path() << ":"
+     << this->_loc._line_num << COL_DEFAULT << std::endl;
+
+  // エラーが起きた行
+  this->show_error_lines(os);
+
+  os << std::endl << std::endl;
+
+  return os.str();
+}
+
+void Error::show_error_lines(std::ostream& os) const
 {
   auto [tbegin, tend] = this->get_token_range();
 
@@ -107,25 +115,24 @@ void Error::show_error_lines()
     lines.rbegin()->insert(0, "\033[4m");
   }
 
-  std::cerr << "     |" << std::endl;
+  os << "     |" << std::endl;
 
   for (auto line_num = this->_loc._line_num;
        auto&& line : lines) {
-    std::cerr << COL_DEFAULT
-              << Utils::format("%4d | ", line_num++) << line
-              << std::endl;
+    os << COL_DEFAULT << Utils::format("%4d | ", line_num++)
+       << line << std::endl;
   }
 
-  std::cerr << "     | ";
+  os << "     | ";
 
   if (lines.size() == 1) {
-    std::cerr << std::string(tbegin->src_loc.position -
-                                 src_data._lines[begin].begin,
-                             ' ')
-              << std::string(std::max<size_t>(
-                                 tend->src_loc.get_end_pos() -
-                                     tbegin->src_loc.position,
-                                 1),
-                             '^');
+    os << std::string(tbegin->src_loc.position -
+                          src_data._lines[begin].begin,
+                      ' ')
+       << std::string(std::max<size_t>(
+                          tend->src_loc.get_end_pos() -
+                              tbegin->src_loc.position,
+                          1),
+                      '^');
   }
 }
@@ -0,0 +1,770 @@
+//
+// 構文木をクロージャに変換して実行する (-engine=closure)
+//  子ノードのクロージャと、Sema で決まった型・スロットを
+//  変換するときに束縛しておき、実行中は kind で分岐しない
+//  (結果は evaluate() と同じになるようにする)
+//
+
+#include <cassert>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Arith.h"
+#include "Object.h"
+#include "BuiltinFunc.h"
+
+#include "Error.h"
+#include "Sema.h"
+#include "Operators.h"
+#include "Evaluator.h"
+#include "JIT.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+extern bool _gc_stopped;
+
+using Closure = Evaluator::Closure;
+
+//
+// 範囲のステップ (なければ 1)
+static int64_t eval_step(Closure const& step, AST::Range* ast)
+{
+  if (!step)
+    return 1;
+
+  auto ret = step().v_int;
+
+  if (ret == 0)
+    Error(ast->step, "range step must not be zero").emit().exit();
+
+  return ret;
+}
+
+//
+// int どうしの二項演算
+template <class F>
+static Closure int_op(Closure left, Closure right, F op)
+{
+  return [left, right, op] {
+    auto a = left().v_int;
+    auto b = right().v_int;
+
+    return Value::from_int(op(a, b));
+  };
+}
+
+Value Evaluator::evaluate_compiled(AST::Scope* root)
+{
+  return this->compile(root)();
+}
+
+Closure Evaluator::compile(AST::Base* _ast)
+{
+  if (!_ast)
+    return [] { return Value(); };
+
+  switch (_ast->kind) {
+    case AST_None:
+    case AST_Function:
+    case AST_Struct:
+      return [] { return Value(); };
+
+    case AST_True:
+    case AST_False: {
+      auto value = Value::from_bool(_ast->kind == AST_True);
+
+      return [value] { return value; };
+    }
+
+    case AST_UnaryMinus: {
+      auto expr = this->compile(((AST::UnaryOp*)_ast)->expr);
+
+      return [expr] {
+        auto obj = expr();
+
+        if (obj.kind == TYPE_Float)
+          obj.v_float = -obj.v_float;
+        else
+          obj.v_int = Arith::neg(obj.v_int);
+
+        return obj;
+      };
+    }
+
+    case AST_UnaryPlus:
+      return this->compile(((AST::UnaryOp*)_ast)->expr);
+
+    case AST_Cast: {
+      astdef(Cast);
+
+      auto expr = this->compile(ast->expr);
+      auto kind = Sema::value_type_cache[ast->cast_to].kind;
+
+      return [expr, kind] {
+        return Evaluator::cast_value(expr(), kind);
+      };
+    }
+
+    //
+    // 即値は変換するときに作っておく
+    case AST_Value: {
+      auto value = this->create_object((AST::Value*)_ast);
+
+      return [value] { return value; };
+    }
+
+    case AST_Vector: {
+      astdef(Vector);
+
+      auto type = TypeInfo::intern(Sema::value_type_cache[ast]);
+
+      std::vector<Closure> elements;
+
+      for (auto&& e : ast->elements)
+        elements.emplace_back(this->compile(e));
+
+      return [type, elements]() -> Value {
+        auto ret = new ObjVector(type);
+
+        ret->no_delete = true;
+
+        for (auto&& e : elements)
+          ret->append(e());
+
+        ret->no_delete = false;
+
+        return ret;
+      };
+    }
+
+    case AST_Dict: {
+      astdef(Dict);
+
+      auto type = TypeInfo::intern(Sema::value_type_cache[ast]);
+
+      std::vector<std::pair<Closure, Closure>> elements;
+
+      for (auto&& elem : ast->elements) {
+        elements.emplace_back(this->compile(elem.key),
+                              this->compile(elem.value));
+      }
+
+      return [type, elements]() -> Value {
+        auto ret = new ObjDict();
+
+        ret->type = type;
+        ret->no_delete = true;
+
+        for (auto&& [key, value] : elements) {
+          auto k = key();
+
+          ret->append(k, value());
+        }
+
+        ret->no_delete = false;
+
+        return ret;
+      };
+    }
+
+    case AST_Range: {
+      astdef(Range);
+
+      auto begin = this->compile(ast->begin);
+      auto end = this->compile(ast->end);
+      auto step = ast->step ? this->compile(ast->step) : Closure();
+
+      return [ast, begin, end, step]() -> Value {
+        auto b = begin().v_int;
+        auto e = end().v_int;
+
+        return new ObjRange(b, e, eval_step(step, ast));
+      };
+    }
+
+    //
+    // 変数
+    //  スロットは Sema で決まっている
+    case AST_Variable: {
+      astdef(Variable);
+
+      auto slot = ast->slot;
+
+      if (ast->is_global)
+        return [this, slot] { return this->stack[slot].clone(); };
+
+      return [this, slot] {
+        return this->stack[this->frame_base + slot].clone();
+      };
+    }
+
+    case AST_IndexRef:
+      return this->compile_index((AST::IndexRef*)_ast);
+
+    case AST_CallFunc:
+      return this->compile_call((AST::CallFunc*)_ast);
+
+    case AST_Expr:
+      return this->compile_expr((AST::Expr*)_ast);
+
+    case AST_Assign: {
+      astdef(Assign);
+
+      auto expr = this->compile(ast->expr);
+
+      if (ast->dest->kind != AST_Variable) {
+        return [this, ast, expr] {
+          return this->assign(ast, expr());
+        };
+      }
+
+      //
+      // 変数への代入
+      //  代入先を評価しないので、一時ルートに入れなくてよい
+      auto var = (AST::Variable*)ast->dest;
+
+      return [this, var, expr] {
+        auto value = expr();
+        auto& dest = this->get_var(var);
+
+        value.inc_ref();
+        dest.dec_ref();
+
+        return dest = value;
+      };
+    }
+
+    case AST_Compare: {
+      astdef(Compare);
+
+      auto first = this->compile(ast->first);
+
+      std::vector<std::pair<Operators::CompareKernel, Closure>>
+          elements;
+
+      for (auto&& elem : ast->elements)
+        elements.emplace_back(elem.kernel, this->compile(elem.ast));
+
+      if (elements.size() == 1) {
+        auto [kernel, second] = elements[0];
+
+        return [first, kernel, second] {
+          auto a = first();
+          auto b = second();
+
+          return Value::from_bool(kernel(a, b));
+        };
+      }
+
+      return [first, elements] {
+        auto obj = first();
+
+        for (auto&& [kernel, elem] : elements) {
+          auto tmp = elem();
+
+          if (!kernel(obj, tmp))
+            return Value::from_bool(false);
+
+          obj = tmp;
+        }
+
+        return Value::from_bool(true);
+      };
+    }
+
+    case AST_Scope:
+      return this->compile_scope((AST::Scope*)_ast);
+
+    case AST_Let: {
+      auto ast = (AST::VariableDeclaration*)_ast;
+
+      auto slot = ast->slot;
+      Closure init;
+
+      if (ast->init) {
+        init = this->compile(ast->init);
+      }
+      else {
+        init = [this, type = Sema::value_type_cache[ast->type]] {
+          return this->default_constructor(type);
+        };
+      }
+
+      return [this, slot, init] {
+        auto obj = init();
+
+        obj.inc_ref();
+
+        this->stack[this->frame_base + slot] = obj;
+
+        return Value();
+      };
+    }
+
+    case AST_If: {
+      astdef(If);
+
+      auto cond = this->compile(ast->condition);
+      auto if_true = this->compile(ast->if_true);
+      auto if_false = this->compile(ast->if_false);
+
+      return [cond, if_true, if_false] {
+        if (cond().v_bool)
+          return if_true();
+
+        return if_false();
+      };
+    }
+
+    case AST_For:
+      return this->compile_for((AST::For*)_ast);
+
+    case AST_Loop: {
+      auto code = this->compile(((AST::Loop*)_ast)->code);
+
+      return [this, code] {
+        auto& loop = this->loop_stack.emplace_front();
+
+        while (true) {
+          code();
+
+          if (loop.is_breaked || this->is_returned())
+            break;
+
+          loop.is_continued = false;
+        }
+
+        this->loop_stack.pop_front();
+
+        return Value();
+      };
+    }
+
+    case AST_While: {
+      astdef(While);
+
+      auto cond = this->compile(ast->cond);
+      auto code = this->compile(ast->code);
+
+      return [this, cond, code] {
+        auto& loop = this->loop_stack.emplace_front();
+
+        while (cond().v_bool) {
+          code();
+
+          if (loop.is_breaked || this->is_returned())
+            break;
+
+          loop.is_continued = false;
+        }
+
+        this->loop_stack.pop_front();
+
+        return Value();
+      };
+    }
+
+    case AST_DoWhile: {
+      astdef(DoWhile);
+
+      auto cond = this->compile(ast->cond);
+      auto code = this->compile(ast->code);
+
+      return [this, cond, code] {
+        auto& loop = this->loop_stack.emplace_front();
+
+        do {
+          code();
+
+          if (loop.is_breaked || this->is_returned())
+            break;
+
+          loop.is_continued = false;
+        } while (cond().v_bool);
+
+        this->loop_stack.pop_front();
+
+        return Value();
+      };
+    }
+
+    case AST_Return: {
+      astdef(Return);
+
+      auto expr = ast->expr ? this->compile(ast->expr) : Closure();
+
+      return [this, expr] {
+        auto& fs = this->get_current_func_stack();
+
+        if (expr) {
+          auto _flag_b = _gc_stopped;
+
+          _gc_stopped = true;
+
+          fs.result = expr();
+
+          _gc_stopped = _flag_b;
+        }
+        else
+          fs.result = {};
+
+        fs.is_returned = true;
+
+        return Value();
+      };
+    }
+
+    case AST_Break:
+      return [this] {
+        this->get_cur_loop()->is_breaked = true;
+        return Value();
+      };
+
+    case AST_Continue:
+      return [this] {
+        this->get_cur_loop()->is_continued = true;
+        return Value();
+      };
+
+    default:
+      break;
+  }
+
+  //
+  // MemberAccess, TypeConstructor, Switch などは
+  // そのまま評価する
+  return [this, _ast] { return this->evaluate(_ast); };
+}
+
+Closure Evaluator::compile_scope(AST::Scope* ast)
+{
+  if (ast->list.empty())
+    return [] { return Value(); };
+
+  std::vector<Closure> list;
+
+  for (auto&& item : ast->list)
+    list.emplace_back(this->compile(item));
+
+  return [this, ast, list] {
+    // 関数またはトップレベルのスコープ
+    if (ast->frame_size != 0)
+      this->frame_end = this->frame_base + ast->frame_size;
+
+    auto gc_mark = GarbageCollector::get_mark();
+    auto last = list.size() - 1;
+
+    Value obj{};
+
+    for (size_t i = 0; i < last; i++) {
+      list[i]();
+
+      if (auto L = this->get_cur_loop();
+          L && (L->is_breaked || L->is_continued))
+        goto _end;
+
+      if (this->is_returned())
+        goto _end;
+    }
+
+    obj = list[last]();
+
+  _end:
+    this->leave_scope(ast, gc_mark, obj);
+
+    return obj;
+  };
+}
+
+Closure Evaluator::compile_expr(AST::Expr* ast)
+{
+  auto first = this->compile(ast->first);
+
+  //
+  // int だけの式は、型を調べずに計算する
+  auto is_int =
+      Sema::value_type_cache[ast->first].kind == TYPE_Int;
+
+  for (auto&& elem : ast->elements) {
+    is_int = is_int && elem.kind != AST::EX_And &&
+             elem.kind != AST::EX_Or &&
+             Sema::value_type_cache[elem.ast].kind == TYPE_Int;
+  }
+
+  if (is_int) {
+    auto ret = first;
+
+    for (auto&& elem : ast->elements) {
+      auto right = this->compile(elem.ast);
+      auto op = &elem.op;
+
+      switch (elem.kind) {
+        case AST::EX_Add:
+          ret = int_op(ret, right, [](int64_t a, int64_t b) {
+            return Arith::add(a, b);
+          });
+          break;
+
+        case AST::EX_Sub:
+          ret = int_op(ret, right, [](int64_t a, int64_t b) {
+            return Arith::sub(a, b);
+          });
+          break;
+
+        case AST::EX_Mul:
+          ret = int_op(ret, right, [](int64_t a, int64_t b) {
+            return Arith::mul(a, b);
+          });
+          break;
+
+        case AST::EX_Div:
+          ret = int_op(ret, right, [op](int64_t a, int64_t b) {
+            if (b == 0)
+              Error(*op, "division by zero").emit().exit();
+
+            return Arith::div(a, b);
+          });
+          break;
+
+        case AST::EX_Mod:
+          ret = int_op(ret, right, [op](int64_t a, int64_t b) {
+            if (b == 0)
+              Error(*op, "division by zero").emit().exit();
+
+            return Arith::mod(a, b);
+          });
+          break;
+
+        case AST::EX_LShift:
+          ret = int_op(ret, right, [](int64_t a, int64_t b) {
+            return Arith::shl(a, b);
+          });
+          break;
+
+        case AST::EX_RShift:
+          ret = int_op(ret, right, [](int64_t a, int64_t b) {
+            return Arith::shr(a, b);
+          });
+          break;
+
+        case AST::EX_BitAND:
+          ret = int_op(ret, right, std::bit_and<int64_t>());
+          break;
+
+        case AST::EX_BitXOR:
+          ret = int_op(ret, right, std::bit_xor<int64_t>());
+          break;
+
+        case AST::EX_BitOR:
+          ret = int_op(ret, right, std::bit_or<int64_t>());
+          break;
+
+        default:
+          todo_impl;
+      }
+    }
+
+    return ret;
+  }
+
+  std::vector<std::pair<AST::Expr::Element const*, Closure>>
+      elements;
+
+  for (auto&& elem : ast->elements)
+    elements.emplace_back(&elem, this->compile(elem.ast));
+
+  return [first, elements] {
+    auto ret = first().clone();
+
+    if (ret.is_heap())
+      ret.v_obj->no_delete = true;
+
+    for (auto&& [elem, right] : elements) {
+      if (!Operators::is_short_circuit(elem->kind, ret))
+        elem->kernel(ret, right(), elem->op);
+    }
+
+    if (ret.is_heap())
+      ret.v_obj->no_delete = false;
+
+    return ret;
+  };
+}
+
+//
+// 変数のベクタを 1 つの添字で読むときだけ直接読む
+//  それ以外は evaluate() と同じ
+Closure Evaluator::compile_index(AST::IndexRef* ast)
+{
+  if (ast->expr->kind != AST_Variable || ast->indexes.size() != 1 ||
+      Sema::value_type_cache[ast->expr].kind != TYPE_Vector)
+    return [this, ast] { return this->evaluate(ast); };
+
+  auto var = (AST::Variable*)ast->expr;
+  auto index_ast = ast->indexes[0];
+  auto index = this->compile(index_ast);
+  auto check = ast->needs_bounds_check(index_ast);
+
+  return [this, var, index_ast, index, check] {
+    auto i = Evaluator::to_index(index());
+    auto vec = (ObjVector*)this->get_var(var).v_obj;
+
+    if (check && i >= vec->size())
+      Error(index_ast, "index out of range").emit().exit();
+
+    return vec->at(i).clone();
+  };
+}
+
+Closure Evaluator::compile_call(AST::CallFunc* ast)
+{
+  auto passing = ast->is_builtin ? ast->builtin_func->arg_passing
+                                 : BuiltinFunc::ARG_Copy;
+
+  std::vector<Closure> args;
+
+  for (auto&& arg : ast->args) {
+    // 複製せずに渡す
+    if ((passing == BuiltinFunc::ARG_Ref && args.empty()) ||
+        (passing != BuiltinFunc::ARG_Copy &&
+         arg->kind == AST_Variable))
+      args.emplace_back([this, arg] { return this->eval_left(arg); });
+    else
+      args.emplace_back(this->compile(arg));
+  }
+
+  //
+  // 組み込み関数
+  if (ast->is_builtin) {
+    return [this, ast, args] {
+      std::vector<Value> values;
+
+      auto temp_mark = this->temp_roots.size();
+
+      for (auto&& arg : args) {
+        values.emplace_back(arg()).inc_ref();
+        this->temp_roots.emplace_back(values.back());
+      }
+
+      Value result;
+
+      try {
+        result = ast->builtin_func->impl(values);
+      }
+      catch (BuiltinFunc::RuntimeError const& err) {
+        Error(ast, err.message).emit().exit();
+      }
+
+      for (auto&& obj : values)
+        obj.dec_ref();
+
+      this->temp_roots.resize(temp_mark);
+
+      return result;
+    };
+  }
+
+  //
+  // ユーザー定義関数
+  //  引数は一時ルートに積んで、そこからフレームに移す
+  auto func = ast->callee;
+
+  if (this->use_jit) {
+    if (auto jit = JIT::find_function(func); jit) {
+      return [jit, args] {
+        Value values[JIT::MAX_ARGS];
+
+        for (size_t i = 0; i < args.size(); i++)
+          values[i] = args[i]();
+
+        return jit->call(values);
+      };
+    }
+  }
+
+  auto body = &this->compile_function(func);
+
+  return [this, ast, func, body, args] {
+    auto temp_mark = this->temp_roots.size();
+
+    for (auto&& arg : args)
+      this->temp_roots.emplace_back(arg()).inc_ref();
+
+    auto base = this->frame_end;
+
+    this->check_stack(ast, func->code->frame_size);
+
+    auto& cf = this->enter_function(func);
+
+    cf.saved_base = this->frame_base;
+    cf.saved_end = this->frame_end;
+
+    this->frame_base = base;
+    this->frame_end = base + func->code->frame_size;
+
+    auto argc = args.size();
+
+    for (size_t i = 0; i < argc; i++)
+      this->stack[base + i] = this->temp_roots[temp_mark + i];
+
+    auto ret = (*body)();
+
+    auto result = cf.is_returned ? cf.result : ret;
+
+    for (size_t i = 0; i < argc; i++) {
+      this->temp_roots[temp_mark + i].dec_ref();
+      this->stack[base + i] = {};
+    }
+
+    this->temp_roots.resize(temp_mark);
+
+    this->frame_base = cf.saved_base;
+    this->frame_end = cf.saved_end;
+
+    this->leave_function();
+
+    return result;
+  };
+}
+
+Closure const& Evaluator::compile_function(AST::Function* func)
+{
+  // 先に登録しておく (再帰呼び出しはこれを参照する)
+  auto [it, inserted] = this->compiled_functions.try_emplace(func);
+
+  if (inserted)
+    it->second = this->compile(func->code);
+
+  return it->second;
+}
+
+Closure Evaluator::compile_for(AST::For* ast)
+{
+  auto body = this->compile(ast->code);
+
+  if (ast->iterable->kind != AST_Range) {
+    return [this, ast, body] {
+      this->eval_for(ast, body);
+      return Value();
+    };
+  }
+
+  //
+  // a .. b (by c) は範囲を作らずに回す
+  auto range = (AST::Range*)ast->iterable;
+
+  auto begin = this->compile(range->begin);
+  auto end = this->compile(range->end);
+  auto step = range->step ? this->compile(range->step) : Closure();
+
+  return [this, ast, range, body, begin, end, step] {
+    auto b = begin().v_int;
+    auto e = end().v_int;
+
+    this->eval_range_loop(ast, b, e, eval_step(step, range), body);
+
+    return Value();
+  };
+}
@@ -11,20 +11,30 @@
 
 #include "Error.h"
 #include "Sema.h"
+#include "Operators.h"
 #include "Evaluator.h"
 
-Object* Evaluator::default_constructor(
-    TypeInfo const& type, bool construct_member)
+Value Evaluator::default_constructor(TypeInfo const& type,
+                                     bool construct_member)
 {
   switch (type.kind) {
+    case TYPE_None:
+      return {};
+
     case TYPE_Int:
-      return new ObjLong;
+      return Value::from_int(0);
 
     case TYPE_USize:
-      return new ObjUSize;
+      return Value::from_usize(0);
 
     case TYPE_Float:
-      return new ObjFloat;
+      return Value::from_float(0);
+
+    case TYPE_Bool:
+      return Value::from_bool(false);
+
+    case TYPE_Char:
+      return Value::from_char(0);
 
     case TYPE_String:
       return new ObjString;
@@ -32,21 +42,17 @@ Object* Evaluator::default_constructor(
     case TYPE_Dict: {
       auto ret = new ObjDict;
 
-      ret->type = type;
+      ret->type = TypeInfo::intern(type);
 
       return ret;
     }
 
     case TYPE_Vector: {
-      auto ret = new ObjVector;
-
-      ret->type = type;
-
-      return ret;
+      return new ObjVector(TypeInfo::intern(type));
     }
 
     case TYPE_UserDef: {
-      auto ret = new ObjUserType(type);
+      auto ret = new ObjUserType(TypeInfo::intern(type));
 
       if (construct_member) {
         for (auto&& member : type.members) {
@@ -62,192 +68,100 @@ Object* Evaluator::default_constructor(
   panic("u9r043290");
 }
 
+//
+// 演算は Sema で選んだ関数で行う
+//  && と || は、左辺で決まれば右辺を評価しない
 void Evaluator::eval_expr_elem(
-    AST::Expr::Element const& elem, Object* dest)
+    AST::Expr::Element const& elem, Value& dest)
 {
-  auto const& op = elem.op;
-
-  auto right = this->evaluate(elem.ast);
-
-  switch (elem.kind) {
-    case AST::EX_Add: {
-      switch (dest->type.kind) {
-        case TYPE_Int:
-          ((ObjLong*)dest)->value +=
-              ((ObjLong*)right)->value;
-          break;
-
-        case TYPE_String:
-          ((ObjString*)dest)->value +=
-              ((ObjString*)right)->value;
-          break;
-
-        default:
-          todo_impl;
-      }
-      break;
-    }
-
-    case AST::EX_Sub: {
-      switch (dest->type.kind) {
-        case TYPE_Int:
-          ((ObjLong*)dest)->value -=
-              ((ObjLong*)right)->value;
-          break;
-
-        default:
-          todo_impl;
-      }
-      break;
-    }
-
-    case AST::EX_Mul: {
-      switch (dest->type.kind) {
-        case TYPE_Int:
-          ((ObjLong*)dest)->value *=
-              ((ObjLong*)right)->value;
-          break;
-
-        case TYPE_Float:
-          ((ObjFloat*)dest)->value *=
-              ((ObjFloat*)right)->value;
-          break;
-
-        default:
-          todo_impl;
-      }
-      break;
-    }
-
-    case AST::EX_Div: {
-      switch (dest->type.kind) {
-        case TYPE_Int: {
-          auto rval = ((ObjLong*)right)->value;
-
-          if (rval == 0) {
-            Error(op, "division by zero").emit().exit();
-          }
-
-          ((ObjLong*)dest)->value /= rval;
-          break;
-        }
-
-        case TYPE_Float: {
-          auto rval = ((ObjFloat*)right)->value;
-
-          if (rval == 0) {
-            Error(op, "division by zero").emit().exit();
-          }
-
-          ((ObjFloat*)dest)->value /= rval;
-          break;
-        }
+  if (Operators::is_short_circuit(elem.kind, dest))
+    return;
 
-        default:
-          todo_impl;
-      }
-      break;
-    }
-
-    case AST::EX_LShift:
-      ((ObjLong*)dest)->value <<= ((ObjLong*)right)->value;
-      break;
+  elem.kernel(dest, this->evaluate(elem.ast), elem.op);
+}
 
-    case AST::EX_RShift:
-      ((ObjLong*)dest)->value >>= ((ObjLong*)right)->value;
-      break;
+/**
+ * @brief スカラー値を別の型に変換する
+ *
+ * @param value
+ * @param kind 変換先の型
+ * @return Value
+ */
+Value Evaluator::cast_value(Value const& value, TypeKind kind)
+{
+  if (value.kind == kind)
+    return value;
 
-    case AST::EX_BitAND:
-      ((ObjLong*)dest)->value &= ((ObjLong*)right)->value;
-      break;
+  auto conv = [kind](auto x) -> Value {
+    switch (kind) {
+      case TYPE_Int:
+        return Value::from_int((int64_t)x);
 
-    case AST::EX_BitXOR:
-      ((ObjLong*)dest)->value ^= ((ObjLong*)right)->value;
-      break;
+      case TYPE_USize:
+        return Value::from_usize((size_t)x);
 
-    case AST::EX_BitOR:
-      ((ObjLong*)dest)->value |= ((ObjLong*)right)->value;
-      break;
+      case TYPE_Float:
+        return Value::from_float((float)x);
 
-    case AST::EX_And: {
-      ((ObjBool*)dest)->value = ((ObjBool*)dest)->value &&
-                                ((ObjBool*)right)->value;
-      break;
-    }
+      case TYPE_Bool:
+        return Value::from_bool((bool)x);
 
-    case AST::EX_Or: {
-      ((ObjBool*)dest)->value = ((ObjBool*)dest)->value ||
-                                ((ObjBool*)right)->value;
-      break;
+      case TYPE_Char:
+        return Value::from_char((wchar_t)x);
     }
 
-    default:
-      todo_impl;
-  }
-}
-
-bool Evaluator::compute_compare(AST::CmpKind kind,
-                                Object* left, Object* right)
-{
-  float a = left->type.kind == TYPE_Int
-                ? ((ObjLong*)left)->value
-                : ((ObjFloat*)left)->value;
-
-  float b = right->type.kind == TYPE_Int
-                ? ((ObjLong*)right)->value
-                : ((ObjFloat*)right)->value;
+    todo_impl;
+  };
 
-  switch (kind) {
-    case AST::CMP_LeftBigger:
-      return a > b;
-
-    case AST::CMP_RightBigger:
-      return a < b;
+  switch (value.kind) {
+    case TYPE_Int:
+      return conv(value.v_int);
 
-    case AST::CMP_LeftBigOrEqual:
-      return a >= b;
+    case TYPE_USize:
+      return conv(value.v_usize);
 
-    case AST::CMP_RightBigOrEqual:
-      return a <= b;
+    case TYPE_Float:
+      return conv(value.v_float);
 
-    case AST::CMP_Equal:
-      return a == b;
+    case TYPE_Bool:
+      return conv(value.v_bool);
 
-    case AST::CMP_NotEqual:
-      return a != b;
+    case TYPE_Char:
+      return conv(value.v_char);
   }
 
-  return false;
+  todo_impl;
 }
 
 /**
  * @brief 即値・リテラルの AST からオブジェクトを作成する
  *
  * @note すでに作成済みのものであれば、既存のものを返す
+ *  (AST::Value::object_index に位置を覚えておく)
  *
  * @param ast
- * @return 作成されたオブジェクト (Object*)
+ * @return 作成された値 (Value)
  */
-Object* Evaluator::create_object(AST::Value* ast)
+Value Evaluator::create_object(AST::Value* ast)
 {
-  auto type = Sema::value_type_cache[ast];
+  if (ast->object_index < this->immediate_objects.size())
+    return this->immediate_objects[ast->object_index];
 
-  auto& obj = this->immediate_objects[ast];
+  auto type = Sema::value_type_cache[ast];
 
-  if (obj)
-    return obj;
+  Value obj;
 
   switch (type.kind) {
     case TYPE_Int:
-      obj = new ObjLong(std::stoi(ast->token.str.data()));
+      obj = Value::from_int(std::stoll(ast->token.str.data()));
       break;
 
     case TYPE_Float:
-      obj = new ObjFloat(std::stof(ast->token.str.data()));
+      obj = Value::from_float(std::stof(ast->token.str.data()));
       break;
 
     case TYPE_USize:
-      obj = new ObjUSize(std::stoi(ast->token.str.data()));
+      obj = Value::from_usize(std::stoull(ast->token.str.data()));
       break;
 
     case TYPE_String: {
@@ -260,6 +174,9 @@ Object* Evaluator::create_object(AST::Value* ast)
 
       obj = new ObjString(std::move(ws));
 
+      // immediate_objects が所有する
+      obj.inc_ref();
+
       break;
     }
 
@@ -269,9 +186,8 @@ Object* Evaluator::create_object(AST::Value* ast)
       todo_impl;
   }
 
-  assert(obj != nullptr);
-
-  obj->no_delete = 1;
+  ast->object_index = this->immediate_objects.size();
+  this->immediate_objects.emplace_back(obj);
 
   return obj;
 }
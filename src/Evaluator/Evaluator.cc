@@ -6,19 +6,34 @@
 #include "debug/alert.h"
 
 #include "AST.h"
+#include "Arith.h"
 #include "Object.h"
 #include "BuiltinFunc.h"
 
 #include "Error.h"
 #include "Sema.h"
+#include "Application.h"
 #include "Evaluator.h"
+#include "JIT.h"
 
 #define astdef(T) auto ast = (AST::T*)_ast
 
-std::map<Object*, bool> Evaluator::allocated_objects;
-
 bool _gc_stopped;
 
+size_t Evaluator::to_index(Value const& value)
+{
+  switch (value.kind) {
+    case TYPE_Int:
+      return value.v_int;
+
+    case TYPE_USize:
+      return value.v_usize;
+
+    default:
+      panic("int or usize??aa");
+  }
+}
+
 void Evaluator::gc_stop()
 {
   _gc_stopped = false;
@@ -29,59 +44,89 @@ void Evaluator::gc_resume()
   _gc_stopped = true;
 }
 
-Object::Object(TypeInfo type)
-    : type(type),
-      ref_count(0),
-      no_delete(false)
+void Evaluator::release_slots(size_t begin, size_t end)
 {
-  Evaluator::allocated_objects[this] = 1;
-}
+  for (auto i = begin; i < end; i++) {
+    auto& var = this->stack[i];
 
-Object::~Object()
-{
+    var.dec_ref();
+    var = {};
+  }
 }
 
-void Evaluator::delete_object(Object* p)
+void Evaluator::collect_garbage()
 {
-  if (_gc_stopped)
-    return;
+  if (GarbageCollector::is_roots_needed()) {
+    for (size_t i = 0; i < this->frame_end; i++)
+      GarbageCollector::mark_root(this->stack[i]);
 
-  if (this->return_binds[p] != nullptr)
-    return;
+    for (auto&& value : this->immediate_objects)
+      GarbageCollector::mark_root(value);
 
-  if (allocated_objects[p] == 0)
-    return;
+    for (auto&& fs : this->call_stack)
+      GarbageCollector::mark_root(fs.result);
 
-  if (p->ref_count == 0 && !p->no_delete) {
-    allocated_objects[p] = 0;
-    delete p;
+    for (auto&& value : this->temp_roots)
+      GarbageCollector::mark_root(value);
   }
+
+  GarbageCollector::execute();
 }
 
-void Evaluator::clean_obj()
+void Evaluator::leave_scope(AST::Scope* ast, size_t gc_mark,
+                            Value const& result)
 {
-  for (auto&& [p, b] : allocated_objects) {
-    delete_object(p);
+  this->release_slots(this->frame_base + ast->slot_begin,
+                      this->frame_base + ast->slot_end);
+
+  if (_gc_stopped)
+    return;
+
+  Object* keep_result = nullptr;
+
+  // return 文の値は呼び出し元まで残す
+  if (!this->call_stack.empty()) {
+    if (auto& fs = this->get_current_func_stack();
+        fs.is_returned && fs.result.is_heap())
+      keep_result = fs.result.v_obj;
   }
+
+  GarbageCollector::collect(
+      gc_mark,
+      {result.is_heap() ? result.v_obj : nullptr, keep_result});
+
+  // 結果は ZCT に残っているのでルートになる
+  if (GarbageCollector::is_requested())
+    this->collect_garbage();
 }
 
 Evaluator::Evaluator()
+    : stack(STACK_SIZE),
+      frame_base(0),
+      frame_end(0),
+      stack_limit(Utils::native_stack_limit()),
+      use_jit(Application::get_instance()->get_options().jit)
 {
 }
 
 Evaluator::~Evaluator()
 {
-  for (auto&& [x, y] : this->immediate_objects) {
-    delete y;
+  for (auto&& obj : this->immediate_objects) {
+    if (obj.is_heap())
+      delete obj.v_obj;
   }
-
-  allocated_objects.clear();
 }
 
-Object* Evaluator::evaluate(AST::Base* _ast)
+Value Evaluator::evaluate(AST::Base* _ast)
 {
   if (!_ast)
-    return new ObjNone();
+    return {};
+
+  if (_ast->quick == QUICK_None)
+    this->quicken(_ast);
+
+  if (_ast->quick != QUICK_Generic)
+    return this->eval_quick(_ast);
 
   switch (_ast->kind) {
     case AST_None:
@@ -90,24 +135,23 @@ Object* Evaluator::evaluate(AST::Base* _ast)
       break;
 
     case AST_True:
-      return new ObjBool(true);
+      return Value::from_bool(true);
 
     case AST_False:
-      return new ObjBool(false);
+      return Value::from_bool(false);
 
     case AST_UnaryMinus: {
       astdef(UnaryOp);
 
-      auto obj = this->evaluate(ast->expr)->clone();
+      auto obj = this->evaluate(ast->expr);
 
-      switch (obj->type.kind) {
+      switch (obj.kind) {
         case TYPE_Int:
-          ((ObjLong*)obj)->value = -((ObjLong*)obj)->value;
+          obj.v_int = Arith::neg(obj.v_int);
           break;
 
         case TYPE_Float:
-          ((ObjFloat*)obj)->value =
-              -((ObjFloat*)obj)->value;
+          obj.v_float = -obj.v_float;
           break;
 
         default:
@@ -127,20 +171,8 @@ Object* Evaluator::evaluate(AST::Base* _ast)
       auto const& cast_to =
           Sema::value_type_cache[ast->cast_to];
 
-      auto obj = this->evaluate(ast->expr);
-
-      switch (cast_to.kind) {
-        case TYPE_Int: {
-          switch (obj->type.kind) {
-            case TYPE_Float:
-              return new ObjLong(
-                  (float)((ObjFloat*)obj)->value);
-          }
-          break;
-        }
-      }
-
-      todo_impl;
+      return Evaluator::cast_value(this->evaluate(ast->expr),
+                                   cast_to.kind);
     }
 
     //
@@ -154,36 +186,51 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_Vector: {
       astdef(Vector);
 
-      auto ret = new ObjVector();
+      auto ret = new ObjVector(
+          TypeInfo::intern(Sema::value_type_cache[ast]));
 
-      ret->type = Sema::value_type_cache[ast];
+      ret->no_delete = true;
 
       for (auto&& e : ast->elements) {
         ret->append(this->evaluate(e));
       }
 
+      ret->no_delete = false;
+
       return ret;
     }
 
     //
     // 変数
     case AST_Variable:
-      return this->eval_left(_ast)->clone();
+      return this->eval_left(_ast).clone();
 
     case AST_IndexRef: {
       astdef(IndexRef);
 
+      // 変数は複製せずにたどる
+      //  (複製が残っていると、次の書き込みで中身全体を複製してしまう)
+      if (ast->expr->kind == AST_Variable) {
+        return this->eval_index(
+            this->get_var((AST::Variable*)ast->expr), ast);
+      }
+
       auto obj = this->evaluate(ast->expr);
 
-      return this->eval_index_ref(obj, ast);
+      return this->eval_index(obj, ast);
     }
 
     case AST_MemberAccess: {
       astdef(IndexRef);
 
+      if (ast->expr->kind == AST_Variable) {
+        return this->eval_member(
+            this->get_var((AST::Variable*)ast->expr), ast);
+      }
+
       auto obj = this->evaluate(ast->expr);
 
-      return this->eval_member_access(obj, ast);
+      return this->eval_member(obj, ast);
     }
 
     //
@@ -192,13 +239,19 @@ Object* Evaluator::evaluate(AST::Base* _ast)
       astdef(Dict);
 
       auto ret = new ObjDict();
-      ret->type = Sema::value_type_cache[_ast];
+
+      ret->type =
+          TypeInfo::intern(Sema::value_type_cache[_ast]);
+      ret->no_delete = true;
 
       for (auto&& elem : ast->elements) {
-        ret->append(this->evaluate(elem.key),
-                    this->evaluate(elem.value));
+        auto key = this->evaluate(elem.key);
+
+        ret->append(key, this->evaluate(elem.value));
       }
 
+      ret->no_delete = false;
+
       return ret;
     }
 
@@ -210,8 +263,8 @@ Object* Evaluator::evaluate(AST::Base* _ast)
       auto begin = this->evaluate(ast->begin);
       auto end = this->evaluate(ast->end);
 
-      return new ObjRange(((ObjLong*)begin)->value,
-                          ((ObjLong*)end)->value);
+      return new ObjRange(begin.v_int, end.v_int,
+                          this->eval_range_step(ast));
     }
 
     //
@@ -219,58 +272,10 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_CallFunc: {
       auto ast = (AST::CallFunc*)_ast;
 
-      std::vector<Object*> args;
-
-      // 引数
-      for (auto&& arg : ast->args) {
-        args.emplace_back(this->evaluate(arg));
-      }
-
-      // 組み込み関数
-      if (ast->is_builtin) {
-        return ast->builtin_func->impl(args);
-      }
-
-      // ユーザー定義関数
-      auto func = ast->callee;
-
-      // コールスタック作成
-      auto& cf = this->enter_function(func);
-
-      // 引数
-      auto& vst = this->push_vst();
-
-      for (auto&& obj : args) {
-        vst.append_lvar(obj)->ref_count++;
-      }
-
-      // 関数実行
-      auto ret = this->evaluate(func->code);
-
-      // 戻り値を取得
-      auto result = cf.result;
+      if (ast->is_builtin)
+        return this->call_builtin(ast);
 
-      if (!cf.is_returned) {
-        assert(func->code->return_last_expr);
-
-        result = ret;
-      }
-
-      assert(result != nullptr);
-
-      for (auto&& obj : args) {
-        obj->ref_count--;
-      }
-
-      this->pop_vst();
-
-      // コールスタック削除
-      this->leave_function();
-
-      this->return_binds[result] = nullptr;
-
-      // 戻り値を返す
-      return result;
+      return this->call_user_func(ast);
     }
 
     case AST_TypeConstructor: {
@@ -278,13 +283,18 @@ Object* Evaluator::evaluate(AST::Base* _ast)
 
       debug(assert(ast->typeinfo.kind == TYPE_UserDef));
 
-      auto ret = (ObjUserType*)this->default_constructor(
-          ast->typeinfo, false);
+      auto ret = (ObjUserType*)this
+                     ->default_constructor(ast->typeinfo, false)
+                     .v_obj;
+
+      ret->no_delete = true;
 
       for (auto&& elem : ast->elements) {
         ret->add_member(this->evaluate(elem.value));
       }
 
+      ret->no_delete = false;
+
       return ret;
     }
 
@@ -293,15 +303,17 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_Expr: {
       auto x = (AST::Expr*)_ast;
 
-      auto ret = this->evaluate(x->first)->clone();
+      auto ret = this->evaluate(x->first).clone();
 
-      ret->no_delete = true;
+      if (ret.is_heap())
+        ret.v_obj->no_delete = true;
 
       for (auto&& elem : x->elements) {
         this->eval_expr_elem(elem, ret);
       }
 
-      ret->no_delete = false;
+      if (ret.is_heap())
+        ret.v_obj->no_delete = false;
 
       return ret;
     }
@@ -311,14 +323,7 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_Assign: {
       astdef(Assign);
 
-      auto& dest = this->eval_left(ast->dest);
-
-      dest->ref_count--;
-
-      dest = this->evaluate(ast->expr);
-      dest->ref_count++;
-
-      return dest;
+      return this->assign(ast, this->evaluate(ast->expr));
     }
 
     //
@@ -326,21 +331,18 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_Compare: {
       auto x = (AST::Compare*)_ast;
 
-      auto ret = new ObjBool(false);
       auto obj = this->evaluate(x->first);
 
       for (auto&& elem : x->elements) {
         auto tmp = this->evaluate(elem.ast);
 
-        if (Evaluator::compute_compare(elem.kind, obj, tmp))
+        if (elem.kernel(obj, tmp))
           obj = tmp;
         else
-          return ret;
+          return Value::from_bool(false);
       }
 
-      ret->value = true;
-
-      return ret;
+      return Value::from_bool(true);
     }
 
     // スコープ
@@ -350,26 +352,28 @@ Object* Evaluator::evaluate(AST::Base* _ast)
       if (ast->list.empty())
         break;
 
-      auto& vst = this->push_vst();
+      // 関数またはトップレベルのスコープ
+      if (ast->frame_size != 0)
+        this->frame_end = this->frame_base + ast->frame_size;
+
+      // このスコープで参照されなくなったオブジェクトは
+      // ここから後ろに追加される
+      auto gc_mark = GarbageCollector::get_mark();
 
       auto iter = ast->list.begin();
       auto const& last = *ast->list.rbegin();
 
-      Object* obj{};
+      Value obj{};
 
       for (auto&& item : ast->list) {
         if (item == last) {
           obj = this->evaluate(*iter++);
-          this->return_binds[obj] = ast;
           break;
         }
         else {
           this->evaluate(*iter++);
         }
 
-        if (vst.is_skipped)
-          break;
-
         if (auto L = this->get_cur_loop();
             L && (L->is_breaked || L->is_continued))
           break;
@@ -380,26 +384,16 @@ Object* Evaluator::evaluate(AST::Base* _ast)
         }
       }
 
-      for (auto&& obj : vst.lvar_list) {
-        obj->ref_count--;
-
-        this->delete_object(obj);
-      }
+      this->leave_scope(ast, gc_mark, obj);
 
-      this->pop_vst();
-      this->clean_obj();
-
-      if (obj)
-        return obj;
-
-      break;
+      return obj;
     }
 
     // 変数定義
     case AST_Let: {
       auto ast = (AST::VariableDeclaration*)_ast;
 
-      Object* obj{};
+      Value obj;
 
       if (!ast->init) {
         obj = this->default_constructor(
@@ -409,9 +403,9 @@ Object* Evaluator::evaluate(AST::Base* _ast)
         obj = this->evaluate(ast->init);
       }
 
-      obj->ref_count++;
+      obj.inc_ref();
 
-      this->get_vst().append_lvar(obj);
+      this->stack[this->frame_base + ast->slot] = obj;
 
       break;
     }
@@ -426,7 +420,7 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_Break:
     case AST_Continue:
       if (auto res = this->eval_stmt(_ast); res)
-        return res;
+        return *res;
 
       break;
 
@@ -437,10 +431,197 @@ Object* Evaluator::evaluate(AST::Base* _ast)
       todo_impl;
   }
 
-  return new ObjNone;
+  return {};
+}
+
+//
+// 組み込み関数の呼び出し
+Value Evaluator::call_builtin(AST::CallFunc* ast)
+{
+  std::vector<Value> args;
+
+  auto temp_mark = this->temp_roots.size();
+
+  // 引数
+  //  残りの引数を評価している間に削除されないよう、
+  //  参照カウントを増やしておく
+  auto passing = ast->builtin_func->arg_passing;
+
+  for (auto&& arg : ast->args) {
+    // 複製せずに渡す
+    if ((passing == BuiltinFunc::ARG_Ref && args.empty()) ||
+        (passing != BuiltinFunc::ARG_Copy &&
+         arg->kind == AST_Variable))
+      args.emplace_back(this->eval_left(arg)).inc_ref();
+    else
+      args.emplace_back(this->evaluate(arg)).inc_ref();
+
+    this->temp_roots.emplace_back(args.back());
+  }
+
+  Value result;
+
+  try {
+    result = ast->builtin_func->impl(args);
+  }
+  catch (BuiltinFunc::RuntimeError const& err) {
+    Error(ast, err.message).emit().exit();
+  }
+
+  for (auto&& obj : args) {
+    obj.dec_ref();
+  }
+
+  this->temp_roots.resize(temp_mark);
+
+  return result;
+}
+
+//
+// 1 回の呼び出しで使うネイティブのスタックは関数の中身で
+// 変わるので、呼び出した回数ではなく今の位置で調べる
+void Evaluator::check_stack(AST::Base* ast, size_t frame_size)
+{
+  auto sp = (uintptr_t)__builtin_frame_address(0);
+
+  if (this->frame_end + frame_size > STACK_SIZE ||
+      sp < this->stack_limit)
+    Error(ast, "stack overflow").emit().exit();
+}
+
+//
+// ユーザー定義関数の呼び出し
+//  引数は一時ルートに積んで、そこからフレームの先頭に移す
+Value Evaluator::call_user_func(AST::CallFunc* ast)
+{
+  auto func = ast->callee;
+  auto argc = ast->args.size();
+
+  if (this->use_jit) {
+    if (auto jit = JIT::find_function(func); jit)
+      return this->call_jit(ast, jit);
+  }
+
+  auto temp_mark = this->temp_roots.size();
+
+  for (auto&& arg : ast->args)
+    this->temp_roots.emplace_back(this->evaluate(arg)).inc_ref();
+
+  auto base = this->frame_end;
+
+  this->check_stack(ast, func->code->frame_size);
+
+  // コールスタック作成
+  auto& cf = this->enter_function(func);
+
+  cf.saved_base = this->frame_base;
+  cf.saved_end = this->frame_end;
+
+  this->frame_base = base;
+  this->frame_end = base + func->code->frame_size;
+
+  for (size_t i = 0; i < argc; i++)
+    this->stack[base + i] = this->temp_roots[temp_mark + i];
+
+  // 関数実行
+  auto ret = this->evaluate(func->code);
+
+  // 戻り値を取得
+  auto result = cf.result;
+
+  // return しないで終わった void の関数は none を返す
+  if (!cf.is_returned)
+    result = func->code->return_last_expr ? ret : Value{};
+
+  for (size_t i = 0; i < argc; i++) {
+    this->temp_roots[temp_mark + i].dec_ref();
+    this->stack[base + i] = {};
+  }
+
+  this->temp_roots.resize(temp_mark);
+
+  this->frame_base = cf.saved_base;
+  this->frame_end = cf.saved_end;
+
+  // コールスタック削除
+  this->leave_function();
+
+  // 戻り値を返す
+  return result;
 }
 
-Object*& Evaluator::eval_left(AST::Base* _ast)
+//
+// 引数はすべてスカラーなので、スタックに置かずに渡す
+Value Evaluator::call_jit(AST::CallFunc* ast,
+                          JIT::Function const* func)
+{
+  Value args[JIT::MAX_ARGS];
+
+  for (size_t i = 0; i < ast->args.size(); i++)
+    args[i] = this->evaluate(ast->args[i]);
+
+  return func->call(args);
+}
+
+//
+// 評価した値を代入する
+Value Evaluator::assign(AST::Assign* ast, Value value)
+{
+  // 代入先の評価中に削除されないよう、先に増やしておく
+  value.inc_ref();
+  this->temp_roots.emplace_back(value);
+
+  Value* dest;
+
+  if (ast->dest->kind == AST_IndexRef) {
+    auto ref = (AST::IndexRef*)ast->dest;
+    auto last = ref->indexes.back();
+
+    dest = &this->eval_left(ref->expr);
+
+    for (auto&& index_ast : ref->indexes) {
+      if (index_ast == last)
+        break;
+
+      dest = &this->eval_index_step(
+          *dest, index_ast,
+          ref->needs_bounds_check(index_ast));
+    }
+
+    // 詰めて持っているベクタには直接書き込む
+    if (dest->kind == TYPE_Vector &&
+        ((ObjVector*)dest->v_obj)->is_packed()) {
+      auto vec = (ObjVector*)dest->v_obj;
+      auto index = to_index(this->evaluate(last));
+
+      if (ref->needs_bounds_check(last) &&
+          index >= vec->size()) {
+        Error(last, "index out of range").emit().exit();
+      }
+
+      vec->set(index, value);
+
+      this->temp_roots.pop_back();
+
+      return value;
+    }
+
+    dest = &this->eval_index_step(
+        *dest, last, ref->needs_bounds_check(last));
+  }
+  else {
+    dest = &this->eval_left(ast->dest);
+  }
+
+  dest->dec_ref();
+  *dest = value;
+
+  this->temp_roots.pop_back();
+
+  return *dest;
+}
+
+Value& Evaluator::eval_left(AST::Base* _ast)
 {
   switch (_ast->kind) {
     case AST_Variable:
@@ -456,7 +637,7 @@ Object*& Evaluator::eval_left(AST::Base* _ast)
     case AST_MemberAccess: {
       astdef(IndexRef);
 
-      return this->eval_index_ref(
+      return this->eval_member_access(
           this->eval_left(ast->expr), ast);
     }
   }
@@ -464,63 +645,150 @@ Object*& Evaluator::eval_left(AST::Base* _ast)
   throw 1;
 }
 
-Object*& Evaluator::eval_index_ref(Object*& obj,
-                                   AST::IndexRef* ast)
+//
+// 書き込み先
+//  たどるコンテナが中身を共有していれば、ここで複製する
+Value& Evaluator::eval_index_ref(Value& obj,
+                                 AST::IndexRef* ast)
 {
-  Object** ret = &obj;
+  Value* ret = &obj;
 
   for (auto&& index_ast : ast->indexes) {
-    auto obj_index = this->evaluate(index_ast);
+    ret = &this->eval_index_step(
+        *ret, index_ast, ast->needs_bounds_check(index_ast));
+  }
 
-    switch ((*ret)->type.kind) {
-      case TYPE_Vector: {
-        auto& obj_vec = *(ObjVector**)ret;
+  return *ret;
+}
+
+//
+// 要素を一つたどる
+//  (詰めて持っているベクタの要素は参照できないので、
+//   代入では呼ばずに ObjVector::set で書き込む)
+Value& Evaluator::eval_index_step(Value& obj,
+                                  AST::Base* index_ast,
+                                  bool check_bounds)
+{
+  auto obj_index = this->evaluate(index_ast);
 
-        size_t index = 0;
+  switch (obj.kind) {
+    case TYPE_Vector: {
+      auto& elements =
+          ((ObjVector*)obj.v_obj)->get_mut_elements();
 
-        switch (obj_index->type.kind) {
-          case TYPE_Int:
-            index = ((ObjLong*)obj_index)->value;
-            break;
+      size_t index = to_index(obj_index);
 
-          case TYPE_USize:
-            index = ((ObjUSize*)obj_index)->value;
-            break;
+      if (check_bounds && index >= elements.size()) {
+        Error(index_ast, "index out of range").emit().exit();
+      }
 
-          default:
-            panic("int or usize??aa");
-        }
+      return elements[index];
+    }
+
+    case TYPE_Dict: {
+      auto obj_dict = (ObjDict*)obj.v_obj;
+
+      if (auto value = obj_dict->find_mut(obj_index); value)
+        return *value;
+
+      // なければ追加する
+      auto value = this->default_constructor(
+          obj_dict->type->type_params[1]);
 
-        if (index >= obj_vec->elements.size()) {
+      return obj_dict->append(obj_index, value).value;
+    }
+  }
+
+  panic("no index");
+}
+
+Value& Evaluator::eval_member_access(Value& obj,
+                                     AST::IndexRef* ast)
+{
+  auto pobj = &obj;
+
+  for (auto&& m : ast->indexes) {
+    switch (m->kind) {
+      case AST_Variable: {
+        pobj = &((ObjUserType*)pobj->v_obj)
+                    ->get_mut_members()[((AST::Variable*)m)->index];
+
+        break;
+      }
+
+      default:
+        todo_impl;
+    }
+  }
+
+  return *pobj;
+}
+
+int64_t Evaluator::eval_range_step(AST::Range* ast)
+{
+  if (!ast->step)
+    return 1;
+
+  auto step = this->evaluate(ast->step).v_int;
+
+  if (step == 0)
+    Error(ast->step, "range step must not be zero").emit().exit();
+
+  return step;
+}
+
+//
+// 読み込み
+//  中身を共有したまま要素を取り出して、複製を返す
+Value Evaluator::eval_index(Value const& obj, AST::IndexRef* ast)
+{
+  Value const* ret = &obj;
+
+  // 辞書にキーがないときのデフォルト値
+  Value default_value;
+
+  // 詰めて持っているベクタの要素
+  Value element;
+
+  for (auto&& index_ast : ast->indexes) {
+    auto obj_index = this->evaluate(index_ast);
+
+    switch (ret->kind) {
+      case TYPE_Vector: {
+        auto vec = (ObjVector*)ret->v_obj;
+
+        size_t index = to_index(obj_index);
+
+        if (ast->needs_bounds_check(index_ast) &&
+            index >= vec->size()) {
           Error(index_ast, "index out of range")
               .emit()
               .exit();
         }
 
-        ret = &obj_vec->elements[index];
+        // 詰めて持っているものは取り出した値を使う
+        if (vec->is_packed()) {
+          element = vec->at(index);
+          ret = &element;
+          break;
+        }
+
+        ret = &vec->get_elements()[index];
         break;
       }
 
       case TYPE_Dict: {
-        auto& obj_dict = *(ObjDict**)ret;
+        auto obj_dict = (ObjDict*)ret->v_obj;
 
-        for (auto&& item : obj_dict->items) {
-          if (item.key->equals(obj_index)) {
-            ret = &item.value;
-            goto _dict_value_found;
-          }
+        if (auto item = obj_dict->find(obj_index); item) {
+          ret = &item->value;
+          break;
         }
 
-        {
-          auto& item = obj_dict->append(
-              obj_index,
-              this->default_constructor(
-                  obj_dict->type.type_params[1]));
-
-          ret = &item.value;
-        }
+        default_value = this->default_constructor(
+            obj_dict->type->type_params[1]);
 
-      _dict_value_found:
+        ret = &default_value;
         break;
       }
 
@@ -529,27 +797,18 @@ Object*& Evaluator::eval_index_ref(Object*& obj,
     }
   }
 
-  return *ret;
+  return ret->clone();
 }
 
-Object*& Evaluator::eval_member_access(Object*& obj,
-                                       AST::IndexRef* ast)
+Value Evaluator::eval_member(Value const& obj,
+                             AST::IndexRef* ast)
 {
   auto pobj = &obj;
 
   for (auto&& m : ast->indexes) {
-    switch (m->kind) {
-      case AST_Variable: {
-        pobj = &((ObjUserType*)*pobj)
-                    ->members[((AST::Variable*)m)->index];
-
-        break;
-      }
-
-      default:
-        todo_impl;
-    }
+    pobj = &((ObjUserType*)pobj->v_obj)
+                ->get_members()[((AST::Variable*)m)->index];
   }
 
-  return *pobj;
+  return pobj->clone();
 }
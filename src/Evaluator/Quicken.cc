@@ -0,0 +1,405 @@
+//
+// 構文木の特殊化 (quickening)
+//  最初に評価したときに、Sema で決まった型から特殊化を選んで
+//  ast->quick に書き込む
+//  次からは evaluate() の先頭で quick を見て、
+//  kind や値の型で分岐せずに評価する
+//
+
+#include <iostream>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Arith.h"
+#include "Object.h"
+
+#include "Error.h"
+#include "Sema.h"
+#include "Application.h"
+#include "Evaluator.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+extern bool _gc_stopped;
+
+size_t Evaluator::quicken_counts[QUICK_Max];
+
+static char const* const quick_names[] = {
+#define _AST_QUICK_NAME(name) #name,
+    AST_QUICK_LIST(_AST_QUICK_NAME)
+#undef _AST_QUICK_NAME
+};
+
+//
+// Sema で決まった型 (なければ TYPE_None)
+TypeKind Evaluator::type_of(AST::Base* ast)
+{
+  auto it = Sema::value_type_cache.find(ast);
+
+  if (it == Sema::value_type_cache.end())
+    return TYPE_None;
+
+  return it->second.kind;
+}
+
+static bool is_scalar(TypeKind kind)
+{
+  switch (kind) {
+    case TYPE_Int:
+    case TYPE_USize:
+    case TYPE_Float:
+    case TYPE_Bool:
+    case TYPE_Char:
+      return true;
+  }
+
+  return false;
+}
+
+static bool is_user_call(AST::Base* ast)
+{
+  return ast->kind == AST_CallFunc &&
+         !((AST::CallFunc*)ast)->is_builtin;
+}
+
+static bool is_same_variable(AST::Base* a, AST::Base* b)
+{
+  auto x = (AST::Variable*)a;
+  auto y = (AST::Variable*)b;
+
+  return a->kind == AST_Variable && b->kind == AST_Variable &&
+         x->slot == y->slot && x->is_global == y->is_global;
+}
+
+QuickKind Evaluator::select_quick(AST::Base* _ast)
+{
+  //
+  // int どうしの比較が一つだけ
+  auto is_compare_int = [](AST::Base* ast) {
+    if (ast->kind != AST_Compare)
+      return false;
+
+    auto cmp = (AST::Compare*)ast;
+
+    return cmp->elements.size() == 1 &&
+           type_of(cmp->first) == TYPE_Int &&
+           type_of(cmp->elements[0].ast) == TYPE_Int;
+  };
+
+  switch (_ast->kind) {
+    case AST_Variable:
+      if (is_scalar(type_of(_ast)))
+        return QUICK_VariableScalar;
+
+      break;
+
+    case AST_IndexRef: {
+      astdef(IndexRef);
+
+      if (ast->expr->kind == AST_Variable &&
+          ast->indexes.size() == 1 &&
+          type_of(ast->expr) == TYPE_Vector &&
+          type_of(ast->indexes[0]) == TYPE_Int)
+        return QUICK_IndexRefVectorInt;
+
+      break;
+    }
+
+    case AST_CallFunc:
+      if (((AST::CallFunc*)_ast)->is_builtin)
+        return QUICK_CallBuiltin;
+
+      return QUICK_CallUserFuncFixedArity;
+
+    case AST_Expr: {
+      astdef(Expr);
+
+      if (type_of(ast->first) != TYPE_Int)
+        break;
+
+      for (auto&& elem : ast->elements) {
+        if (elem.kind == AST::EX_And || elem.kind == AST::EX_Or ||
+            type_of(elem.ast) != TYPE_Int)
+          return QUICK_Generic;
+      }
+
+      return QUICK_ExprInt;
+    }
+
+    case AST_Compare:
+      if (is_compare_int(_ast))
+        return QUICK_CompareInt;
+
+      break;
+
+    case AST_Assign: {
+      astdef(Assign);
+
+      if (ast->dest->kind != AST_Variable)
+        break;
+
+      auto type = type_of(ast->expr);
+
+      //
+      // x = x + y
+      if (type == TYPE_Int && ast->expr->kind == AST_Expr) {
+        auto expr = (AST::Expr*)ast->expr;
+
+        if (expr->elements.size() == 1 &&
+            expr->elements[0].kind == AST::EX_Add &&
+            is_same_variable(expr->first, ast->dest))
+          return QUICK_AssignAddInt;
+      }
+
+      if (is_scalar(type))
+        return QUICK_AssignScalar;
+
+      break;
+    }
+
+    case AST_If:
+      if (is_compare_int(((AST::If*)_ast)->condition))
+        return QUICK_IfCompareInt;
+
+      break;
+
+    //
+    // return f(..) + g(..)
+    case AST_Return: {
+      astdef(Return);
+
+      if (!ast->expr || ast->expr->kind != AST_Expr ||
+          type_of(ast->expr) != TYPE_Int)
+        break;
+
+      auto expr = (AST::Expr*)ast->expr;
+
+      if (expr->elements.size() == 1 &&
+          expr->elements[0].kind == AST::EX_Add &&
+          is_user_call(expr->first) &&
+          is_user_call(expr->elements[0].ast))
+        return QUICK_ReturnAddCalls;
+
+      break;
+    }
+  }
+
+  return QUICK_Generic;
+}
+
+static bool compare_int(AST::CmpKind kind, int64_t a, int64_t b)
+{
+  switch (kind) {
+    case AST::CMP_LeftBigger:
+      return a > b;
+
+    case AST::CMP_RightBigger:
+      return a < b;
+
+    case AST::CMP_LeftBigOrEqual:
+      return a >= b;
+
+    case AST::CMP_RightBigOrEqual:
+      return a <= b;
+
+    case AST::CMP_Equal:
+      return a == b;
+
+    case AST::CMP_NotEqual:
+      return a != b;
+  }
+
+  return false;
+}
+
+static int64_t compute_int(AST::Expr::Element const& elem,
+                           int64_t a, int64_t b)
+{
+  switch (elem.kind) {
+    case AST::EX_Add:
+      return Arith::add(a, b);
+
+    case AST::EX_Sub:
+      return Arith::sub(a, b);
+
+    case AST::EX_Mul:
+      return Arith::mul(a, b);
+
+    case AST::EX_Div:
+    case AST::EX_Mod:
+      if (b == 0)
+        Error(elem.op, "division by zero").emit().exit();
+
+      return elem.kind == AST::EX_Div ? Arith::div(a, b)
+                                      : Arith::mod(a, b);
+
+    case AST::EX_LShift:
+      return Arith::shl(a, b);
+
+    case AST::EX_RShift:
+      return Arith::shr(a, b);
+
+    case AST::EX_BitAND:
+      return a & b;
+
+    case AST::EX_BitXOR:
+      return a ^ b;
+
+    case AST::EX_BitOR:
+      return a | b;
+  }
+
+  todo_impl;
+}
+
+void Evaluator::quicken(AST::Base* ast)
+{
+  auto const& options = Application::get_instance()->get_options();
+
+  auto kind =
+      options.no_quicken ? QUICK_Generic : select_quick(ast);
+
+  ast->quick = kind;
+  quicken_counts[kind]++;
+}
+
+Value Evaluator::eval_quick(AST::Base* _ast)
+{
+  switch (_ast->quick) {
+    case QUICK_VariableScalar:
+      return this->get_var((AST::Variable*)_ast);
+
+    case QUICK_IndexRefVectorInt: {
+      astdef(IndexRef);
+
+      auto index_ast = ast->indexes[0];
+      auto index = (size_t)this->evaluate(index_ast).v_int;
+
+      auto vec =
+          (ObjVector*)this->get_var((AST::Variable*)ast->expr)
+              .v_obj;
+
+      if (ast->needs_bounds_check(index_ast) &&
+          index >= vec->size()) {
+        Error(index_ast, "index out of range").emit().exit();
+      }
+
+      return vec->at(index).clone();
+    }
+
+    case QUICK_CallUserFuncFixedArity:
+      return this->call_user_func((AST::CallFunc*)_ast);
+
+    case QUICK_CallBuiltin:
+      return this->call_builtin((AST::CallFunc*)_ast);
+
+    case QUICK_ExprInt: {
+      astdef(Expr);
+
+      auto x = this->evaluate(ast->first).v_int;
+
+      for (auto&& elem : ast->elements)
+        x = compute_int(elem, x, this->evaluate(elem.ast).v_int);
+
+      return Value::from_int(x);
+    }
+
+    case QUICK_CompareInt: {
+      astdef(Compare);
+
+      auto const& elem = ast->elements[0];
+
+      auto a = this->evaluate(ast->first).v_int;
+      auto b = this->evaluate(elem.ast).v_int;
+
+      return Value::from_bool(compare_int(elem.kind, a, b));
+    }
+
+    //
+    // 参照カウントがないので、そのまま書き込む
+    case QUICK_AssignScalar: {
+      astdef(Assign);
+
+      auto value = this->evaluate(ast->expr);
+
+      return this->get_var((AST::Variable*)ast->dest) = value;
+    }
+
+    case QUICK_AssignAddInt: {
+      astdef(Assign);
+
+      auto expr = (AST::Expr*)ast->expr;
+      auto& dest = this->get_var((AST::Variable*)ast->dest);
+
+      auto x = dest.v_int;
+      auto y = this->evaluate(expr->elements[0].ast).v_int;
+
+      return dest = Value::from_int(Arith::add(x, y));
+    }
+
+    case QUICK_IfCompareInt: {
+      astdef(If);
+
+      auto cmp = (AST::Compare*)ast->condition;
+      auto const& elem = cmp->elements[0];
+
+      auto a = this->evaluate(cmp->first).v_int;
+      auto b = this->evaluate(elem.ast).v_int;
+
+      if (compare_int(elem.kind, a, b))
+        return this->evaluate(ast->if_true);
+
+      return this->evaluate(ast->if_false);
+    }
+
+    case QUICK_ReturnAddCalls: {
+      astdef(Return);
+
+      auto expr = (AST::Expr*)ast->expr;
+      auto& fs = this->get_current_func_stack();
+
+      auto _flag_b = _gc_stopped;
+
+      _gc_stopped = true;
+
+      auto a = this->call_user_func((AST::CallFunc*)expr->first);
+      auto b = this->call_user_func(
+          (AST::CallFunc*)expr->elements[0].ast);
+
+      fs.result =
+          Value::from_int(Arith::add(a.v_int, b.v_int));
+
+      _gc_stopped = _flag_b;
+
+      fs.is_returned = true;
+
+      return {};
+    }
+
+    default:
+      break;
+  }
+
+  panic("invalid quick kind");
+}
+
+void Evaluator::print_quicken_statistics(std::ostream& os)
+{
+  size_t total = 0;
+
+  for (auto count : quicken_counts)
+    total += count;
+
+  os << "quicken: " << total - quicken_counts[QUICK_Generic]
+     << " of " << total << " nodes specialized\n";
+
+  for (size_t i = QUICK_Generic; i < QUICK_Max; i++) {
+    if (quicken_counts[i] == 0)
+      continue;
+
+    os << "  " << quick_names[i] << ": " << quicken_counts[i]
+       << "\n";
+  }
+}
@@ -5,6 +5,7 @@
 #include "Utils.h"
 #include "debug/alert.h"
 
+#include "Arith.h"
 #include "AST.h"
 #include "Object.h"
 #include "BuiltinFunc.h"
@@ -17,7 +18,7 @@
 
 extern bool _gc_stopped;
 
-Object* Evaluator::eval_stmt(AST::Base* _ast)
+std::optional<Value> Evaluator::eval_stmt(AST::Base* _ast)
 {
   switch (_ast->kind) {
     //
@@ -35,16 +36,13 @@ Object* Evaluator::eval_stmt(AST::Base* _ast)
         fs.result = this->evaluate(ast->expr);
 
         _gc_stopped = _flag_b;
-
-        this->return_binds[fs.result] = ast;
       }
       else
-        fs.result = new ObjNone();
+        fs.result = {};
 
       // フラグ有効化
       fs.is_returned = true;
 
-      assert(fs.result != nullptr);
       break;
     }
 
@@ -63,7 +61,7 @@ Object* Evaluator::eval_stmt(AST::Base* _ast)
     case AST_If: {
       auto ast = (AST::If*)_ast;
 
-      if (((ObjBool*)this->evaluate(ast->condition))->value)
+      if (this->evaluate(ast->condition).v_bool)
         return this->evaluate(ast->if_true);
       else if (ast->if_false)
         return this->evaluate(ast->if_false);
@@ -83,12 +81,12 @@ Object* Evaluator::eval_stmt(AST::Base* _ast)
 
         auto cond = this->evaluate(c->cond);
 
-        if (cond->type.equals(TYPE_Bool)) {
-          if (!((ObjBool*)cond)->value)
+        if (cond.kind == TYPE_Bool) {
+          if (!cond.v_bool)
             continue;
         }
 
-        if (!cond->equals(item))
+        if (!cond.equals(item))
           continue;
 
         this->evaluate(c->scope);
@@ -101,13 +99,12 @@ Object* Evaluator::eval_stmt(AST::Base* _ast)
     //
     // loop
     case AST_Loop: {
-      auto& vst = this->get_vst();
-      auto& loop = this->loop_stack.emplace_front(vst);
+      auto& loop = this->loop_stack.emplace_front();
 
       while (true) {
         this->evaluate(((AST::Loop*)_ast)->code);
 
-        if (loop.is_breaked)
+        if (loop.is_breaked || this->is_returned())
           break;
 
         loop.is_continued = false;
@@ -122,56 +119,23 @@ Object* Evaluator::eval_stmt(AST::Base* _ast)
     case AST_For: {
       astdef(For);
 
-      auto _obj = this->evaluate(ast->iterable);
-      _obj->ref_count++;
-
-      auto& v = this->push_vst();
-
-      auto& loop = this->loop_stack.emplace_front(v);
-
-      Object** p_iter = nullptr;
-
-      if (ast->iter->kind == AST_Variable) {
-        p_iter = &v.append_lvar(nullptr);
-      }
-      else {
-        p_iter = &this->eval_left(ast->iter);
-      }
-
-      switch (_obj->type.kind) {
-        case TYPE_Range: {
-          auto& iter = *(ObjLong**)p_iter;
-          auto obj = (ObjRange*)_obj;
-
-          iter = new ObjLong(obj->begin);
-          iter->ref_count = 1;
+      auto body = [&] { return this->evaluate(ast->code); };
 
-          while (iter->value < obj->end) {
-            this->evaluate(ast->code);
+      //
+      // a .. b (by c) と書いたものは、範囲を作らずに回す
+      if (ast->iterable->kind == AST_Range) {
+        auto range = (AST::Range*)ast->iterable;
 
-            if (loop.is_breaked) {
-              break;
-            }
+        auto begin = this->evaluate(range->begin).v_int;
+        auto end = this->evaluate(range->end).v_int;
 
-            iter->value++;
-            loop.is_continued = false;
-          }
+        this->eval_range_loop(ast, begin, end,
+                              this->eval_range_step(range), body);
 
-          // delete iter;
-          iter->ref_count = 0;
-          this->delete_object(iter);
-
-          break;
-        }
-
-        default:
-          todo_impl;
+        break;
       }
 
-      this->loop_stack.pop_front();
-      this->pop_vst();
-
-      _obj->ref_count--;
+      this->eval_for(ast, body);
       break;
     }
 
@@ -180,13 +144,12 @@ Object* Evaluator::eval_stmt(AST::Base* _ast)
     case AST_While: {
       astdef(While);
 
-      auto& vst = this->get_vst();
-      auto& loop = this->loop_stack.emplace_front(vst);
+      auto& loop = this->loop_stack.emplace_front();
 
-      while (((ObjBool*)this->evaluate(ast->cond))->value) {
+      while (this->evaluate(ast->cond).v_bool) {
         this->evaluate(ast->code);
 
-        if (loop.is_breaked)
+        if (loop.is_breaked || this->is_returned())
           break;
 
         loop.is_continued = false;
@@ -202,18 +165,16 @@ Object* Evaluator::eval_stmt(AST::Base* _ast)
     case AST_DoWhile: {
       astdef(DoWhile);
 
-      auto& vst = this->get_vst();
-      auto& loop = this->loop_stack.emplace_front(vst);
+      auto& loop = this->loop_stack.emplace_front();
 
       do {
         this->evaluate(ast->code);
 
-        if (loop.is_breaked)
+        if (loop.is_breaked || this->is_returned())
           break;
 
         loop.is_continued = false;
-      } while (
-          ((ObjBool*)this->evaluate(ast->cond))->value);
+      } while (this->evaluate(ast->cond).v_bool);
 
       this->loop_stack.pop_front();
 
@@ -221,5 +182,146 @@ Object* Evaluator::eval_stmt(AST::Base* _ast)
     }
   }
 
-  return nullptr;
+  return std::nullopt;
+}
+
+//
+// for i in begin .. end by step
+//  i はスタック上の int のまま増やしていく
+//  (ループ中にオブジェクトを作らない)
+void Evaluator::eval_range_loop(AST::For* ast, int64_t begin,
+                                int64_t end, int64_t step,
+                                Closure const& body)
+{
+  auto& loop = this->loop_stack.emplace_front();
+  auto& iter = this->eval_left(ast->iter);
+
+  iter = Value::from_int(begin);
+
+  while (step > 0 ? iter.v_int < end : iter.v_int > end) {
+    body();
+
+    if (loop.is_breaked || this->is_returned())
+      break;
+
+    if (!Arith::range_next(iter.v_int, end, step))
+      break;
+
+    loop.is_continued = false;
+  }
+
+  this->loop_stack.pop_front();
+}
+
+//
+// for x in (範囲のオブジェクト、ベクタ、辞書、文字列)
+void Evaluator::eval_for(AST::For* ast, Closure const& body)
+{
+  // 変数は複製せずに回す
+  //  (ループ中に代入されても消えないよう、参照を増やす)
+  auto _obj = ast->iterable->kind == AST_Variable
+                  ? this->eval_left(ast->iterable)
+                  : this->evaluate(ast->iterable);
+
+  _obj.inc_ref();
+
+  this->temp_roots.emplace_back(_obj);
+
+  if (_obj.kind == TYPE_Range) {
+    auto obj = (ObjRange*)_obj.v_obj;
+
+    this->eval_range_loop(ast, obj->begin, obj->end,
+                          obj->step, body);
+
+    this->temp_roots.pop_back();
+    _obj.dec_ref();
+    return;
+  }
+
+  auto& loop = this->loop_stack.emplace_front();
+
+  // イテレータ
+  //  スタックは固定長なので、ループ中も参照は有効
+  auto& iter = this->eval_left(ast->iter);
+
+  auto is_var = ast->iter->kind == AST_Variable;
+
+  //
+  // コンテナの要素を回す
+  //  変数には要素をそのまま入れる (複製しない)
+  //  version が変わったら、途中で書き換えられたのでエラー
+  auto for_each = [&](auto* obj, auto&& get_size,
+                      auto&& get_elem) {
+    auto version = obj->version;
+
+    for (size_t i = 0; i < get_size(); i++) {
+      if (is_var) {
+        iter = get_elem(i);
+      }
+      else {
+        iter.dec_ref();
+        iter = get_elem(i).clone();
+        iter.inc_ref();
+      }
+
+      body();
+
+      if (loop.is_breaked || this->is_returned())
+        break;
+
+      if (obj->version != version) {
+        Error(ast->iterable,
+              "container modified during iteration")
+            .emit()
+            .exit();
+      }
+
+      loop.is_continued = false;
+    }
+  };
+
+  switch (_obj.kind) {
+    case TYPE_String: {
+      auto obj = (ObjString*)_obj.v_obj;
+
+      for_each(
+          obj, [&] { return obj->get_value().length(); },
+          [&](size_t i) {
+            return Value::from_char(obj->get_value()[i]);
+          });
+
+      break;
+    }
+
+    case TYPE_Vector: {
+      auto obj = (ObjVector*)_obj.v_obj;
+
+      for_each(
+          obj, [&] { return obj->size(); },
+          [&](size_t i) { return obj->at(i); });
+
+      break;
+    }
+
+    case TYPE_Dict: {
+      auto obj = (ObjDict*)_obj.v_obj;
+
+      for_each(
+          obj, [&] { return obj->get_items().size(); },
+          [&](size_t i) { return obj->get_items()[i].key; });
+
+      break;
+    }
+
+    default:
+      todo_impl;
+  }
+
+  this->loop_stack.pop_front();
+
+  if (is_var)
+    iter = {};
+
+  this->temp_roots.pop_back();
+  _obj.dec_ref();
 }
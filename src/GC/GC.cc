@@ -1,32 +1,873 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "debug/alert.h"
 #include "Object.h"
 #include "GC.h"
 
-#define GC_
+std::vector<Object*> GarbageCollector::zct;
 
-static std::vector<Object*>* objects;
+void GarbageCollector::add_zero(Object* obj)
+{
+  if (obj->in_zct)
+    return;
+
+  obj->in_zct = true;
+  zct.emplace_back(obj);
+
+  // 評価中の一時オブジェクトになった
+  write_barrier(obj);
+}
+
+size_t GarbageCollector::collect(
+    size_t mark, std::initializer_list<Object*> keep)
+{
+  size_t count = 0;
+  size_t w = mark;
+
+  // 削除したオブジェクトの子要素が末尾に追加されるので、
+  // size() は毎回取り直す
+  for (size_t i = mark; i < zct.size(); i++) {
+    auto obj = zct[i];
+
+    // 再び参照された
+    if (obj->ref_count != 0) {
+      obj->in_zct = false;
+      continue;
+    }
+
+    bool is_kept = obj->no_delete;
+
+    for (auto&& k : keep)
+      is_kept |= obj == k;
+
+    if (is_kept) {
+      // マーク中は、ZCT 内で位置が変わっても見落とさないよう
+      // ここで灰色にしておく
+      write_barrier(obj);
+
+      zct[w++] = obj;
+      continue;
+    }
+
+    delete obj;
+    count++;
+  }
+
+  zct.resize(w);
+
+  return count;
+}
+
+// ------------------------------------------------ //
+//  slab
+// ------------------------------------------------ //
+struct GarbageCollector::Chunk {
+  size_t live;  // 生存しているオブジェクトの数
+  size_t slot_size;
+
+  char* top;  // まだ使っていない領域の先頭
+  char* end;
+
+  void* free_list;  // 削除されたスロットのリスト
+
+  Slab* slab;
+
+  // スラブの空きのあるチャンクのリスト
+  // または空きチャンクのリスト
+  Chunk* prev;
+  Chunk* next;
+
+  bool is_partial;
+
+  char* begin()
+  {
+    return (char*)this + ((sizeof(Chunk) + 15) & ~15);
+  }
+};
+
+struct GarbageCollector::Slab {
+  size_t slot_size;
+
+  Chunk* cur;  // 確保中のチャンク
+  Chunk* partial;  // 空きのあるチャンク
+
+  // 統計
+  size_t chunks;
+  size_t peak_chunks;
+  size_t live;
+  size_t peak_live;
+  size_t allocations;
+
+  // GC のたびに足し合わせる
+  size_t sampled_live;
+  size_t sampled_slots;
+};
+
+GarbageCollector::Slab GarbageCollector::slabs[SLAB_COUNT];
+
+GarbageCollector::Chunk* GarbageCollector::free_chunks;
+GarbageCollector::Chunk* GarbageCollector::purged_chunks;
+size_t GarbageCollector::free_chunk_count;
+size_t GarbageCollector::purged_chunk_count;
+
+size_t GarbageCollector::allocated_bytes;
+
+GarbageCollector::Chunk* GarbageCollector::take_chunk(
+    Slab& slab)
+{
+  Chunk* chunk;
+
+  if (free_chunks) {
+    chunk = free_chunks;
+    free_chunks = chunk->next;
+    free_chunk_count--;
+  }
+  else if (purged_chunks) {
+    // 物理メモリは触ったときに割り当て直される
+    chunk = purged_chunks;
+    purged_chunks = chunk->next;
+    purged_chunk_count--;
+  }
+  else {
+    // アドレスからチャンクを求められるように揃える
+    chunk = (Chunk*)std::aligned_alloc(CHUNK_SIZE, CHUNK_SIZE);
+
+    if (!chunk)
+      throw std::bad_alloc();
+  }
+
+  chunk->live = 0;
+  chunk->slot_size = slab.slot_size;
+  chunk->top = chunk->begin();
+  chunk->end = (char*)chunk + CHUNK_SIZE;
+  chunk->free_list = nullptr;
+  chunk->slab = &slab;
+  chunk->prev = chunk->next = nullptr;
+  chunk->is_partial = false;
+
+  slab.chunks++;
+  slab.peak_chunks = std::max(slab.peak_chunks, slab.chunks);
+
+  return chunk;
+}
+
+void GarbageCollector::release_chunk(Chunk* chunk)
+{
+  chunk->slab->chunks--;
+
+  if (free_chunk_count < MAX_FREE_CHUNKS) {
+    chunk->next = free_chunks;
+    free_chunks = chunk;
+    free_chunk_count++;
+    return;
+  }
+
+  if (purged_chunk_count >= MAX_PURGED_CHUNKS) {
+    std::free(chunk);
+    return;
+  }
+
+  // ヘッダのあるページ以外の物理メモリを OS に返す
+  static size_t const page_size = sysconf(_SC_PAGESIZE);
+
+  if (page_size < CHUNK_SIZE)
+    madvise((char*)chunk + page_size, CHUNK_SIZE - page_size,
+            MADV_DONTNEED);
+
+  chunk->next = purged_chunks;
+  purged_chunks = chunk;
+  purged_chunk_count++;
+}
+
+void* GarbageCollector::allocate(size_t size, TypeKind kind)
+{
+  size = (size + 15) & ~15;
+
+  allocated_bytes += size;
+
+  if (size > MAX_SMALL_SIZE)
+    return ::operator new(size);
+
+  auto& slab = slabs[kind];
+
+  // 型ごとに大きさは決まっている
+  if (slab.slot_size == 0)
+    slab.slot_size = size;
+
+  assert(slab.slot_size == size);
+
+  auto chunk = slab.cur;
+
+  if (!chunk ||
+      (!chunk->free_list && chunk->top + size > chunk->end)) {
+    // 空きのあるチャンクを先に使う
+    if ((chunk = slab.partial)) {
+      slab.partial = chunk->next;
+
+      if (slab.partial)
+        slab.partial->prev = nullptr;
+
+      chunk->next = nullptr;
+      chunk->is_partial = false;
+    }
+    else {
+      chunk = take_chunk(slab);
+    }
+
+    slab.cur = chunk;
+  }
+
+  void* p;
+
+  if (chunk->free_list) {
+    p = chunk->free_list;
+    chunk->free_list = *(void**)p;
+  }
+  else {
+    p = chunk->top;
+    chunk->top += size;
+  }
+
+  chunk->live++;
+
+  slab.allocations++;
+  slab.peak_live = std::max(slab.peak_live, ++slab.live);
+
+  return p;
+}
+
+void GarbageCollector::deallocate(void* p, size_t size)
+{
+  size = (size + 15) & ~15;
+
+  if (size > MAX_SMALL_SIZE) {
+    ::operator delete(p);
+    return;
+  }
+
+  auto chunk = (Chunk*)((uintptr_t)p & ~(CHUNK_SIZE - 1));
+  auto& slab = *chunk->slab;
+
+  slab.live--;
+
+  if (--chunk->live == 0) {
+    // 確保中のチャンク
+    //  => 巻き戻して、同じ場所を使い回す
+    if (chunk == slab.cur) {
+      chunk->top = chunk->begin();
+      chunk->free_list = nullptr;
+      return;
+    }
+
+    if (chunk->is_partial) {
+      if (chunk->prev)
+        chunk->prev->next = chunk->next;
+      else
+        slab.partial = chunk->next;
+
+      if (chunk->next)
+        chunk->next->prev = chunk->prev;
+    }
+
+    release_chunk(chunk);
+    return;
+  }
+
+  *(void**)p = chunk->free_list;
+  chunk->free_list = p;
+
+  // 満杯だったチャンクに空きができた
+  if (chunk != slab.cur && !chunk->is_partial) {
+    chunk->prev = nullptr;
+    chunk->next = slab.partial;
+
+    if (slab.partial)
+      slab.partial->prev = chunk;
+
+    slab.partial = chunk;
+    chunk->is_partial = true;
+  }
+}
+
+void GarbageCollector::print_slab_statistics(std::ostream& os)
+{
+  os << "slab: " << free_chunk_count << " free, "
+     << purged_chunk_count << " purged chunks ("
+     << (CHUNK_SIZE >> 10) << " KiB each)\n";
+
+  for (size_t i = 0; i < SLAB_COUNT; i++) {
+    auto& slab = slabs[i];
+
+    if (slab.allocations == 0)
+      continue;
+
+    // GC の時点で使っていたスロットの割合 (平均)
+    size_t occupancy =
+        slab.sampled_slots == 0
+            ? 0
+            : slab.sampled_live * 100 / slab.sampled_slots;
+
+    auto name = i == TYPE_UserDef
+                    ? std::string("struct")
+                    : TypeInfo((TypeKind)i).to_string();
+
+    os << "  " << name << " ("
+       << slab.slot_size << " bytes): " << slab.allocations
+       << " allocs, " << slab.live << " live (peak "
+       << slab.peak_live << "), " << slab.chunks
+       << " chunks (peak " << slab.peak_chunks << "), "
+       << occupancy << "% occupied\n";
+  }
+}
+
+void GarbageCollector::sample_slabs()
+{
+  size_t header = (sizeof(Chunk) + 15) & ~15;
+
+  for (auto&& slab : slabs) {
+    if (slab.chunks == 0)
+      continue;
+
+    slab.sampled_live += slab.live;
+    slab.sampled_slots +=
+        (CHUNK_SIZE - header) / slab.slot_size * slab.chunks;
+  }
+}
+
+// ------------------------------------------------ //
+//  mark-sweep
+// ------------------------------------------------ //
+Object* GarbageCollector::young;
+Object* GarbageCollector::young_tail;
+Object* GarbageCollector::old;
+
+uint32_t GarbageCollector::epoch;
+
+size_t GarbageCollector::young_count;
+size_t GarbageCollector::old_count;
+size_t GarbageCollector::major_threshold = MIN_MAJOR_OBJECTS;
+size_t GarbageCollector::minor_budget = MAX_MINOR_OBJECTS;
+
+std::vector<Object*> GarbageCollector::roots;
+std::deque<Object*> GarbageCollector::gray;
+
+GarbageCollector::Phase GarbageCollector::phase;
+
+size_t GarbageCollector::zct_cursor;
+
+Object* GarbageCollector::scanning;
+size_t GarbageCollector::scan_cursor;
+
+Object* GarbageCollector::sweep_cursor;
+bool GarbageCollector::sweeping_old;
+
+size_t GarbageCollector::max_pause_us = DEFAULT_MAX_PAUSE_US;
+
+std::vector<size_t> GarbageCollector::minor_pauses;
+std::vector<size_t> GarbageCollector::major_pauses;
+size_t GarbageCollector::max_pause_observed;
+size_t GarbageCollector::minor_count;
+size_t GarbageCollector::major_count;
+size_t GarbageCollector::promoted_count;
+size_t GarbageCollector::bulk_promote_count;
+
+static size_t now_us()
+{
+  using namespace std::chrono;
+
+  return duration_cast<microseconds>(
+             steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool GarbageCollector::is_old(Object const* obj)
+{
+  return obj->gc_epoch != epoch;
+}
+
+void GarbageCollector::add(Object* obj)
+{
+  // マーク中に作られたものは黒
+  obj->gc_marked = phase == PHASE_Mark;
+
+  obj->gc_epoch = epoch;
+  obj->gc_prev = nullptr;
+  obj->gc_next = young;
+
+  if (young)
+    young->gc_prev = obj;
+  else
+    young_tail = obj;
+
+  young = obj;
+  young_count++;
+}
+
+void GarbageCollector::remove(Object* obj)
+{
+  bool is_old = GarbageCollector::is_old(obj);
+  auto& head = is_old ? old : young;
+
+  // スイープ中に参照カウントで削除された
+  if (obj == sweep_cursor)
+    sweep_cursor = obj->gc_next;
+
+  if (obj->gc_gray)
+    gray[obj->gc_gray - 1] = nullptr;
+
+  if (obj == scanning)
+    scanning = nullptr;
+
+  if (obj->gc_prev)
+    obj->gc_prev->gc_next = obj->gc_next;
+  else
+    head = obj->gc_next;
+
+  if (obj->gc_next)
+    obj->gc_next->gc_prev = obj->gc_prev;
 
-void GarbageCollector::execute()
+  if (is_old) {
+    old_count--;
+  }
+  else {
+    if (obj == young_tail)
+      young_tail = obj->gc_prev;
+
+    young_count--;
+  }
+}
+
+void GarbageCollector::mark_object(Object* obj, bool full)
 {
+  // minor では old は調べない
+  if (obj->gc_marked || (!full && is_old(obj)))
+    return;
+
+  obj->gc_marked = true;
+  obj->gc_gray = gray.size() + 1;
+
+  gray.emplace_back(obj);
 }
 
-void GarbageCollector::final()
+void GarbageCollector::rescan(Object* obj)
 {
+  if (phase == PHASE_Mark) {
+    obj->gc_marked = false;
+    mark_object(obj, true);
+  }
 }
 
-void GarbageCollector::set_object_list(std::vector<Object*>* vec)
+void GarbageCollector::moved_children(Object* obj)
 {
-  objects = vec;
+  if (obj != scanning)
+    return;
+
+  obj->trace([](Value& child) {
+    if (child.is_heap())
+      mark_object(child.v_obj, true);
+  });
+
+  scanning = nullptr;
 }
 
-void GarbageCollector::clean()
+void GarbageCollector::mark_root(Value const& value)
 {
+  if (value.is_heap())
+    roots.emplace_back(value.v_obj);
 }
 
-bool GarbageCollector::add(Object* obj)
+void GarbageCollector::free_garbage(Object* obj, bool full)
 {
+  // 回収するもの同士の参照は先に切っておく
+  //  (デストラクタで削除済みのオブジェクトを触らないように)
+  obj->trace([full](Value& child) {
+    if (child.is_heap() && !child.v_obj->gc_marked &&
+        (full || !is_old(child.v_obj)))
+      child = {};
+  });
+
+  delete obj;
 }
 
-bool GarbageCollector::remove(Object* obj)
+size_t GarbageCollector::collect_minor(size_t deadline_us)
 {
+  auto begin = now_us();
+  auto traced = young_count;
+
+  // SCAN_STEP 個ごとに時間を確かめる
+  size_t steps = 0;
+
+  auto is_over = [&] {
+    return ++steps % SCAN_STEP == 0 &&
+           now_us() >= deadline_us;
+  };
+
+  // ヒープの中からの参照を差し引いて、
+  // 外 (変数、評価中の一時オブジェクト、old) からの参照数を求める
+  for (auto p = young; p; p = p->gc_next)
+    p->gc_refs = p->ref_count;
+
+  for (auto p = young; p; p = p->gc_next) {
+    if (is_over()) {
+      abandon_minor();
+      return 0;
+    }
+
+    // 中身を共有している子要素は、持ち主が何人いても
+    // 参照カウントは 1 なので、差し引かない
+    //  (外から参照されているものとして残す)
+    if (p->is_shared())
+      continue;
+
+    p->trace([](Value& child) {
+      if (child.is_heap() && !is_old(child.v_obj))
+        child.v_obj->gc_refs--;
+    });
+  }
+
+  for (auto p = young; p; p = p->gc_next) {
+    if (p->gc_refs > 0 || p->in_zct || p->no_delete)
+      mark_object(p, false);
+  }
+
+  for (auto&& obj : roots)
+    mark_object(obj, false);
+
+  roots.clear();
+
+  while (!gray.empty()) {
+    if (is_over()) {
+      abandon_minor();
+      return 0;
+    }
+
+    auto obj = gray.back();
+    gray.pop_back();
+
+    obj->gc_gray = 0;
+
+    obj->trace([](Value& child) {
+      if (child.is_heap())
+        mark_object(child.v_obj, false);
+    });
+  }
+
+  std::vector<Object*> garbage;
+
+  for (auto p = young; p; p = p->gc_next) {
+    if (!p->gc_marked)
+      garbage.emplace_back(p);
+  }
+
+  // 先に全て切ってから削除する
+  for (auto&& obj : garbage) {
+    obj->trace([](Value& child) {
+      if (child.is_heap() && !child.v_obj->gc_marked &&
+          !is_old(child.v_obj))
+        child = {};
+    });
+  }
+
+  for (auto&& obj : garbage)
+    delete obj;
+
+  for (auto p = young; p; p = p->gc_next)
+    p->gc_marked = false;
+
+  promote();
+  minor_count++;
+
+  update_minor_budget(traced, now_us() - begin);
+
+  return garbage.size();
+}
+
+void GarbageCollector::abandon_minor()
+{
+  for (auto&& obj : gray) {
+    if (obj)
+      obj->gc_gray = 0;
+  }
+
+  gray.clear();
+  roots.clear();
+
+  for (auto p = young; p; p = p->gc_next)
+    p->gc_marked = false;
+
+  promote();
+  bulk_promote_count++;
+
+  // 次からは少ない数で minor にする
+  minor_budget =
+      std::max(minor_budget / 2, MIN_MINOR_OBJECTS);
+}
+
+void GarbageCollector::update_minor_budget(size_t count,
+                                           size_t us)
+{
+  // 数が少ないと時間が測れないので、そのまま
+  if (count < MIN_MINOR_OBJECTS)
+    return;
+
+  // 上限の半分で終わる数にする
+  //  (子要素の数で時間が変わるので余裕を持たせる)
+  auto budget =
+      max_pause_us * count / (2 * std::max(us, (size_t)1));
+
+  minor_budget = std::clamp(budget, MIN_MINOR_OBJECTS,
+                            MAX_MINOR_OBJECTS);
+}
+
+void GarbageCollector::promote()
+{
+  // 世代番号を進めれば、今の young は全て old になる
+  epoch++;
+
+  if (young) {
+    young_tail->gc_next = old;
+
+    if (old)
+      old->gc_prev = young_tail;
+
+    old = young;
+  }
+
+  old_count += young_count;
+  promoted_count += young_count;
+
+  young = young_tail = nullptr;
+  young_count = 0;
+
+  allocated_bytes = 0;
+}
+
+void GarbageCollector::start_major()
+{
+  phase = PHASE_Mark;
+
+  for (auto&& obj : roots)
+    mark_object(obj, true);
+
+  roots.clear();
+
+  // 評価中の一時オブジェクト (ZCT) は mark_slice で少しずつ調べる
+  zct_cursor = 0;
+
+  major_count++;
+}
+
+bool GarbageCollector::mark_slice(size_t deadline_us)
+{
+  // 調べたオブジェクトと子要素の数
+  size_t work = 0;
+  size_t next_check = 64;
+
+  auto mark_child = [&work](Value& child) {
+    work++;
+
+    if (child.is_heap())
+      mark_object(child.v_obj, true);
+  };
+
+  while (true) {
+    if (work >= next_check) {
+      if (now_us() >= deadline_us)
+        return false;
+
+      next_check = work + 64;
+    }
+
+    work++;
+
+    // 大きいコンテナは SCAN_STEP ずつ調べて、
+    // 停止時間がヒープの大きさによらないようにする
+    if (scanning) {
+      scan_cursor = scanning->trace_part(
+          scan_cursor, SCAN_STEP, mark_child);
+
+      if (scan_cursor == 0)
+        scanning = nullptr;
+
+      continue;
+    }
+
+    // gray を先に処理して、スタックを小さく保つ
+    if (gray.empty()) {
+      if (zct_cursor >= zct.size())
+        break;
+
+      mark_object(zct[zct_cursor++], true);
+      continue;
+    }
+
+    auto obj = gray.back();
+    gray.pop_back();
+
+    // 参照カウントで削除された
+    if (!obj)
+      continue;
+
+    obj->gc_gray = 0;
+
+    scanning = obj;
+    scan_cursor = 0;
+  }
+
+  return true;
+}
+
+size_t GarbageCollector::sweep_slice(size_t deadline_us)
+{
+  size_t count = 0;
+
+  for (size_t n = 0;; n++) {
+    if (!sweep_cursor) {
+      if (sweeping_old) {
+        phase = PHASE_Idle;
+        break;
+      }
+
+      sweeping_old = true;
+      sweep_cursor = old;
+      continue;
+    }
+
+    if (n % 64 == 63 && now_us() >= deadline_us)
+      break;
+
+    auto obj = sweep_cursor;
+    sweep_cursor = obj->gc_next;
+
+    if (obj->gc_marked) {
+      obj->gc_marked = false;
+      continue;
+    }
+
+    free_garbage(obj, true);
+    count++;
+  }
+
+  if (phase == PHASE_Idle) {
+    major_threshold =
+        std::max(old_count * 2, MIN_MAJOR_OBJECTS);
+  }
+
+  return count;
+}
+
+size_t GarbageCollector::execute()
+{
+  auto begin = now_us();
+  auto deadline = begin + max_pause_us;
+
+  sample_slabs();
+
+  size_t count = 0;
+
+  switch (phase) {
+    case PHASE_Idle:
+      if (old_count < major_threshold) {
+        // セーフポイントを通らずに大量に作られた
+        //  => 調べずに昇格して、major に任せる
+        if (young_count > minor_budget * 2) {
+          roots.clear();
+          promote();
+          bulk_promote_count++;
+        }
+        else {
+          count = collect_minor(deadline);
+        }
+
+        record_pause(minor_pauses, now_us() - begin);
+        return count;
+      }
+
+      start_major();
+      [[fallthrough]];
+
+    case PHASE_Mark:
+      if (!mark_slice(deadline))
+        break;
+
+      // マーク完了
+      //  => これ以降に作られたものは白のまま
+      //     (リストの先頭に追加されるので、スイープされない)
+      phase = PHASE_Sweep;
+      sweeping_old = false;
+      sweep_cursor = young;
+      [[fallthrough]];
+
+    case PHASE_Sweep:
+      count = sweep_slice(deadline);
+      break;
+  }
+
+  record_pause(major_pauses, now_us() - begin);
+
+  return count;
+}
+
+void GarbageCollector::record_pause(
+    std::vector<size_t>& histogram, size_t us)
+{
+  size_t index = 0;
+
+  while (us >> index)
+    index++;
+
+  if (histogram.size() <= index)
+    histogram.resize(index + 1);
+
+  histogram[index]++;
+
+  max_pause_observed = std::max(max_pause_observed, us);
+}
+
+void GarbageCollector::print_histogram(
+    std::ostream& os, char const* name,
+    std::vector<size_t> const& histogram)
+{
+  if (histogram.empty())
+    return;
+
+  os << "  " << name << " pauses:\n";
+
+  for (size_t i = 0; i < histogram.size(); i++) {
+    if (histogram[i] == 0)
+      continue;
+
+    size_t lo = i == 0 ? 0 : (size_t)1 << (i - 1);
+    size_t hi = (size_t)1 << i;
+
+    os << "    " << lo << " - " << hi
+       << " us: " << histogram[i] << "\n";
+  }
+}
+
+void GarbageCollector::print_statistics(std::ostream& os)
+{
+  size_t total = 0;
+
+  for (auto&& n : minor_pauses)
+    total += n;
+
+  for (auto&& n : major_pauses)
+    total += n;
+
+  os << "gc: " << minor_count << " minor, " << major_count
+     << " major, " << total << " pauses (max " << max_pause_observed
+     << " us, limit " << max_pause_us << " us)\n";
+
+  os << "  young: minor every " << (YOUNG_SIZE >> 10)
+     << " KiB or " << minor_budget << " objects, "
+     << promoted_count << " objects promoted ("
+     << bulk_promote_count << " times without tracing)\n";
+
+  print_histogram(os, "minor", minor_pauses);
+  print_histogram(os, "major", major_pauses);
 }
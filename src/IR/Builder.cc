@@ -0,0 +1,1802 @@
+#include <stdexcept>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Error.h"
+#include "Evaluator.h"
+#include "Object.h"
+#include "Sema.h"
+#include "BuiltinFunc.h"
+#include "IR/Builder.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+namespace IR {
+
+//
+// 0 より大きい数値のリテラル (範囲の by)
+static bool is_positive_literal(AST::Base* ast)
+{
+  if (ast->kind != AST_Value)
+    return false;
+
+  switch (ast->token.kind) {
+    case TOK_Int:
+    case TOK_USize:
+    case TOK_Float:
+      try {
+        return std::stod(std::string(ast->token.str)) > 0;
+      }
+      catch (std::exception const&) {
+      }
+  }
+
+  return false;
+}
+
+//
+// Operators の result_kind と同じ
+static TypeKind result_kind(AST::ExprKind kind, TypeKind L,
+                            TypeKind R)
+{
+  if (kind == AST::EX_Sub && L != R && L != TYPE_Float)
+    return R;
+
+  return L;
+}
+
+//
+// int, float などの既定値
+static Value zero_of(TypeKind kind)
+{
+  return Evaluator::cast_value(Value::from_int(0), kind);
+}
+
+Builder::Builder()
+    : func(nullptr),
+      cur(nullptr),
+      func_depth(0)
+{
+}
+
+Builder::~Builder()
+{
+}
+
+Module Builder::build(AST::Scope* root)
+{
+  this->global_names = AST::global_names(root);
+
+  auto main = this->module.functions
+                  .emplace_back(std::make_unique<Function>(
+                      "main", nullptr))
+                  .get();
+
+  // 呼び出しより後に定義した関数もあるので、先に作っておく
+  for (auto&& item : root->list) {
+    if (item->kind != AST_Function)
+      continue;
+
+    auto ast = (AST::Function*)item;
+
+    this->functions[ast] =
+        this->module.functions
+            .emplace_back(std::make_unique<Function>(
+                std::string(ast->name.str), ast))
+            .get();
+  }
+
+  this->func = main;
+  this->cur = main->new_block();
+  this->sealed.emplace(this->cur);
+
+  this->scope(root, false);
+  this->emit(OP_Return, TYPE_None);
+
+  this->finish();
+
+  return std::move(this->module);
+}
+
+void Builder::build_function(AST::Function* ast)
+{
+  auto it = this->functions.find(ast);
+
+  if (it == this->functions.end())
+    unsupported(ast);
+
+  auto saved_func = this->func;
+  auto saved_cur = this->cur;
+  auto saved_scopes = std::move(this->scopes);
+  auto saved_loops = std::move(this->loops);
+  auto saved_depth = this->func_depth;
+
+  auto f = it->second;
+
+  f->result = ast->result_type ? type_of(ast->result_type)
+                               : TypeInfo(TYPE_None);
+
+  this->func = f;
+  this->cur = f->new_block();
+  this->sealed.emplace(this->cur);
+
+  this->scopes.clear();
+  this->loops.clear();
+  this->func_depth = 0;
+
+  //
+  // 引数は関数の中で参照を持つ
+  //  (引数のスコープは回収しない)
+  this->enter_scope(false);
+
+  for (size_t i = 0; auto&& arg : ast->args) {
+    auto type = type_of(arg->type);
+    auto param = this->emit(OP_Param, type);
+
+    param->index = (int64_t)i++;
+    f->params.emplace_back(type);
+
+    auto var = this->new_variable(arg->name, type);
+
+    this->write_var(var, this->cur, param);
+    this->declare(arg->name, var);
+
+    if (!is_scalar(type.kind)) {
+      this->emit(OP_Retain, TYPE_None, {param});
+      this->scopes.back().vars.emplace_back(var);
+    }
+  }
+
+  auto value = this->scope(ast->code,
+                           ast->code->return_last_expr);
+
+  // 最後まで来たら、最後の式か戻り値の型の既定値を返す
+  if (!value || value->type.kind != f->result.kind) {
+    if (is_scalar(f->result.kind))
+      value = this->constant(zero_of(f->result.kind),
+                             f->result);
+    else
+      value = this->constant(Value(), f->result);
+  }
+
+  this->leave_scope(value);
+  this->emit(OP_Return, TYPE_None, {value});
+
+  this->finish();
+
+  this->func = saved_func;
+  this->cur = saved_cur;
+  this->scopes = std::move(saved_scopes);
+  this->loops = std::move(saved_loops);
+  this->func_depth = saved_depth;
+}
+
+void Builder::finish()
+{
+  // cleanup で基本ブロックを消すので、構築中の情報も捨てる
+  for (auto&& block : this->func->blocks) {
+    this->sealed.erase(block.get());
+    this->incomplete_phis.erase(block.get());
+  }
+
+  std::erase_if(this->defs, [this](auto const& def) {
+    return def.first.first->parent == this->func;
+  });
+
+  this->func->cleanup();
+  this->remove_trivial_phis();
+  this->func->renumber();
+}
+
+// --------------------------------------------------------
+//  命令の追加
+// --------------------------------------------------------
+
+Instr* Builder::emit(OpCode op, TypeInfo const& type,
+                     std::vector<Instr*> const& operands,
+                     AST::Base* ast)
+{
+  auto instr = this->func->new_instr(op, type);
+
+  instr->operands = operands;
+  instr->ast = ast;
+  instr->parent = this->cur;
+
+  this->cur->instrs.emplace_back(instr);
+
+  return instr;
+}
+
+Instr* Builder::constant(Value const& value,
+                         TypeInfo const& type)
+{
+  auto instr = this->emit(OP_Const, type);
+
+  instr->imm = value;
+
+  return instr;
+}
+
+Instr* Builder::insert_front(Block* block, Instr* instr)
+{
+  auto it = block->instrs.begin();
+
+  while (it != block->instrs.end() && (*it)->op == OP_Phi)
+    it++;
+
+  instr->parent = block;
+  block->instrs.insert(it, instr);
+
+  return instr;
+}
+
+Instr* Builder::new_phi(Block* block, TypeInfo const& type)
+{
+  return this->insert_front(
+      block, this->func->new_instr(OP_Phi, type));
+}
+
+void Builder::jump(Block* to)
+{
+  this->emit(OP_Jump, TYPE_None)->targets = {to};
+
+  add_edge(this->cur, to);
+
+  this->terminate();
+}
+
+void Builder::branch(Instr* cond, Block* if_true,
+                     Block* if_false)
+{
+  this->emit(OP_Branch, TYPE_None, {cond})->targets = {
+      if_true, if_false};
+
+  add_edge(this->cur, if_true);
+  add_edge(this->cur, if_false);
+
+  this->terminate();
+}
+
+void Builder::set_block(Block* block)
+{
+  this->cur = block;
+}
+
+void Builder::terminate()
+{
+  // 後ろに続くコードは到達しない (cleanup で消す)
+  this->cur = this->func->new_block();
+  this->sealed.emplace(this->cur);
+}
+
+void Builder::add_edge(Block* from, Block* to)
+{
+  to->preds.emplace_back(from);
+}
+
+// --------------------------------------------------------
+//  変数 (SSA)
+// --------------------------------------------------------
+
+size_t Builder::new_variable(std::string_view name,
+                             TypeInfo const& type)
+{
+  this->vars.push_back({name, type});
+
+  return this->vars.size() - 1;
+}
+
+void Builder::write_var(size_t var, Block* block,
+                        Instr* value)
+{
+  this->defs[{block, var}] = value;
+}
+
+Instr* Builder::read_var(size_t var, Block* block)
+{
+  if (auto it = this->defs.find({block, var});
+      it != this->defs.end())
+    return it->second;
+
+  return this->read_var_recursive(var, block);
+}
+
+Instr* Builder::read_var_recursive(size_t var,
+                                   Block* block)
+{
+  auto const& type = this->vars[var].type;
+  Instr* value;
+
+  if (!this->sealed.contains(block)) {
+    // 前の基本ブロックが決まったら seal() で埋める
+    value = this->new_phi(block, type);
+    this->incomplete_phis[block].emplace_back(var, value);
+  }
+  else if (block->preds.empty()) {
+    value = this->insert_front(
+        block, this->func->new_instr(OP_Undef, type));
+  }
+  else if (block->preds.size() == 1) {
+    value = this->read_var(var, block->preds[0]);
+  }
+  else {
+    // ループで自分に戻ってくるので、先に phi を登録する
+    value = this->new_phi(block, type);
+    this->write_var(var, block, value);
+    this->add_phi_operands(var, value);
+  }
+
+  this->write_var(var, block, value);
+
+  return value;
+}
+
+void Builder::add_phi_operands(size_t var, Instr* phi)
+{
+  for (auto&& pred : phi->parent->preds) {
+    phi->operands.emplace_back(this->read_var(var, pred));
+    phi->targets.emplace_back(pred);
+  }
+}
+
+void Builder::seal(Block* block)
+{
+  if (auto it = this->incomplete_phis.find(block);
+      it != this->incomplete_phis.end()) {
+    auto list = std::move(it->second);
+
+    this->incomplete_phis.erase(it);
+
+    for (auto&& [var, phi] : list)
+      this->add_phi_operands(var, phi);
+  }
+
+  this->sealed.emplace(block);
+}
+
+static Instr* resolve(Instr* x)
+{
+  while (x->replaced_by)
+    x = x->replaced_by;
+
+  return x;
+}
+
+void Builder::remove_trivial_phis()
+{
+  for (bool changed = true; changed;) {
+    changed = false;
+
+    for (auto&& block : this->func->blocks) {
+      for (auto&& phi : block->instrs) {
+        if (phi->op != OP_Phi)
+          break;
+
+        if (phi->replaced_by)
+          continue;
+
+        Instr* same = nullptr;
+        bool trivial = true;
+
+        for (auto&& x : phi->operands) {
+          auto op = resolve(x);
+
+          if (op == same || op == phi)
+            continue;
+
+          if (same) {
+            trivial = false;
+            break;
+          }
+
+          same = op;
+        }
+
+        if (!trivial)
+          continue;
+
+        // 自分しか参照していなければ、到達しない値
+        if (!same) {
+          same = this->insert_front(
+              this->func->entry(),
+              this->func->new_instr(OP_Undef, phi->type));
+        }
+
+        phi->replaced_by = same;
+        changed = true;
+      }
+    }
+  }
+
+  for (auto&& block : this->func->blocks) {
+    std::erase_if(block->instrs, [](Instr* x) {
+      return x->replaced_by != nullptr;
+    });
+
+    for (auto&& instr : block->instrs) {
+      for (auto&& op : instr->operands)
+        op = resolve(op);
+    }
+  }
+}
+
+Builder::Binding Builder::find(AST::Base* ast)
+{
+  auto name = ast->token.str;
+
+  for (auto s = this->scopes.rbegin();
+       s != this->scopes.rend(); s++) {
+    for (auto b = s->names.rbegin(); b != s->names.rend();
+         b++) {
+      if (b->first == name)
+        return b->second;
+    }
+  }
+
+  // 関数の中からトップレベルの変数を参照する
+  if (auto it = this->visible_globals.find(name);
+      it != this->visible_globals.end())
+    return {true, it->second};
+
+  unsupported(ast);
+}
+
+TypeInfo const& Builder::type_of_binding(
+    Binding const& b) const
+{
+  if (b.is_global)
+    return this->module.globals[b.index].type;
+
+  return this->vars[b.index].type;
+}
+
+void Builder::declare(std::string_view name, size_t var)
+{
+  this->scopes.back().names.push_back({name, {false, var}});
+}
+
+// --------------------------------------------------------
+//  スコープ
+// --------------------------------------------------------
+
+void Builder::enter_scope(bool mark)
+{
+  this->scopes.emplace_back(
+      mark ? this->emit(OP_Mark, TYPE_USize) : nullptr);
+}
+
+void Builder::leave_scopes(size_t depth, Instr* keep)
+{
+  for (auto i = this->scopes.size(); i-- > depth;) {
+    auto const& s = this->scopes[i];
+
+    for (auto v = s.vars.rbegin(); v != s.vars.rend();
+         v++) {
+      this->emit(OP_Release, TYPE_None,
+                 {this->read_var(*v, this->cur)});
+    }
+
+    if (s.retained)
+      this->emit(OP_Release, TYPE_None, {s.retained});
+
+    if (s.mark) {
+      std::vector<Instr*> operands = {s.mark};
+
+      if (keep && !is_scalar(keep->type.kind))
+        operands.emplace_back(keep);
+
+      this->emit(OP_Collect, TYPE_None, operands);
+    }
+  }
+}
+
+void Builder::leave_scope(Instr* keep)
+{
+  this->leave_scopes(this->scopes.size() - 1, keep);
+  this->scopes.pop_back();
+}
+
+// --------------------------------------------------------
+//  式
+// --------------------------------------------------------
+
+Instr* Builder::expr(AST::Base* _ast)
+{
+  switch (_ast->kind) {
+    case AST_None:
+      return this->constant(Value(), TYPE_None);
+
+    case AST_True:
+      return this->constant(Value::from_bool(true),
+                            TYPE_Bool);
+
+    case AST_False:
+      return this->constant(Value::from_bool(false),
+                            TYPE_Bool);
+
+    case AST_Value:
+      return this->literal((AST::Value*)_ast);
+
+    case AST_Variable: {
+      auto value = this->borrow(_ast);
+
+      if (is_scalar(value->type.kind))
+        return value;
+
+      return this->emit(OP_Clone, value->type, {value});
+    }
+
+    case AST_UnaryPlus:
+      return this->expr(((AST::UnaryOp*)_ast)->expr);
+
+    case AST_UnaryMinus: {
+      astdef(UnaryOp);
+
+      auto kind = type_of(ast->expr).kind;
+
+      if (kind != TYPE_Int && kind != TYPE_Float)
+        unsupported(ast);
+
+      return this->emit(OP_Neg, kind,
+                        {this->expr(ast->expr)});
+    }
+
+    case AST_Cast: {
+      astdef(Cast);
+
+      auto value = this->expr(ast->expr);
+      auto type = type_of(ast->cast_to);
+
+      if (value->type.kind == type.kind)
+        return value;
+
+      return this->emit(OP_Cast, type, {value});
+    }
+
+    case AST_Vector:
+    case AST_Dict:
+    case AST_TypeConstructor:
+      return this->new_container(_ast);
+
+    case AST_Range:
+      return this->range((AST::Range*)_ast);
+
+    case AST_CallFunc:
+      return this->call((AST::CallFunc*)_ast);
+
+    case AST_IndexRef:
+      return this->index((AST::IndexRef*)_ast);
+
+    case AST_MemberAccess:
+      return this->member((AST::IndexRef*)_ast);
+
+    case AST_Expr:
+      return this->arith((AST::Expr*)_ast);
+
+    case AST_Compare:
+      return this->compare((AST::Compare*)_ast);
+
+    case AST_Assign:
+      return this->assign((AST::Assign*)_ast);
+
+    case AST_If:
+    case AST_Scope:
+    case AST_Switch:
+    case AST_For:
+    case AST_While:
+    case AST_DoWhile:
+    case AST_Loop: {
+      if (auto value = this->stmt(_ast, true); value)
+        return value;
+
+      return this->constant(Value(), TYPE_None);
+    }
+  }
+
+  unsupported(_ast);
+}
+
+Instr* Builder::borrow(AST::Base* ast)
+{
+  if (ast->kind == AST_Variable)
+    return this->read(this->find(ast));
+
+  return this->expr(ast);
+}
+
+Instr* Builder::lvalue(AST::Base* _ast)
+{
+  switch (_ast->kind) {
+    case AST_Variable:
+      return this->read(this->find(_ast));
+
+    case AST_MemberAccess: {
+      astdef(IndexRef);
+
+      auto ptr = this->lvalue(ast->expr);
+
+      for (auto&& m : ast->indexes) {
+        auto index = ((AST::Variable*)m)->index;
+
+        ptr = this->emit(
+            OP_Member, ptr->type.members[index].second,
+            {ptr});
+
+        ptr->index = (int64_t)index;
+      }
+
+      return ptr;
+    }
+
+    case AST_IndexRef: {
+      astdef(IndexRef);
+
+      auto ptr = this->lvalue(ast->expr);
+
+      for (auto&& index : ast->indexes) {
+        ptr = this->emit(OP_IndexRef,
+                         element_type(ptr->type),
+                         {ptr, this->expr(index)});
+
+        ptr->check = ast->needs_bounds_check(index);
+        ptr->site = location(index);
+      }
+
+      return ptr;
+    }
+  }
+
+  unsupported(_ast);
+}
+
+Instr* Builder::literal(AST::Value* ast)
+{
+  auto type = type_of(ast);
+  auto str = std::string(ast->token.str);
+
+  try {
+    switch (type.kind) {
+      case TYPE_Int:
+        return this->constant(
+            Value::from_int(std::stoll(str)), type);
+
+      case TYPE_USize:
+        return this->constant(
+            Value::from_usize(std::stoull(str)), type);
+
+      case TYPE_Float:
+        return this->constant(
+            Value::from_float(std::stof(str)), type);
+
+      case TYPE_String: {
+        auto [it, inserted] =
+            this->strings.try_emplace(ast);
+
+        if (inserted) {
+          auto ws = Utils::String::to_wstr(str);
+
+          // remove double quotation
+          ws.erase(ws.begin());
+          ws.pop_back();
+
+          it->second = new ObjString(std::move(ws));
+          it->second.inc_ref();
+
+          this->module.constants.emplace_back(it->second);
+        }
+
+        return this->constant(it->second, type);
+      }
+    }
+  }
+  catch (std::exception const&) {
+  }
+
+  unsupported(ast);
+}
+
+Instr* Builder::call(AST::CallFunc* ast)
+{
+  if (ast->is_builtin)
+    return this->call_builtin(ast);
+
+  auto it = this->functions.find(ast->callee);
+
+  if (it == this->functions.end())
+    unsupported(ast);
+
+  std::vector<Instr*> args;
+
+  for (auto&& arg : ast->args)
+    args.emplace_back(this->expr(arg));
+
+  auto instr = this->emit(OP_Call, type_of(ast), args, ast);
+
+  instr->callee = it->second;
+
+  return instr;
+}
+
+Instr* Builder::call_builtin(AST::CallFunc* ast)
+{
+  auto func = ast->builtin_func;
+  auto passing = func->arg_passing;
+
+  std::vector<Instr*> args;
+
+  for (auto&& arg : ast->args) {
+    // 複製せずに渡す
+    if (passing == BuiltinFunc::ARG_Ref &&
+        arg == ast->args[0])
+      args.emplace_back(this->lvalue(arg));
+    else if (passing != BuiltinFunc::ARG_Copy &&
+             arg->kind == AST_Variable)
+      args.emplace_back(this->borrow(arg));
+    else
+      args.emplace_back(this->expr(arg));
+  }
+
+  auto instr =
+      this->emit(OP_CallBuiltin, type_of(ast), args, ast);
+
+  instr->index =
+      func - BuiltinFunc::get_builtin_list().data();
+
+  instr->site = location(ast);
+
+  return instr;
+}
+
+Instr* Builder::index(AST::IndexRef* ast)
+{
+  auto ptr = this->borrow(ast->expr);
+
+  for (auto&& index : ast->indexes) {
+    ptr = this->emit(OP_Index, element_type(ptr->type),
+                     {ptr, this->borrow(index)});
+
+    ptr->check = ast->needs_bounds_check(index);
+    ptr->site = location(index);
+  }
+
+  if (is_scalar(ptr->type.kind))
+    return ptr;
+
+  return this->emit(OP_Clone, ptr->type, {ptr});
+}
+
+Instr* Builder::member(AST::IndexRef* ast)
+{
+  auto ptr = this->borrow(ast->expr);
+
+  for (auto&& m : ast->indexes) {
+    auto index = ((AST::Variable*)m)->index;
+
+    ptr = this->emit(OP_Member,
+                     ptr->type.members[index].second,
+                     {ptr});
+
+    ptr->index = (int64_t)index;
+  }
+
+  if (is_scalar(ptr->type.kind))
+    return ptr;
+
+  return this->emit(OP_Clone, ptr->type, {ptr});
+}
+
+Instr* Builder::arith(AST::Expr* ast)
+{
+  if (type_of(ast->first).kind == TYPE_String)
+    return this->concat(ast);
+
+  auto acc = this->expr(ast->first);
+
+  for (auto&& elem : ast->elements) {
+    auto L = acc->type.kind;
+    auto R = type_of(elem.ast).kind;
+
+    switch (elem.kind) {
+      case AST::EX_And:
+      case AST::EX_Or:
+        if (L != TYPE_Bool || R != TYPE_Bool)
+          unsupported(ast);
+
+        acc = this->short_circuit(acc, elem.kind, elem.ast);
+        continue;
+
+      case AST::EX_Mod:
+        unsupported(ast);
+
+      case AST::EX_LShift:
+      case AST::EX_RShift:
+      case AST::EX_BitAND:
+      case AST::EX_BitXOR:
+      case AST::EX_BitOR:
+        if (L != TYPE_Int || R != TYPE_Int)
+          unsupported(ast);
+
+        break;
+
+      case AST::EX_Add:
+        if (L != R)
+          unsupported(ast);
+
+        [[fallthrough]];
+
+      default:
+        if (L != TYPE_Int && L != TYPE_USize &&
+            L != TYPE_Float)
+          unsupported(ast);
+
+        if (R != TYPE_Int && R != TYPE_USize &&
+            R != TYPE_Float)
+          unsupported(ast);
+    }
+
+    auto right = this->expr(elem.ast);
+
+    acc = this->emit(OP_Binary,
+                     result_kind(elem.kind, L, R),
+                     {acc, right}, elem.ast);
+
+    acc->index = elem.kind;
+    acc->token = &elem.op;
+  }
+
+  return acc;
+}
+
+Instr* Builder::concat(AST::Expr* ast)
+{
+  // 右辺で GC が動くなら、左辺を先に複製しておく
+  bool simple = true;
+
+  for (auto&& elem : ast->elements) {
+    if (elem.kind != AST::EX_Add)
+      unsupported(ast);
+
+    simple &= is_simple(elem.ast);
+  }
+
+  std::vector<Instr*> operands = {
+      simple ? this->borrow(ast->first)
+             : this->expr(ast->first)};
+
+  for (auto&& elem : ast->elements)
+    operands.emplace_back(this->borrow(elem.ast));
+
+  return this->emit(OP_Concat, TYPE_String, operands, ast);
+}
+
+Instr* Builder::compare(AST::Compare* ast)
+{
+  auto apply = [&](AST::CmpKind kind, Instr* a, Instr* b) {
+    if (a->type.kind == TYPE_None ||
+        b->type.kind == TYPE_None)
+      unsupported(ast);
+
+    auto instr =
+        this->emit(OP_Compare, TYPE_Bool, {a, b}, ast);
+
+    instr->index = kind;
+
+    return instr;
+  };
+
+  auto left = this->borrow(ast->first);
+
+  if (ast->elements.size() == 1) {
+    auto const& elem = ast->elements[0];
+
+    return apply(elem.kind, left,
+                 this->borrow(elem.ast));
+  }
+
+  //
+  // a < b < c
+  //  左から順に比べて、偽になったら残りは評価しない
+  auto merge = this->func->new_block();
+
+  std::vector<std::pair<Block*, Instr*>> incoming;
+
+  for (auto&& elem : ast->elements) {
+    auto right = this->borrow(elem.ast);
+    auto cond = apply(elem.kind, left, right);
+
+    if (&elem == &ast->elements.back()) {
+      incoming.emplace_back(this->cur, cond);
+      this->jump(merge);
+      break;
+    }
+
+    auto next = this->func->new_block();
+
+    incoming.emplace_back(
+        this->cur,
+        this->constant(Value::from_bool(false), TYPE_Bool));
+
+    this->branch(cond, next, merge);
+
+    this->seal(next);
+    this->set_block(next);
+
+    left = right;
+  }
+
+  this->seal(merge);
+  this->set_block(merge);
+
+  auto phi = this->new_phi(merge, TYPE_Bool);
+
+  for (auto&& [block, value] : incoming) {
+    phi->operands.emplace_back(value);
+    phi->targets.emplace_back(block);
+  }
+
+  return phi;
+}
+
+Instr* Builder::assign(AST::Assign* ast)
+{
+  switch (ast->dest->kind) {
+    case AST_Variable: {
+      auto value = this->expr(ast->expr);
+
+      return this->assign_var(this->find(ast->dest), value);
+    }
+
+    case AST_IndexRef: {
+      auto ref = (AST::IndexRef*)ast->dest;
+      auto last = ref->indexes.back();
+
+      // 書き込み先をたどる間に削除されないよう、先に増やす
+      auto value = this->expr(ast->expr);
+
+      if (!is_scalar(value->type.kind))
+        this->emit(OP_Retain, TYPE_None, {value});
+
+      auto ptr = this->lvalue(ref->expr);
+
+      for (auto&& index : ref->indexes) {
+        if (index == last)
+          break;
+
+        ptr = this->emit(OP_IndexRef,
+                         element_type(ptr->type),
+                         {ptr, this->expr(index)});
+
+        ptr->check = ref->needs_bounds_check(index);
+        ptr->site = location(index);
+      }
+
+      auto instr =
+          this->emit(OP_Store, value->type,
+                     {ptr, this->expr(last), value});
+
+      instr->check = ref->needs_bounds_check(last);
+      instr->site = location(last);
+
+      return instr;
+    }
+  }
+
+  unsupported(ast);
+}
+
+Instr* Builder::assign_var(Binding const& b, Instr* value)
+{
+  auto heap = !is_scalar(value->type.kind);
+
+  if (heap)
+    this->emit(OP_Retain, TYPE_None, {value});
+
+  if (b.is_global) {
+    if (heap) {
+      auto old = this->read(b);
+
+      this->emit(OP_Release, TYPE_None, {old});
+    }
+
+    this->emit(OP_StoreGlobal, TYPE_None, {value})->index =
+        (int64_t)b.index;
+  }
+  else {
+    if (heap) {
+      auto old = this->read_var(b.index, this->cur);
+
+      this->emit(OP_Release, TYPE_None, {old});
+    }
+
+    this->write_var(b.index, this->cur, value);
+  }
+
+  return value;
+}
+
+Instr* Builder::read(Binding const& b)
+{
+  if (!b.is_global)
+    return this->read_var(b.index, this->cur);
+
+  auto instr =
+      this->emit(OP_LoadGlobal, this->type_of_binding(b));
+
+  instr->index = (int64_t)b.index;
+
+  return instr;
+}
+
+Instr* Builder::short_circuit(Instr* left,
+                              AST::ExprKind kind,
+                              AST::Base* right)
+{
+  auto rhs = this->func->new_block();
+  auto merge = this->func->new_block();
+  auto from = this->cur;
+
+  if (kind == AST::EX_And)
+    this->branch(left, rhs, merge);
+  else
+    this->branch(left, merge, rhs);
+
+  this->seal(rhs);
+  this->set_block(rhs);
+
+  auto value = this->expr(right);
+  auto rhs_end = this->cur;
+
+  this->jump(merge);
+
+  this->seal(merge);
+  this->set_block(merge);
+
+  auto phi = this->new_phi(merge, TYPE_Bool);
+
+  phi->operands = {left, value};
+  phi->targets = {from, rhs_end};
+
+  return phi;
+}
+
+Instr* Builder::new_container(AST::Base* _ast)
+{
+  auto type = type_of(_ast);
+  auto desc = TypeInfo::intern(type);
+
+  Instr* obj;
+  bool protect = false;
+
+  switch (_ast->kind) {
+    case AST_Vector:
+      obj = this->emit(OP_NewVector, type);
+
+      for (auto&& e : ((AST::Vector*)_ast)->elements)
+        protect |= !is_simple(e);
+
+      break;
+
+    case AST_Dict:
+      obj = this->emit(OP_NewDict, type);
+
+      for (auto&& elem : ((AST::Dict*)_ast)->elements)
+        protect |= !is_simple(elem.key) ||
+                   !is_simple(elem.value);
+
+      break;
+
+    default:
+      obj = this->emit(OP_NewStruct, type);
+
+      for (auto&& elem :
+           ((AST::TypeConstructor*)_ast)->elements)
+        protect |= !is_simple(elem.value);
+
+      break;
+  }
+
+  obj->desc = desc;
+
+  // 要素を評価している間に削除されないようにする
+  if (protect)
+    this->emit(OP_NoDelete, TYPE_None, {obj})->index = 1;
+
+  switch (_ast->kind) {
+    case AST_Vector:
+      for (auto&& e : ((AST::Vector*)_ast)->elements) {
+        this->emit(OP_Append, TYPE_None,
+                   {obj, this->expr(e)});
+      }
+
+      break;
+
+    case AST_Dict:
+      for (auto&& elem : ((AST::Dict*)_ast)->elements) {
+        auto key = this->expr(elem.key);
+
+        this->emit(OP_Append, TYPE_None,
+                   {obj, key, this->expr(elem.value)});
+      }
+
+      break;
+
+    default:
+      // 書いた順に追加する (Evaluator と同じ)
+      for (auto&& elem :
+           ((AST::TypeConstructor*)_ast)->elements) {
+        this->emit(OP_AddMember, TYPE_None,
+                   {obj, this->expr(elem.value)});
+      }
+
+      break;
+  }
+
+  if (protect)
+    this->emit(OP_NoDelete, TYPE_None, {obj})->index = 0;
+
+  return obj;
+}
+
+Instr* Builder::range(AST::Range* ast)
+{
+  auto begin = this->expr(ast->begin);
+  auto end = this->expr(ast->end);
+  Instr* step;
+
+  if (ast->step) {
+    step = this->emit(OP_RangeStep, TYPE_Int,
+                      {this->expr(ast->step)});
+
+    step->site = location(ast->step);
+  }
+  else {
+    step = this->constant(Value::from_int(1), TYPE_Int);
+  }
+
+  return this->emit(OP_NewRange, TYPE_Range,
+                    {begin, end, step}, ast);
+}
+
+// --------------------------------------------------------
+//  文
+// --------------------------------------------------------
+
+Instr* Builder::stmt(AST::Base* _ast, bool want)
+{
+  switch (_ast->kind) {
+    case AST_None:
+    case AST_Struct:
+      return nullptr;
+
+    case AST_Impl:
+      unsupported(_ast);
+
+    case AST_Function:
+      this->build_function((AST::Function*)_ast);
+      return nullptr;
+
+    case AST_Let:
+      this->let((AST::VariableDeclaration*)_ast);
+      return nullptr;
+
+    case AST_Return:
+      this->return_stmt((AST::Return*)_ast);
+      return nullptr;
+
+    case AST_Break:
+      this->loop_control(_ast, true);
+      return nullptr;
+
+    case AST_Continue:
+      this->loop_control(_ast, false);
+      return nullptr;
+
+    case AST_If:
+      return this->if_stmt((AST::If*)_ast, want);
+
+    case AST_Scope:
+      return this->scope(_ast, want);
+
+    case AST_Switch:
+      this->switch_stmt((AST::Switch*)_ast);
+      return nullptr;
+
+    case AST_For:
+      this->for_stmt((AST::For*)_ast);
+      return nullptr;
+
+    case AST_While:
+      this->while_stmt((AST::While*)_ast);
+      return nullptr;
+
+    case AST_DoWhile:
+      this->do_while((AST::DoWhile*)_ast);
+      return nullptr;
+
+    case AST_Loop:
+      this->loop_stmt((AST::Loop*)_ast);
+      return nullptr;
+  }
+
+  auto value = this->expr(_ast);
+
+  return want ? value : nullptr;
+}
+
+Instr* Builder::scope(AST::Base* ast, bool want)
+{
+  if (ast->kind != AST_Scope)
+    return this->stmt(ast, want);
+
+  auto x = (AST::Scope*)ast;
+  Instr* result = nullptr;
+
+  this->enter_scope(!x->list.empty());
+
+  for (auto&& item : x->list)
+    result =
+        this->stmt(item, want && item == x->list.back());
+
+  this->leave_scope(result);
+
+  return result;
+}
+
+Instr* Builder::if_stmt(AST::If* ast, bool want)
+{
+  // else がなければ値はない
+  want = want && ast->if_false;
+
+  auto cond = this->expr(ast->condition);
+
+  auto then_block = this->func->new_block();
+  auto else_block =
+      ast->if_false ? this->func->new_block() : nullptr;
+  auto merge = this->func->new_block();
+
+  this->branch(cond, then_block,
+               else_block ? else_block : merge);
+
+  this->seal(then_block);
+  this->set_block(then_block);
+
+  auto if_true = this->scope(ast->if_true, want);
+  auto true_end = this->cur;
+
+  this->jump(merge);
+
+  Instr* if_false = nullptr;
+  Block* false_end = nullptr;
+
+  if (else_block) {
+    this->seal(else_block);
+    this->set_block(else_block);
+
+    if (ast->if_false->kind == AST_If)
+      if_false =
+          this->if_stmt((AST::If*)ast->if_false, want);
+    else
+      if_false = this->scope(ast->if_false, want);
+
+    false_end = this->cur;
+
+    this->jump(merge);
+  }
+
+  this->seal(merge);
+  this->set_block(merge);
+
+  if (!want)
+    return nullptr;
+
+  //
+  // 型が違う (return で抜けたなど) 側は Undef にする
+  auto type = type_of(ast);
+  auto phi = this->new_phi(merge, type);
+
+  auto undef = [&](Instr* value, Block* block) {
+    if (value && value->type.kind == type.kind)
+      return value;
+
+    auto x = this->func->new_instr(OP_Undef, type);
+
+    x->parent = block;
+    block->instrs.insert(block->instrs.end() - 1, x);
+
+    return x;
+  };
+
+  phi->operands = {undef(if_true, true_end),
+                   undef(if_false, false_end)};
+
+  phi->targets = {true_end, false_end};
+
+  return phi;
+}
+
+void Builder::let(AST::VariableDeclaration* ast)
+{
+  auto type =
+      ast->type ? type_of(ast->type) : type_of(ast->init);
+
+  auto heap = !is_scalar(type.kind);
+
+  // 初期化式の中では、まだ新しい変数は見えない
+  Instr* init;
+
+  if (ast->init)
+    init = this->expr(ast->init);
+  else if (!heap)
+    init = this->constant(zero_of(type.kind), type);
+  else {
+    init = this->emit(OP_Default, type);
+    init->desc = TypeInfo::intern(type);
+  }
+
+  if (heap)
+    this->emit(OP_Retain, TYPE_None, {init});
+
+  //
+  // 関数から参照されるトップレベルの変数
+  if (this->func == this->module.functions[0].get() &&
+      this->scopes.size() == 1 &&
+      this->global_names.contains(ast->name)) {
+    auto slot = this->module.globals.size();
+
+    this->module.globals.push_back({ast->name, type});
+
+    // ループの中なら前の値を手放す
+    if (heap) {
+      auto old = this->emit(OP_LoadGlobal, type);
+
+      old->index = (int64_t)slot;
+
+      this->emit(OP_Release, TYPE_None, {old});
+    }
+
+    this->emit(OP_StoreGlobal, TYPE_None, {init})->index =
+        (int64_t)slot;
+
+    this->scopes.back().names.push_back(
+        {ast->name, {true, slot}});
+
+    this->visible_globals[ast->name] = slot;
+
+    return;
+  }
+
+  auto var = this->new_variable(ast->name, type);
+
+  this->write_var(var, this->cur, init);
+  this->declare(ast->name, var);
+
+  if (heap)
+    this->scopes.back().vars.emplace_back(var);
+}
+
+void Builder::switch_stmt(AST::Switch* ast)
+{
+  auto item = this->expr(ast->expr);
+  auto merge = this->func->new_block();
+
+  for (auto&& c : ast->cases) {
+    auto cond = this->expr(c->cond);
+    Instr* match;
+
+    // false なら飛ばし、true なら値と比べる
+    //  (bool でない値とは一致しない)
+    if (cond->type.kind == TYPE_Bool) {
+      auto no = this->constant(Value::from_bool(false),
+                               TYPE_Bool);
+
+      match = item->type.kind == TYPE_Bool
+                  ? this->emit(OP_Select, TYPE_Bool,
+                               {cond, item, no})
+                  : no;
+    }
+    else {
+      match = this->emit(OP_Compare, TYPE_Bool,
+                         {cond, item}, c);
+
+      match->index = AST::CMP_Equal;
+    }
+
+    auto body = this->func->new_block();
+    auto next = this->func->new_block();
+
+    this->branch(match, body, next);
+
+    this->seal(body);
+    this->set_block(body);
+
+    this->scope(c->scope, false);
+    this->jump(merge);
+
+    this->seal(next);
+    this->set_block(next);
+  }
+
+  this->jump(merge);
+
+  this->seal(merge);
+  this->set_block(merge);
+}
+
+void Builder::for_stmt(AST::For* ast)
+{
+  if (ast->iter->kind != AST_Variable)
+    unsupported(ast->iter);
+
+  auto kind = type_of(ast->iterable).kind;
+
+  // ループ変数のスコープ (回収はしない)
+  this->enter_scope(false);
+
+  if (kind == TYPE_Range)
+    this->for_range(ast);
+  else if (type_of(ast->iterable).is_iterable())
+    this->for_in(ast);
+  else
+    unsupported(ast->iterable);
+
+  this->leave_scope();
+}
+
+void Builder::for_range(AST::For* ast)
+{
+  Instr* begin;
+  Instr* end;
+  Instr* step;
+
+  // 向きが分かっていれば、比べる方向を決めておく
+  bool positive = false;
+
+  if (ast->iterable->kind == AST_Range) {
+    auto range = (AST::Range*)ast->iterable;
+
+    begin = this->expr(range->begin);
+    end = this->expr(range->end);
+
+    if (!range->step) {
+      step = this->constant(Value::from_int(1), TYPE_Int);
+      positive = true;
+    }
+    else if (is_positive_literal(range->step)) {
+      step = this->expr(range->step);
+      positive = true;
+    }
+    else {
+      step = this->emit(OP_RangeStep, TYPE_Int,
+                        {this->expr(range->step)});
+
+      step->site = location(range->step);
+    }
+  }
+  else {
+    auto obj = this->borrow(ast->iterable);
+
+    begin = this->emit(OP_RangeField, TYPE_Int, {obj});
+    end = this->emit(OP_RangeField, TYPE_Int, {obj});
+    step = this->emit(OP_RangeField, TYPE_Int, {obj});
+
+    end->index = 1;
+    step->index = 2;
+  }
+
+  auto name = ast->iter->token.str;
+  auto var = this->new_variable(name, TYPE_Int);
+
+  this->write_var(var, this->cur, begin);
+  this->declare(name, var);
+
+  auto header = this->func->new_block();
+  auto body = this->func->new_block();
+  auto latch = this->func->new_block();
+  auto exit = this->func->new_block();
+
+  this->jump(header);
+  this->set_block(header);
+
+  auto i = this->read_var(var, header);
+
+  auto compare = [&](AST::CmpKind kind, Instr* a,
+                     Instr* b) {
+    auto instr = this->emit(OP_Compare, TYPE_Bool, {a, b});
+
+    instr->index = kind;
+
+    return instr;
+  };
+
+  Instr* cond;
+
+  if (positive)
+    cond = compare(AST::CMP_LeftBigger, end, i);
+  else {
+    auto zero =
+        this->constant(Value::from_int(0), TYPE_Int);
+
+    cond = this->emit(
+        OP_Select, TYPE_Bool,
+        {compare(AST::CMP_LeftBigger, step, zero),
+         compare(AST::CMP_LeftBigger, end, i),
+         compare(AST::CMP_RightBigger, end, i)});
+  }
+
+  this->branch(cond, body, exit);
+
+  this->seal(body);
+  this->set_block(body);
+
+  this->loop_body(ast->code, exit, latch);
+
+  this->seal(latch);
+  this->set_block(latch);
+
+  // 次の値が end を越えるなら end にして抜ける
+  //  (i + step は桁あふれすることがある)
+  auto next = this->emit(
+      OP_RangeNext, TYPE_Int,
+      {this->read_var(var, latch), end, step}, ast);
+
+  this->write_var(var, latch, next);
+  this->jump(header);
+
+  this->seal(header);
+  this->seal(exit);
+  this->set_block(exit);
+}
+
+void Builder::for_in(AST::For* ast)
+{
+  auto type = type_of(ast->iterable);
+
+  // 回している間は参照を持っておく
+  auto obj = this->borrow(ast->iterable);
+
+  this->emit(OP_Retain, TYPE_None, {obj});
+  this->scopes.back().retained = obj;
+
+  auto version =
+      this->emit(OP_IterVersion, TYPE_USize, {obj});
+
+  auto elem_type = type.kind == TYPE_String
+                       ? TypeInfo(TYPE_Char)
+                       : type.type_params[0];
+
+  auto index = this->new_variable("", TYPE_USize);
+
+  this->write_var(
+      index, this->cur,
+      this->constant(Value::from_usize(0), TYPE_USize));
+
+  //
+  // 変数には要素をそのまま入れる (複製しない)
+  auto name = ast->iter->token.str;
+  auto var = this->new_variable(name, elem_type);
+
+  this->declare(name, var);
+
+  auto header = this->func->new_block();
+  auto body = this->func->new_block();
+  auto latch = this->func->new_block();
+  auto exit = this->func->new_block();
+
+  this->jump(header);
+  this->set_block(header);
+
+  auto i = this->read_var(index, header);
+  auto size = this->emit(OP_IterSize, TYPE_USize, {obj});
+
+  auto cond = this->emit(OP_Compare, TYPE_Bool, {size, i});
+
+  cond->index = AST::CMP_LeftBigger;
+
+  this->branch(cond, body, exit);
+
+  this->seal(body);
+  this->set_block(body);
+
+  this->write_var(
+      var, body,
+      this->emit(OP_IterGet, elem_type,
+                 {obj, this->read_var(index, body)}));
+
+  this->loop_body(ast->code, exit, latch);
+
+  this->seal(latch);
+  this->set_block(latch);
+
+  // 書き換えられていたらエラー
+  this->emit(OP_IterCheck, TYPE_None, {obj, version})
+      ->site = location(ast->iterable);
+
+  auto next = this->emit(
+      OP_Binary, TYPE_USize,
+      {this->read_var(index, latch),
+       this->constant(Value::from_usize(1), TYPE_USize)},
+      ast);
+
+  next->index = AST::EX_Add;
+  next->token = &ast->token;
+
+  this->write_var(index, latch, next);
+  this->jump(header);
+
+  this->seal(header);
+  this->seal(exit);
+  this->set_block(exit);
+}
+
+void Builder::while_stmt(AST::While* ast)
+{
+  auto header = this->func->new_block();
+  auto body = this->func->new_block();
+  auto exit = this->func->new_block();
+
+  this->jump(header);
+  this->set_block(header);
+
+  this->branch(this->expr(ast->cond), body, exit);
+
+  this->seal(body);
+  this->set_block(body);
+
+  this->loop_body(ast->code, exit, header);
+
+  this->seal(header);
+  this->seal(exit);
+  this->set_block(exit);
+}
+
+void Builder::do_while(AST::DoWhile* ast)
+{
+  auto body = this->func->new_block();
+  auto cond = this->func->new_block();
+  auto exit = this->func->new_block();
+
+  this->jump(body);
+  this->set_block(body);
+
+  this->loop_body(ast->code, exit, cond);
+
+  this->seal(cond);
+  this->set_block(cond);
+
+  this->branch(this->expr(ast->cond), body, exit);
+
+  this->seal(body);
+  this->seal(exit);
+  this->set_block(exit);
+}
+
+void Builder::loop_stmt(AST::Loop* ast)
+{
+  auto body = this->func->new_block();
+  auto exit = this->func->new_block();
+
+  this->jump(body);
+  this->set_block(body);
+
+  this->loop_body(ast->code, exit, body);
+
+  this->seal(body);
+  this->seal(exit);
+  this->set_block(exit);
+}
+
+void Builder::return_stmt(AST::Return* ast)
+{
+  auto value = ast->expr ? this->expr(ast->expr) : nullptr;
+
+  this->leave_scopes(this->func_depth, value);
+
+  this->emit(OP_Return, TYPE_None,
+             value ? std::vector<Instr*>{value}
+                   : std::vector<Instr*>{});
+
+  this->terminate();
+}
+
+void Builder::loop_control(AST::Base* ast, bool is_break)
+{
+  if (this->loops.empty())
+    unsupported(ast);
+
+  auto const& loop = this->loops.back();
+
+  this->leave_scopes(loop.depth, nullptr);
+
+  this->jump(is_break ? loop.break_to : loop.continue_to);
+}
+
+void Builder::loop_body(AST::Base* body, Block* break_to,
+                        Block* continue_to)
+{
+  this->loops.push_back(
+      {break_to, continue_to, this->scopes.size()});
+
+  this->scope(body, false);
+  this->jump(continue_to);
+
+  this->loops.pop_back();
+}
+
+// --------------------------------------------------------
+//  その他
+// --------------------------------------------------------
+
+TypeInfo Builder::type_of(AST::Base* ast)
+{
+  switch (ast->kind) {
+    case AST_TypeConstructor:
+      return ((AST::TypeConstructor*)ast)->typeinfo;
+
+    // else があると、Sema は型を残さずに返る
+    case AST_If:
+      if (auto x = (AST::If*)ast; x->if_false)
+        return type_of(x->if_true);
+
+      break;
+  }
+
+  auto it = Sema::value_type_cache.find(ast);
+
+  if (it == Sema::value_type_cache.end())
+    return TYPE_None;
+
+  return it->second;
+}
+
+bool Builder::is_scalar(TypeKind kind)
+{
+  return kind >= TYPE_Int && kind <= TYPE_Char;
+}
+
+TypeInfo Builder::element_type(TypeInfo const& type)
+{
+  switch (type.kind) {
+    case TYPE_String:
+      return TYPE_Char;
+
+    case TYPE_Vector:
+      return type.type_params[0];
+
+    case TYPE_Dict:
+      return type.type_params[1];
+  }
+
+  return TYPE_None;
+}
+
+bool Builder::is_simple(AST::Base* ast)
+{
+  switch (ast->kind) {
+    case AST_None:
+    case AST_True:
+    case AST_False:
+    case AST_Value:
+    case AST_Variable:
+      return true;
+  }
+
+  return false;
+}
+
+std::string Builder::location(AST::Base* ast)
+{
+  // 終わりの位置がなければ、最初の字句だけ表示する
+  if (ast->end_token == std::list<Token>::const_iterator())
+    return Error(ast->token, "").get_location();
+
+  return Error(ast, "").get_location();
+}
+
+void Builder::unsupported(AST::Base* ast)
+{
+  Error(ast, "cannot lower this to IR").emit().exit();
+}
+
+}  // namespace IR
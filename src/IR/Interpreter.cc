@@ -0,0 +1,362 @@
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Arith.h"
+#include "Error.h"
+#include "Evaluator.h"
+#include "Operators.h"
+#include "AOT/Runtime.h"
+#include "IR/Interpreter.h"
+
+namespace IR {
+
+//
+// 呼び出しの深さの上限
+//  (C++ のスタックを使い切る前にエラーにする)
+static constexpr size_t MAX_DEPTH = 10000;
+
+Interpreter::Interpreter(Module const& module)
+    : module(module),
+      globals(module.globals.size()),
+      depth(0)
+{
+}
+
+void Interpreter::run()
+{
+  this->call(this->module.functions[0].get(), {});
+}
+
+//
+// 呼び出しと分岐以外の命令を実行する
+//  (call の再帰でスタックを使いすぎないよう、別の関数にする)
+[[gnu::noinline]] void Interpreter::execute(
+    Instr const* x, std::vector<Value>& regs,
+    std::vector<Value> const& args)
+{
+  auto get = [&regs](Instr const* x) -> Value& {
+    return regs[x->id];
+  };
+
+  auto const& ops = x->operands;
+
+  switch (x->op) {
+    case OP_Undef:
+      get(x) = Value();
+      break;
+
+    case OP_Const:
+      get(x) = x->imm;
+      break;
+
+    case OP_Param:
+      get(x) = args[x->index];
+      break;
+
+    case OP_LoadGlobal:
+      get(x) = this->globals[x->index];
+      break;
+
+    case OP_StoreGlobal:
+      this->globals[x->index] = get(ops[0]);
+      break;
+
+    case OP_Binary: {
+      auto kernel = Operators::get_expr_kernel(
+          (AST::ExprKind)x->index, ops[0]->type.kind,
+          ops[1]->type.kind);
+
+      Value dest = get(ops[0]);
+
+      kernel(dest, get(ops[1]), *x->token);
+
+      get(x) = dest;
+      break;
+    }
+
+    case OP_Compare: {
+      auto kernel = Operators::get_compare_kernel(
+          (AST::CmpKind)x->index, ops[0]->type.kind,
+          ops[1]->type.kind);
+
+      get(x) = Value::from_bool(
+          kernel(get(ops[0]), get(ops[1])));
+
+      break;
+    }
+
+    case OP_Neg: {
+      auto const& v = get(ops[0]);
+
+      get(x) = v.kind == TYPE_Float
+                   ? Value::from_float(-v.v_float)
+                   : Value::from_int(Arith::neg(v.v_int));
+
+      break;
+    }
+
+    case OP_Cast:
+      get(x) =
+          Evaluator::cast_value(get(ops[0]), x->type.kind);
+      break;
+
+    case OP_Select:
+      get(x) = get(ops[0]).v_bool ? get(ops[1])
+                                  : get(ops[2]);
+      break;
+
+    case OP_Concat: {
+      Value str = get(ops[0]).clone();
+
+      for (size_t k = 1; k < ops.size(); k++)
+        AOT::concat(str, get(ops[k]));
+
+      get(x) = str;
+      break;
+    }
+
+    case OP_Clone:
+      get(x) = get(ops[0]).clone();
+      break;
+
+    case OP_Retain:
+      get(ops[0]).inc_ref();
+      break;
+
+    case OP_Release:
+      get(ops[0]).dec_ref();
+      break;
+
+    case OP_Mark:
+      get(x) = Value::from_usize(AOT::mark());
+      break;
+
+    case OP_Collect: {
+      auto mark = get(ops[0]).v_usize;
+
+      if (AOT::mark() == mark)
+        break;
+
+      AOT::collect(mark, ops.size() > 1 ? get(ops[1])
+                                        : Value());
+
+      break;
+    }
+
+    case OP_NoDelete:
+      get(ops[0]).v_obj->no_delete = x->index != 0;
+      break;
+
+    case OP_Default:
+      get(x) = AOT::default_value(*x->desc);
+      break;
+
+    case OP_NewVector:
+      get(x) = AOT::new_vector(x->desc);
+      break;
+
+    case OP_NewDict:
+      get(x) = AOT::new_dict(x->desc);
+      break;
+
+    case OP_NewStruct:
+      get(x) = AOT::default_value(*x->desc, false);
+      break;
+
+    case OP_Append:
+      if (ops.size() == 2)
+        AOT::append(get(ops[0]), get(ops[1]));
+      else
+        AOT::append(get(ops[0]), get(ops[1]),
+                    get(ops[2]));
+
+      break;
+
+    case OP_AddMember:
+      AOT::add_member(get(ops[0]), get(ops[1]));
+      break;
+
+    case OP_NewRange:
+      get(x) = Value(new ObjRange(get(ops[0]).v_int,
+                                  get(ops[1]).v_int,
+                                  get(ops[2]).v_int));
+      break;
+
+    case OP_RangeStep:
+      get(x) = Value::from_int(AOT::range_step(
+          get(ops[0]).v_int, x->site.c_str()));
+      break;
+
+    case OP_RangeNext: {
+      auto i = get(ops[0]).v_int;
+      auto end = get(ops[1]).v_int;
+
+      if (!Arith::range_next(i, end, get(ops[2]).v_int))
+        i = end;
+
+      get(x) = Value::from_int(i);
+
+      break;
+    }
+
+    case OP_RangeField: {
+      auto range = (ObjRange*)get(ops[0]).v_obj;
+
+      get(x) = Value::from_int(x->index == 0 ? range->begin
+                               : x->index == 1
+                                   ? range->end
+                                   : range->step);
+
+      break;
+    }
+
+    case OP_Index: {
+      Value tmp;
+
+      get(x) = AOT::at(get(ops[0]), get(ops[1]), tmp,
+                       x->check, x->site.c_str());
+
+      break;
+    }
+
+    case OP_IndexRef:
+      get(x) = AOT::step(get(ops[0]), get(ops[1]),
+                         x->check, x->site.c_str());
+      break;
+
+    case OP_Store:
+      get(x) =
+          AOT::store(get(ops[0]), get(ops[1]), get(ops[2]),
+                     x->check, x->site.c_str());
+      break;
+
+    case OP_Member:
+      get(x) = AOT::member(get(ops[0]), x->index);
+      break;
+
+    case OP_CallBuiltin: {
+      // 引数の参照は call_builtin で減らす
+      std::vector<Value> values;
+
+      values.reserve(ops.size());
+
+      for (auto&& op : ops)
+        values.emplace_back(get(op)).inc_ref();
+
+      get(x) = AOT::call_builtin(x->index, values,
+                                 x->site.c_str());
+
+      break;
+    }
+
+    case OP_IterSize:
+      get(x) = Value::from_usize(
+          AOT::iter_size(get(ops[0])));
+      break;
+
+    case OP_IterGet:
+      get(x) = AOT::iter_get(get(ops[0]),
+                             get(ops[1]).v_usize);
+      break;
+
+    case OP_IterVersion:
+      get(x) = Value::from_usize(
+          AOT::iter_version(get(ops[0])));
+      break;
+
+    case OP_IterCheck:
+      AOT::iter_check(get(ops[0]),
+                      (uint32_t)get(ops[1]).v_usize,
+                      x->site.c_str());
+      break;
+
+    default:
+      panic("unknown opcode");
+  }
+}
+
+Value Interpreter::call(Function const* func,
+                        std::vector<Value> const& args)
+{
+  std::vector<Value> regs(func->num_values);
+  std::vector<Value> incoming;
+
+  Block const* block = func->entry();
+  Block const* prev = nullptr;
+
+  auto get = [&regs](Instr const* x) -> Value& {
+    return regs[x->id];
+  };
+
+  while (true) {
+    auto const& instrs = block->instrs;
+    size_t i = 0;
+
+    //
+    // phi は前の基本ブロックから来た値をまとめて入れる
+    //  (同じ基本ブロックの phi どうしで参照しあうことがある)
+    incoming.clear();
+
+    for (; instrs[i]->op == OP_Phi; i++) {
+      auto phi = instrs[i];
+
+      for (size_t k = 0; k < phi->targets.size(); k++) {
+        if (phi->targets[k] == prev) {
+          incoming.emplace_back(get(phi->operands[k]));
+          break;
+        }
+      }
+    }
+
+    for (size_t k = 0; k < incoming.size(); k++)
+      regs[instrs[k]->id] = incoming[k];
+
+    Block const* next = nullptr;
+
+    for (; !next; i++) {
+      auto x = instrs[i];
+      auto const& ops = x->operands;
+
+      switch (x->op) {
+        case OP_Call: {
+          if (this->depth >= MAX_DEPTH)
+            Error(x->ast, "stack overflow").emit().exit();
+
+          std::vector<Value> values;
+
+          values.reserve(ops.size());
+
+          for (auto&& op : ops)
+            values.emplace_back(get(op));
+
+          this->depth++;
+          get(x) = this->call(x->callee, values);
+          this->depth--;
+
+          break;
+        }
+
+        case OP_Jump:
+          next = x->targets[0];
+          break;
+
+        case OP_Branch:
+          next = get(ops[0]).v_bool ? x->targets[0]
+                                    : x->targets[1];
+          break;
+
+        case OP_Return:
+          return ops.empty() ? Value() : get(ops[0]);
+
+        default:
+          this->execute(x, regs, args);
+      }
+    }
+
+    prev = block;
+    block = next;
+  }
+}
+
+}  // namespace IR
@@ -0,0 +1,279 @@
+#include <set>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "BuiltinFunc.h"
+#include "IR/Module.h"
+
+namespace IR {
+
+static char const* expr_names[] = {
+    "add", "sub", "mul", "div", "mod", "shl",
+    "shr", "and", "xor", "or",  "land", "lor",
+};
+
+static char const* compare_names[] = {
+    "gt", "lt", "ge", "le", "eq", "ne",
+};
+
+char const* Instr::get_name(OpCode op)
+{
+  static char const* names[] = {
+#define _IR_OPCODE_NAME(name) #name,
+      IR_OPCODE_LIST(_IR_OPCODE_NAME)
+#undef _IR_OPCODE_NAME
+  };
+
+  return names[op];
+}
+
+static std::string value_name(Instr const* x)
+{
+  return "%" + std::to_string(x->id);
+}
+
+static std::string block_name(Block const* block)
+{
+  return "bb" + std::to_string(block->id);
+}
+
+std::string Instr::to_string() const
+{
+  std::string ret;
+
+  if (!this->is_void())
+    ret = value_name(this) + " = ";
+
+  switch (this->op) {
+    case OP_Binary:
+      ret += std::string("Binary.") +
+             expr_names[this->index];
+      break;
+
+    case OP_Compare:
+      ret += std::string("Compare.") +
+             compare_names[this->index];
+      break;
+
+    default:
+      ret += get_name(this->op);
+  }
+
+  if (!this->is_void())
+    ret += " " + this->type.to_string();
+
+  std::vector<std::string> args;
+
+  switch (this->op) {
+    case OP_Const:
+      if (this->imm.kind == TYPE_String)
+        args.emplace_back('"' + this->imm.to_string() +
+                          '"');
+      else
+        args.emplace_back(this->imm.to_string());
+
+      break;
+
+    case OP_Phi:
+      for (size_t i = 0; i < this->operands.size(); i++) {
+        args.emplace_back("[" +
+                          block_name(this->targets[i]) +
+                          ": " +
+                          value_name(this->operands[i]) +
+                          "]");
+      }
+
+      break;
+
+    case OP_Param:
+    case OP_Member:
+    case OP_RangeField:
+    case OP_NoDelete:
+      args.emplace_back("#" + std::to_string(this->index));
+      break;
+
+    case OP_LoadGlobal:
+    case OP_StoreGlobal:
+      args.emplace_back("@" + std::to_string(this->index));
+      break;
+
+    case OP_Call:
+      args.emplace_back("@" + this->callee->name);
+      break;
+
+    case OP_CallBuiltin:
+      args.emplace_back(
+          "@" + BuiltinFunc::get_builtin_list()[this->index]
+                    .name);
+      break;
+
+    case OP_Default:
+    case OP_NewVector:
+    case OP_NewDict:
+    case OP_NewStruct:
+      args.emplace_back("<" + this->desc->to_string() +
+                        ">");
+      break;
+  }
+
+  if (this->op != OP_Phi) {
+    for (auto&& x : this->operands)
+      args.emplace_back(value_name(x));
+  }
+
+  for (size_t i = 0;
+       this->op != OP_Phi && i < this->targets.size(); i++)
+    args.emplace_back(block_name(this->targets[i]));
+
+  if ((this->op == OP_Index || this->op == OP_IndexRef ||
+       this->op == OP_Store) &&
+      !this->check)
+    args.emplace_back("nocheck");
+
+  for (size_t i = 0; i < args.size(); i++)
+    ret += (i == 0 ? " " : ", ") + args[i];
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  Function
+// --------------------------------------------------------
+
+Block* Function::new_block()
+{
+  return this->blocks
+      .emplace_back(std::make_unique<Block>(
+          this->blocks.size(), this))
+      .get();
+}
+
+Instr* Function::new_instr(OpCode op, TypeInfo const& type)
+{
+  return this->instrs
+      .emplace_back(std::make_unique<Instr>(op, type))
+      .get();
+}
+
+void Function::cleanup()
+{
+  std::set<Block*> reachable;
+  std::vector<Block*> work = {this->entry()};
+
+  while (!work.empty()) {
+    auto block = work.back();
+
+    work.pop_back();
+
+    if (!reachable.emplace(block).second)
+      continue;
+
+    for (auto&& succ : block->succs())
+      work.emplace_back(succ);
+  }
+
+  std::erase_if(this->blocks, [&](auto const& block) {
+    return !reachable.contains(block.get());
+  });
+
+  //
+  // 消した基本ブロックからの辺を取り除く
+  for (auto&& block : this->blocks) {
+    std::erase_if(block->preds, [&](Block* pred) {
+      return !reachable.contains(pred);
+    });
+
+    for (auto&& instr : block->instrs) {
+      if (instr->op != OP_Phi)
+        break;
+
+      for (size_t i = 0; i < instr->targets.size();) {
+        if (reachable.contains(instr->targets[i])) {
+          i++;
+          continue;
+        }
+
+        instr->targets.erase(instr->targets.begin() + i);
+        instr->operands.erase(instr->operands.begin() + i);
+      }
+    }
+  }
+}
+
+void Function::renumber()
+{
+  this->num_values = 0;
+
+  for (size_t i = 0; auto&& block : this->blocks) {
+    block->id = i++;
+
+    for (auto&& instr : block->instrs) {
+      instr->parent = block.get();
+
+      if (!instr->is_void())
+        instr->id = this->num_values++;
+    }
+  }
+}
+
+std::string Function::dump() const
+{
+  std::string ret = "fn " + this->name + "(";
+
+  for (size_t i = 0; i < this->params.size(); i++) {
+    if (i > 0)
+      ret += ", ";
+
+    ret += this->params[i].to_string();
+  }
+
+  ret += ") -> " + this->result.to_string() + " {\n";
+
+  for (auto&& block : this->blocks) {
+    ret += block_name(block.get()) + ":";
+
+    if (!block->preds.empty()) {
+      ret += "  ; preds";
+
+      for (size_t i = 0; i < block->preds.size(); i++)
+        ret += (i == 0 ? " " : ", ") +
+               block_name(block->preds[i]);
+    }
+
+    ret += "\n";
+
+    for (auto&& instr : block->instrs)
+      ret += "  " + instr->to_string() + "\n";
+  }
+
+  return ret + "}\n";
+}
+
+// --------------------------------------------------------
+//  Module
+// --------------------------------------------------------
+
+std::string Module::dump() const
+{
+  std::string ret;
+
+  for (size_t i = 0; i < this->globals.size(); i++) {
+    auto const& g = this->globals[i];
+
+    ret += Utils::format("global @%zu %s: %s\n", i,
+                         std::string(g.name).c_str(),
+                         g.type.to_string().c_str());
+  }
+
+  for (auto&& func : this->functions) {
+    if (!ret.empty())
+      ret += "\n";
+
+    ret += func->dump();
+  }
+
+  return ret;
+}
+
+}  // namespace IR
@@ -0,0 +1,385 @@
+#include <algorithm>
+#include <map>
+
+#include "Utils.h"
+#include "IR/Verifier.h"
+
+namespace IR {
+
+//
+// オペランドの数 (最小, 最大)
+static std::pair<size_t, size_t> arity(OpCode op)
+{
+  switch (op) {
+    case OP_Undef:
+    case OP_Const:
+    case OP_Param:
+    case OP_LoadGlobal:
+    case OP_Mark:
+    case OP_Default:
+    case OP_NewVector:
+    case OP_NewDict:
+    case OP_NewStruct:
+    case OP_Jump:
+      return {0, 0};
+
+    case OP_StoreGlobal:
+    case OP_Neg:
+    case OP_Cast:
+    case OP_Clone:
+    case OP_Retain:
+    case OP_Release:
+    case OP_NoDelete:
+    case OP_RangeStep:
+    case OP_RangeField:
+    case OP_Member:
+    case OP_IterSize:
+    case OP_IterVersion:
+    case OP_Branch:
+      return {1, 1};
+
+    case OP_Binary:
+    case OP_Compare:
+    case OP_AddMember:
+    case OP_Index:
+    case OP_IndexRef:
+    case OP_IterGet:
+    case OP_IterCheck:
+      return {2, 2};
+
+    case OP_Select:
+    case OP_NewRange:
+    case OP_RangeNext:
+    case OP_Store:
+      return {3, 3};
+
+    case OP_Collect:
+      return {1, 2};
+
+    case OP_Append:
+      return {2, 3};
+
+    case OP_Concat:
+      return {2, SIZE_MAX};
+
+    case OP_Return:
+      return {0, 1};
+  }
+
+  // Phi, Call, CallBuiltin は別に調べる
+  return {0, SIZE_MAX};
+}
+
+// ---------------------------------------------
+//  Dominators
+//   Cooper, Harvey, Kennedy
+//   "A Simple, Fast Dominance Algorithm"
+// ---------------------------------------------
+struct Dominators {
+  std::map<Block const*, Block const*> idom;
+  std::map<Block const*, size_t> order;  // 後順
+
+  explicit Dominators(Function const& func)
+  {
+    std::vector<Block const*> post;
+    std::vector<std::pair<Block const*, size_t>> stack;
+    std::map<Block const*, bool> visited;
+
+    stack.emplace_back(func.entry(), 0);
+    visited[func.entry()] = true;
+
+    while (!stack.empty()) {
+      auto& [block, i] = stack.back();
+      auto succs = block->succs();
+
+      if (i < succs.size()) {
+        auto next = succs[i++];
+
+        if (!visited[next]) {
+          visited[next] = true;
+          stack.emplace_back(next, 0);
+        }
+
+        continue;
+      }
+
+      this->order[block] = post.size();
+      post.emplace_back(block);
+      stack.pop_back();
+    }
+
+    this->idom[func.entry()] = func.entry();
+
+    for (bool changed = true; changed;) {
+      changed = false;
+
+      for (auto it = post.rbegin(); it != post.rend();
+           it++) {
+        auto block = *it;
+
+        if (block == func.entry())
+          continue;
+
+        Block const* dom = nullptr;
+
+        for (auto&& pred : block->preds) {
+          if (!this->idom.contains(pred))
+            continue;
+
+          dom = dom ? this->intersect(pred, dom) : pred;
+        }
+
+        if (dom && this->idom[block] != dom) {
+          this->idom[block] = dom;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  Block const* intersect(Block const* a, Block const* b)
+  {
+    while (a != b) {
+      while (this->order[a] < this->order[b])
+        a = this->idom[a];
+
+      while (this->order[b] < this->order[a])
+        b = this->idom[b];
+    }
+
+    return a;
+  }
+
+  bool dominates(Block const* a, Block const* b) const
+  {
+    while (true) {
+      if (a == b)
+        return true;
+
+      auto it = this->idom.find(b);
+
+      if (it == this->idom.end() || it->second == b)
+        return false;
+
+      b = it->second;
+    }
+  }
+};
+
+static void verify_function(
+    Function const& func, std::vector<std::string>& errors)
+{
+  auto error = [&](Block const* block, Instr const* instr,
+                   std::string const& msg) {
+    auto text =
+        func.name + ": bb" + std::to_string(block->id);
+
+    if (instr)
+      text += ": " + instr->to_string();
+
+    errors.emplace_back(text + ": " + msg);
+  };
+
+  if (func.blocks.empty()) {
+    errors.emplace_back(func.name + ": no entry block");
+    return;
+  }
+
+  if (!func.entry()->preds.empty())
+    error(func.entry(), nullptr, "entry block has preds");
+
+  Dominators dom(func);
+
+  // 同じ基本ブロックの中での位置
+  std::map<Instr const*, size_t> position;
+
+  for (auto&& block : func.blocks) {
+    for (size_t i = 0; auto&& instr : block->instrs)
+      position[instr] = i++;
+  }
+
+  for (auto&& _block : func.blocks) {
+    auto block = _block.get();
+
+    if (!block->terminator()) {
+      error(block, nullptr, "missing terminator");
+      continue;
+    }
+
+    //
+    // 前後の基本ブロック
+    for (auto&& succ : block->succs()) {
+      if (std::count(succ->preds.begin(), succ->preds.end(),
+                     block) != 1)
+        error(block, nullptr,
+              "not a pred of bb" +
+                  std::to_string(succ->id));
+    }
+
+    for (auto&& pred : block->preds) {
+      auto succs = pred->succs();
+
+      if (std::find(succs.begin(), succs.end(), block) ==
+          succs.end())
+        error(block, nullptr,
+              "bb" + std::to_string(pred->id) +
+                  " does not branch here");
+    }
+
+    bool in_phis = true;
+
+    for (auto&& instr : block->instrs) {
+      if (instr->parent != block)
+        error(block, instr, "wrong parent");
+
+      if (instr->is_terminator() &&
+          instr != block->instrs.back())
+        error(block, instr, "terminator in the middle");
+
+      //
+      // phi は先頭に並び、前の基本ブロックごとに値を一つ持つ
+      if (instr->op == OP_Phi) {
+        if (!in_phis)
+          error(block, instr, "phi after non-phi");
+
+        auto targets = instr->targets;
+        auto preds = block->preds;
+
+        std::sort(targets.begin(), targets.end());
+        std::sort(preds.begin(), preds.end());
+
+        if (targets != preds ||
+            instr->operands.size() != targets.size())
+          error(block, instr, "phi does not match preds");
+      }
+      else {
+        in_phis = false;
+      }
+
+      auto [min, max] = arity(instr->op);
+      auto count = instr->operands.size();
+
+      if (count < min || count > max)
+        error(block, instr, "wrong number of operands");
+
+      if (instr->op == OP_Call &&
+          (!instr->callee ||
+           count != instr->callee->params.size()))
+        error(block, instr, "wrong number of arguments");
+
+      //
+      // 定義が使う場所を支配しているか
+      for (size_t i = 0; i < count; i++) {
+        auto x = instr->operands[i];
+
+        if (!x || x->is_void() || !x->parent ||
+            x->parent->parent != &func ||
+            !position.contains(x)) {
+          error(block, instr, "invalid operand");
+          continue;
+        }
+
+        // phi では前の基本ブロックの最後で使う
+        Block const* use = instr->op == OP_Phi
+                               ? instr->targets[i]
+                               : block;
+
+        bool ok;
+
+        if (x->parent == use)
+          ok = instr->op == OP_Phi ||
+               position[x] < position[instr];
+        else
+          ok = dom.dominates(x->parent, use);
+
+        if (!ok)
+          error(block, instr,
+                "%" + std::to_string(x->id) +
+                    " does not dominate its use");
+      }
+
+      if (count < min)
+        continue;
+
+      //
+      // 型
+      switch (instr->op) {
+        case OP_Branch:
+          if (instr->operands[0]->type.kind != TYPE_Bool)
+            error(block, instr, "condition is not bool");
+
+          if (instr->targets.size() != 2)
+            error(block, instr, "branch needs two targets");
+
+          break;
+
+        case OP_Select:
+          if (instr->operands[0]->type.kind != TYPE_Bool)
+            error(block, instr, "condition is not bool");
+
+          break;
+
+        case OP_Jump:
+          if (instr->targets.size() != 1)
+            error(block, instr, "jump needs one target");
+
+          break;
+
+        case OP_Compare:
+          if (instr->type.kind != TYPE_Bool)
+            error(block, instr, "compare is not bool");
+
+          break;
+
+        case OP_Phi:
+          for (auto&& x : instr->operands) {
+            if (x && x->type.kind != instr->type.kind)
+              error(block, instr, "phi operand type");
+          }
+
+          break;
+
+        case OP_Return:
+          if (count == 1 &&
+              instr->operands[0]->type.kind !=
+                  func.result.kind)
+            error(block, instr, "wrong return type");
+
+          break;
+
+        case OP_RangeStep:
+        case OP_NewRange:
+        case OP_RangeField:
+        case OP_RangeNext:
+          for (auto&& x : instr->operands) {
+            auto kind = x->type.kind;
+
+            if (kind != TYPE_Int && kind != TYPE_Range)
+              error(block, instr, "range operand type");
+          }
+
+          break;
+
+        case OP_Concat:
+          for (auto&& x : instr->operands) {
+            if (x->type.kind != TYPE_String)
+              error(block, instr, "concat operand type");
+          }
+
+          break;
+      }
+    }
+  }
+}
+
+std::vector<std::string> verify(Module const& module)
+{
+  std::vector<std::string> errors;
+
+  for (auto&& func : module.functions)
+    verify_function(*func, errors);
+
+  return errors;
+}
+
+}  // namespace IR
@@ -0,0 +1,362 @@
+#include "debug/alert.h"
+
+#include "JIT/Assembler.h"
+
+namespace JIT {
+
+Assembler::Label Assembler::new_label()
+{
+  this->labels.emplace_back();
+
+  return this->labels.size() - 1;
+}
+
+void Assembler::bind(Label label)
+{
+  this->labels[label].position = this->buf.size();
+}
+
+std::vector<uint8_t> const& Assembler::finish()
+{
+  for (auto&& label : this->labels) {
+    for (auto&& at : label.fixups) {
+      assert(label.position >= 0);
+
+      // rel32 は命令の次の位置から数える
+      this->patch32(at, label.position - (at + 4));
+    }
+
+    label.fixups.clear();
+  }
+
+  return this->buf;
+}
+
+void Assembler::patch32(size_t position, int32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    this->buf[position + i] = (uint8_t)(value >> (i * 8));
+}
+
+void Assembler::emit(uint8_t byte)
+{
+  this->buf.emplace_back(byte);
+}
+
+void Assembler::emit32(int32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    this->emit((uint8_t)(value >> (i * 8)));
+}
+
+void Assembler::emit64(int64_t value)
+{
+  for (int i = 0; i < 8; i++)
+    this->emit((uint8_t)(value >> (i * 8)));
+}
+
+void Assembler::rex(bool w, int reg, int rm)
+{
+  uint8_t byte =
+      0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+
+  if (byte != 0x40)
+    this->emit(byte);
+}
+
+void Assembler::modrm_reg(int reg, int rm)
+{
+  this->emit(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+//
+// [base + disp32]
+//  rsp, r12 が base のときは SIB が要る
+void Assembler::modrm_mem(int reg, Reg base, int32_t disp)
+{
+  this->emit(0x80 | ((reg & 7) << 3) | (base & 7));
+
+  if ((base & 7) == RSP)
+    this->emit(0x24);
+
+  this->emit32(disp);
+}
+
+void Assembler::jump_to(Label label)
+{
+  this->labels[label].fixups.emplace_back(this->buf.size());
+  this->emit32(0);
+}
+
+// --------------------------------------------------------
+//  整数
+// --------------------------------------------------------
+
+void Assembler::push(Reg r)
+{
+  this->rex(false, 0, r);
+  this->emit(0x50 + (r & 7));
+}
+
+void Assembler::pop(Reg r)
+{
+  this->rex(false, 0, r);
+  this->emit(0x58 + (r & 7));
+}
+
+void Assembler::mov(Reg dst, Reg src)
+{
+  this->alu((AluOp)0x89, dst, src);
+}
+
+void Assembler::mov_imm(Reg dst, int64_t imm)
+{
+  // 符号拡張で足りるなら短くする
+  if (imm == (int32_t)imm) {
+    this->rex(true, 0, dst);
+    this->emit(0xC7);
+    this->modrm_reg(0, dst);
+    this->emit32((int32_t)imm);
+    return;
+  }
+
+  this->rex(true, 0, dst);
+  this->emit(0xB8 + (dst & 7));
+  this->emit64(imm);
+}
+
+void Assembler::mov_imm32(Reg dst, uint32_t imm)
+{
+  this->rex(false, 0, dst);
+  this->emit(0xB8 + (dst & 7));
+  this->emit32((int32_t)imm);
+}
+
+void Assembler::load(Reg dst, Reg base, int32_t disp)
+{
+  this->rex(true, dst, base);
+  this->emit(0x8B);
+  this->modrm_mem(dst, base, disp);
+}
+
+void Assembler::store(Reg base, int32_t disp, Reg src)
+{
+  this->rex(true, src, base);
+  this->emit(0x89);
+  this->modrm_mem(src, base, disp);
+}
+
+void Assembler::lea(Reg dst, Reg base, int32_t disp)
+{
+  this->rex(true, dst, base);
+  this->emit(0x8D);
+  this->modrm_mem(dst, base, disp);
+}
+
+void Assembler::alu(AluOp op, Reg dst, Reg src)
+{
+  this->rex(true, src, dst);
+  this->emit(op);
+  this->modrm_reg(src, dst);
+}
+
+void Assembler::cmp_mem(Reg r, Reg base, int32_t disp)
+{
+  this->rex(true, r, base);
+  this->emit(0x3B);
+  this->modrm_mem(r, base, disp);
+}
+
+void Assembler::add_imm(Reg dst, int32_t imm)
+{
+  this->rex(true, 0, dst);
+  this->emit(0x81);
+  this->modrm_reg(0, dst);
+  this->emit32(imm);
+}
+
+void Assembler::sub_imm(Reg dst, int32_t imm)
+{
+  this->rex(true, 0, dst);
+  this->emit(0x81);
+  this->modrm_reg(5, dst);
+  this->emit32(imm);
+}
+
+void Assembler::cmp_imm(Reg dst, int32_t imm)
+{
+  this->rex(true, 0, dst);
+  this->emit(0x81);
+  this->modrm_reg(7, dst);
+  this->emit32(imm);
+}
+
+size_t Assembler::sub_imm_patchable(Reg dst)
+{
+  this->sub_imm(dst, 0);
+
+  return this->buf.size() - 4;
+}
+
+void Assembler::imul(Reg dst, Reg src)
+{
+  this->rex(true, dst, src);
+  this->emit(0x0F);
+  this->emit(0xAF);
+  this->modrm_reg(dst, src);
+}
+
+void Assembler::cqo()
+{
+  this->emit(0x48);
+  this->emit(0x99);
+}
+
+void Assembler::idiv(Reg src)
+{
+  this->rex(true, 0, src);
+  this->emit(0xF7);
+  this->modrm_reg(7, src);
+}
+
+void Assembler::neg(Reg r)
+{
+  this->rex(true, 0, r);
+  this->emit(0xF7);
+  this->modrm_reg(3, r);
+}
+
+void Assembler::shl_cl(Reg r)
+{
+  this->rex(true, 0, r);
+  this->emit(0xD3);
+  this->modrm_reg(4, r);
+}
+
+void Assembler::sar_cl(Reg r)
+{
+  this->rex(true, 0, r);
+  this->emit(0xD3);
+  this->modrm_reg(7, r);
+}
+
+// --------------------------------------------------------
+//  制御
+// --------------------------------------------------------
+
+void Assembler::jmp(Label label)
+{
+  this->emit(0xE9);
+  this->jump_to(label);
+}
+
+void Assembler::jcc(Cond cc, Label label)
+{
+  this->emit(0x0F);
+  this->emit(0x80 + cc);
+  this->jump_to(label);
+}
+
+void Assembler::call(Reg r)
+{
+  this->rex(false, 0, r);
+  this->emit(0xFF);
+  this->modrm_reg(2, r);
+}
+
+void Assembler::call_mem(Reg base, int32_t disp)
+{
+  this->rex(false, 0, base);
+  this->emit(0xFF);
+  this->modrm_mem(2, base, disp);
+}
+
+void Assembler::ret()
+{
+  this->emit(0xC3);
+}
+
+// --------------------------------------------------------
+//  浮動小数点
+//   プレフィックス (F3, 66) は REX より前に置く
+// --------------------------------------------------------
+
+void Assembler::movss_load(XReg dst, Reg base, int32_t disp)
+{
+  this->emit(0xF3);
+  this->rex(false, dst, base);
+  this->emit(0x0F);
+  this->emit(0x10);
+  this->modrm_mem(dst, base, disp);
+}
+
+void Assembler::movss_store(Reg base, int32_t disp, XReg src)
+{
+  this->emit(0xF3);
+  this->rex(false, src, base);
+  this->emit(0x0F);
+  this->emit(0x11);
+  this->modrm_mem(src, base, disp);
+}
+
+void Assembler::movaps(XReg dst, XReg src)
+{
+  this->rex(false, dst, src);
+  this->emit(0x0F);
+  this->emit(0x28);
+  this->modrm_reg(dst, src);
+}
+
+void Assembler::sse(SseOp op, XReg dst, XReg src)
+{
+  this->emit(0xF3);
+  this->rex(false, dst, src);
+  this->emit(0x0F);
+  this->emit(op);
+  this->modrm_reg(dst, src);
+}
+
+void Assembler::ucomiss(XReg a, XReg b)
+{
+  this->rex(false, a, b);
+  this->emit(0x0F);
+  this->emit(0x2E);
+  this->modrm_reg(a, b);
+}
+
+void Assembler::xorps(XReg dst, XReg src)
+{
+  this->rex(false, dst, src);
+  this->emit(0x0F);
+  this->emit(0x57);
+  this->modrm_reg(dst, src);
+}
+
+void Assembler::cvtsi2ss(XReg dst, Reg src)
+{
+  this->emit(0xF3);
+  this->rex(true, dst, src);
+  this->emit(0x0F);
+  this->emit(0x2A);
+  this->modrm_reg(dst, src);
+}
+
+void Assembler::cvttss2si(Reg dst, XReg src)
+{
+  this->emit(0xF3);
+  this->rex(true, dst, src);
+  this->emit(0x0F);
+  this->emit(0x2C);
+  this->modrm_reg(dst, src);
+}
+
+void Assembler::movd(XReg dst, Reg src)
+{
+  this->emit(0x66);
+  this->rex(false, dst, src);
+  this->emit(0x0F);
+  this->emit(0x6E);
+  this->modrm_reg(dst, src);
+}
+
+}  // namespace JIT
@@ -0,0 +1,223 @@
+//
+// 生成した機械語の置き場所
+//  呼び出す関数をたどって、全部機械語にできるときだけ
+//  まとめて生成し、実行できるメモリに置く
+//  (書き込みが終わってから実行可能にする)
+//
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Error.h"
+#include "JIT/CodeGen.h"
+#include "JIT/CodeCache.h"
+
+namespace JIT {
+
+uintptr_t stack_limit;
+
+//
+// 機械語にしたもの・できなかったもの
+//  (機械語から code を参照するので、無効にならない std::map)
+static std::map<AST::Function*, Function> functions;
+
+void error_at_token(Token const* token, char const* message)
+{
+  Error(*token, message).emit().exit();
+}
+
+void error_at_ast(AST::Base const* ast, char const* message)
+{
+  Error(ast, message).emit().exit();
+}
+
+//
+// perf が名前を付けられるように書き出す
+//  <開始アドレス> <大きさ> <名前> (16 進数)
+static void write_perf_map(void const* addr, size_t size,
+                           std::string const& name)
+{
+  static std::ofstream ofs("/tmp/perf-" +
+                           std::to_string(getpid()) + ".map");
+
+  ofs << std::hex << (uintptr_t)addr << " " << size << std::dec
+      << " " << name << std::endl;
+}
+
+Value Function::call(Value const* args) const
+{
+  uint64_t io[MAX_ARGS] = {};
+
+  for (size_t i = 0; i < this->arg_types.size(); i++) {
+    switch (this->arg_types[i]) {
+      case TYPE_Int:
+        io[i] = args[i].v_int;
+        break;
+
+      case TYPE_Float:
+        std::memcpy(&io[i], &args[i].v_float, sizeof(float));
+        break;
+
+      case TYPE_Bool:
+        io[i] = args[i].v_bool;
+        break;
+    }
+  }
+
+  this->entry(io);
+
+  switch (this->result_type) {
+    case TYPE_Int:
+      return Value::from_int((int64_t)io[0]);
+
+    case TYPE_Float: {
+      float x;
+
+      std::memcpy(&x, &io[0], sizeof(float));
+
+      return Value::from_float(x);
+    }
+  }
+
+  return Value::from_bool(io[0] != 0);
+}
+
+//
+// root から呼び出す関数を集めて生成する
+static bool compile_group(AST::Function* root)
+{
+  std::vector<std::unique_ptr<CodeGen>> generators;
+  std::vector<AST::Function*> group;
+  std::vector<AST::Function*> work{root};
+
+  while (!work.empty()) {
+    auto func = work.back();
+
+    work.pop_back();
+
+    if (std::find(group.begin(), group.end(), func) !=
+        group.end())
+      continue;
+
+    // 生成済み (できなかったもの) はそのまま使う
+    if (auto it = functions.find(func); it != functions.end()) {
+      if (!it->second.code)
+        return false;
+
+      continue;
+    }
+
+    auto gen = std::make_unique<CodeGen>(func);
+
+    if (!gen->analyze())
+      return false;
+
+    for (auto&& callee : gen->get_callees())
+      work.emplace_back(callee);
+
+    group.emplace_back(func);
+    generators.emplace_back(std::move(gen));
+  }
+
+  if (!stack_limit)
+    stack_limit = Utils::native_stack_limit();
+
+  //
+  // 呼び出し先の場所を先に作っておく (再帰呼び出し)
+  for (auto&& func : group)
+    functions[func].ast = func;
+
+  auto resolve = [](AST::Function* func) -> void* const* {
+    return &functions[func].code;
+  };
+
+  //
+  // 本体と入口を一つのバッファに並べる
+  std::vector<uint8_t> code;
+  std::vector<std::pair<size_t, size_t>> offsets;
+
+  for (size_t i = 0; i < group.size(); i++) {
+    Assembler body;
+    Assembler entry;
+
+    generators[i]->compile(body, resolve);
+    generators[i]->compile_entry(entry, &functions[group[i]].code);
+
+    auto const& x = body.finish();
+    auto const& y = entry.finish();
+
+    offsets.emplace_back(code.size(), code.size() + x.size());
+
+    code.insert(code.end(), x.begin(), x.end());
+    code.insert(code.end(), y.begin(), y.end());
+  }
+
+  auto mem = (uint8_t*)mmap(nullptr, code.size(),
+                            PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (mem == MAP_FAILED) {
+    for (auto&& func : group)
+      functions.erase(func);
+
+    return false;
+  }
+
+  std::memcpy(mem, code.data(), code.size());
+
+  mprotect(mem, code.size(), PROT_READ | PROT_EXEC);
+
+  for (size_t i = 0; i < group.size(); i++) {
+    auto func = group[i];
+    auto& fn = functions[func];
+
+    auto [body, entry] = offsets[i];
+    auto end = i + 1 < offsets.size() ? offsets[i + 1].first
+                                      : code.size();
+
+    fn.code = mem + body;
+    fn.entry = (void (*)(uint64_t*))(mem + entry);
+    fn.result_type = CodeGen::type_of(func->result_type);
+
+    for (auto&& arg : func->args)
+      fn.arg_types.emplace_back(CodeGen::type_of(arg->type));
+
+    auto name = "metro::" + std::string(func->name.str);
+
+    write_perf_map(fn.code, entry - body, name);
+    write_perf_map((void*)fn.entry, end - entry, name + " [entry]");
+  }
+
+  return true;
+}
+
+Function const* find_function(AST::Function* func)
+{
+#if defined(__x86_64__)
+  if (auto it = functions.find(func); it != functions.end())
+    return it->second.code ? &it->second : nullptr;
+
+  if (!compile_group(func)) {
+    functions[func].ast = func;
+    return nullptr;
+  }
+
+  return &functions[func];
+#else
+  (void)func;
+  return nullptr;
+#endif
+}
+
+}  // namespace JIT
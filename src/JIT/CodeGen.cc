@@ -0,0 +1,1649 @@
+//
+// 関数を x86-64 の機械語にする
+//
+//  フレーム (rbp から下)
+//    [rbp - 8 * 1 ..]  使う callee-saved レジスタ
+//    [...]             レジスタに入らなかった変数
+//    [...]             式の途中の値 (temp)
+//
+//  rsp は本体の中では動かさず、16 バイト境界に揃えておく
+//  (関数・エラー処理をそのまま呼べる)
+//
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Sema.h"
+#include "JIT/CodeGen.h"
+#include "JIT/CodeCache.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+namespace JIT {
+
+static constexpr Reg int_arg_regs[MAX_INT_ARGS] = {
+    RDI, RSI, RDX, RCX, R8, R9};
+
+//
+// 変数に割り当てるレジスタ
+//  int は callee-saved だけを使う (呼び出しで壊れない)
+//  float は関数を呼ばないときだけ xmm8 - xmm15 を使う
+static constexpr Reg local_regs[] = {RBX, R12, R13, R14, R15};
+
+static constexpr XReg local_xregs[] = {
+    XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15};
+
+TypeKind CodeGen::type_of(AST::Base* ast)
+{
+  auto it = Sema::value_type_cache.find(ast);
+
+  if (it == Sema::value_type_cache.end())
+    return TYPE_None;
+
+  return it->second.kind;
+}
+
+static bool is_value_type(TypeKind kind)
+{
+  return kind == TYPE_Int || kind == TYPE_Float ||
+         kind == TYPE_Bool;
+}
+
+static bool is_numeric(TypeKind kind)
+{
+  return kind == TYPE_Int || kind == TYPE_Float;
+}
+
+static bool is_logical(AST::ExprKind kind)
+{
+  return kind == AST::EX_And || kind == AST::EX_Or;
+}
+
+//
+// 二項演算の結果の型 (Operators と同じ規則)
+static TypeKind result_kind(AST::ExprKind kind, TypeKind lhs,
+                            TypeKind rhs)
+{
+  if (kind == AST::EX_Sub && lhs != rhs && lhs != TYPE_Float)
+    return rhs;
+
+  return lhs;
+}
+
+//
+// 比べる型
+static TypeKind common_kind(TypeKind lhs, TypeKind rhs)
+{
+  if (lhs == rhs)
+    return lhs;
+
+  return TYPE_Float;
+}
+
+//
+// 即値 (Evaluator::create_object と同じ変換)
+static int64_t int_value(AST::Base* ast)
+{
+  return std::stoll(ast->token.str.data());
+}
+
+static float float_value(AST::Base* ast)
+{
+  return std::stof(ast->token.str.data());
+}
+
+//
+// 定数の int (1, -1, 0 - 1)
+static bool const_int(AST::Base* ast, int64_t& out)
+{
+  switch (ast->kind) {
+    case AST_Value:
+      if (CodeGen::type_of(ast) != TYPE_Int)
+        return false;
+
+      out = int_value(ast);
+      return true;
+
+    case AST_UnaryPlus:
+    case AST_UnaryMinus:
+      if (!const_int(((AST::UnaryOp*)ast)->expr, out))
+        return false;
+
+      if (ast->kind == AST_UnaryMinus)
+        out = -out;
+
+      return true;
+
+    //
+    // 0 - 1 など
+    case AST_Expr: {
+      auto expr = (AST::Expr*)ast;
+
+      if (!const_int(expr->first, out))
+        return false;
+
+      for (auto&& elem : expr->elements) {
+        int64_t x;
+
+        if (!const_int(elem.ast, x))
+          return false;
+
+        switch (elem.kind) {
+          case AST::EX_Add:
+            out += x;
+            break;
+
+          case AST::EX_Sub:
+            out -= x;
+            break;
+
+          case AST::EX_Mul:
+            out *= x;
+            break;
+
+          default:
+            return false;
+        }
+      }
+
+      return out == (int32_t)out;
+    }
+  }
+
+  return false;
+}
+
+static XReg xreg_of(int index)
+{
+  return (XReg)(XMM0 + index);
+}
+
+CodeGen::CodeGen(AST::Function* func)
+    : func(func),
+      position(0),
+      has_calls(false),
+      as(nullptr),
+      resolve(nullptr),
+      spill_count(0),
+      temp_depth(0),
+      max_temp_depth(0),
+      return_label(0)
+{
+}
+
+// --------------------------------------------------------
+//  解析
+// --------------------------------------------------------
+
+bool CodeGen::analyze()
+{
+  auto func = this->func;
+
+  if (!func->result_type ||
+      !is_value_type(type_of(func->result_type)))
+    return false;
+
+  this->slots.resize(func->code->frame_size);
+
+  size_t ints = 0;
+  size_t floats = 0;
+
+  for (size_t i = 0; i < func->args.size(); i++) {
+    auto type = type_of(func->args[i]->type);
+
+    if (!is_value_type(type) || i >= this->slots.size())
+      return false;
+
+    (type == TYPE_Float ? floats : ints)++;
+
+    this->touch(i, type);
+  }
+
+  if (ints > MAX_INT_ARGS || floats > MAX_FLOAT_ARGS)
+    return false;
+
+  return this->analyze(func->code);
+}
+
+//
+// 変数を使った位置を記録する
+//  同じスロットを int と float の両方で使っていたら対応しない
+bool CodeGen::touch(size_t slot, TypeKind type)
+{
+  if (slot >= this->slots.size())
+    return false;
+
+  auto& info = this->slots[slot];
+  auto is_float = type == TYPE_Float;
+
+  if (!info.used) {
+    info.used = true;
+    info.is_float = is_float;
+    info.begin = this->position;
+  }
+  else if (info.is_float != is_float)
+    return false;
+
+  info.end = this->position;
+
+  return true;
+}
+
+bool CodeGen::touch_variable(AST::Base* ast, TypeKind type)
+{
+  auto var = (AST::Variable*)ast;
+
+  return ast->kind == AST_Variable && !var->is_global &&
+         is_value_type(type) && this->touch(var->slot, type);
+}
+
+bool CodeGen::analyze(AST::Base* _ast)
+{
+  this->position++;
+
+  switch (_ast->kind) {
+    case AST_True:
+    case AST_False:
+      return true;
+
+    case AST_Value:
+      return is_numeric(type_of(_ast));
+
+    case AST_Variable:
+      return this->touch_variable(_ast, type_of(_ast));
+
+    case AST_UnaryPlus:
+    case AST_UnaryMinus:
+      return is_numeric(type_of(_ast)) &&
+             this->analyze(((AST::UnaryOp*)_ast)->expr);
+
+    case AST_Cast: {
+      astdef(Cast);
+
+      return is_value_type(type_of(ast->expr)) &&
+             is_value_type(type_of(ast)) &&
+             this->analyze(ast->expr);
+    }
+
+    case AST_Expr:
+      return this->analyze_expr((AST::Expr*)_ast);
+
+    case AST_Compare:
+      return this->analyze_compare((AST::Compare*)_ast);
+
+    //
+    // 代入先は変数だけ
+    //  (左辺の型は value_type_cache にないので右辺から)
+    case AST_Assign: {
+      astdef(Assign);
+
+      return this->analyze(ast->expr) &&
+             this->touch_variable(ast->dest, type_of(ast->expr));
+    }
+
+    case AST_CallFunc: {
+      astdef(CallFunc);
+
+      if (ast->is_builtin || !ast->callee)
+        return false;
+
+      for (auto&& arg : ast->args) {
+        if (!this->analyze(arg))
+          return false;
+      }
+
+      this->has_calls = true;
+
+      if (std::find(this->callees.begin(), this->callees.end(),
+                    ast->callee) == this->callees.end())
+        this->callees.emplace_back(ast->callee);
+
+      return true;
+    }
+
+    case AST_Let: {
+      auto ast = (AST::VariableDeclaration*)_ast;
+
+      auto type = ast->init ? type_of(ast->init)
+                            : type_of(ast->type);
+
+      if (ast->init && !this->analyze(ast->init))
+        return false;
+
+      return is_value_type(type) && this->touch(ast->slot, type);
+    }
+
+    case AST_Return:
+      return ((AST::Return*)_ast)->expr &&
+             this->analyze(((AST::Return*)_ast)->expr);
+
+    case AST_If: {
+      astdef(If);
+
+      return this->analyze(ast->condition) &&
+             this->analyze(ast->if_true) &&
+             (!ast->if_false || this->analyze(ast->if_false));
+    }
+
+    case AST_Scope: {
+      for (auto&& item : ((AST::Scope*)_ast)->list) {
+        if (!this->analyze(item))
+          return false;
+      }
+
+      return true;
+    }
+
+    case AST_Break:
+    case AST_Continue:
+      return true;
+
+    //
+    // ループ
+    //  前にある変数をループの中で使っていたら、
+    //  ループの終わりまで生かす (allocate_registers)
+    case AST_Loop:
+    case AST_While:
+    case AST_DoWhile:
+    case AST_For: {
+      auto begin = this->position;
+      bool ok;
+
+      switch (_ast->kind) {
+        case AST_Loop:
+          ok = this->analyze(((AST::Loop*)_ast)->code);
+          break;
+
+        case AST_While:
+          ok = this->analyze(((AST::While*)_ast)->cond) &&
+               this->analyze(((AST::While*)_ast)->code);
+          break;
+
+        case AST_DoWhile:
+          ok = this->analyze(((AST::DoWhile*)_ast)->code) &&
+               this->analyze(((AST::DoWhile*)_ast)->cond);
+          break;
+
+        //
+        // a .. b (by 定数) だけ
+        default: {
+          astdef(For);
+
+          auto range = (AST::Range*)ast->iterable;
+          int64_t step;
+
+          ok = range->kind == AST_Range &&
+               type_of(range->begin) == TYPE_Int &&
+               type_of(range->end) == TYPE_Int &&
+               (!range->step ||
+                (const_int(range->step, step) &&
+                 step == (int32_t)step)) &&
+               this->analyze(range->begin) &&
+               this->analyze(range->end) &&
+               this->touch_variable(ast->iter, TYPE_Int) &&
+               this->analyze(ast->code);
+
+          break;
+        }
+      }
+
+      this->loops.emplace_back(begin, this->position);
+
+      return ok;
+    }
+  }
+
+  return false;
+}
+
+//
+// 四則演算などは int, float だけ
+// && と || は bool だけ (混ざっていないもの)
+bool CodeGen::analyze_expr(AST::Expr* ast)
+{
+  auto type = type_of(ast->first);
+  auto logical = is_logical(ast->elements[0].kind);
+
+  if (!this->analyze(ast->first))
+    return false;
+
+  for (auto&& elem : ast->elements) {
+    auto rhs = type_of(elem.ast);
+
+    if (logical) {
+      if (!is_logical(elem.kind) || type != TYPE_Bool ||
+          rhs != TYPE_Bool)
+        return false;
+    }
+    else {
+      if (is_logical(elem.kind) || !is_numeric(type) ||
+          !is_numeric(rhs))
+        return false;
+
+      // Operators::select_expr と同じ組み合わせ
+      switch (elem.kind) {
+        case AST::EX_Add:
+          if (type != rhs)
+            return false;
+
+          break;
+
+        case AST::EX_Sub:
+        case AST::EX_Mul:
+        case AST::EX_Div:
+          break;
+
+        default:
+          if (type != TYPE_Int || rhs != TYPE_Int)
+            return false;
+      }
+
+      type = result_kind(elem.kind, type, rhs);
+    }
+
+    if (!this->analyze(elem.ast))
+      return false;
+  }
+
+  return true;
+}
+
+bool CodeGen::analyze_compare(AST::Compare* ast)
+{
+  auto type = type_of(ast->first);
+
+  if (!this->analyze(ast->first))
+    return false;
+
+  for (auto&& elem : ast->elements) {
+    auto rhs = type_of(elem.ast);
+
+    if (!(type == rhs && is_value_type(type)) &&
+        !(is_numeric(type) && is_numeric(rhs)))
+      return false;
+
+    if (!this->analyze(elem.ast))
+      return false;
+
+    type = rhs;
+  }
+
+  return true;
+}
+
+// --------------------------------------------------------
+//  レジスタ割り当て (線形走査)
+// --------------------------------------------------------
+
+void CodeGen::allocate_registers()
+{
+  auto& slots = this->slots;
+
+  //
+  // ループより前から生きていて、ループの中で使うもの
+  //  => 次の周回でも使うので、ループの終わりまで延ばす
+  for (bool changed = true; changed;) {
+    changed = false;
+
+    for (auto&& info : slots) {
+      for (auto&& [begin, end] : this->loops) {
+        if (info.used && info.begin < begin &&
+            info.end >= begin && info.end < end) {
+          info.end = end;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> order;
+
+  for (size_t i = 0; i < slots.size(); i++) {
+    if (slots[i].used)
+      order.emplace_back(i);
+  }
+
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) {
+                     return slots[a].begin < slots[b].begin;
+                   });
+
+  // [0] = int, [1] = float
+  std::vector<size_t> active[2];
+  std::vector<int> pool[2];
+
+  for (auto it = std::rbegin(local_regs);
+       it != std::rend(local_regs); it++)
+    pool[0].emplace_back(*it);
+
+  if (!this->has_calls) {
+    for (auto it = std::rbegin(local_xregs);
+         it != std::rend(local_xregs); it++)
+      pool[1].emplace_back(*it);
+  }
+
+  for (auto&& index : order) {
+    auto& info = slots[index];
+    auto& act = active[info.is_float];
+    auto& free = pool[info.is_float];
+
+    // 終わった区間のレジスタを戻す
+    std::erase_if(act, [&](size_t x) {
+      if (slots[x].end >= info.begin)
+        return false;
+
+      free.emplace_back(slots[x].reg);
+      return true;
+    });
+
+    if (!free.empty()) {
+      info.reg = free.back();
+      free.pop_back();
+      act.emplace_back(index);
+      continue;
+    }
+
+    // 空きがなければ、一番遅くまで生きるものをスタックに移す
+    auto far = std::max_element(
+        act.begin(), act.end(), [&](size_t a, size_t b) {
+          return slots[a].end < slots[b].end;
+        });
+
+    if (far != act.end() && slots[*far].end > info.end) {
+      info.reg = slots[*far].reg;
+      slots[*far].reg = -1;
+      *far = index;
+    }
+  }
+
+  //
+  // 使う callee-saved レジスタ
+  for (auto&& reg : local_regs) {
+    for (auto&& info : slots) {
+      if (info.used && !info.is_float && info.reg == reg) {
+        this->saved_regs.emplace_back(reg);
+        break;
+      }
+    }
+  }
+
+  // スタックに置くもの
+  for (auto&& info : slots) {
+    if (info.used && info.reg < 0) {
+      info.offset = -8 * (int32_t)(this->saved_regs.size() +
+                                   ++this->spill_count);
+    }
+  }
+}
+
+// --------------------------------------------------------
+//  生成
+// --------------------------------------------------------
+
+void CodeGen::compile(Assembler& as, SlotResolver const& resolve)
+{
+  this->as = &as;
+  this->resolve = &resolve;
+
+  this->allocate_registers();
+
+  this->return_label = as.new_label();
+
+  //
+  // prologue
+  as.push(RBP);
+  as.mov(RBP, RSP);
+
+  for (auto&& reg : this->saved_regs)
+    as.push(reg);
+
+  auto frame_size_at = as.sub_imm_patchable(RSP);
+
+  //
+  // 引数をそれぞれの場所に移す
+  size_t ints = 0;
+  size_t floats = 0;
+
+  for (size_t i = 0; i < this->func->args.size(); i++) {
+    auto const& info = this->slots[i];
+
+    if (info.is_float) {
+      auto src = xreg_of(floats++);
+
+      if (info.reg >= 0)
+        as.movaps((XReg)info.reg, src);
+      else
+        as.movss_store(RBP, info.offset, src);
+    }
+    else {
+      auto src = int_arg_regs[ints++];
+
+      if (info.reg >= 0)
+        as.mov((Reg)info.reg, src);
+      else
+        as.store(RBP, info.offset, src);
+    }
+  }
+
+  // 最後の式の値がそのまま戻り値になる
+  this->gen(this->func->code);
+
+  //
+  // epilogue
+  as.bind(this->return_label);
+  as.lea(RSP, RBP, -8 * (int32_t)this->saved_regs.size());
+
+  for (auto it = this->saved_regs.rbegin();
+       it != this->saved_regs.rend(); it++)
+    as.pop(*it);
+
+  as.pop(RBP);
+  as.ret();
+
+  //
+  // 実行時エラー (戻らない)
+  for (auto&& stub : this->stubs) {
+    as.bind(stub.label);
+    as.mov_imm(RDI, (int64_t)stub.location);
+    as.mov_imm(RSI, (int64_t)stub.message);
+    as.mov_imm(RAX, stub.is_token ? (int64_t)error_at_token
+                                  : (int64_t)error_at_ast);
+    as.call(RAX);
+  }
+
+  //
+  // フレームの大きさ
+  //  push した分と合わせて 16 バイトの倍数にする
+  int32_t size = 8 * (this->spill_count + this->max_temp_depth);
+
+  if ((8 * this->saved_regs.size() + size) % 16)
+    size += 8;
+
+  as.patch32(frame_size_at, size);
+}
+
+void CodeGen::compile_entry(Assembler& as, void* const* body)
+{
+  // rbx を積むと rsp が 16 バイト境界になる
+  as.push(RBX);
+  as.mov(RBX, RDI);
+
+  size_t ints = 0;
+  size_t floats = 0;
+
+  for (size_t i = 0; i < this->func->args.size(); i++) {
+    if (type_of(this->func->args[i]->type) == TYPE_Float)
+      as.movss_load(xreg_of(floats++), RBX, 8 * i);
+    else
+      as.load(int_arg_regs[ints++], RBX, 8 * i);
+  }
+
+  as.mov_imm(RAX, (int64_t)body);
+  as.call_mem(RAX, 0);
+
+  if (type_of(this->func->result_type) == TYPE_Float)
+    as.movss_store(RBX, 0, XMM0);
+  else
+    as.store(RBX, 0, RAX);
+
+  as.pop(RBX);
+  as.ret();
+}
+
+TypeKind CodeGen::gen(AST::Base* _ast)
+{
+  auto& as = *this->as;
+
+  switch (_ast->kind) {
+    case AST_True:
+    case AST_False:
+      as.mov_imm32(RAX, _ast->kind == AST_True);
+      return TYPE_Bool;
+
+    case AST_Value: {
+      auto type = type_of(_ast);
+
+      if (type == TYPE_Float)
+        this->load_float_imm(XMM0, float_value(_ast));
+      else
+        as.mov_imm(RAX, int_value(_ast));
+
+      return type;
+    }
+
+    case AST_Variable:
+      this->load_var(((AST::Variable*)_ast)->slot, RAX, XMM0);
+      return type_of(_ast);
+
+    case AST_UnaryPlus:
+      return this->gen(((AST::UnaryOp*)_ast)->expr);
+
+    //
+    // float は符号ビットを反転する
+    case AST_UnaryMinus: {
+      auto type = this->gen(((AST::UnaryOp*)_ast)->expr);
+
+      if (type == TYPE_Float) {
+        as.mov_imm32(R11, 0x80000000);
+        as.movd(XMM1, R11);
+        as.xorps(XMM0, XMM1);
+      }
+      else
+        as.neg(RAX);
+
+      return type;
+    }
+
+    case AST_Cast:
+      return this->gen_cast((AST::Cast*)_ast);
+
+    case AST_Expr:
+      return this->gen_expr((AST::Expr*)_ast);
+
+    case AST_Compare:
+      this->gen_bool(_ast);
+      return TYPE_Bool;
+
+    case AST_Assign: {
+      astdef(Assign);
+
+      auto type = this->gen(ast->expr);
+
+      this->store_var(((AST::Variable*)ast->dest)->slot);
+
+      return type;
+    }
+
+    case AST_CallFunc:
+      return this->gen_call((AST::CallFunc*)_ast);
+
+    case AST_Let: {
+      auto ast = (AST::VariableDeclaration*)_ast;
+
+      if (ast->init)
+        this->gen(ast->init);
+      else if (this->slots[ast->slot].is_float)
+        as.xorps(XMM0, XMM0);
+      else
+        as.mov_imm32(RAX, 0);
+
+      this->store_var(ast->slot);
+
+      return TYPE_None;
+    }
+
+    case AST_Return:
+      this->gen(((AST::Return*)_ast)->expr);
+      as.jmp(this->return_label);
+
+      return TYPE_None;
+
+    case AST_If:
+      return this->gen_if((AST::If*)_ast);
+
+    case AST_Scope:
+      return this->gen_scope((AST::Scope*)_ast);
+
+    case AST_Break:
+      as.jmp(this->loop_labels.back().break_to);
+      return TYPE_None;
+
+    case AST_Continue:
+      as.jmp(this->loop_labels.back().continue_to);
+      return TYPE_None;
+
+    case AST_Loop: {
+      auto top = as.new_label();
+      auto end = as.new_label();
+
+      this->loop_labels.push_back({end, top});
+
+      as.bind(top);
+      this->gen(((AST::Loop*)_ast)->code);
+      as.jmp(top);
+      as.bind(end);
+
+      this->loop_labels.pop_back();
+
+      return TYPE_None;
+    }
+
+    //
+    // 条件を後ろに置く
+    case AST_While: {
+      astdef(While);
+
+      auto body = as.new_label();
+      auto cond = as.new_label();
+      auto end = as.new_label();
+
+      this->loop_labels.push_back({end, cond});
+
+      as.jmp(cond);
+      as.bind(body);
+      this->gen(ast->code);
+      as.bind(cond);
+      this->branch(ast->cond, body, true);
+      as.bind(end);
+
+      this->loop_labels.pop_back();
+
+      return TYPE_None;
+    }
+
+    case AST_DoWhile: {
+      astdef(DoWhile);
+
+      auto body = as.new_label();
+      auto cond = as.new_label();
+      auto end = as.new_label();
+
+      this->loop_labels.push_back({end, cond});
+
+      as.bind(body);
+      this->gen(ast->code);
+      as.bind(cond);
+      this->branch(ast->cond, body, true);
+      as.bind(end);
+
+      this->loop_labels.pop_back();
+
+      return TYPE_None;
+    }
+
+    case AST_For:
+      this->gen_for((AST::For*)_ast);
+      return TYPE_None;
+  }
+
+  panic("unsupported node in jit");
+}
+
+TypeKind CodeGen::gen_scope(AST::Scope* ast)
+{
+  auto type = TYPE_None;
+
+  for (auto&& item : ast->list)
+    type = this->gen(item);
+
+  return ast->return_last_expr ? type : TYPE_None;
+}
+
+TypeKind CodeGen::gen_expr(AST::Expr* ast)
+{
+  if (is_logical(ast->elements[0].kind)) {
+    this->gen_bool(ast);
+    return TYPE_Bool;
+  }
+
+  auto type = this->gen(ast->first);
+
+  for (auto&& elem : ast->elements) {
+    auto rhs = type_of(elem.ast);
+    auto res = result_kind(elem.kind, type, rhs);
+
+    // 右辺が変数・即値なら、左辺を退避しなくてよい
+    if (this->is_simple(elem.ast)) {
+      this->convert(type, res);
+      this->load_simple(elem.ast, res, RCX, XMM1);
+    }
+    else {
+      auto temp = this->push_temp(type);
+
+      this->move_to_rhs(this->gen(elem.ast), res);
+      this->load_temp(temp, type, RAX, XMM0);
+      this->pop_temp();
+      this->convert(type, res);
+    }
+
+    if (res == TYPE_Float)
+      this->emit_float_op(elem);
+    else
+      this->emit_int_op(elem);
+
+    type = res;
+  }
+
+  return type;
+}
+
+//
+// 引数は先に (呼び出しがあるものを) 全部評価してから
+// レジスタに並べる
+TypeKind CodeGen::gen_call(AST::CallFunc* ast)
+{
+  auto& as = *this->as;
+  auto callee = ast->callee;
+  auto mark = this->temp_depth;
+
+  std::vector<size_t> temps(ast->args.size());
+
+  for (size_t i = 0; i < ast->args.size(); i++) {
+    if (!this->is_simple(ast->args[i]))
+      temps[i] = this->push_temp(this->gen(ast->args[i]));
+  }
+
+  size_t ints = 0;
+  size_t floats = 0;
+
+  for (size_t i = 0; i < ast->args.size(); i++) {
+    auto arg = ast->args[i];
+    auto type = type_of(callee->args[i]->type);
+
+    Reg reg = R11;
+    XReg xreg = XMM2;
+
+    if (type == TYPE_Float)
+      xreg = xreg_of(floats++);
+    else
+      reg = int_arg_regs[ints++];
+
+    if (this->is_simple(arg))
+      this->load_simple(arg, type, reg, xreg);
+    else
+      this->load_temp(temps[i], type, reg, xreg);
+  }
+
+  this->temp_depth = mark;
+
+  //
+  // ネイティブのスタックが足りなくなったらエラー
+  as.mov_imm(RAX, (int64_t)&stack_limit);
+  as.cmp_mem(RSP, RAX, 0);
+  as.jcc(CC_B, this->add_stub(ast, false, "stack overflow"));
+
+  // 呼び出し先は後から決まることがあるので、場所を経由する
+  as.mov_imm(RAX, (int64_t)(*this->resolve)(callee));
+  as.call_mem(RAX, 0);
+
+  return type_of(callee->result_type);
+}
+
+TypeKind CodeGen::gen_cast(AST::Cast* ast)
+{
+  auto& as = *this->as;
+
+  auto from = this->gen(ast->expr);
+  auto to = type_of(ast);
+
+  if (to != TYPE_Bool) {
+    this->convert(from, to);
+    return to;
+  }
+
+  //
+  // 0 以外なら true
+  //  (mov はフラグを変えない)
+  auto done = as.new_label();
+
+  if (from == TYPE_Float) {
+    as.xorps(XMM1, XMM1);
+    as.ucomiss(XMM0, XMM1);
+    as.mov_imm32(RAX, 1);
+    as.jcc(CC_P, done);
+    as.jcc(CC_NE, done);
+  }
+  else {
+    as.alu(Assembler::ALU_Test, RAX, RAX);
+    as.mov_imm32(RAX, 1);
+    as.jcc(CC_NE, done);
+  }
+
+  as.mov_imm32(RAX, 0);
+  as.bind(done);
+
+  return TYPE_Bool;
+}
+
+TypeKind CodeGen::gen_if(AST::If* ast)
+{
+  auto& as = *this->as;
+
+  auto else_label = as.new_label();
+  auto end = as.new_label();
+
+  this->branch(ast->condition, else_label, false);
+
+  auto type = this->gen(ast->if_true);
+
+  if (ast->if_false) {
+    as.jmp(end);
+    as.bind(else_label);
+    this->gen(ast->if_false);
+  }
+  else
+    as.bind(else_label);
+
+  as.bind(end);
+
+  return ast->if_false ? type : TYPE_None;
+}
+
+//
+// for i in begin .. end (by step)
+//  end は一度だけ評価して、定数でなければスタックに置く
+void CodeGen::gen_for(AST::For* ast)
+{
+  auto& as = *this->as;
+
+  auto range = (AST::Range*)ast->iterable;
+  auto slot = ((AST::Variable*)ast->iter)->slot;
+  auto const& info = this->slots[slot];
+
+  auto mark = this->temp_depth;
+
+  int64_t step = 1;
+  int64_t end_value = 0;
+
+  if (range->step)
+    const_int(range->step, step);
+
+  auto end_is_imm = const_int(range->end, end_value) &&
+                    end_value == (int32_t)end_value;
+
+  size_t end_temp = 0;
+
+  this->gen(range->begin);
+
+  if (!end_is_imm) {
+    auto begin_temp = this->push_temp(TYPE_Int);
+
+    this->gen(range->end);
+    end_temp = this->push_temp(TYPE_Int);
+    this->load_temp(begin_temp, TYPE_Int, RAX, XMM0);
+  }
+
+  if (step == 0) {
+    as.jmp(this->add_stub(range->step, false,
+                          "range step must not be zero"));
+  }
+
+  this->store_var(slot);
+
+  auto body = as.new_label();
+  auto cont = as.new_label();
+  auto cond = as.new_label();
+  auto end = as.new_label();
+
+  this->loop_labels.push_back({end, cont});
+
+  // ループ変数がレジスタにあれば直接増やす
+  auto iter = info.reg >= 0 ? (Reg)info.reg : RAX;
+
+  as.jmp(cond);
+
+  as.bind(body);
+  this->gen(ast->code);
+
+  as.bind(cont);
+
+  if (info.reg < 0)
+    this->load_var(slot, RAX, XMM0);
+
+  as.add_imm(iter, (int32_t)step);
+
+  // 桁あふれしたら end を越えているので抜ける
+  as.jcc(CC_O, end);
+
+  if (info.reg < 0)
+    this->store_var(slot);
+
+  as.bind(cond);
+
+  if (info.reg < 0)
+    this->load_var(slot, RAX, XMM0);
+
+  if (end_is_imm)
+    as.cmp_imm(iter, (int32_t)end_value);
+  else
+    as.cmp_mem(iter, RBP, this->temp_offset(end_temp));
+
+  as.jcc(step > 0 ? CC_L : CC_G, body);
+  as.bind(end);
+
+  this->loop_labels.pop_back();
+  this->temp_depth = mark;
+}
+
+// --------------------------------------------------------
+//  条件分岐
+// --------------------------------------------------------
+
+void CodeGen::branch(AST::Base* ast, Label target, bool when)
+{
+  auto& as = *this->as;
+
+  switch (ast->kind) {
+    case AST_True:
+    case AST_False:
+      if ((ast->kind == AST_True) == when)
+        as.jmp(target);
+
+      return;
+
+    case AST_Compare:
+      this->branch_compare((AST::Compare*)ast, target, when);
+      return;
+
+    case AST_Expr: {
+      auto expr = (AST::Expr*)ast;
+
+      if (is_logical(expr->elements[0].kind)) {
+        this->branch_logical(expr, expr->elements.size(), target,
+                             when);
+        return;
+      }
+
+      break;
+    }
+  }
+
+  this->gen(ast);
+
+  as.alu(Assembler::ALU_Test, RAX, RAX);
+  as.jcc(when ? CC_NE : CC_E, target);
+}
+
+//
+// first op[0] e[0] ... op[count-1] e[count-1] (左結合)
+void CodeGen::branch_logical(AST::Expr* ast, size_t count,
+                              Label target, bool when)
+{
+  if (count == 0) {
+    this->branch(ast->first, target, when);
+    return;
+  }
+
+  auto const& elem = ast->elements[count - 1];
+
+  //
+  // a && b が false、a || b が true
+  //  => どちらか一方で決まる
+  if ((elem.kind == AST::EX_And) != when) {
+    this->branch_logical(ast, count - 1, target, when);
+    this->branch(elem.ast, target, when);
+    return;
+  }
+
+  //
+  // a && b が true、a || b が false
+  //  => 左辺で決まったら飛ばない
+  auto skip = this->as->new_label();
+
+  this->branch_logical(ast, count - 1, skip, !when);
+  this->branch(elem.ast, target, when);
+
+  this->as->bind(skip);
+}
+
+//
+// a < b < c は、途中で false になったら終わり
+//  右辺は変換する前の値を次の左辺にする
+void CodeGen::branch_compare(AST::Compare* ast, Label target,
+                              bool when)
+{
+  auto& as = *this->as;
+
+  auto skip = as.new_label();
+  auto type = this->gen(ast->first);
+
+  for (size_t i = 0; i < ast->elements.size(); i++) {
+    auto const& elem = ast->elements[i];
+    auto is_last = i + 1 == ast->elements.size();
+
+    auto rhs = type_of(elem.ast);
+    auto common = common_kind(type, rhs);
+
+    auto mark = this->temp_depth;
+    size_t rhs_temp = 0;
+
+    if (this->is_simple(elem.ast)) {
+      this->convert(type, common);
+      this->load_simple(elem.ast, common, RCX, XMM1);
+    }
+    else {
+      auto lhs_temp = this->push_temp(type);
+
+      this->gen(elem.ast);
+
+      if (!is_last)
+        rhs_temp = this->push_temp(rhs);
+
+      this->move_to_rhs(rhs, common);
+      this->load_temp(lhs_temp, type, RAX, XMM0);
+      this->convert(type, common);
+    }
+
+    if (is_last)
+      this->emit_compare_jump(elem.kind, common, target, when);
+    else {
+      this->emit_compare_jump(elem.kind, common,
+                              when ? skip : target, false);
+
+      if (this->is_simple(elem.ast))
+        this->load_simple(elem.ast, rhs, RAX, XMM0);
+      else
+        this->load_temp(rhs_temp, rhs, RAX, XMM0);
+    }
+
+    this->temp_depth = mark;
+    type = rhs;
+  }
+
+  as.bind(skip);
+}
+
+//
+// rax と rcx (xmm0 と xmm1) を比べて、結果が when なら飛ぶ
+//  float は比べられない (NaN) とき false
+void CodeGen::emit_compare_jump(AST::CmpKind kind, TypeKind type,
+                                 Label target, bool when)
+{
+  auto& as = *this->as;
+
+  if (type != TYPE_Float) {
+    Cond cc = CC_E;
+
+    switch (kind) {
+      case AST::CMP_LeftBigger:
+        cc = CC_G;
+        break;
+
+      case AST::CMP_RightBigger:
+        cc = CC_L;
+        break;
+
+      case AST::CMP_LeftBigOrEqual:
+        cc = CC_GE;
+        break;
+
+      case AST::CMP_RightBigOrEqual:
+        cc = CC_LE;
+        break;
+
+      case AST::CMP_Equal:
+        cc = CC_E;
+        break;
+
+      case AST::CMP_NotEqual:
+        cc = CC_NE;
+        break;
+    }
+
+    as.alu(Assembler::ALU_Cmp, RAX, RCX);
+    as.jcc(when ? cc : negate(cc), target);
+
+    return;
+  }
+
+  switch (kind) {
+    //
+    // a > b, a >= b は CF, ZF だけで決まる
+    // (比べられないときは CF = ZF = 1)
+    case AST::CMP_LeftBigger:
+    case AST::CMP_LeftBigOrEqual:
+    case AST::CMP_RightBigger:
+    case AST::CMP_RightBigOrEqual: {
+      auto is_left = kind == AST::CMP_LeftBigger ||
+                     kind == AST::CMP_LeftBigOrEqual;
+
+      auto cc = kind == AST::CMP_LeftBigger ||
+                        kind == AST::CMP_RightBigger
+                    ? CC_A
+                    : CC_AE;
+
+      if (is_left)
+        as.ucomiss(XMM0, XMM1);
+      else
+        as.ucomiss(XMM1, XMM0);
+
+      as.jcc(when ? cc : negate(cc), target);
+      break;
+    }
+
+    //
+    // 等しい = ZF = 1 かつ PF = 0
+    case AST::CMP_Equal:
+    case AST::CMP_NotEqual: {
+      as.ucomiss(XMM0, XMM1);
+
+      if ((kind == AST::CMP_Equal) == when) {
+        auto skip = as.new_label();
+
+        as.jcc(CC_P, skip);
+        as.jcc(CC_E, target);
+        as.bind(skip);
+      }
+      else {
+        as.jcc(CC_P, target);
+        as.jcc(CC_NE, target);
+      }
+
+      break;
+    }
+  }
+}
+
+void CodeGen::gen_bool(AST::Base* ast)
+{
+  auto& as = *this->as;
+
+  auto is_false = as.new_label();
+  auto done = as.new_label();
+
+  this->branch(ast, is_false, false);
+
+  as.mov_imm32(RAX, 1);
+  as.jmp(done);
+  as.bind(is_false);
+  as.mov_imm32(RAX, 0);
+  as.bind(done);
+}
+
+// --------------------------------------------------------
+//  演算
+// --------------------------------------------------------
+
+void CodeGen::emit_int_op(AST::Expr::Element const& elem)
+{
+  auto& as = *this->as;
+
+  switch (elem.kind) {
+    case AST::EX_Add:
+      as.alu(Assembler::ALU_Add, RAX, RCX);
+      break;
+
+    case AST::EX_Sub:
+      as.alu(Assembler::ALU_Sub, RAX, RCX);
+      break;
+
+    case AST::EX_Mul:
+      as.imul(RAX, RCX);
+      break;
+
+    //
+    // -1 で割るときは idiv を使わない
+    //  (最小値 / -1 は例外になるので、Arith と同じく
+    //   符号反転と 0 にする)
+    case AST::EX_Div:
+    case AST::EX_Mod: {
+      auto by_minus_one = as.new_label();
+      auto done = as.new_label();
+
+      as.alu(Assembler::ALU_Test, RCX, RCX);
+      as.jcc(CC_E,
+             this->add_stub(&elem.op, true, "division by zero"));
+
+      as.cmp_imm(RCX, -1);
+      as.jcc(CC_E, by_minus_one);
+
+      as.cqo();
+      as.idiv(RCX);
+
+      if (elem.kind == AST::EX_Mod)
+        as.mov(RAX, RDX);
+
+      as.jmp(done);
+
+      as.bind(by_minus_one);
+
+      if (elem.kind == AST::EX_Div)
+        as.neg(RAX);
+      else
+        as.mov_imm32(RAX, 0);
+
+      as.bind(done);
+      break;
+    }
+
+    case AST::EX_LShift:
+      as.shl_cl(RAX);
+      break;
+
+    case AST::EX_RShift:
+      as.sar_cl(RAX);
+      break;
+
+    case AST::EX_BitAND:
+      as.alu(Assembler::ALU_And, RAX, RCX);
+      break;
+
+    case AST::EX_BitXOR:
+      as.alu(Assembler::ALU_Xor, RAX, RCX);
+      break;
+
+    case AST::EX_BitOR:
+      as.alu(Assembler::ALU_Or, RAX, RCX);
+      break;
+  }
+}
+
+void CodeGen::emit_float_op(AST::Expr::Element const& elem)
+{
+  auto& as = *this->as;
+
+  switch (elem.kind) {
+    case AST::EX_Add:
+      as.sse(Assembler::SSE_Add, XMM0, XMM1);
+      break;
+
+    case AST::EX_Sub:
+      as.sse(Assembler::SSE_Sub, XMM0, XMM1);
+      break;
+
+    case AST::EX_Mul:
+      as.sse(Assembler::SSE_Mul, XMM0, XMM1);
+      break;
+
+    //
+    // 0 と等しいとき (NaN は除く) エラー
+    case AST::EX_Div: {
+      auto ok = as.new_label();
+
+      as.xorps(XMM2, XMM2);
+      as.ucomiss(XMM1, XMM2);
+      as.jcc(CC_P, ok);
+      as.jcc(CC_E,
+             this->add_stub(&elem.op, true, "division by zero"));
+      as.bind(ok);
+
+      as.sse(Assembler::SSE_Div, XMM0, XMM1);
+      break;
+    }
+  }
+}
+
+void CodeGen::convert(TypeKind from, TypeKind to)
+{
+  if ((from == TYPE_Float) == (to == TYPE_Float))
+    return;
+
+  if (to == TYPE_Float)
+    this->as->cvtsi2ss(XMM0, RAX);
+  else
+    this->as->cvttss2si(RAX, XMM0);
+}
+
+void CodeGen::move_to_rhs(TypeKind from, TypeKind to)
+{
+  auto& as = *this->as;
+
+  if (from == TYPE_Float) {
+    if (to == TYPE_Float)
+      as.movaps(XMM1, XMM0);
+    else
+      as.cvttss2si(RCX, XMM0);
+  }
+  else {
+    if (to == TYPE_Float)
+      as.cvtsi2ss(XMM1, RAX);
+    else
+      as.mov(RCX, RAX);
+  }
+}
+
+// --------------------------------------------------------
+//  値の置き場所
+// --------------------------------------------------------
+
+bool CodeGen::is_simple(AST::Base* ast) const
+{
+  switch (ast->kind) {
+    case AST_True:
+    case AST_False:
+    case AST_Value:
+    case AST_Variable:
+      return true;
+  }
+
+  return false;
+}
+
+//
+// 変換が要るときは、もう片方のレジスタを一時的に使う
+void CodeGen::load_simple(AST::Base* ast, TypeKind to, Reg reg,
+                           XReg xreg)
+{
+  auto& as = *this->as;
+  auto from = type_of(ast);
+
+  switch (ast->kind) {
+    case AST_True:
+    case AST_False:
+      as.mov_imm32(reg, ast->kind == AST_True);
+      return;
+
+    case AST_Value:
+      if (from == TYPE_Float) {
+        if (to == TYPE_Float)
+          this->load_float_imm(xreg, float_value(ast));
+        else
+          as.mov_imm(reg, (int64_t)float_value(ast));
+      }
+      else {
+        if (to == TYPE_Float)
+          this->load_float_imm(xreg, (float)int_value(ast));
+        else
+          as.mov_imm(reg, int_value(ast));
+      }
+
+      return;
+  }
+
+  this->load_var(((AST::Variable*)ast)->slot, reg, xreg);
+
+  if (from == TYPE_Float && to != TYPE_Float)
+    as.cvttss2si(reg, xreg);
+  else if (from != TYPE_Float && to == TYPE_Float)
+    as.cvtsi2ss(xreg, reg);
+}
+
+void CodeGen::load_var(size_t slot, Reg reg, XReg xreg)
+{
+  auto& as = *this->as;
+  auto const& info = this->slots[slot];
+
+  if (info.is_float) {
+    if (info.reg >= 0)
+      as.movaps(xreg, (XReg)info.reg);
+    else
+      as.movss_load(xreg, RBP, info.offset);
+  }
+  else {
+    if (info.reg >= 0)
+      as.mov(reg, (Reg)info.reg);
+    else
+      as.load(reg, RBP, info.offset);
+  }
+}
+
+void CodeGen::store_var(size_t slot)
+{
+  auto& as = *this->as;
+  auto const& info = this->slots[slot];
+
+  if (info.is_float) {
+    if (info.reg >= 0)
+      as.movaps((XReg)info.reg, XMM0);
+    else
+      as.movss_store(RBP, info.offset, XMM0);
+  }
+  else {
+    if (info.reg >= 0)
+      as.mov((Reg)info.reg, RAX);
+    else
+      as.store(RBP, info.offset, RAX);
+  }
+}
+
+size_t CodeGen::push_temp(TypeKind type)
+{
+  auto offset = this->temp_offset(this->temp_depth);
+
+  if (type == TYPE_Float)
+    this->as->movss_store(RBP, offset, XMM0);
+  else
+    this->as->store(RBP, offset, RAX);
+
+  this->max_temp_depth =
+      std::max(this->max_temp_depth, this->temp_depth + 1);
+
+  return this->temp_depth++;
+}
+
+void CodeGen::load_temp(size_t index, TypeKind type, Reg reg,
+                         XReg xreg)
+{
+  auto offset = this->temp_offset(index);
+
+  if (type == TYPE_Float)
+    this->as->movss_load(xreg, RBP, offset);
+  else
+    this->as->load(reg, RBP, offset);
+}
+
+void CodeGen::pop_temp()
+{
+  this->temp_depth--;
+}
+
+int32_t CodeGen::temp_offset(size_t index) const
+{
+  return -8 * (int32_t)(this->saved_regs.size() +
+                        this->spill_count + index + 1);
+}
+
+//
+// r11 は他で使わないので、即値を作るのに使う
+void CodeGen::load_float_imm(XReg dst, float value)
+{
+  uint32_t bits;
+
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  if (bits == 0) {
+    this->as->xorps(dst, dst);
+    return;
+  }
+
+  this->as->mov_imm32(R11, bits);
+  this->as->movd(dst, R11);
+}
+
+CodeGen::Label CodeGen::add_stub(void const* location,
+                                   bool is_token,
+                                   char const* message)
+{
+  auto label = this->as->new_label();
+
+  this->stubs.push_back({label, location, is_token, message});
+
+  return label;
+}
+
+}  // namespace JIT
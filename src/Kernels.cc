@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <immintrin.h>
+
+#include "Arith.h"
+#include "Kernels.h"
+
+namespace Kernels {
+
+bool has_avx2()
+{
+  static bool const ret = __builtin_cpu_supports("avx2");
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  scalar
+// --------------------------------------------------------
+
+//
+// int は桁あふれしたら巻き戻す (式の演算と同じ)
+static int64_t compute(Operator op, int64_t a, int64_t b)
+{
+  switch (op) {
+    case OP_Add:
+      return Arith::add(a, b);
+
+    case OP_Sub:
+      return Arith::sub(a, b);
+
+    case OP_Mul:
+      return Arith::mul(a, b);
+
+    case OP_Div:
+      return Arith::div(a, b);
+  }
+
+  return 0;
+}
+
+static float compute(Operator op, float a, float b)
+{
+  switch (op) {
+    case OP_Add:
+      return a + b;
+
+    case OP_Sub:
+      return a - b;
+
+    case OP_Mul:
+      return a * b;
+
+    case OP_Div:
+      return a / b;
+  }
+
+  return 0;
+}
+
+//
+// b_step = 0 なら b[0] をすべての要素に使う
+template <class T>
+static void apply_scalar_impl(Operator op, T* dst, T const* a,
+                              T const* b, size_t b_step,
+                              size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dst[i] = compute(op, a[i], b[i * b_step]);
+}
+
+//
+// float の合計は 8 本に分けて足し、最後に決まった順番でまとめる
+//  (AVX2 と同じ結果にする)
+static float reduce_lanes(float const* acc)
+{
+  return ((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+         ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+static float sum_scalar(float const* a, size_t n)
+{
+  float acc[8] = {};
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    for (size_t j = 0; j < 8; j++)
+      acc[j] += a[i + j];
+  }
+
+  auto ret = reduce_lanes(acc);
+
+  for (; i < n; i++)
+    ret += a[i];
+
+  return ret;
+}
+
+static float dot_scalar(float const* a, float const* b,
+                        size_t n)
+{
+  float acc[8] = {};
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    for (size_t j = 0; j < 8; j++)
+      acc[j] += a[i + j] * b[i + j];
+  }
+
+  auto ret = reduce_lanes(acc);
+
+  for (; i < n; i++)
+    ret += a[i] * b[i];
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  AVX2
+// --------------------------------------------------------
+
+#define AVX2 __attribute__((target("avx2")))
+
+//
+// int の掛け算と割り算は AVX2 にないので、スカラーで計算する
+AVX2 static void apply_avx2(Operator op, int64_t* dst,
+                            int64_t const* a, int64_t const* b,
+                            size_t b_step, size_t n)
+{
+  if (op == OP_Mul || op == OP_Div) {
+    apply_scalar_impl(op, dst, a, b, b_step, n);
+    return;
+  }
+
+  size_t i = 0;
+
+  auto y = _mm256_set1_epi64x(*b);
+
+  for (; i + 4 <= n; i += 4) {
+    auto x = _mm256_loadu_si256((__m256i const*)(a + i));
+
+    if (b_step != 0)
+      y = _mm256_loadu_si256((__m256i const*)(b + i));
+
+    x = op == OP_Add ? _mm256_add_epi64(x, y)
+                     : _mm256_sub_epi64(x, y);
+
+    _mm256_storeu_si256((__m256i*)(dst + i), x);
+  }
+
+  apply_scalar_impl(op, dst + i, a + i, b + i * b_step, b_step,
+                    n - i);
+}
+
+AVX2 static void apply_avx2(Operator op, float* dst,
+                            float const* a, float const* b,
+                            size_t b_step, size_t n)
+{
+  size_t i = 0;
+
+  auto y = _mm256_set1_ps(*b);
+
+  for (; i + 8 <= n; i += 8) {
+    auto x = _mm256_loadu_ps(a + i);
+
+    if (b_step != 0)
+      y = _mm256_loadu_ps(b + i);
+
+    switch (op) {
+      case OP_Add:
+        x = _mm256_add_ps(x, y);
+        break;
+
+      case OP_Sub:
+        x = _mm256_sub_ps(x, y);
+        break;
+
+      case OP_Mul:
+        x = _mm256_mul_ps(x, y);
+        break;
+
+      case OP_Div:
+        x = _mm256_div_ps(x, y);
+        break;
+    }
+
+    _mm256_storeu_ps(dst + i, x);
+  }
+
+  apply_scalar_impl(op, dst + i, a + i, b + i * b_step, b_step,
+                    n - i);
+}
+
+AVX2 static int64_t sum_avx2(int64_t const* a, size_t n)
+{
+  auto acc = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_add_epi64(
+        acc, _mm256_loadu_si256((__m256i const*)(a + i)));
+  }
+
+  int64_t lanes[4];
+
+  _mm256_storeu_si256((__m256i*)lanes, acc);
+
+  auto ret = compute(OP_Add, compute(OP_Add, lanes[0], lanes[1]),
+                     compute(OP_Add, lanes[2], lanes[3]));
+
+  for (; i < n; i++)
+    ret = compute(OP_Add, ret, a[i]);
+
+  return ret;
+}
+
+AVX2 static float sum_avx2(float const* a, size_t n)
+{
+  auto acc = _mm256_setzero_ps();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    acc = _mm256_add_ps(acc, _mm256_loadu_ps(a + i));
+
+  float lanes[8];
+
+  _mm256_storeu_ps(lanes, acc);
+
+  auto ret = reduce_lanes(lanes);
+
+  for (; i < n; i++)
+    ret += a[i];
+
+  return ret;
+}
+
+AVX2 static float dot_avx2(float const* a, float const* b,
+                           size_t n)
+{
+  auto acc = _mm256_setzero_ps();
+  size_t i = 0;
+
+  // FMA は使わない (スカラーと結果を合わせる)
+  for (; i + 8 <= n; i += 8) {
+    acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                           _mm256_loadu_ps(b + i)));
+  }
+
+  float lanes[8];
+
+  _mm256_storeu_ps(lanes, acc);
+
+  auto ret = reduce_lanes(lanes);
+
+  for (; i < n; i++)
+    ret += a[i] * b[i];
+
+  return ret;
+}
+
+//
+// is_max = true なら最大値
+AVX2 static int64_t minmax_avx2(int64_t const* a, size_t n,
+                                bool is_max)
+{
+  size_t i = 0;
+  int64_t ret = a[0];
+
+  if (n >= 4) {
+    auto acc = _mm256_loadu_si256((__m256i const*)a);
+
+    for (i = 4; i + 4 <= n; i += 4) {
+      auto x = _mm256_loadu_si256((__m256i const*)(a + i));
+
+      auto gt = is_max ? _mm256_cmpgt_epi64(x, acc)
+                       : _mm256_cmpgt_epi64(acc, x);
+
+      acc = _mm256_blendv_epi8(acc, x, gt);
+    }
+
+    int64_t lanes[4];
+
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+
+    ret = is_max ? *std::max_element(lanes, lanes + 4)
+                 : *std::min_element(lanes, lanes + 4);
+  }
+
+  for (; i < n; i++)
+    ret = is_max ? std::max(ret, a[i]) : std::min(ret, a[i]);
+
+  return ret;
+}
+
+AVX2 static float minmax_avx2(float const* a, size_t n,
+                              bool is_max)
+{
+  size_t i = 0;
+  float ret = a[0];
+
+  if (n >= 8) {
+    auto acc = _mm256_loadu_ps(a);
+
+    for (i = 8; i + 8 <= n; i += 8) {
+      auto x = _mm256_loadu_ps(a + i);
+
+      acc = is_max ? _mm256_max_ps(acc, x)
+                   : _mm256_min_ps(acc, x);
+    }
+
+    float lanes[8];
+
+    _mm256_storeu_ps(lanes, acc);
+
+    ret = is_max ? *std::max_element(lanes, lanes + 8)
+                 : *std::min_element(lanes, lanes + 8);
+  }
+
+  for (; i < n; i++)
+    ret = is_max ? std::max(ret, a[i]) : std::min(ret, a[i]);
+
+  return ret;
+}
+
+AVX2 static void clamp_avx2(int64_t* dst, int64_t const* a,
+                            int64_t lo, int64_t hi, size_t n)
+{
+  auto vlo = _mm256_set1_epi64x(lo);
+  auto vhi = _mm256_set1_epi64x(hi);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    auto x = _mm256_loadu_si256((__m256i const*)(a + i));
+
+    x = _mm256_blendv_epi8(x, vlo, _mm256_cmpgt_epi64(vlo, x));
+    x = _mm256_blendv_epi8(x, vhi, _mm256_cmpgt_epi64(x, vhi));
+
+    _mm256_storeu_si256((__m256i*)(dst + i), x);
+  }
+
+  for (; i < n; i++)
+    dst[i] = std::min(std::max(a[i], lo), hi);
+}
+
+AVX2 static void clamp_avx2(float* dst, float const* a,
+                            float lo, float hi, size_t n)
+{
+  auto vlo = _mm256_set1_ps(lo);
+  auto vhi = _mm256_set1_ps(hi);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    auto x = _mm256_loadu_ps(a + i);
+
+    x = _mm256_min_ps(_mm256_max_ps(x, vlo), vhi);
+
+    _mm256_storeu_ps(dst + i, x);
+  }
+
+  for (; i < n; i++)
+    dst[i] = std::min(std::max(a[i], lo), hi);
+}
+
+#undef AVX2
+
+// --------------------------------------------------------
+//  dispatch
+// --------------------------------------------------------
+
+template <class T>
+void apply(Operator op, T* dst, T const* a, T const* b, size_t n)
+{
+  if (has_avx2())
+    apply_avx2(op, dst, a, b, 1, n);
+  else
+    apply_scalar_impl(op, dst, a, b, 1, n);
+}
+
+template <class T>
+void apply_scalar(Operator op, T* dst, T const* a, T b, size_t n)
+{
+  if (has_avx2())
+    apply_avx2(op, dst, a, &b, 0, n);
+  else
+    apply_scalar_impl(op, dst, a, &b, 0, n);
+}
+
+int64_t sum(int64_t const* a, size_t n)
+{
+  if (has_avx2())
+    return sum_avx2(a, n);
+
+  int64_t ret = 0;
+
+  for (size_t i = 0; i < n; i++)
+    ret = compute(OP_Add, ret, a[i]);
+
+  return ret;
+}
+
+float sum(float const* a, size_t n)
+{
+  return has_avx2() ? sum_avx2(a, n) : sum_scalar(a, n);
+}
+
+int64_t dot(int64_t const* a, int64_t const* b, size_t n)
+{
+  int64_t ret = 0;
+
+  for (size_t i = 0; i < n; i++)
+    ret = compute(OP_Add, ret, compute(OP_Mul, a[i], b[i]));
+
+  return ret;
+}
+
+float dot(float const* a, float const* b, size_t n)
+{
+  return has_avx2() ? dot_avx2(a, b, n) : dot_scalar(a, b, n);
+}
+
+template <class T>
+T min(T const* a, size_t n)
+{
+  if (has_avx2())
+    return minmax_avx2(a, n, false);
+
+  return *std::min_element(a, a + n);
+}
+
+template <class T>
+T max(T const* a, size_t n)
+{
+  if (has_avx2())
+    return minmax_avx2(a, n, true);
+
+  return *std::max_element(a, a + n);
+}
+
+//
+// 前の要素に依存するので、スカラーだけ
+template <class T>
+void cumsum(T* dst, T const* a, size_t n)
+{
+  T acc = 0;
+
+  for (size_t i = 0; i < n; i++)
+    dst[i] = acc = compute(OP_Add, acc, a[i]);
+}
+
+template <class T>
+void clamp(T* dst, T const* a, T lo, T hi, size_t n)
+{
+  if (has_avx2()) {
+    clamp_avx2(dst, a, lo, hi, n);
+    return;
+  }
+
+  for (size_t i = 0; i < n; i++)
+    dst[i] = std::min(std::max(a[i], lo), hi);
+}
+
+#define instantiate(T)                                          \
+  template void apply(Operator, T*, T const*, T const*, size_t); \
+  template void apply_scalar(Operator, T*, T const*, T, size_t); \
+  template T min(T const*, size_t);                             \
+  template T max(T const*, size_t);                             \
+  template void cumsum(T*, T const*, size_t);                   \
+  template void clamp(T*, T const*, T, T, size_t)
+
+instantiate(int64_t);
+instantiate(float);
+
+#undef instantiate
+
+}  // namespace Kernels
@@ -0,0 +1,408 @@
+#include <array>
+#include <utility>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "Arith.h"
+#include "Object.h"
+#include "Error.h"
+#include "Operators.h"
+
+namespace Operators {
+
+//
+// Value の中身を C++ の型で読み書きする
+template <TypeKind K>
+struct Scalar;
+
+template <>
+struct Scalar<TYPE_Int> {
+  using type = int64_t;
+
+  static int64_t get(Value const& v)
+  {
+    return v.v_int;
+  }
+
+  static Value make(int64_t x)
+  {
+    return Value::from_int(x);
+  }
+};
+
+template <>
+struct Scalar<TYPE_USize> {
+  using type = size_t;
+
+  static size_t get(Value const& v)
+  {
+    return v.v_usize;
+  }
+
+  static Value make(size_t x)
+  {
+    return Value::from_usize(x);
+  }
+};
+
+template <>
+struct Scalar<TYPE_Float> {
+  using type = float;
+
+  static float get(Value const& v)
+  {
+    return v.v_float;
+  }
+
+  static Value make(float x)
+  {
+    return Value::from_float(x);
+  }
+};
+
+template <>
+struct Scalar<TYPE_Bool> {
+  using type = bool;
+
+  static bool get(Value const& v)
+  {
+    return v.v_bool;
+  }
+
+  static Value make(bool x)
+  {
+    return Value::from_bool(x);
+  }
+};
+
+template <>
+struct Scalar<TYPE_Char> {
+  using type = wchar_t;
+
+  static wchar_t get(Value const& v)
+  {
+    return v.v_char;
+  }
+
+  static Value make(wchar_t x)
+  {
+    return Value::from_char(x);
+  }
+};
+
+// 表に入れる型 (TYPE_None から TYPE_Char まで)
+static constexpr size_t NUM_TYPES = TYPE_Char + 1;
+
+static constexpr size_t NUM_EXPR_KINDS = AST::EX_Or + 1;
+static constexpr size_t NUM_CMP_KINDS = AST::CMP_NotEqual + 1;
+
+static constexpr bool is_numeric(TypeKind kind)
+{
+  return kind == TYPE_Int || kind == TYPE_USize ||
+         kind == TYPE_Float;
+}
+
+// --------------------------------------------------------
+//  二項演算
+// --------------------------------------------------------
+
+//
+// 結果の型 (Sema::is_valid_expr と同じ規則)
+//  引き算は float を優先し、それ以外は左辺の型にする
+template <AST::ExprKind K, TypeKind L, TypeKind R>
+static constexpr TypeKind result_kind()
+{
+  if (K == AST::EX_Sub && L != R && L != TYPE_Float)
+    return R;
+
+  return L;
+}
+
+template <AST::ExprKind K, TypeKind L, TypeKind R>
+static void numeric(Value& dest, Value const& right,
+                    Token const& op)
+{
+  constexpr auto res = result_kind<K, L, R>();
+
+  using T = typename Scalar<res>::type;
+
+  auto a = (T)Scalar<L>::get(dest);
+  auto b = (T)Scalar<R>::get(right);
+
+  if constexpr (K == AST::EX_Div || K == AST::EX_Mod) {
+    if (b == 0)
+      Error(op, "division by zero").emit().exit();
+  }
+
+  T x{};
+
+  //
+  // int は Arith で計算する (桁あふれ、-1 での割り算)
+  if constexpr (res == TYPE_Int) {
+    switch (K) {
+      case AST::EX_Add:
+        x = Arith::add(a, b);
+        break;
+
+      case AST::EX_Sub:
+        x = Arith::sub(a, b);
+        break;
+
+      case AST::EX_Mul:
+        x = Arith::mul(a, b);
+        break;
+
+      case AST::EX_Div:
+        x = Arith::div(a, b);
+        break;
+
+      case AST::EX_Mod:
+        x = Arith::mod(a, b);
+        break;
+
+      case AST::EX_LShift:
+        x = Arith::shl(a, b);
+        break;
+
+      case AST::EX_RShift:
+        x = Arith::shr(a, b);
+        break;
+
+      case AST::EX_BitAND:
+        x = a & b;
+        break;
+
+      case AST::EX_BitXOR:
+        x = a ^ b;
+        break;
+
+      case AST::EX_BitOR:
+        x = a | b;
+        break;
+    }
+
+    dest = Scalar<res>::make(x);
+    return;
+  }
+
+  switch (K) {
+    case AST::EX_Add:
+      x = a + b;
+      break;
+
+    case AST::EX_Sub:
+      x = a - b;
+      break;
+
+    case AST::EX_Mul:
+      x = a * b;
+      break;
+
+    case AST::EX_Div:
+      x = a / b;
+      break;
+
+    default:
+      if constexpr (res != TYPE_Float) {
+        switch (K) {
+          case AST::EX_Mod:
+            x = a % b;
+            break;
+
+          case AST::EX_LShift:
+            x = a << b;
+            break;
+
+          case AST::EX_RShift:
+            x = a >> b;
+            break;
+
+          case AST::EX_BitAND:
+            x = a & b;
+            break;
+
+          case AST::EX_BitXOR:
+            x = a ^ b;
+            break;
+
+          case AST::EX_BitOR:
+            x = a | b;
+            break;
+        }
+      }
+  }
+
+  dest = Scalar<res>::make(x);
+}
+
+//
+// && と || は、左辺で決まらなかったときだけ呼ばれる
+//  (Evaluator が Operators::is_short_circuit で調べる)
+static void logical(Value& dest, Value const& right, Token const&)
+{
+  dest.v_bool = right.v_bool;
+}
+
+static void concat(Value& dest, Value const& right, Token const&)
+{
+  ((ObjString*)dest.v_obj)->get_mut_value() +=
+      ((ObjString*)right.v_obj)->get_value();
+}
+
+static void unsupported(Value&, Value const&, Token const&)
+{
+  todo_impl;
+}
+
+template <AST::ExprKind K, TypeKind L, TypeKind R>
+static constexpr ExprKernel select_expr()
+{
+  // 足し算は同じ型、余りは整数どうし
+  constexpr auto arith =
+      K == AST::EX_Add   ? L == R
+      : K == AST::EX_Mod ? L == R && L != TYPE_Float
+                         : K <= AST::EX_Div;
+
+  constexpr auto bit = K >= AST::EX_LShift && K <= AST::EX_BitOR;
+
+  if constexpr (arith && is_numeric(L) && is_numeric(R))
+    return numeric<K, L, R>;
+  else if constexpr (bit && L == TYPE_Int && R == TYPE_Int)
+    return numeric<K, L, R>;
+  else if constexpr ((K == AST::EX_And || K == AST::EX_Or) &&
+                     L == TYPE_Bool && R == TYPE_Bool)
+    return logical;
+  else
+    return unsupported;
+}
+
+template <size_t... I>
+static constexpr auto make_expr_table(std::index_sequence<I...>)
+{
+  constexpr auto N = NUM_TYPES;
+
+  return std::array<ExprKernel, sizeof...(I)>{
+      select_expr<(AST::ExprKind)(I / (N * N)),
+                  (TypeKind)(I / N % N), (TypeKind)(I % N)>()...};
+}
+
+static constexpr auto expr_table = make_expr_table(
+    std::make_index_sequence<NUM_EXPR_KINDS * NUM_TYPES *
+                             NUM_TYPES>());
+
+ExprKernel get_expr_kernel(AST::ExprKind kind, TypeKind lhs,
+                           TypeKind rhs)
+{
+  if (kind == AST::EX_Add && lhs == TYPE_String &&
+      rhs == TYPE_String)
+    return concat;
+
+  if (lhs >= NUM_TYPES || rhs >= NUM_TYPES)
+    return unsupported;
+
+  return expr_table[(kind * NUM_TYPES + lhs) * NUM_TYPES + rhs];
+}
+
+// --------------------------------------------------------
+//  比較
+// --------------------------------------------------------
+
+template <AST::CmpKind K, class T>
+static bool compare(T a, T b)
+{
+  switch (K) {
+    case AST::CMP_LeftBigger:
+      return a > b;
+
+    case AST::CMP_RightBigger:
+      return a < b;
+
+    case AST::CMP_LeftBigOrEqual:
+      return a >= b;
+
+    case AST::CMP_RightBigOrEqual:
+      return a <= b;
+
+    case AST::CMP_Equal:
+      return a == b;
+
+    case AST::CMP_NotEqual:
+      return a != b;
+  }
+
+  return false;
+}
+
+//
+// 比べる型
+//  float があれば float、int と usize は int にする
+//  (整数どうしは変換せずに正確に比べる)
+template <TypeKind L, TypeKind R>
+static constexpr TypeKind common_kind()
+{
+  if (L == R)
+    return L;
+
+  if (L == TYPE_Float || R == TYPE_Float)
+    return TYPE_Float;
+
+  return TYPE_Int;
+}
+
+template <AST::CmpKind K, TypeKind L, TypeKind R>
+static bool scalar(Value const& left, Value const& right)
+{
+  using T = typename Scalar<common_kind<L, R>()>::type;
+
+  return compare<K>((T)Scalar<L>::get(left),
+                    (T)Scalar<R>::get(right));
+}
+
+//
+// 文字列・コンテナなど
+template <AST::CmpKind K>
+static bool object(Value const& left, Value const& right)
+{
+  auto eq = left.equals(right);
+
+  return K == AST::CMP_NotEqual ? !eq : eq;
+}
+
+template <AST::CmpKind K, TypeKind L, TypeKind R>
+static constexpr CompareKernel select_compare()
+{
+  if constexpr (L != TYPE_None && R != TYPE_None &&
+                (L == R || (is_numeric(L) && is_numeric(R))))
+    return scalar<K, L, R>;
+  else
+    return object<K>;
+}
+
+template <size_t... I>
+static constexpr auto make_compare_table(
+    std::index_sequence<I...>)
+{
+  constexpr auto N = NUM_TYPES;
+
+  return std::array<CompareKernel, sizeof...(I)>{
+      select_compare<(AST::CmpKind)(I / (N * N)),
+                     (TypeKind)(I / N % N),
+                     (TypeKind)(I % N)>()...};
+}
+
+static constexpr auto compare_table = make_compare_table(
+    std::make_index_sequence<NUM_CMP_KINDS * NUM_TYPES *
+                             NUM_TYPES>());
+
+CompareKernel get_compare_kernel(AST::CmpKind kind, TypeKind lhs,
+                                 TypeKind rhs)
+{
+  if (lhs >= NUM_TYPES || rhs >= NUM_TYPES)
+    lhs = rhs = TYPE_None;
+
+  return compare_table[(kind * NUM_TYPES + lhs) * NUM_TYPES +
+                       rhs];
+}
+
+}  // namespace Operators
@@ -0,0 +1,777 @@
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "Arith.h"
+#include "AST.h"
+#include "BuiltinFunc.h"
+#include "Evaluator.h"
+#include "Operators.h"
+#include "Sema.h"
+#include "Optimizer/Folder.h"
+#include "Optimizer/Tree.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+namespace Optimizer {
+
+static size_t fold_counts[Folder::FOLD_Max];
+
+static char const* fold_names[] = {
+    "Expr",
+    "Variable",
+    "Branch",
+};
+
+TypeKind Folder::kind_of(AST::Base* ast)
+{
+  auto it = Sema::value_type_cache.find(ast);
+
+  if (it == Sema::value_type_cache.end())
+    return TYPE_None;
+
+  return it->second.kind;
+}
+
+std::optional<Value> Folder::literal_value(AST::Base* ast)
+{
+  switch (ast->kind) {
+    case AST_True:
+      return Value::from_bool(true);
+
+    case AST_False:
+      return Value::from_bool(false);
+
+    case AST_Value:
+      break;
+
+    default:
+      return std::nullopt;
+  }
+
+  auto str = std::string(ast->token.str);
+
+  try {
+    switch (kind_of(ast)) {
+      case TYPE_Int:
+        return Value::from_int(std::stoll(str));
+
+      case TYPE_USize:
+        return Value::from_usize(std::stoull(str));
+
+      case TYPE_Float:
+        return Value::from_float(std::stof(str));
+    }
+  }
+  catch (std::exception const&) {
+  }
+
+  return std::nullopt;
+}
+
+bool Folder::is_string(AST::Base* ast)
+{
+  return ast->kind == AST_Value &&
+         kind_of(ast) == TYPE_String;
+}
+
+//
+// 文字列リテラルの中身 (引用符を除く)
+static std::string_view string_of(AST::Base* ast)
+{
+  auto str = ast->token.str;
+
+  return str.substr(1, str.length() - 2);
+}
+
+static bool is_zero(Value const& v)
+{
+  switch (v.kind) {
+    case TYPE_Int:
+      return v.v_int == 0;
+
+    case TYPE_USize:
+      return v.v_usize == 0;
+
+    case TYPE_Float:
+      return v.v_float == 0;
+  }
+
+  return false;
+}
+
+//
+// リテラルにできる値か
+static bool is_representable(Value const& v)
+{
+  switch (v.kind) {
+    case TYPE_Bool:
+    case TYPE_Int:
+    case TYPE_USize:
+      return true;
+
+    case TYPE_Float:
+      return std::isfinite(v.v_float);
+  }
+
+  return false;
+}
+
+//
+// 消すと困る定義を含んでいるか
+static bool has_definition(AST::Base* ast)
+{
+  bool found = false;
+
+  AST::walk(ast, [&found](AST::Base* x) {
+    switch (x->kind) {
+      case AST_Function:
+      case AST_Struct:
+      case AST_Impl:
+        found = true;
+    }
+  });
+
+  return found;
+}
+
+//
+// ARG_Ref の組み込み関数の最初の引数 (左辺値)
+static bool is_ref_arg(AST::CallFunc* call, size_t index)
+{
+  return index == 0 && call->is_builtin &&
+         call->builtin_func->arg_passing ==
+             BuiltinFunc::ARG_Ref;
+}
+
+Folder::Folder(std::list<Token>& tokens,
+               std::list<std::string>& texts)
+    : tokens(tokens),
+      texts(texts)
+{
+}
+
+Folder::~Folder()
+{
+}
+
+void Folder::fold(AST::Scope* root)
+{
+  this->resolve(root);
+
+  // 関数の中から書き換えられるかもしれない
+  for (auto&& decl : this->lets) {
+    if (this->written_outer.contains(decl->name))
+      this->mutated.emplace(decl);
+  }
+
+  AST::Base* ast = root;
+
+  this->fold(ast);
+}
+
+void Folder::print_statistics(std::ostream& os)
+{
+  size_t total = 0;
+
+  for (auto count : fold_counts)
+    total += count;
+
+  os << "fold: " << total << " nodes folded\n";
+
+  for (size_t i = 0; i < FOLD_Max; i++) {
+    if (fold_counts[i] == 0)
+      continue;
+
+    os << "  " << fold_names[i] << ": " << fold_counts[i]
+       << "\n";
+  }
+}
+
+// --------------------------------------------------------
+//  変数の参照先
+// --------------------------------------------------------
+
+void Folder::resolve(AST::Base* _ast)
+{
+  if (!_ast)
+    return;
+
+  switch (_ast->kind) {
+    case AST_Variable: {
+      astdef(Variable);
+
+      if (auto b = this->find(ast->name); b && b->decl)
+        this->defs[ast] = b->decl;
+
+      break;
+    }
+
+    case AST_Let: {
+      astdef(VariableDeclaration);
+
+      // 初期化式からは新しい変数は見えない
+      this->resolve(ast->init);
+
+      this->lets.emplace_back(ast);
+      this->scopes.back().names.push_back({ast->name, ast});
+
+      break;
+    }
+
+    case AST_Assign:
+      this->resolve_left(((AST::Assign*)_ast)->dest);
+      this->resolve(((AST::Assign*)_ast)->expr);
+      break;
+
+    case AST_CallFunc: {
+      astdef(CallFunc);
+
+      for (size_t i = 0; i < ast->args.size(); i++) {
+        if (is_ref_arg(ast, i))
+          this->resolve_left(ast->args[i]);
+        else
+          this->resolve(ast->args[i]);
+      }
+
+      break;
+    }
+
+    case AST_Scope:
+      this->scopes.push_back({{}, false});
+      AST::children(
+          _ast, [this](auto& x) { this->resolve(x); });
+      this->scopes.pop_back();
+      break;
+
+    case AST_Function: {
+      astdef(Function);
+
+      auto& scope = this->scopes.emplace_back();
+
+      scope.is_function = true;
+
+      for (auto&& arg : ast->args)
+        scope.names.push_back({arg->name, nullptr});
+
+      this->resolve(ast->code);
+      this->scopes.pop_back();
+
+      break;
+    }
+
+    case AST_For: {
+      astdef(For);
+
+      this->scopes.push_back({{}, false});
+      this->resolve(ast->iterable);
+
+      if (ast->iter->kind == AST_Variable)
+        this->scopes.back().names.push_back(
+            {((AST::Variable*)ast->iter)->name, nullptr});
+      else
+        this->resolve_left(ast->iter);
+
+      this->resolve(ast->code);
+      this->scopes.pop_back();
+
+      break;
+    }
+
+    default:
+      AST::children(
+          _ast, [this](auto& x) { this->resolve(x); });
+  }
+}
+
+//
+// 書き換えられる変数に印をつける
+void Folder::resolve_left(AST::Base* _ast)
+{
+  switch (_ast->kind) {
+    case AST_Variable: {
+      auto name = ((AST::Variable*)_ast)->name;
+
+      if (auto b = this->find(name); !b)
+        this->written_outer.emplace(name);
+      else if (b->decl)
+        this->mutated.emplace(b->decl);
+
+      break;
+    }
+
+    case AST_IndexRef: {
+      astdef(IndexRef);
+
+      this->resolve_left(ast->expr);
+
+      for (auto&& x : ast->indexes)
+        this->resolve(x);
+
+      break;
+    }
+
+    case AST_MemberAccess:
+      this->resolve_left(((AST::IndexRef*)_ast)->expr);
+      break;
+
+    default:
+      this->resolve(_ast);
+  }
+}
+
+//
+// 後から定義されたものを優先する (シャドウイング)
+//  関数の外までは探さない
+Folder::Binding const* Folder::find(std::string_view name)
+{
+  for (auto it = this->scopes.rbegin();
+       it != this->scopes.rend(); it++) {
+    for (auto b = it->names.rbegin(); b != it->names.rend();
+         b++) {
+      if (b->name == name)
+        return &*b;
+    }
+
+    if (it->is_function)
+      break;
+  }
+
+  return nullptr;
+}
+
+// --------------------------------------------------------
+//  畳み込み
+// --------------------------------------------------------
+
+void Folder::fold(AST::Base*& _ast)
+{
+  if (!_ast)
+    return;
+
+  switch (_ast->kind) {
+    case AST_Variable: {
+      auto it = this->defs.find((AST::Variable*)_ast);
+
+      if (it == this->defs.end())
+        break;
+
+      auto c = this->constants.find(it->second);
+
+      if (c == this->constants.end())
+        break;
+
+      if (auto x = this->make_literal(
+              *literal_value(c->second), _ast))
+        this->replace(_ast, x, FOLD_Variable);
+
+      break;
+    }
+
+    case AST_Let: {
+      astdef(VariableDeclaration);
+
+      this->fold(ast->init);
+
+      // 変更されないスカラーの変数
+      if (ast->init && !this->mutated.contains(ast) &&
+          literal_value(ast->init))
+        this->constants[ast] = ast->init;
+
+      break;
+    }
+
+    case AST_Assign:
+      this->fold_left(((AST::Assign*)_ast)->dest);
+      this->fold(((AST::Assign*)_ast)->expr);
+      break;
+
+    case AST_CallFunc: {
+      astdef(CallFunc);
+
+      for (size_t i = 0; i < ast->args.size(); i++) {
+        if (is_ref_arg(ast, i))
+          this->fold_left(ast->args[i]);
+        else
+          this->fold(ast->args[i]);
+      }
+
+      break;
+    }
+
+    case AST_UnaryMinus: {
+      astdef(UnaryOp);
+
+      this->fold(ast->expr);
+
+      auto v = literal_value(ast->expr);
+
+      if (!v || v->kind == TYPE_Bool ||
+          v->kind == TYPE_USize)
+        break;
+
+      if (v->kind == TYPE_Int)
+        v->v_int = Arith::neg(v->v_int);
+      else
+        v->v_float = -v->v_float;
+
+      if (auto x = this->make_literal(*v, _ast))
+        this->replace(_ast, x, FOLD_Expr);
+
+      break;
+    }
+
+    case AST_UnaryPlus: {
+      astdef(UnaryOp);
+
+      this->fold(ast->expr);
+
+      if (!literal_value(ast->expr))
+        break;
+
+      auto x = ast->expr;
+
+      ast->expr = nullptr;
+      this->replace(_ast, x, FOLD_Expr);
+
+      break;
+    }
+
+    case AST_Cast: {
+      astdef(Cast);
+
+      this->fold(ast->expr);
+
+      auto v = literal_value(ast->expr);
+
+      if (!v)
+        break;
+
+      auto kind = Sema::value_type_cache[ast->cast_to].kind;
+
+      if (auto x = this->make_literal(
+              Evaluator::cast_value(*v, kind), _ast))
+        this->replace(_ast, x, FOLD_Expr);
+
+      break;
+    }
+
+    case AST_Expr:
+      AST::children(
+          _ast, [this](auto& x) { this->fold(x); });
+      this->fold_expr(_ast);
+      break;
+
+    case AST_Compare:
+      AST::children(
+          _ast, [this](auto& x) { this->fold(x); });
+      this->fold_compare(_ast);
+      break;
+
+    case AST_If:
+      this->fold_if(_ast);
+      break;
+
+    default:
+      AST::children(
+          _ast, [this](auto& x) { this->fold(x); });
+  }
+}
+
+//
+// 左辺値の変数はそのまま残す
+void Folder::fold_left(AST::Base*& _ast)
+{
+  switch (_ast->kind) {
+    case AST_Variable:
+      break;
+
+    case AST_IndexRef: {
+      astdef(IndexRef);
+
+      this->fold_left(ast->expr);
+
+      for (auto&& x : ast->indexes)
+        this->fold(x);
+
+      break;
+    }
+
+    case AST_MemberAccess:
+      this->fold_left(((AST::IndexRef*)_ast)->expr);
+      break;
+
+    default:
+      this->fold(_ast);
+  }
+}
+
+//
+// 先頭から続くリテラルの部分を一つにする
+//  a + b + x => (a + b) + x
+//
+// && と || は左辺で決まれば右辺を消し、
+// 決まらなければ右辺だけにする
+void Folder::fold_expr(AST::Base*& _ast)
+{
+  astdef(Expr);
+
+  auto& elems = ast->elements;
+
+  AST::Base* first = nullptr;
+  size_t n = 0;
+
+  if (is_string(ast->first)) {
+    std::string str{string_of(ast->first)};
+
+    for (; n < elems.size() &&
+           elems[n].kind == AST::EX_Add &&
+           is_string(elems[n].ast);
+         n++)
+      str += string_of(elems[n].ast);
+
+    if (n != 0)
+      first = this->make_string(str, _ast);
+  }
+  else if (auto acc = literal_value(ast->first); acc) {
+    AST::Base* rest = nullptr;
+
+    for (; n < elems.size() && !rest; n++) {
+      auto& elem = elems[n];
+
+      if (elem.kind == AST::EX_And ||
+          elem.kind == AST::EX_Or) {
+        if (Operators::is_short_circuit(elem.kind, *acc))
+          continue;
+
+        if (auto v = literal_value(elem.ast); v)
+          acc = v;
+        else
+          std::swap(rest, elem.ast);
+
+        continue;
+      }
+
+      auto right = literal_value(elem.ast);
+
+      // 0 での割り算は実行時のエラーにする
+      if (!right || ((elem.kind == AST::EX_Div ||
+                      elem.kind == AST::EX_Mod) &&
+                     is_zero(*right)))
+        break;
+
+      auto x = *acc;
+
+      elem.kernel(x, *right, elem.op);
+
+      // リテラルで書けない値になった
+      if (!is_representable(x))
+        break;
+
+      acc = x;
+    }
+
+    if (n != 0)
+      first = rest ? rest : this->make_literal(*acc, _ast);
+  }
+
+  if (n == 0)
+    return;
+
+  //
+  // 全部畳み込めた
+  if (n == elems.size()) {
+    this->replace(_ast, first, FOLD_Expr);
+    return;
+  }
+
+  Tree::erase(ast->first);
+
+  for (size_t i = 0; i < n; i++)
+    Tree::erase(elems[i].ast);
+
+  // Element は代入できないので作り直す
+  std::remove_reference_t<decltype(elems)> tail;
+
+  for (size_t i = n; i < elems.size(); i++) {
+    auto const& e = elems[i];
+
+    tail.emplace_back(e.kind, e.op, e.ast).kernel =
+        e.kernel;
+  }
+
+  ast->first = first;
+  elems.swap(tail);
+
+  fold_counts[FOLD_Expr]++;
+}
+
+//
+// a < b < c は途中で偽になれば、残りは評価されない
+void Folder::fold_compare(AST::Base*& _ast)
+{
+  astdef(Compare);
+
+  auto left = ast->first;
+  bool value = true;
+
+  for (auto&& elem : ast->elements) {
+    auto right = elem.ast;
+    bool result;
+
+    if (is_string(left) && is_string(right)) {
+      if (elem.kind == AST::CMP_Equal)
+        result = string_of(left) == string_of(right);
+      else if (elem.kind == AST::CMP_NotEqual)
+        result = string_of(left) != string_of(right);
+      else
+        return;
+    }
+    else {
+      auto a = literal_value(left);
+      auto b = literal_value(right);
+
+      if (!a || !b)
+        return;
+
+      result = elem.kernel(*a, *b);
+    }
+
+    if (!result) {
+      value = false;
+      break;
+    }
+
+    left = right;
+  }
+
+  auto x =
+      this->make_literal(Value::from_bool(value), _ast);
+
+  this->replace(_ast, x, FOLD_Expr);
+}
+
+//
+// 条件が定数なら、選ばれるほうのスコープだけにする
+void Folder::fold_if(AST::Base*& _ast)
+{
+  astdef(If);
+
+  this->fold(ast->condition);
+
+  auto cond = literal_value(ast->condition);
+  auto dead = cond && cond->v_bool ? ast->if_false
+                                   : ast->if_true;
+
+  if (!cond || (dead && has_definition(dead))) {
+    this->fold(ast->if_true);
+    this->fold(ast->if_false);
+
+    return;
+  }
+
+  AST::Base* live;
+
+  if (cond->v_bool) {
+    live = ast->if_true;
+    ast->if_true = nullptr;
+  }
+  else if (ast->if_false) {
+    live = ast->if_false;
+    ast->if_false = nullptr;
+  }
+  else {
+    // else がなければ何もしない
+    live = new AST::Scope(ast->token);
+    live->end_token = ast->end_token;
+
+    Sema::value_type_cache[live] = TYPE_None;
+  }
+
+  this->replace(_ast, live, FOLD_Branch);
+  this->fold(_ast);
+}
+
+void Folder::replace(AST::Base*& ast, AST::Base* to,
+                     FoldKind kind)
+{
+  Tree::erase(ast);
+
+  ast = to;
+  fold_counts[kind]++;
+}
+
+//
+// 書ける範囲外なら nullptr
+AST::Base* Folder::make_literal(Value const& value,
+                                AST::Base* from)
+{
+  if (!is_representable(value))
+    return nullptr;
+
+  AST::Base* ast;
+
+  switch (value.kind) {
+    case TYPE_Bool:
+      ast = new AST::ConstKeyword(
+          value.v_bool ? AST_True : AST_False,
+          this->make_token(TOK_Ident,
+                           value.v_bool ? "true" : "false",
+                           from));
+      break;
+
+    case TYPE_Int:
+      ast = new AST::Value(this->make_token(
+          TOK_Int, std::to_string(value.v_int), from));
+      break;
+
+    case TYPE_USize:
+      ast = new AST::Value(this->make_token(
+          TOK_USize, std::to_string(value.v_usize), from));
+      break;
+
+    // float に戻したときに同じ値になる桁数
+    default:
+      ast = new AST::Value(this->make_token(
+          TOK_Float,
+          Utils::format("%.9g", (double)value.v_float),
+          from));
+  }
+
+  ast->end_token = from->end_token;
+  Sema::value_type_cache[ast] = value.kind;
+
+  return ast;
+}
+
+AST::Base* Folder::make_string(std::string_view str,
+                               AST::Base* from)
+{
+  auto ast = new AST::Value(this->make_token(
+      TOK_String, '"' + std::string(str) + '"', from));
+
+  ast->end_token = from->end_token;
+  Sema::value_type_cache[ast] = TYPE_String;
+
+  return ast;
+}
+
+//
+// エラーの表示には from の位置を使う
+Token const& Folder::make_token(TokenKind kind,
+                                std::string text,
+                                AST::Base* from)
+{
+  auto& tok = this->tokens.emplace_back(kind);
+
+  tok.str = this->texts.emplace_back(std::move(text));
+  tok.src_loc = from->token.src_loc;
+
+  return tok;
+}
+
+}  // namespace Optimizer
@@ -0,0 +1,473 @@
+#include <functional>
+#include <iostream>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "BuiltinFunc.h"
+#include "Optimizer/Hoister.h"
+#include "Optimizer/Tree.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+namespace Optimizer {
+
+static size_t hoist_count;
+
+static bool is_scalar(TypeKind kind)
+{
+  switch (kind) {
+    case TYPE_Int:
+    case TYPE_USize:
+    case TYPE_Float:
+    case TYPE_Bool:
+    case TYPE_Char:
+      return true;
+  }
+
+  return false;
+}
+
+//
+// 0 ではない数値のリテラル (割る数)
+static bool is_nonzero_literal(AST::Base* ast)
+{
+  if (ast->kind != AST_Value)
+    return false;
+
+  auto str = std::string(ast->token.str);
+
+  switch (Tree::type_of(ast).kind) {
+    case TYPE_Int:
+      return std::stoll(str) != 0;
+
+    case TYPE_USize:
+      return std::stoull(str) != 0;
+
+    case TYPE_Float:
+      return std::stof(str) != 0;
+  }
+
+  return false;
+}
+
+//
+// 書き換える変数
+//  v[i] = x, p.x = y なら v, p
+static AST::Variable* root_variable(AST::Base* ast)
+{
+  while (ast->kind == AST_IndexRef ||
+         ast->kind == AST_MemberAccess)
+    ast = ((AST::IndexRef*)ast)->expr;
+
+  if (ast->kind != AST_Variable)
+    return nullptr;
+
+  return (AST::Variable*)ast;
+}
+
+//
+// ループの中で毎回実行される部分をたどる
+//  (for の反復するものは最初に一度だけ評価される)
+static void each_part(
+    AST::Base* _ast,
+    std::function<void(AST::Base*&)> const& fn)
+{
+  // スコープは置き換えられない
+  auto code = [&fn](AST::Base* x) { fn(x); };
+
+  switch (_ast->kind) {
+    case AST_While:
+      fn(((AST::While*)_ast)->cond);
+      code(((AST::While*)_ast)->code);
+      break;
+
+    case AST_DoWhile:
+      code(((AST::DoWhile*)_ast)->code);
+      fn(((AST::DoWhile*)_ast)->cond);
+      break;
+
+    case AST_Loop:
+      code(((AST::Loop*)_ast)->code);
+      break;
+
+    case AST_For:
+      fn(((AST::For*)_ast)->iter);
+      code(((AST::For*)_ast)->code);
+      break;
+  }
+}
+
+Hoister::Hoister(std::list<Token>& tokens,
+                 std::list<std::string>& texts)
+    : tokens(tokens),
+      texts(texts),
+      frame(nullptr),
+      in_function(false)
+{
+}
+
+Hoister::~Hoister()
+{
+}
+
+void Hoister::hoist(AST::Scope* root)
+{
+  //
+  // 関数から書き換えられるグローバル変数
+  this->in_function = true;
+
+  AST::walk(root, [this](AST::Base* x) {
+    if (x->kind != AST_Function)
+      return;
+
+    LoopInfo info;
+
+    this->scan(((AST::Function*)x)->code, info);
+
+    for (auto&& [is_global, slot] : info.variant) {
+      if (is_global)
+        this->written_globals.emplace(slot);
+    }
+  });
+
+  this->frame = root;
+  this->in_function = false;
+
+  AST::Base* ast = root;
+
+  this->visit(ast);
+}
+
+void Hoister::print_statistics(std::ostream& os)
+{
+  os << "hoist: " << hoist_count
+     << " loop-invariant expressions hoisted\n";
+}
+
+void Hoister::visit(AST::Base*& _ast)
+{
+  if (!_ast)
+    return;
+
+  auto each = [this](AST::Base*& x) { this->visit(x); };
+
+  switch (_ast->kind) {
+    case AST_Function: {
+      auto saved_frame = this->frame;
+      auto saved_in_function = this->in_function;
+
+      this->frame = ((AST::Function*)_ast)->code;
+      this->in_function = true;
+
+      AST::children(_ast, each);
+
+      this->frame = saved_frame;
+      this->in_function = saved_in_function;
+
+      return;
+    }
+
+    case AST_Struct:
+    case AST_Impl:
+      return;
+
+    case AST_While:
+    case AST_DoWhile:
+    case AST_Loop:
+    case AST_For: {
+      auto scope = this->hoist_loop(_ast);
+
+      // 外のループで出せなかったものを、中のループで出す
+      AST::children(_ast, each);
+
+      if (scope)
+        _ast = scope;
+
+      return;
+    }
+  }
+
+  AST::children(_ast, each);
+}
+
+AST::Scope* Hoister::hoist_loop(AST::Base* loop)
+{
+  LoopInfo info;
+  bool has_definition = false;
+
+  if (loop->kind == AST_For)
+    this->scan_write(((AST::For*)loop)->iter, info);
+
+  each_part(loop, [&](AST::Base*& part) {
+    this->scan(part, info);
+
+    AST::walk(part, [&](AST::Base* x) {
+      switch (x->kind) {
+        case AST_Function:
+        case AST_Struct:
+        case AST_Impl:
+          has_definition = true;
+      }
+    });
+  });
+
+  if (has_definition)
+    return nullptr;
+
+  std::vector<AST::Base*> lets;
+
+  each_part(loop, [&](AST::Base*& part) {
+    this->replace(part, info, lets);
+  });
+
+  if (lets.empty())
+    return nullptr;
+
+  //
+  // { let <一時変数> = <式>; ...; <ループ> }
+  auto base = this->frame->frame_size - lets.size();
+  auto scope = new AST::Scope(loop->token);
+
+  scope->end_token = loop->end_token;
+
+  for (auto&& let : lets)
+    scope->append(let);
+
+  scope->append(loop);
+
+  scope->slot_begin = base;
+  scope->slot_end = base + lets.size();
+
+  Tree::copy_type(loop, scope);
+
+  return scope;
+}
+
+//
+// ループの中で値が変わる変数を集める
+//  (ループの中で定義される変数と、書き換えられる変数)
+void Hoister::scan(AST::Base* ast, LoopInfo& info)
+{
+  AST::walk(ast, [&](AST::Base* x) {
+    switch (x->kind) {
+      case AST_Let: {
+        auto let = (AST::VariableDeclaration*)x;
+
+        info.variant.emplace(!this->in_function, let->slot);
+        break;
+      }
+
+      case AST_For: {
+        auto iter = ((AST::For*)x)->iter;
+
+        if (iter->kind == AST_Variable)
+          info.variant.emplace(
+              ((AST::Variable*)iter)->is_global,
+              ((AST::Variable*)iter)->slot);
+        else
+          this->scan_write(iter, info);
+
+        break;
+      }
+
+      case AST_Assign:
+        this->scan_write(((AST::Assign*)x)->dest, info);
+        break;
+
+      case AST_CallFunc: {
+        auto call = (AST::CallFunc*)x;
+
+        if (call->is_builtin) {
+          if (!call->args.empty() &&
+              call->builtin_func->arg_passing ==
+                  BuiltinFunc::ARG_Ref)
+            this->scan_write(call->args[0], info);
+
+          break;
+        }
+
+        info.has_call = true;
+
+        // 渡したものは書き換えられるかもしれない
+        for (auto&& arg : call->args)
+          this->scan_write(arg, info);
+
+        break;
+      }
+    }
+  });
+}
+
+void Hoister::scan_write(AST::Base* dest, LoopInfo& info)
+{
+  if (auto var = root_variable(dest); var)
+    info.variant.emplace(var->is_global, var->slot);
+}
+
+//
+// 副作用もエラーもなく、ループの中で値が変わらないか
+bool Hoister::is_invariant(AST::Base* _ast,
+                           LoopInfo const& info) const
+{
+  auto all = [&](auto* ast) {
+    if (!this->is_invariant(ast->first, info))
+      return false;
+
+    for (auto&& elem : ast->elements) {
+      if (!this->is_invariant(elem.ast, info))
+        return false;
+    }
+
+    return true;
+  };
+
+  switch (_ast->kind) {
+    case AST_Value:
+    case AST_True:
+    case AST_False:
+      return true;
+
+    case AST_Variable: {
+      astdef(Variable);
+
+      VarKey key{ast->is_global, ast->slot};
+
+      if (info.variant.contains(key))
+        return false;
+
+      return !ast->is_global || !info.has_call ||
+             !this->written_globals.contains(ast->slot);
+    }
+
+    case AST_UnaryPlus:
+    case AST_UnaryMinus:
+      return this->is_invariant(((AST::UnaryOp*)_ast)->expr,
+                                info);
+
+    // メンバの名前はたどらない
+    case AST_MemberAccess: {
+      auto expr = ((AST::IndexRef*)_ast)->expr;
+
+      return this->is_invariant(expr, info);
+    }
+
+    case AST_Cast: {
+      astdef(Cast);
+
+      return is_scalar(Tree::type_of(ast->expr).kind) &&
+             is_scalar(Tree::type_of(ast->cast_to).kind) &&
+             this->is_invariant(ast->expr, info);
+    }
+
+    case AST_Expr: {
+      astdef(Expr);
+
+      // 0 で割るとエラーになる
+      for (auto&& elem : ast->elements) {
+        if ((elem.kind == AST::EX_Div ||
+             elem.kind == AST::EX_Mod) &&
+            !is_nonzero_literal(elem.ast))
+          return false;
+      }
+
+      return all(ast);
+    }
+
+    case AST_Compare:
+      return all((AST::Compare*)_ast);
+
+    case AST_CallFunc: {
+      astdef(CallFunc);
+
+      if (!ast->is_builtin || !ast->builtin_func->is_pure)
+        return false;
+
+      for (auto&& arg : ast->args) {
+        if (!this->is_invariant(arg, info))
+          return false;
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//
+// ループの外に出せる一番大きい式を一時変数に置き換える
+void Hoister::replace(AST::Base*& ast, LoopInfo const& info,
+                      std::vector<AST::Base*>& lets)
+{
+  if (!ast)
+    return;
+
+  switch (ast->kind) {
+    // 一時変数にしても速くならない
+    case AST_Value:
+    case AST_True:
+    case AST_False:
+    case AST_None:
+    case AST_Variable:
+      return;
+
+    // ループの前に置く let の名前が見えなくなる
+    case AST_Function:
+    case AST_Struct:
+    case AST_Impl:
+      return;
+  }
+
+  auto type = Tree::type_of(ast);
+
+  if ((is_scalar(type.kind) || type.kind == TYPE_String) &&
+      this->is_invariant(ast, info)) {
+    auto& tok = this->make_token(ast);
+    auto slot = this->frame->frame_size++;
+
+    auto let = new AST::VariableDeclaration(tok);
+
+    let->name = tok.str;
+    let->init = ast;
+    let->slot = slot;
+    let->end_token = ast->end_token;
+
+    Tree::set_type(let, TYPE_None);
+
+    auto var = new AST::Variable(tok);
+
+    var->slot = slot;
+    var->is_global = !this->in_function;
+    var->end_token = ast->end_token;
+
+    Tree::set_type(var, type);
+
+    lets.emplace_back(let);
+    ast = var;
+
+    hoist_count++;
+    return;
+  }
+
+  AST::children(ast, [&](AST::Base*& x) {
+    this->replace(x, info, lets);
+  });
+}
+
+//
+// 一時変数の名前
+//  数字で始まるので、スクリプトの変数とは重ならない
+Token const& Hoister::make_token(AST::Base* from)
+{
+  auto& tok = this->tokens.emplace_back(TOK_Ident);
+
+  tok.str = this->texts.emplace_back(
+      std::to_string(hoist_count) + "_hoisted");
+  tok.src_loc = from->token.src_loc;
+
+  return tok;
+}
+
+}  // namespace Optimizer
@@ -0,0 +1,610 @@
+#include <algorithm>
+#include <iostream>
+#include <set>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "BuiltinFunc.h"
+#include "Optimizer/Inliner.h"
+#include "Optimizer/Tree.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+namespace Optimizer {
+
+static size_t inline_count;
+
+static bool has_return(AST::Base* ast)
+{
+  bool found = false;
+
+  AST::walk(ast, [&found](AST::Base* x) {
+    if (x->kind == AST_Return)
+      found = true;
+  });
+
+  return found;
+}
+
+//
+// どの経路でも return で終わるか
+static bool always_returns(AST::Base* _ast)
+{
+  if (!_ast)
+    return false;
+
+  switch (_ast->kind) {
+    case AST_Return:
+      return true;
+
+    case AST_Scope: {
+      auto& list = ((AST::Scope*)_ast)->list;
+
+      return std::any_of(list.begin(), list.end(),
+                         always_returns);
+    }
+
+    case AST_If: {
+      astdef(If);
+
+      return always_returns(ast->if_true) &&
+             always_returns(ast->if_false);
+    }
+  }
+
+  return false;
+}
+
+// --------------------------------------------------------
+//  return を最後の式にする
+//
+//   return x;  ... (後ろは実行されない)   => x
+//   if c { A; return x; } B             => if c { A; x }
+//                                          else { B }
+//
+//   ループや switch の中の return はそのままにできない
+// --------------------------------------------------------
+
+static bool can_lower(AST::Scope::ASTVector const& list,
+                      size_t begin);
+
+static bool can_lower_branch(AST::Base* _ast)
+{
+  if (!_ast)
+    return true;
+
+  if (_ast->kind == AST_If) {
+    astdef(If);
+
+    return can_lower_branch(ast->if_true) &&
+           can_lower_branch(ast->if_false);
+  }
+
+  return can_lower(((AST::Scope*)_ast)->list, 0);
+}
+
+static bool can_lower(AST::Scope::ASTVector const& list,
+                      size_t begin)
+{
+  for (size_t i = begin; i < list.size(); i++) {
+    auto item = list[i];
+
+    if (!has_return(item))
+      continue;
+
+    if (item->kind == AST_Return)
+      return true;
+
+    if (item->kind != AST_If)
+      return false;
+
+    auto x = (AST::If*)item;
+
+    if (!can_lower_branch(x->if_true) ||
+        !can_lower_branch(x->if_false))
+      return false;
+
+    if (i + 1 == list.size() || always_returns(x))
+      return true;
+
+    // 残りを else に移す
+    return !x->if_false && always_returns(x->if_true) &&
+           can_lower(list, i + 1);
+  }
+
+  return true;
+}
+
+static void lower(AST::Scope* scope, TypeInfo const& type,
+                  bool value);
+
+static void lower_branch(AST::Base* _ast,
+                         TypeInfo const& type, bool value)
+{
+  if (!_ast)
+    return;
+
+  if (_ast->kind == AST_If) {
+    astdef(If);
+
+    lower_branch(ast->if_true, type, value);
+    lower_branch(ast->if_false, type, value);
+
+    if (value)
+      Tree::set_type(ast, type);
+
+    return;
+  }
+
+  lower((AST::Scope*)_ast, type, value);
+}
+
+static void lower(AST::Scope* scope, TypeInfo const& type,
+                  bool value)
+{
+  auto& list = scope->list;
+
+  for (size_t i = 0; i < list.size(); i++) {
+    auto item = list[i];
+
+    if (!has_return(item))
+      continue;
+
+    if (i + 1 < list.size()) {
+      if (always_returns(item)) {
+        for (size_t j = i + 1; j < list.size(); j++)
+          Tree::erase(list[j]);
+      }
+      else {
+        auto rest = new AST::Scope(list[i + 1]->token);
+
+        rest->list.assign(list.begin() + i + 1, list.end());
+
+        // 変数は外のスコープのスロットのまま
+        rest->slot_begin = rest->slot_end = scope->slot_end;
+
+        ((AST::If*)item)->if_false = rest;
+      }
+
+      list.resize(i + 1);
+    }
+
+    if (item->kind == AST_Return) {
+      auto ret = (AST::Return*)item;
+
+      if (ret->expr) {
+        list[i] = ret->expr;
+        ret->expr = nullptr;
+      }
+      else
+        list.pop_back();
+
+      Tree::erase(ret);
+    }
+    else {
+      lower_branch(item, type, value);
+    }
+
+    break;
+  }
+
+  if (value) {
+    scope->return_last_expr = true;
+    Tree::set_type(scope, type);
+  }
+}
+
+// --------------------------------------------------------
+//  Inliner
+// --------------------------------------------------------
+
+//
+// 書き換える変数
+//  v[i] = x, p.x = y なら v, p
+static AST::Variable* root_variable(AST::Base* ast)
+{
+  while (ast->kind == AST_IndexRef ||
+         ast->kind == AST_MemberAccess)
+    ast = ((AST::IndexRef*)ast)->expr;
+
+  if (ast->kind != AST_Variable)
+    return nullptr;
+
+  return (AST::Variable*)ast;
+}
+
+static bool is_scalar(TypeKind kind)
+{
+  switch (kind) {
+    case TYPE_Int:
+    case TYPE_USize:
+    case TYPE_Float:
+    case TYPE_Bool:
+    case TYPE_Char:
+      return true;
+  }
+
+  return false;
+}
+
+Inliner::Inliner()
+    : frame(nullptr),
+      in_function(false),
+      depth(0)
+{
+}
+
+Inliner::~Inliner()
+{
+}
+
+void Inliner::inline_calls(AST::Scope* root)
+{
+  this->frame = root;
+  this->global_names = AST::global_names(root);
+
+  //
+  // 呼び出し先を集める
+  AST::walk(root, [this](AST::Base* x) {
+    if (x->kind != AST_Function)
+      return;
+
+    auto func = (AST::Function*)x;
+    auto& list = this->callees[func];
+
+    AST::walk(func->code, [&list](AST::Base* y) {
+      if (y->kind != AST_CallFunc)
+        return;
+
+      auto call = (AST::CallFunc*)y;
+
+      if (!call->is_builtin && call->callee)
+        list.emplace_back(call->callee);
+    });
+  });
+
+  AST::Base* ast = root;
+
+  this->visit(ast);
+}
+
+void Inliner::print_statistics(std::ostream& os)
+{
+  os << "inline: " << inline_count
+     << " call sites inlined\n";
+}
+
+bool Inliner::is_inlinable(AST::Function* func)
+{
+  if (auto it = this->inlinable.find(func);
+      it != this->inlinable.end())
+    return it->second;
+
+  size_t size = 0;
+  bool ok = true;
+
+  // 引数は let に置き換えるので、
+  // 値渡しかどうかで変わるものは書き換えない
+  auto check_write = [&](AST::Base* dest) {
+    auto var = root_variable(dest);
+
+    if (var && !var->is_global &&
+        var->slot < func->args.size() &&
+        (var != dest ||
+         !is_scalar(Tree::type_of(var).kind)))
+      ok = false;
+  };
+
+  AST::walk(func->code, [&](AST::Base* x) {
+    size++;
+
+    switch (x->kind) {
+      case AST_Function:
+      case AST_Struct:
+      case AST_Impl:
+        ok = false;
+        break;
+
+      case AST_Assign:
+        check_write(((AST::Assign*)x)->dest);
+        break;
+
+      case AST_CallFunc: {
+        auto call = (AST::CallFunc*)x;
+
+        if (call->is_builtin && !call->args.empty() &&
+            call->builtin_func->arg_passing ==
+                BuiltinFunc::ARG_Ref)
+          check_write(call->args[0]);
+
+        break;
+      }
+    }
+  });
+
+  ok = ok && size <= max_size &&
+       can_lower(func->code->list, 0) &&
+       !this->is_recursive(func);
+
+  return this->inlinable[func] = ok;
+}
+
+//
+// 呼び出しをたどって自分に戻ってくるか
+bool Inliner::is_recursive(AST::Function* func)
+{
+  std::set<AST::Function*> visited;
+  std::vector<AST::Function*> work = {func};
+
+  while (!work.empty()) {
+    auto f = work.back();
+
+    work.pop_back();
+
+    for (auto&& callee : this->callees[f]) {
+      if (callee == func)
+        return true;
+
+      if (visited.emplace(callee).second)
+        work.emplace_back(callee);
+    }
+  }
+
+  return false;
+}
+
+void Inliner::visit(AST::Base*& _ast)
+{
+  if (!_ast)
+    return;
+
+  auto each = [this](AST::Base*& x) { this->visit(x); };
+
+  switch (_ast->kind) {
+    case AST_Function: {
+      astdef(Function);
+
+      auto saved_frame = this->frame;
+      auto saved_in_function = this->in_function;
+      auto saved_scopes = std::move(this->scopes);
+
+      this->frame = ast->code;
+      this->in_function = true;
+      this->scopes = {{}};
+
+      for (size_t i = 0; i < ast->args.size(); i++)
+        this->bind(ast->args[i]->name, i);
+
+      AST::children(_ast, each);
+
+      this->frame = saved_frame;
+      this->in_function = saved_in_function;
+      this->scopes = std::move(saved_scopes);
+
+      return;
+    }
+
+    case AST_Struct:
+    case AST_Impl:
+      return;
+
+    case AST_Scope:
+      this->scopes.emplace_back();
+      AST::children(_ast, each);
+      this->scopes.pop_back();
+      return;
+
+    case AST_Let: {
+      astdef(VariableDeclaration);
+
+      this->visit(ast->init);
+      this->bind(ast->name, ast->slot);
+
+      return;
+    }
+
+    case AST_For: {
+      astdef(For);
+
+      this->scopes.emplace_back();
+      this->visit(ast->iterable);
+
+      if (ast->iter->kind == AST_Variable)
+        this->bind(((AST::Variable*)ast->iter)->name,
+                   ((AST::Variable*)ast->iter)->slot);
+
+      this->visit(ast->code);
+      this->scopes.pop_back();
+
+      return;
+    }
+
+    case AST_CallFunc: {
+      astdef(CallFunc);
+
+      AST::children(_ast, each);
+
+      if (!this->can_expand(ast))
+        return;
+
+      auto nargs = ast->args.size();
+      auto scope = this->expand(ast);
+
+      _ast = scope;
+
+      //
+      // 展開した中の呼び出し
+      //  (引数はもうたどった)
+      this->depth++;
+      this->scopes.emplace_back();
+
+      for (size_t i = 0; auto&& item : scope->list) {
+        if (i++ < nargs) {
+          auto let = (AST::VariableDeclaration*)item;
+
+          this->bind(let->name, let->slot);
+        }
+        else {
+          this->visit(item);
+        }
+      }
+
+      this->scopes.pop_back();
+      this->depth--;
+
+      return;
+    }
+  }
+
+  AST::children(_ast, each);
+}
+
+bool Inliner::can_expand(AST::CallFunc* call)
+{
+  auto func = call->callee;
+
+  if (call->is_builtin || !func ||
+      this->depth >= max_depth ||
+      call->args.size() != func->args.size() ||
+      !this->is_inlinable(func))
+    return false;
+
+  bool ok = true;
+
+  for (size_t i = 0; i < call->args.size(); i++) {
+    auto type = Tree::type_of(func->args[i]->type);
+
+    if (!Tree::type_of(call->args[i]).equals(type))
+      return false;
+
+    // 先の引数の let で隠れる名前を使っていない
+    AST::walk(call->args[i], [&](AST::Base* x) {
+      if (x->kind != AST_Variable)
+        return;
+
+      auto name = ((AST::Variable*)x)->name;
+
+      for (size_t j = 0; j < i; j++) {
+        if (func->args[j]->name == name)
+          ok = false;
+      }
+    });
+  }
+
+  AST::walk(func->code, [&](AST::Base* x) {
+    if (x->kind != AST_Variable)
+      return;
+
+    auto var = (AST::Variable*)x;
+
+    //
+    // 関数から見えるトップレベルの変数が、
+    // 呼び出し元の変数で隠れていない
+    if (var->is_global) {
+      auto b = this->find(var->name);
+
+      if (this->in_function ? b != nullptr
+                            : !b || !b->is_global ||
+                                  b->slot != var->slot)
+        ok = false;
+    }
+  });
+
+  //
+  // トップレベルに置く let がグローバルの名前にならない
+  if (!this->in_function) {
+    for (auto&& arg : func->args) {
+      if (this->global_names.contains(arg->name))
+        ok = false;
+    }
+
+    AST::walk(func->code, [&](AST::Base* x) {
+      if (x->kind == AST_Let &&
+          this->global_names.contains(
+              ((AST::VariableDeclaration*)x)->name))
+        ok = false;
+    });
+  }
+
+  return ok;
+}
+
+AST::Scope* Inliner::expand(AST::CallFunc* call)
+{
+  auto func = call->callee;
+  auto type = Tree::type_of(call);
+  auto base = this->frame->frame_size;
+  auto nargs = func->args.size();
+
+  auto body = (AST::Scope*)Tree::clone(func->code, base,
+                                       !this->in_function);
+
+  lower(body, type, !type.equals(TYPE_None));
+
+  //
+  // { let <引数> = <値>; ...; <関数の中身> }
+  auto scope = new AST::Scope(call->token);
+
+  scope->end_token = call->end_token;
+
+  for (size_t i = 0; i < nargs; i++) {
+    auto let = new AST::VariableDeclaration(
+        func->args[i]->token);
+
+    let->name = func->args[i]->name;
+    let->init = call->args[i];
+    let->slot = base + i;
+
+    call->args[i] = nullptr;
+
+    Tree::set_type(let, TYPE_None);
+    scope->append(let);
+  }
+
+  for (auto&& item : body->list)
+    scope->append(item);
+
+  scope->return_last_expr = body->return_last_expr;
+  scope->slot_begin = base;
+  scope->slot_end =
+      base + std::max(nargs, func->code->slot_end);
+
+  body->list.clear();
+  Tree::erase(body);
+
+  Tree::set_type(scope, type);
+
+  // 呼び出し元のフレームに関数の変数の場所を足す
+  this->frame->frame_size = base + func->code->frame_size;
+
+  Tree::erase(call);
+  inline_count++;
+
+  return scope;
+}
+
+void Inliner::bind(std::string_view name, size_t slot)
+{
+  this->scopes.back().push_back(
+      {name, slot, !this->in_function});
+}
+
+//
+// 後から定義されたものを優先する (シャドウイング)
+Inliner::Binding const* Inliner::find(
+    std::string_view name) const
+{
+  for (auto s = this->scopes.rbegin();
+       s != this->scopes.rend(); s++) {
+    for (auto b = s->rbegin(); b != s->rend(); b++) {
+      if (b->name == name)
+        return &*b;
+    }
+  }
+
+  return nullptr;
+}
+
+}  // namespace Optimizer
@@ -0,0 +1,425 @@
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Sema.h"
+#include "Optimizer/Tree.h"
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+namespace Optimizer {
+
+void Tree::erase(AST::Base* ast)
+{
+  AST::walk(ast, [](AST::Base* x) {
+    Sema::value_type_cache.erase(x);
+  });
+
+  delete ast;
+}
+
+// --------------------------------------------------------
+//  複製
+// --------------------------------------------------------
+
+namespace {
+
+struct Cloner {
+  size_t slot_offset;
+  bool to_global;
+
+  // 複製できないものがあった
+  bool failed = false;
+
+  template <class T>
+  T* node(T* x, AST::Base* from)
+  {
+    x->end_token = from->end_token;
+    x->is_left = from->is_left;
+
+    Tree::copy_type(from, x);
+
+    return x;
+  }
+
+  AST::Type* type(AST::Type* from)
+  {
+    if (!from)
+      return nullptr;
+
+    auto x = node(new AST::Type(from->token), from);
+
+    x->name = from->name;
+    x->is_const = from->is_const;
+
+    for (auto&& p : from->parameters)
+      x->parameters.emplace_back(this->type(p));
+
+    return x;
+  }
+
+  //
+  // 関数の中の変数だけ動かす
+  size_t slot(size_t slot, bool is_global)
+  {
+    return is_global ? slot : slot + this->slot_offset;
+  }
+
+  template <class T>
+  void expr(T* x, T* from)
+  {
+    for (auto&& elem : from->elements) {
+      auto& y =
+          x->append(elem.kind, elem.op, (*this)(elem.ast));
+
+      y.kernel = elem.kernel;
+    }
+  }
+
+  AST::Scope* scope(AST::Scope* from)
+  {
+    auto x = node(new AST::Scope(from->token), from);
+
+    for (auto&& item : from->list)
+      x->append((*this)(item));
+
+    x->return_last_expr = from->return_last_expr;
+    x->slot_begin = from->slot_begin + this->slot_offset;
+    x->slot_end = from->slot_end + this->slot_offset;
+
+    // フレームの大きさは呼び出し元のものを使う
+    x->frame_size = 0;
+
+    return x;
+  }
+
+  AST::Base* operator()(AST::Base* _ast);
+};
+
+AST::Base* Cloner::operator()(AST::Base* _ast)
+{
+  if (!_ast)
+    return nullptr;
+
+  switch (_ast->kind) {
+    case AST_None:
+    case AST_True:
+    case AST_False:
+      return node(new AST::ConstKeyword(_ast->kind,
+                                        _ast->token),
+                  _ast);
+
+    case AST_Value:
+      return node(new AST::Value(_ast->token), _ast);
+
+    case AST_Variable:
+    case AST_MemberVariable: {
+      astdef(Variable);
+
+      auto x = node(new AST::Variable(ast->token), ast);
+
+      x->kind = ast->kind;
+      x->slot = this->slot(ast->slot, ast->is_global);
+      x->index = ast->index;
+      x->is_global = ast->is_global || this->to_global;
+      x->name = ast->name;
+
+      return x;
+    }
+
+    case AST_CallFunc: {
+      astdef(CallFunc);
+
+      auto x = node(new AST::CallFunc(ast->token), ast);
+
+      for (auto&& arg : ast->args)
+        x->append((*this)(arg));
+
+      x->name = ast->name;
+      x->is_builtin = ast->is_builtin;
+      x->builtin_func = ast->builtin_func;
+      x->callee = ast->callee;
+
+      return x;
+    }
+
+    case AST_Dict:
+    case AST_TypeConstructor: {
+      astdef(Dict);
+
+      AST::Dict* x;
+
+      if (ast->kind == AST_Dict) {
+        x = node(new AST::Dict(ast->token), ast);
+
+        x->key_type = this->type(ast->key_type);
+        x->value_type = this->type(ast->value_type);
+      }
+      else {
+        auto from = (AST::TypeConstructor*)ast;
+        auto type = this->type(from->type);
+        auto y = node(new AST::TypeConstructor(type), ast);
+
+        y->typeinfo = from->typeinfo;
+        x = y;
+      }
+
+      // 構造体のメンバの名前はそのまま写す
+      for (auto&& elem : ast->elements) {
+        auto key = elem.key->kind == AST_MemberVariable
+                       ? Cloner{0, false}(elem.key)
+                       : (*this)(elem.key);
+
+        x->append(key, elem.colon, (*this)(elem.value));
+      }
+
+      return x;
+    }
+
+    case AST_Cast: {
+      astdef(Cast);
+
+      auto x = node(new AST::Cast(ast->token), ast);
+
+      x->cast_to = this->type(ast->cast_to);
+      x->expr = (*this)(ast->expr);
+
+      return x;
+    }
+
+    case AST_UnaryPlus:
+    case AST_UnaryMinus: {
+      astdef(UnaryOp);
+
+      return node(new AST::UnaryOp(ast->kind, ast->token,
+                                   (*this)(ast->expr)),
+                  ast);
+    }
+
+    case AST_Vector: {
+      astdef(Vector);
+
+      auto x = node(new AST::Vector(ast->token), ast);
+
+      for (auto&& e : ast->elements)
+        x->append((*this)(e));
+
+      return x;
+    }
+
+    case AST_IndexRef:
+    case AST_MemberAccess: {
+      astdef(IndexRef);
+
+      auto x = node(new AST::IndexRef(ast->token), ast);
+
+      x->kind = ast->kind;
+      x->expr = (*this)(ast->expr);
+      x->is_in_bounds = ast->is_in_bounds;
+
+      // メンバの名前は変数ではない
+      Cloner names{0, false};
+
+      for (auto&& index : ast->indexes)
+        x->append(ast->kind == AST_MemberAccess
+                      ? names(index)
+                      : (*this)(index));
+
+      return x;
+    }
+
+    case AST_Range: {
+      astdef(Range);
+
+      auto x = node(new AST::Range(ast->token), ast);
+
+      x->begin = (*this)(ast->begin);
+      x->end = (*this)(ast->end);
+      x->step = (*this)(ast->step);
+
+      return x;
+    }
+
+    case AST_Assign: {
+      astdef(Assign);
+
+      auto x = node(new AST::Assign(ast->token), ast);
+
+      x->dest = (*this)(ast->dest);
+      x->expr = (*this)(ast->expr);
+
+      return x;
+    }
+
+    case AST_Expr: {
+      astdef(Expr);
+
+      auto x =
+          node(new AST::Expr((*this)(ast->first)), ast);
+
+      this->expr(x, ast);
+
+      return x;
+    }
+
+    case AST_Compare: {
+      astdef(Compare);
+
+      auto x =
+          node(new AST::Compare((*this)(ast->first)), ast);
+
+      this->expr(x, ast);
+
+      return x;
+    }
+
+    case AST_Let: {
+      astdef(VariableDeclaration);
+
+      auto x = node(
+          new AST::VariableDeclaration(ast->token), ast);
+
+      x->name = ast->name;
+      x->type = this->type(ast->type);
+      x->init = (*this)(ast->init);
+      x->slot = ast->slot + this->slot_offset;
+
+      return x;
+    }
+
+    case AST_Return: {
+      astdef(Return);
+
+      auto x = node(new AST::Return(ast->token), ast);
+
+      x->expr = (*this)(ast->expr);
+
+      return x;
+    }
+
+    case AST_Break:
+    case AST_Continue:
+      return node(
+          new AST::LoopController(_ast->token, _ast->kind),
+          _ast);
+
+    case AST_Scope:
+      return this->scope((AST::Scope*)_ast);
+
+    case AST_If: {
+      astdef(If);
+
+      auto x = node(new AST::If(ast->token), ast);
+
+      x->condition = (*this)(ast->condition);
+      x->if_true = (*this)(ast->if_true);
+      x->if_false = (*this)(ast->if_false);
+
+      return x;
+    }
+
+    case AST_Switch: {
+      astdef(Switch);
+
+      auto x = node(new AST::Switch(ast->token), ast);
+
+      x->expr = (*this)(ast->expr);
+
+      for (auto&& c : ast->cases) {
+        auto y = node(new AST::Case(c->token), c);
+
+        y->cond = (*this)(c->cond);
+        y->scope = this->scope(c->scope);
+
+        x->append(y);
+      }
+
+      return x;
+    }
+
+    case AST_For: {
+      astdef(For);
+
+      auto x = node(new AST::For(ast->token), ast);
+
+      x->iter = (*this)(ast->iter);
+      x->iterable = (*this)(ast->iterable);
+      x->code = (*this)(ast->code);
+
+      return x;
+    }
+
+    case AST_While: {
+      astdef(While);
+
+      auto x = node(new AST::While(ast->token), ast);
+
+      x->cond = (*this)(ast->cond);
+      x->code = this->scope(ast->code);
+
+      return x;
+    }
+
+    case AST_DoWhile: {
+      astdef(DoWhile);
+
+      auto x = node(new AST::DoWhile(ast->token), ast);
+
+      x->code = this->scope(ast->code);
+      x->cond = (*this)(ast->cond);
+
+      return x;
+    }
+
+    case AST_Loop:
+      return node(
+          new AST::Loop((*this)(((AST::Loop*)_ast)->code)),
+          _ast);
+  }
+
+  // 関数や構造体の定義
+  this->failed = true;
+
+  return nullptr;
+}
+
+}  // namespace
+
+AST::Base* Tree::clone(AST::Base* ast, size_t slot_offset,
+                       bool to_global)
+{
+  Cloner cloner{slot_offset, to_global};
+
+  auto x = cloner(ast);
+
+  if (cloner.failed) {
+    erase(x);
+    return nullptr;
+  }
+
+  return x;
+}
+
+TypeInfo Tree::type_of(AST::Base* ast)
+{
+  auto it = Sema::value_type_cache.find(ast);
+
+  if (it == Sema::value_type_cache.end())
+    return TYPE_None;
+
+  return it->second;
+}
+
+void Tree::set_type(AST::Base* ast, TypeInfo const& type)
+{
+  Sema::value_type_cache[ast] = type;
+}
+
+void Tree::copy_type(AST::Base* from, AST::Base* to)
+{
+  if (auto it = Sema::value_type_cache.find(from);
+      it != Sema::value_type_cache.end())
+    Sema::value_type_cache[to] = it->second;
+}
+
+}  // namespace Optimizer
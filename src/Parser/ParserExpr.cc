@@ -34,8 +34,10 @@ AST::Base* Parser::factor()
                                  this->expr());
 
       while (this->eat(",")) {
-        ast->append(this->expr(), *this->expect(":"),
-                    this->expr());
+        auto key = this->expr();
+        auto colon = this->expect(":");
+
+        ast->append(key, *colon, this->expr());
       }
 
       ast->end_token = this->expect("}");
@@ -98,14 +100,15 @@ AST::Base* Parser::factor()
 
       AST::Type* ast_type = nullptr;
 
-      if (this->found("<")) {
+      if (this->found("<") && this->is_type_parameters()) {
         this->cur = ident;
         ast_type = this->expect_typename();
       }
 
       //
       // type constructor
-      if (this->eat("{")) {
+      if ((ast_type || this->is_type_constructor()) &&
+          this->eat("{")) {
         if (!ast_type) {
           ast_type = new AST::Type(*ident);
         }
@@ -113,8 +116,10 @@ AST::Base* Parser::factor()
         auto ast = new AST::TypeConstructor(ast_type);
 
         do {
-          ast->append(this->expr(), *this->expect(":"),
-                      this->expr());
+          auto key = this->expr();
+          auto colon = this->expect(":");
+
+          ast->append(key, *colon, this->expr());
         } while (this->eat(","));
 
         ast->end_token = this->expect("}");
@@ -360,7 +365,7 @@ AST::Base* Parser::compare()
           AST::CMP_Equal, *this->ate, this->shift());
     else if (this->eat("!="))
       AST::Compare::create(x)->append(
-          AST::CMP_Equal, *this->ate, this->shift());
+          AST::CMP_NotEqual, *this->ate, this->shift());
     else if (this->eat(">="))
       AST::Compare::create(x)->append(
           AST::CMP_LeftBigOrEqual, *this->ate,
@@ -431,6 +436,10 @@ AST::Base* Parser::range()
     y->begin = x;
     y->end = this->log_and_or();
 
+    // a .. b by step
+    if (this->eat("by"))
+      y->step = this->log_and_or();
+
     x = y;
   }
 
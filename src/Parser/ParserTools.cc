@@ -19,14 +19,67 @@ bool Parser::is_ended_with_scope(AST::Base* ast)
     case AST_Loop:
     case AST_For:
     case AST_While:
+    case AST_DoWhile:
     case AST_Scope:
     case AST_Struct:
+    case AST_Function:
+    case AST_Impl:
       return true;
   }
 
   return false;
 }
 
+/**
+ * @brief "<" から始まるトークン列が型パラメータかどうか
+ *
+ * @note "a < b" のような比較式と区別するため、
+ *       閉じカッコの次に "{" があるときのみ true
+ *
+ * @return bool
+ */
+bool Parser::is_type_parameters()
+{
+  size_t depth = 0;
+
+  for (auto it = this->cur; it->kind != TOK_End; it++) {
+    if (it->str == "<")
+      depth++;
+    else if (it->str == ">")
+      depth--;
+    else if (it->str == ">>")
+      depth = depth < 2 ? 0 : depth - 2;
+    else if (it->kind != TOK_Ident && it->str != ",")
+      return false;
+
+    if (depth == 0)
+      return (++it)->str == "{";
+  }
+
+  return false;
+}
+
+/**
+ * @brief 型コンストラクタの開始かどうか
+ *
+ * @note "if x { ... }" と区別するため、
+ *       "{" ident ":" の並びのときのみ true
+ *
+ * @return bool
+ */
+bool Parser::is_type_constructor()
+{
+  auto it = this->cur;
+
+  if (it->str != "{")
+    return false;
+
+  if ((++it)->kind != TOK_Ident)
+    return false;
+
+  return (++it)->str == ":";
+}
+
 /**
  * @brief スコープをパースする
  *
@@ -107,17 +160,20 @@ AST::Scope* Parser::expect_scope()
  */
 AST::Function* Parser::parse_function()
 {
+  auto fn_token = this->expect("fn");
+
   auto func = new AST::Function(
-      *this->expect("fn"),
-      *this->expect_identifier());  // AST 作成
+      *fn_token, *this->expect_identifier());  // AST 作成
 
   this->expect("(");  // 引数リストの開きカッコ
 
   // 閉じかっこがなければ、引数を読み取っていく
   if (!this->eat(")")) {
     do {
-      func->append_argument(this->expect_identifier()->str,
-                            *this->expect(":"),
+      auto name = this->expect_identifier()->str;
+      auto colon = this->expect(":");
+
+      func->append_argument(name, *colon,
                             this->expect_typename());
     } while (this->eat(","));  // カンマがあれば続ける
 
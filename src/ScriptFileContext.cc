@@ -12,6 +12,10 @@
 #include "Parser.h"
 #include "Sema.h"
 #include "Evaluator.h"
+#include "VM.h"
+#include "AOT.h"
+#include "IR.h"
+#include "Optimizer.h"
 
 #include "Application.h"
 #include "ScriptFileContext.h"
@@ -202,13 +206,118 @@ bool SFContext::check()
 
   sema.check(this->_ast);
 
+  //
+  // 範囲の検査を省いたインデックス参照
+  //  path:line: v[i]
+  if (Application::get_instance()->get_options().dump_bce) {
+    for (auto&& ref : sema.get_in_bounds_refs()) {
+      std::cout << this->get_path() << ":"
+                << ref->token.src_loc.line_num << ": "
+                << ref->expr->to_string() << "["
+                << ref->indexes[0]->to_string() << "]\n";
+    }
+  }
+
   return !Error::was_emitted();
 }
 
-Object* SFContext::evaluate()
+//
+// 構文木の最適化
+void SFContext::optimize()
+{
+  auto const& options =
+      Application::get_instance()->get_options();
+
+  // 展開した引数も畳み込めるように、先に展開する
+  if (!options.no_inline)
+    Optimizer::Inliner().inline_calls(this->_ast);
+
+  if (!options.no_fold) {
+    Optimizer::Folder folder{this->_opt_tokens,
+                            this->_opt_text};
+
+    folder.fold(this->_ast);
+  }
+
+  // 畳み込んだ後で、残った式をループの外に出す
+  if (!options.no_hoist) {
+    Optimizer::Hoister hoister{this->_opt_tokens,
+                              this->_opt_text};
+
+    hoister.hoist(this->_ast);
+  }
+}
+
+Value SFContext::evaluate()
 {
+  auto const& options = Application::get_instance()->get_options();
+
+  //
+  // C++ に変換する (実行はしない)
+  if (!options.emit_cpp.empty() || options.aot) {
+    bool ok = true;
+
+    if (!options.emit_cpp.empty())
+      ok = AOT::write_source(this->_ast, options.emit_cpp);
+
+    if (ok && options.aot) {
+      auto output = options.aot_output;
+
+      // script.metro -> script
+      if (output.empty())
+        output = this->get_path().substr(
+            0, this->get_path().size() - 6);
+
+      ok = AOT::build_executable(this->_ast, output);
+    }
+
+    if (!ok)
+      std::exit(1);
+
+    return {};
+  }
+
+  //
+  // SSA 形式の IR
+  if (options.engine == Application::ENGINE_IR ||
+      options.dump_ir) {
+    auto module = IR::Builder().build(this->_ast);
+
+    if (auto errors = IR::verify(module); !errors.empty()) {
+      for (auto&& e : errors)
+        std::cerr << "fatal: invalid IR: " << e
+                  << std::endl;
+
+      std::exit(1);
+    }
+
+    if (options.dump_ir)
+      std::cout << module.dump();
+
+    if (options.engine == Application::ENGINE_IR) {
+      IR::Interpreter(module).run();
+      return {};
+    }
+  }
+
+  //
+  // バイトコード VM
+  if (options.engine == Application::ENGINE_VM) {
+    auto program = VM::Compiler().compile(this->_ast);
+
+    if (options.dump_bytecode)
+      std::cout << program.dump();
+
+    VM::Machine(program).run();
+
+    return {};
+  }
+
   Evaluator eval;
 
+  if (options.engine == Application::ENGINE_Closure)
+    return eval.evaluate_compiled(this->_ast);
+
   auto result = eval.evaluate(this->_ast);
 
   return result;
@@ -232,9 +341,8 @@ void SFContext::execute_full()
   if (!this->check())
     return;
 
-  auto result = this->evaluate();
-
-  delete result;
+  this->optimize();
+  this->evaluate();
 }
 
 std::string const& SFContext::get_path() const
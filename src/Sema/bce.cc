@@ -0,0 +1,134 @@
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "BuiltinFunc.h"
+
+#include "Error.h"
+#include "Sema.h"
+
+// ------------------------------------------------ //
+//  bounds-check elimination
+//
+//   for i in 0 .. len(v) {
+//     v[i] ...
+//   }
+//
+//   ループの中で v と i に代入しなければ、v の大きさは
+//   変わらないので、v[i] は常に範囲内になる
+// ------------------------------------------------ //
+
+//
+// 同じ変数を指しているか
+static bool is_same_var(AST::Base* ast, AST::Variable* var)
+{
+  if (ast->kind != AST_Variable)
+    return false;
+
+  auto x = (AST::Variable*)ast;
+
+  return x->slot == var->slot && x->is_global == var->is_global;
+}
+
+//
+// 0 以上の整数リテラル
+//  (負の数は単項マイナスになる)
+static bool is_non_negative_literal(AST::Base* ast)
+{
+  return ast->kind == AST_Value &&
+         ast->token.kind == TOK_Int;
+}
+
+AST::Variable* Sema::get_bce_vector(AST::For* ast)
+{
+  if (ast->iter->kind != AST_Variable ||
+      ast->iterable->kind != AST_Range)
+    return nullptr;
+
+  auto range = (AST::Range*)ast->iterable;
+
+  if (!is_non_negative_literal(range->begin))
+    return nullptr;
+
+  if (range->step && !is_non_negative_literal(range->step))
+    return nullptr;
+
+  if (range->end->kind != AST_CallFunc)
+    return nullptr;
+
+  // len(v)
+  auto call = (AST::CallFunc*)range->end;
+
+  if (!call->is_builtin || call->builtin_func->name != "len" ||
+      call->args[0]->kind != AST_Variable)
+    return nullptr;
+
+  if (value_type_cache[call->args[0]].kind != TYPE_Vector)
+    return nullptr;
+
+  return (AST::Variable*)call->args[0];
+}
+
+void Sema::eliminate_bounds_checks(
+    AST::For* ast, AST::Variable* vec,
+    std::vector<AST::Base*> const& nodes)
+{
+  auto iter = (AST::Variable*)ast->iter;
+
+  // グローバル変数は、呼び出した関数の中で書き換えられる
+  auto is_global = vec->is_global || iter->is_global;
+
+  std::vector<AST::IndexRef*> refs;
+
+  for (auto&& x : nodes) {
+    switch (x->kind) {
+      case AST_Assign: {
+        auto dest = ((AST::Assign*)x)->dest;
+
+        // v = ..., i = ...
+        //  (v[j] = ... は大きさを変えない)
+        if (is_same_var(dest, vec) ||
+            is_same_var(get_root_variable(dest), iter))
+          return;
+
+        if (dest->kind == AST_IndexRef)
+          refs.emplace_back((AST::IndexRef*)dest);
+
+        break;
+      }
+
+      case AST_CallFunc: {
+        auto call = (AST::CallFunc*)x;
+
+        if (!call->is_builtin) {
+          if (is_global)
+            return;
+
+          break;
+        }
+
+        // 引数を書き換える組み込み関数
+        if (call->builtin_func->arg_passing ==
+                BuiltinFunc::ARG_Ref &&
+            (is_same_var(get_root_variable(call->args[0]), vec) ||
+             is_same_var(get_root_variable(call->args[0]), iter)))
+          return;
+
+        break;
+      }
+
+      case AST_IndexRef:
+        refs.emplace_back((AST::IndexRef*)x);
+        break;
+    }
+  }
+
+  for (auto&& ref : refs) {
+    if (ref->is_in_bounds || !is_same_var(ref->expr, vec) ||
+        !is_same_var(ref->indexes[0], iter))
+      continue;
+
+    ref->is_in_bounds = true;
+    this->in_bounds_refs.emplace_back(ref);
+  }
+}
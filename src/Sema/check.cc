@@ -6,10 +6,20 @@
 #include "BuiltinFunc.h"
 
 #include "Error.h"
+#include "Operators.h"
 #include "Sema.h"
 
 #define astdef(T) auto ast = (AST::T*)_ast
 
+AST::Base* Sema::get_root_variable(AST::Base* ast)
+{
+  while (ast->kind == AST_IndexRef ||
+         ast->kind == AST_MemberAccess)
+    ast = ((AST::IndexRef*)ast)->expr;
+
+  return ast;
+}
+
 /**
  * @brief 演算子に対する両辺の型が適切かどうかチェックする
  *
@@ -107,7 +117,7 @@ TypeInfo& Sema::get_subscripted_type(
   for (auto&& index : indexes) {
     auto index_type = this->check(index);
 
-    switch (type.kind) {
+    switch (ret->kind) {
       //
       // Vector
       case TYPE_Vector: {
@@ -123,9 +133,9 @@ TypeInfo& Sema::get_subscripted_type(
       //
       // Disctionary
       case TYPE_Dict: {
-        if (!index_type.equals(type.type_params[0])) {
+        if (!index_type.equals(ret->type_params[0])) {
           Error(index, "expecte '" +
-                           type.type_params[0].to_string() +
+                           ret->type_params[0].to_string() +
                            "' but found '" +
                            index_type.to_string() + "'")
               .emit()
@@ -137,7 +147,7 @@ TypeInfo& Sema::get_subscripted_type(
       }
 
       default:
-        Error(index, "'" + type.to_string() +
+        Error(index, "'" + ret->to_string() +
                          "' is not subscriptable")
             .emit()
             .exit();
@@ -494,6 +504,10 @@ TypeInfo Sema::check(AST::Base* _ast)
         Error(ast, "expected integer").emit().exit();
       }
 
+      if (ast->step && !this->check(ast->step).equals(TYPE_Int)) {
+        Error(ast->step, "expected integer").emit().exit();
+      }
+
       _ret = TYPE_Range;
       break;
     }
@@ -514,6 +528,9 @@ TypeInfo Sema::check(AST::Base* _ast)
           Error(elem.op, "invalid operator").emit().exit();
         }
         else {
+          elem.kernel = Operators::get_expr_kernel(
+              elem.kind, left.kind, right.kind);
+
           left = res.value();
         }
       }
@@ -529,7 +546,10 @@ TypeInfo Sema::check(AST::Base* _ast)
 
       auto dest = this->check_as_left(ast->dest);
 
-      if (dest.is_const) {
+      // 変更できない変数は、要素にも代入できない
+      if (dest.is_const ||
+          this->check_as_left(get_root_variable(ast->dest))
+              .is_const) {
         Error(ast, "destination is not mutable")
             .emit()
             .exit();
@@ -563,6 +583,9 @@ TypeInfo Sema::check(AST::Base* _ast)
           Error(elem.op, "invalid operator").emit().exit();
         }
 
+        elem.kernel = Operators::get_compare_kernel(
+            elem.kind, left.kind, right.kind);
+
         left = right;
       }
 
@@ -575,8 +598,6 @@ TypeInfo Sema::check(AST::Base* _ast)
     case AST_Let: {
       auto ast = (AST::VariableDeclaration*)_ast;
 
-      auto& scope_emu = this->get_cur_scope();
-
       TypeInfo type;
       TypeInfo init_expr_type;
 
@@ -611,22 +632,14 @@ TypeInfo Sema::check(AST::Base* _ast)
         }
 
         type = std::move(init_expr_type);
-      }
-
-      // 同スコープ内で同じ名前の変数を探す
-      auto pvar = scope_emu.lvar.find_var(ast->name);
 
-      // すでに定義済みの同じ名前があって、違う型
-      //  => シャドウイングする
-      if (pvar && !pvar->type.equals(type)) {
-        pvar->type = type;
+        // 値は複製されるので、const は引き継がない
+        type.is_const = false;
       }
-      // そうでなければ新規追加
-      else {
-        auto& var = scope_emu.lvar.append(type, ast->name);
 
-        var.index = scope_emu.lvar.variables.size() - 1;
-      }
+      // 同じ名前の変数がすでにあっても、新しい位置に追加する
+      //  => 後から定義されたほうが優先される (シャドウイング)
+      ast->slot = this->append_lvar(type, ast->name).slot;
 
       break;
     }
@@ -742,7 +755,7 @@ TypeInfo Sema::check(AST::Base* _ast)
     case AST_For: {
       astdef(For);
 
-      auto& e = this->enter_scope((AST::Scope*)ast->code);
+      this->enter_scope((AST::Scope*)ast->code);
 
       auto iterable = this->check(ast->iterable);
 
@@ -759,21 +772,49 @@ TypeInfo Sema::check(AST::Base* _ast)
           iter = TYPE_Int;
           break;
 
+        case TYPE_String:
+          iter = TYPE_Char;
+          break;
+
+        //
+        // 辞書はキーを回す
+        //  ループ変数は要素をそのまま指すので、変更できない
         case TYPE_Vector:
         case TYPE_Dict:
           iter = iterable.type_params[0];
+          iter.is_const = ast->iter->kind == AST_Variable;
           break;
       }
 
       if (ast->iter->kind == AST_Variable) {
-        e.lvar.append(iter, ast->iter->token.str);
+        auto x = (AST::Variable*)ast->iter;
+        auto& var = this->append_lvar(iter, x->token.str);
+
+        x->slot = var.slot;
+        x->is_global = var.is_global;
       }
       else if (auto x = this->check_as_left(ast->iter);
                !x.equals(iter)) {
         Error(ast->iter, "type mismatch").emit().exit();
       }
 
-      this->check(ast->code);
+      // for i in 0 .. len(v) なら、中で検査したものを集めて
+      // v[i] の範囲の検査を省けるか調べる
+      if (auto vec = this->get_bce_vector(ast); vec) {
+        std::vector<AST::Base*> nodes;
+
+        this->begin_capture(
+            [&](AST::Base* x) { nodes.emplace_back(x); });
+
+        this->check(ast->code);
+
+        this->end_capture();
+
+        this->eliminate_bounds_checks(ast, vec, nodes);
+      }
+      else {
+        this->check(ast->code);
+      }
 
       this->leave_scope();
 
@@ -826,6 +867,12 @@ TypeInfo Sema::check(AST::Base* _ast)
           this->check(e);
       }
 
+      ast->slot_begin = this->get_cur_scope().slot_begin;
+      ast->slot_end = this->slot_count;
+
+      if (ast == this->root)
+        ast->frame_size = this->frame_size;
+
       this->leave_scope();
 
       break;
@@ -850,15 +897,19 @@ TypeInfo Sema::check(AST::Base* _ast)
       // 関数のスコープ　実装があるところ
       auto fn_scope = ast->code;
 
+      // 新しいフレーム
+      auto saved_slot_count = this->slot_count;
+      auto saved_frame_size = this->frame_size;
+
+      this->slot_count = this->frame_size = 0;
+
       // スコープ追加
-      auto& S = this->enter_scope(fn_scope);
+      this->enter_scope(fn_scope);
 
       // 引数追加
-      for (size_t ww = 0; auto&& arg : ast->args) {
-        auto& V = S.lvar.append(this->check(arg->type),
-                                arg->name);
-
-        V.index = ww++;
+      //  フレームの先頭から順に置かれる
+      for (auto&& arg : ast->args) {
+        this->append_lvar(this->check(arg->type), arg->name);
       }
 
       auto res_type = this->check(ast->result_type);
@@ -924,6 +975,11 @@ TypeInfo Sema::check(AST::Base* _ast)
       // スコープ削除
       this->leave_scope();
 
+      fn_scope->frame_size = this->frame_size;
+
+      this->slot_count = saved_slot_count;
+      this->frame_size = saved_frame_size;
+
       this->function_history.pop_front();
 
       break;
@@ -1016,18 +1072,16 @@ TypeInfo& Sema::check_as_left(AST::Base* _ast)
     case AST_Variable: {
       astdef(Variable);
 
-      for (size_t step = 0; auto&& S : this->scope_list) {
+      for (auto&& S : this->scope_list) {
         for (auto it = S.lvar.variables.rbegin();
              it != S.lvar.variables.rend(); it++) {
           if (it->name == ast->token.str) {
-            ast->step = step;
-            ast->index = it->index;
+            ast->slot = it->slot;
+            ast->is_global = it->is_global;
 
             return it->type;
           }
         }
-
-        step++;
       }
 
       Error(ast->token, "undefined variable name")
@@ -1059,8 +1113,11 @@ TypeInfo Sema::check_function_call(AST::CallFunc* ast)
   }
 
   // 同じ名前のビルトインを探す
+  //  (ユーザー定義関数があればそちらを使う)
   auto builtin_func_found =
-      this->find_builtin_func(ast->name);
+      this->find_function(ast->name)
+          ? nullptr
+          : this->find_builtin_func(ast->name);
 
   if (builtin_func_found) {
     ast->is_builtin = true;
@@ -1111,6 +1168,31 @@ TypeInfo Sema::check_function_call(AST::CallFunc* ast)
       arg++;
     }
 
+    // 呼び出し元の変数を書き換える
+    if (builtin_func_found->arg_passing ==
+            BuiltinFunc::ARG_Ref &&
+        (this->check_as_left(ast->args[0]).is_const ||
+         this->check_as_left(get_root_variable(ast->args[0]))
+             .is_const)) {
+      Error(ast->args[0], "destination is not mutable")
+          .emit()
+          .exit();
+    }
+
+    if (builtin_func_found->get_result_type) {
+      auto result =
+          builtin_func_found->get_result_type(arg_types);
+
+      if (!result) {
+        Error(ast, "mismatched argument types for '" +
+                       std::string(ast->name) + "'")
+            .emit()
+            .exit();
+      }
+
+      return *result;
+    }
+
     return builtin_func_found->result_type;
   }
 
@@ -68,6 +68,20 @@ AST::Function* Sema::get_cur_func()
   return *this->function_history.begin();
 }
 
+Sema::LocalVar& Sema::append_lvar(TypeInfo const& type,
+                                  std::string_view name)
+{
+  auto& var = this->get_cur_scope().lvar.append(type, name);
+
+  var.slot = this->slot_count++;
+  var.is_global = this->function_history.empty();
+
+  if (this->frame_size < this->slot_count)
+    this->frame_size = this->slot_count;
+
+  return var;
+}
+
 void Sema::begin_capture(Sema::CaptureFunction cap_func)
 {
   this->captures.emplace_back(cap_func);
@@ -7,6 +7,7 @@
 
 #include "Token.h"
 #include "Object.h"
+#include "GC.h"
 
 #include "AST.h"
 
@@ -16,6 +17,40 @@
 
 static bool nested = 0;
 
+//
+// 作成された時点では参照されていないので、
+// ゼロカウントテーブルに入れておく
+Object::Object(TypeInfo const* type)
+    : type(type),
+      ref_count(0),
+      no_delete(false),
+      in_zct(false),
+      gc_marked(false),
+      gc_epoch(0),
+      gc_refs(0),
+      gc_gray(0),
+      gc_prev(nullptr),
+      gc_next(nullptr)
+{
+  GarbageCollector::add(this);
+  GarbageCollector::add_zero(this);
+}
+
+Object::~Object()
+{
+  GarbageCollector::remove(this);
+}
+
+void* Object::allocate(size_t size, TypeKind kind)
+{
+  return GarbageCollector::allocate(size, kind);
+}
+
+void Object::operator delete(void* p, size_t size)
+{
+  GarbageCollector::deallocate(p, size);
+}
+
 bool Object::equals(Object* object) const
 {
 #define eeeee(A, B) \
@@ -24,23 +59,18 @@ bool Object::equals(Object* object) const
 
 #define ajjja(A) eeeee(A, A)
 
-  if (!this->type.equals(object->type))
+  // 型は intern されているので、アドレスで比較できる
+  if (this->type != object->type)
     return 0;
 
   // なんなのこれ
   // めんどくさすぎ
-  switch (this->type.kind) {
-    eeeee(Int, Long);
-
-    ajjja(Float);
-    ajjja(Bool);
-    ajjja(Char);
+  switch (this->type->kind) {
     ajjja(String);
+    ajjja(Range);
     ajjja(Dict);
     ajjja(Vector);
-
-    case TYPE_None:
-      return true;
+    eeeee(UserDef, UserType);
   }
 
   todo_impl;
@@ -48,7 +78,7 @@ bool Object::equals(Object* object) const
 
 std::string ObjUserType::to_string() const
 {
-  auto pStruct = this->type.userdef_struct;
+  auto pStruct = this->type->userdef_struct;
 
   auto ret = std::string(pStruct->name) + "{ ";
 
@@ -56,9 +86,9 @@ std::string ObjUserType::to_string() const
   nested = true;
 
   for (auto pm = pStruct->members.begin();
-       auto&& member : this->members) {
+       auto&& member : this->get_members()) {
     ret += std::string((pm++)->name) + ": " +
-           member->to_string();
+           member.to_string();
 
     if (pm != pStruct->members.end())
       ret += ", ";
@@ -68,43 +98,22 @@ std::string ObjUserType::to_string() const
   return ret + " }";
 }
 
-std::string ObjNone::to_string() const
-{
-  return "none";
-}
-
-std::string ObjLong::to_string() const
-{
-  return std::to_string(this->value);
-}
-
-std::string ObjUSize::to_string() const
-{
-  return std::to_string(this->value);
-}
-
-std::string ObjFloat::to_string() const
-{
-  auto ret = std::to_string(this->value);
-
-  while (ret.size() > 1 && *ret.rbegin() == '0') {
-    ret.pop_back();
-  }
-
-  return ret;
-}
-
 std::string ObjString::to_string() const
 {
   if (nested) {
-    return '"' + Utils::String::to_str(this->value) + '"';
+    return '"' + Utils::String::to_str(this->get_value()) + '"';
   }
 
-  return Utils::String::to_str(this->value);
+  return Utils::String::to_str(this->get_value());
 }
 
 std::string ObjRange::to_string() const
 {
+  if (this->step != 1) {
+    return Utils::format("%zd..%zd by %zd", this->begin, this->end,
+                         this->step);
+  }
+
   return Utils::format("%zd..%zd", this->begin, this->end);
 }
 
@@ -115,10 +124,12 @@ std::string ObjDict::to_string() const
   auto nss = nested;
   nested = 1;
 
-  for (auto&& x : this->items) {
-    s += x.key->to_string() + ": " + x.value->to_string();
+  auto const& items = this->get_items();
 
-    if (&x != &*this->items.rbegin())
+  for (auto&& x : items) {
+    s += x.key.to_string() + ": " + x.value.to_string();
+
+    if (&x != &*items.rbegin())
       s += ", ";
   }
 
@@ -134,9 +145,10 @@ std::string ObjVector::to_string() const
   auto nss = nested;
   nested = 1;
 
-  for (auto&& x : this->elements) {
-    s += x->to_string();
-    if (x != *this->elements.rbegin())
+  for (size_t i = 0, n = this->size(); i < n; i++) {
+    s += this->at(i).to_string();
+
+    if (i + 1 != n)
       s += ", ";
   }
 
@@ -145,63 +157,661 @@ std::string ObjVector::to_string() const
   return s + "]";
 }
 
-ObjUserType* ObjUserType::clone() const
+//
+// 要素を複製する
+//  ヒープのものは clone() して、別のオブジェクトにする
+//  (中身は共有される)
+static Value copy_value(Value const& value)
+{
+  auto ret = value.is_heap() ? value.clone() : value;
+
+  ret.inc_ref();
+
+  return ret;
+}
+
+static std::vector<Value> copy_values(
+    std::vector<Value> const& values)
+{
+  std::vector<Value> ret;
+
+  ret.reserve(values.size());
+
+  for (auto&& value : values)
+    ret.emplace_back(copy_value(value));
+
+  return ret;
+}
+
+//
+// 位置は変わらないので、index はそのまま使える
+static ObjDict::Table copy_table(ObjDict::Table const& table)
+{
+  ObjDict::Table ret;
+
+  ret.items.reserve(table.items.size());
+
+  for (auto&& item : table.items) {
+    auto& x = ret.items.emplace_back(copy_value(item.key),
+                                     copy_value(item.value),
+                                     item.hash);
+
+    x.is_removed = item.is_removed;
+  }
+
+  ret.index = table.index;
+  ret.removed = table.removed;
+
+  return ret;
+}
+
+static void release_values(std::vector<Value>& values)
+{
+  for (auto&& value : values)
+    value.dec_ref();
+}
+
+//
+// 中身を共有する
+//  マーク中に元のオブジェクトが先に削除されても子要素を
+//  見落とさないよう、新しいオブジェクトを調べ直させる
+ObjUserType::ObjUserType(ObjUserType const& other)
+    : Object(other.type),
+      members(other.members)
+{
+  GarbageCollector::rescan(this);
+}
+
+ObjString::ObjString(ObjString const& other)
+    : Object(other.type),
+      value(other.value)
+{
+}
+
+ObjDict::ObjDict(ObjDict const& other)
+    : Object(other.type),
+      table(other.table)
+{
+  GarbageCollector::rescan(this);
+}
+
+//
+// 詰めて持っているものはそのまま複製する
+static ObjVector::Elements copy_elements(
+    ObjVector::Elements const& elements)
+{
+  if (auto values = std::get_if<0>(&elements); values)
+    return copy_values(*values);
+
+  return elements;
+}
+
+ObjVector::ObjVector(ObjVector const& other)
+    : Object(other.type),
+      elements(other.elements)
+{
+  GarbageCollector::rescan(this);
+}
+
+//
+// 共有していなければ、最後の持ち主なので子要素を手放す
+ObjUserType::~ObjUserType()
+{
+  if (!this->members.is_shared())
+    release_values(this->members.get_shared());
+}
+
+ObjDict::~ObjDict()
+{
+  if (this->table.is_shared())
+    return;
+
+  for (auto&& item : this->table.get_shared().items) {
+    item.key.dec_ref();
+    item.value.dec_ref();
+  }
+}
+
+ObjVector::~ObjVector()
+{
+  if (this->elements.is_shared())
+    return;
+
+  if (auto values = std::get_if<0>(&this->elements.get_shared());
+      values)
+    release_values(*values);
+}
+
+std::vector<Value>& ObjUserType::get_mut_members()
+{
+  return this->members.get_mut(copy_values);
+}
+
+std::wstring& ObjString::get_mut_value()
+{
+  this->version++;
+
+  return this->value.get_mut(
+      [](std::wstring const& s) { return s; });
+}
+
+
+// --------------------------------------------------------
+//  hash
+// --------------------------------------------------------
+
+//
+// 整数をそのまま使うと下位ビットが偏るので混ぜる
+static size_t mix(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccd;
+  x ^= x >> 33;
+
+  return x;
+}
+
+static size_t hash_combine(size_t h, size_t x)
+{
+  return h ^ (x + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2));
+}
+
+size_t ObjUserType::hash() const
+{
+  size_t h = (uintptr_t)this->type;
+
+  for (auto&& member : this->get_members())
+    h = hash_combine(h, member.hash());
+
+  return h;
+}
+
+size_t ObjString::hash() const
+{
+  return std::hash<std::wstring>()(this->get_value());
+}
+
+size_t ObjRange::hash() const
+{
+  return hash_combine(
+      hash_combine(mix(this->begin), mix(this->end)),
+      mix(this->step));
+}
+
+size_t ObjDict::hash() const
+{
+  size_t h = 0;
+
+  for (auto&& item : this->get_items())
+    h = hash_combine(hash_combine(h, item.hash),
+                     item.value.hash());
+
+  return h;
+}
+
+size_t ObjVector::hash() const
+{
+  size_t h = 0;
+
+  for (size_t i = 0, n = this->size(); i < n; i++)
+    h = hash_combine(h, this->at(i).hash());
+
+  return h;
+}
+
+// --------------------------------------------------------
+//  ObjDict
+// --------------------------------------------------------
+
+// これ以下なら index を作らずに順に調べる
+static constexpr size_t MAX_LINEAR_ITEMS = 8;
+
+int64_t ObjDict::find_position(Table const& table,
+                               Value const& key, size_t hash)
+{
+  auto const& items = table.items;
+
+  if (table.index.empty()) {
+    for (size_t i = 0; i < items.size(); i++) {
+      if (!items[i].is_removed && items[i].hash == hash &&
+          items[i].key.equals(key))
+        return i;
+    }
+
+    return -1;
+  }
+
+  size_t mask = table.index.size() - 1;
+
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    auto slot = table.index[i];
+
+    if (slot == 0)
+      return -1;
+
+    auto const& item = items[slot - 1];
+
+    // 削除の跡は飛ばして先を探す
+    if (!item.is_removed && item.hash == hash &&
+        item.key.equals(key))
+      return slot - 1;
+  }
+}
+
+void ObjDict::rebuild_index(Table& table)
+{
+  auto const& items = table.items;
+
+  if (items.size() <= MAX_LINEAR_ITEMS) {
+    table.index.clear();
+    return;
+  }
+
+  // 使用率が 1/4 から 1/2 になるようにする
+  size_t size = 16;
+
+  while (size < items.size() * 4)
+    size <<= 1;
+
+  table.index.assign(size, 0);
+
+  for (size_t pos = 0; pos < items.size(); pos++) {
+    if (items[pos].is_removed)
+      continue;
+
+    size_t i = items[pos].hash & (size - 1);
+
+    while (table.index[i] != 0)
+      i = (i + 1) & (size - 1);
+
+    table.index[i] = pos + 1;
+  }
+}
+
+ObjDict::Table& ObjDict::get_mut_table()
+{
+  this->version++;
+
+  return this->table.get_mut(copy_table);
+}
+
+ObjDict::Item const* ObjDict::find(Value const& key) const
+{
+  auto const& table = this->table.get();
+  auto pos = find_position(table, key, key.hash());
+
+  return pos < 0 ? nullptr : &table.items[pos];
+}
+
+Value* ObjDict::find_mut(Value const& key)
+{
+  auto pos = find_position(this->table.get(), key, key.hash());
+
+  if (pos < 0)
+    return nullptr;
+
+  return &this->get_mut_table().items[pos].value;
+}
+
+ObjDict::Item& ObjDict::append(Value const& key,
+                               Value const& value)
 {
-  auto obj = new ObjUserType(this->type);
+  auto& table = this->get_mut_table();
+  auto hash = key.hash();
+
+  auto& item = table.items.emplace_back(key, value, hash);
+
+  item.key.inc_ref();
+  item.value.inc_ref();
 
-  for (auto&& member : this->members)
-    obj->add_member(member->clone());
+  // 使用率が 1/2 を超えたら作り直す
+  if (table.items.size() * 2 > table.index.size()) {
+    rebuild_index(table);
+  }
+  else {
+    size_t mask = table.index.size() - 1;
+    size_t i = hash & mask;
+
+    while (table.index[i] != 0)
+      i = (i + 1) & mask;
 
-  return obj;
+    table.index[i] = table.items.size();
+  }
+
+  return item;
 }
 
-ObjNone* ObjNone::clone() const
+bool ObjDict::remove(Value const& key)
 {
-  return new ObjNone;  // ???
+  auto pos = find_position(this->table.get(), key, key.hash());
+
+  if (pos < 0)
+    return false;
+
+  auto& table = this->get_mut_table();
+  auto& item = table.items[pos];
+
+  item.key.dec_ref();
+  item.value.dec_ref();
+
+  // index からはたどれるまま残しておく
+  item.key = {};
+  item.value = {};
+  item.is_removed = true;
+
+  // 詰めるのは跡が半分を超えたときだけにする
+  if (++table.removed * 2 > table.items.size())
+    this->compact();
+
+  return true;
+}
+
+void ObjDict::compact()
+{
+  auto& table = this->table.get_shared();
+
+  std::erase_if(table.items, [](Item const& item) {
+    return item.is_removed;
+  });
+
+  table.removed = 0;
+
+  rebuild_index(table);
+
+  GarbageCollector::moved_children(this);
+}
+
+// --------------------------------------------------------
+//  ObjVector
+// --------------------------------------------------------
+
+//
+// 要素の型で詰め方を決める
+static ObjVector::Elements make_elements(TypeInfo const* type)
+{
+  if (type->type_params.empty())
+    return std::vector<Value>();
+
+  switch (type->type_params[0].kind) {
+    case TYPE_Int:
+      return std::vector<int64_t>();
+
+    case TYPE_USize:
+      return std::vector<size_t>();
+
+    case TYPE_Float:
+      return std::vector<float>();
+
+    case TYPE_Bool:
+      return std::vector<uint8_t>();
+
+    case TYPE_Char:
+      return std::vector<wchar_t>();
+  }
+
+  return std::vector<Value>();
+}
+
+ObjVector::ObjVector(TypeInfo const* type)
+    : Object(type),
+      elements(make_elements(type))
+{
+}
+
+ObjVector::Elements& ObjVector::get_mut()
+{
+  this->version++;
+
+  return this->elements.get_mut(copy_elements);
+}
+
+std::vector<Value>& ObjVector::get_mut_elements()
+{
+  return std::get<0>(this->get_mut());
+}
+
+void ObjVector::set(size_t i, Value const& value)
+{
+  auto& elements = this->get_mut();
+
+  switch (elements.index()) {
+    case 0: {
+      auto& elem = std::get<0>(elements)[i];
+
+      elem.dec_ref();
+
+      elem = value;
+      elem.inc_ref();
+
+      break;
+    }
+
+    case 1:
+      std::get<1>(elements)[i] = value.v_int;
+      break;
+
+    case 2:
+      std::get<2>(elements)[i] = value.v_usize;
+      break;
+
+    case 3:
+      std::get<3>(elements)[i] = value.v_float;
+      break;
+
+    case 4:
+      std::get<4>(elements)[i] = value.v_bool;
+      break;
+
+    case 5:
+      std::get<5>(elements)[i] = value.v_char;
+      break;
+  }
 }
 
-ObjLong* ObjLong::clone() const
+void ObjVector::append(Value const& value)
 {
-  return new ObjLong(this->value);
+  auto& elements = this->get_mut();
+
+  switch (elements.index()) {
+    case 0:
+      std::get<0>(elements).emplace_back(value).inc_ref();
+      break;
+
+    case 1:
+      std::get<1>(elements).emplace_back(value.v_int);
+      break;
+
+    case 2:
+      std::get<2>(elements).emplace_back(value.v_usize);
+      break;
+
+    case 3:
+      std::get<3>(elements).emplace_back(value.v_float);
+      break;
+
+    case 4:
+      std::get<4>(elements).emplace_back(value.v_bool);
+      break;
+
+    case 5:
+      std::get<5>(elements).emplace_back(value.v_char);
+      break;
+  }
 }
 
-ObjUSize* ObjUSize::clone() const
+bool ObjVector::equals(ObjVector* x) const
 {
-  return new ObjUSize(this->value);
+  auto n = this->size();
+
+  if (n != x->size())
+    return false;
+
+  for (size_t i = 0; i < n; i++) {
+    if (!this->at(i).equals(x->at(i)))
+      return false;
+  }
+
+  return true;
 }
 
-ObjFloat* ObjFloat::clone() const
+ObjUserType* ObjUserType::clone() const
 {
-  return new ObjFloat(this->value);
+  return new ObjUserType(*this);
 }
 
 ObjString* ObjString::clone() const
 {
-  return new ObjString(this->value);
+  return new ObjString(*this);
 }
 
 ObjRange* ObjRange::clone() const
 {
-  return new ObjRange(this->begin, this->end);
+  return new ObjRange(this->begin, this->end, this->step);
 }
 
 ObjDict* ObjDict::clone() const
 {
-  auto ret = new ObjDict;
+  return new ObjDict(*this);
+}
+
+ObjVector* ObjVector::clone() const
+{
+  return new ObjVector(*this);
+}
+
+// --------------------------------------------------------
+//  Value
+// --------------------------------------------------------
+
+Value::Value(Object* obj)
+    : kind(obj->type->kind),
+      v_obj(obj)
+{
+}
+
+TypeInfo Value::get_type() const
+{
+  if (this->is_heap())
+    return *this->v_obj->type;
+
+  return this->kind;
+}
+
+std::string Value::to_string() const
+{
+  switch (this->kind) {
+    case TYPE_None:
+      return "none";
+
+    case TYPE_Int:
+      return std::to_string(this->v_int);
+
+    case TYPE_USize:
+      return std::to_string(this->v_usize);
+
+    case TYPE_Float: {
+      auto ret = std::to_string(this->v_float);
+
+      while (ret.size() > 1 && *ret.rbegin() == '0') {
+        ret.pop_back();
+      }
+
+      return ret;
+    }
+
+    case TYPE_Bool:
+      return this->v_bool ? "true" : "false";
 
-  for (auto&& item : this->items) {
-    ret->append(item.key->clone(), item.value->clone());
+    case TYPE_Char: {
+      auto s =
+          Utils::String::to_str(std::wstring(1, this->v_char));
+
+      if (nested) {
+        return '\'' + s + '\'';
+      }
+
+      return s;
+    }
   }
 
-  return ret;
+  return this->v_obj->to_string();
 }
 
-ObjVector* ObjVector::clone() const
+bool Value::equals(Value const& other) const
 {
-  auto ret = new ObjVector;
+  if (this->kind != other.kind)
+    return false;
+
+  switch (this->kind) {
+    case TYPE_None:
+      return true;
 
-  for (auto&& xx : this->elements)
-    ret->append(xx->clone());
+    case TYPE_Int:
+      return this->v_int == other.v_int;
 
-  return ret;
-}
\ No newline at end of file
+    case TYPE_USize:
+      return this->v_usize == other.v_usize;
+
+    case TYPE_Float:
+      return this->v_float == other.v_float;
+
+    case TYPE_Bool:
+      return this->v_bool == other.v_bool;
+
+    case TYPE_Char:
+      return this->v_char == other.v_char;
+  }
+
+  return this->v_obj->equals(other.v_obj);
+}
+
+size_t Value::hash() const
+{
+  switch (this->kind) {
+    case TYPE_None:
+      return 0;
+
+    case TYPE_Int:
+      return mix(this->v_int);
+
+    case TYPE_USize:
+      return mix(this->v_usize);
+
+    case TYPE_Float:
+      // 0.0 == -0.0 なので揃える
+      return this->v_float == 0
+                 ? 0
+                 : std::hash<float>()(this->v_float);
+
+    case TYPE_Bool:
+      return this->v_bool;
+
+    case TYPE_Char:
+      return mix(this->v_char);
+  }
+
+  return this->v_obj->hash();
+}
+
+Value Value::clone() const
+{
+  if (this->is_heap())
+    return this->v_obj->clone();
+
+  return *this;
+}
+
+void Value::inc_ref() const
+{
+  if (this->is_heap()) {
+    this->v_obj->ref_count++;
+
+    GarbageCollector::write_barrier(this->v_obj);
+  }
+}
+
+void Value::dec_ref() const
+{
+  if (this->is_heap() && --this->v_obj->ref_count == 0)
+    GarbageCollector::add_zero(this->v_obj);
+}
@@ -1,5 +1,7 @@
 #include <cassert>
+#include <deque>
 #include <iostream>
+#include <unordered_map>
 
 #include "Utils.h"
 #include "debug/alert.h"
@@ -55,6 +57,102 @@ std::optional<TypeKind> TypeInfo::get_kind_from_name(
   return std::nullopt;
 }
 
+//
+// ------------------------------------------------
+//  Intern
+// ------------------------------------------------
+static std::deque<TypeInfo> g_interned;
+
+// ハッシュ値 => 記述子
+static std::unordered_multimap<size_t, TypeInfo const*>
+    g_interned_map;
+
+static bool is_plain(TypeInfo const& type)
+{
+  return type.type_params.empty() && type.members.empty() &&
+         !type.userdef_struct;
+}
+
+static size_t hash_type(TypeInfo const& type)
+{
+  size_t h = type.kind;
+
+  h = h * 31 + (uintptr_t)type.userdef_struct;
+
+  for (auto&& param : type.type_params)
+    h = h * 31 + hash_type(param);
+
+  for (auto&& [name, member] : type.members) {
+    h = h * 31 + std::hash<std::string_view>()(name);
+    h = h * 31 + hash_type(member);
+  }
+
+  return h;
+}
+
+// is_const 以外が全て同じか
+static bool is_same_type(TypeInfo const& a, TypeInfo const& b)
+{
+  if (a.kind != b.kind || a.userdef_struct != b.userdef_struct ||
+      a.type_params.size() != b.type_params.size() ||
+      a.members.size() != b.members.size())
+    return false;
+
+  for (size_t i = 0; i < a.type_params.size(); i++)
+    if (!is_same_type(a.type_params[i], b.type_params[i]))
+      return false;
+
+  for (size_t i = 0; i < a.members.size(); i++)
+    if (a.members[i].first != b.members[i].first ||
+        !is_same_type(a.members[i].second, b.members[i].second))
+      return false;
+
+  return true;
+}
+
+static void remove_const(TypeInfo& type)
+{
+  type.is_const = false;
+
+  for (auto&& param : type.type_params)
+    remove_const(param);
+
+  for (auto&& [name, member] : type.members)
+    remove_const(member);
+}
+
+TypeInfo const* TypeInfo::intern(TypeKind kind)
+{
+  static TypeInfo const* table[TYPE_Template + 1];
+
+  auto& desc = table[kind];
+
+  if (!desc)
+    desc = &g_interned.emplace_back(kind);
+
+  return desc;
+}
+
+TypeInfo const* TypeInfo::intern(TypeInfo const& type)
+{
+  if (is_plain(type))
+    return TypeInfo::intern(type.kind);
+
+  auto hash = hash_type(type);
+  auto [begin, end] = g_interned_map.equal_range(hash);
+
+  for (auto it = begin; it != end; it++)
+    if (is_same_type(*it->second, type))
+      return it->second;
+
+  auto& desc = g_interned.emplace_back(type);
+
+  remove_const(desc);
+  g_interned_map.emplace(hash, &desc);
+
+  return &desc;
+}
+
 //
 // ------------------------------------------------
 //  Convert TypeInfo to std::string
@@ -152,6 +250,7 @@ bool TypeInfo::is_iterable() const
 {
   switch (this->kind) {
     case TYPE_Range:
+    case TYPE_String:
     case TYPE_Vector:
     case TYPE_Dict:
       return true;
@@ -1,9 +1,46 @@
 #include <codecvt>
 #include <locale>
 
+#include <pthread.h>
+#include <sys/resource.h>
+
 #include "Utils.h"
 #include "debug/alert.h"
 
+namespace Utils {
+
+//
+// エラーを表示するぶんは残しておく
+static constexpr size_t STACK_MARGIN = 256 << 10;
+
+uintptr_t native_stack_limit()
+{
+  pthread_attr_t attr;
+
+  void* addr;
+  size_t size;
+
+  if (pthread_getattr_np(pthread_self(), &attr) == 0 &&
+      pthread_attr_getstack(&attr, &addr, &size) == 0) {
+    pthread_attr_destroy(&attr);
+    return (uintptr_t)addr + STACK_MARGIN;
+  }
+
+  // 分からなければ、今の位置から上限の半分まで
+  rlimit lim;
+  char here;
+
+  size = 8 << 20;
+
+  if (getrlimit(RLIMIT_STACK, &lim) == 0 &&
+      lim.rlim_cur != RLIM_INFINITY)
+    size = lim.rlim_cur;
+
+  return (uintptr_t)&here - size / 2;
+}
+
+}  // namespace Utils
+
 namespace Utils::String {
 
 static std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t>
@@ -0,0 +1,1672 @@
+#include <cassert>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Object.h"
+#include "BuiltinFunc.h"
+
+#include "Error.h"
+#include "Sema.h"
+#include "VM.h"
+
+namespace VM {
+
+#define astdef(T) auto ast = (AST::T*)_ast
+
+Compiler::Compiler()
+    : state(nullptr),
+      toplevel(nullptr)
+{
+}
+
+Compiler::~Compiler()
+{
+}
+
+Program Compiler::compile(AST::Scope* root)
+{
+  this->program.functions.emplace_back("<toplevel>", nullptr);
+
+  //
+  // 関数の番号を先に決めておく
+  //  (定義より前にある呼び出しのため)
+  for (auto&& item : root->list) {
+    if (item->kind != AST_Function)
+      continue;
+
+    auto func = (AST::Function*)item;
+
+    this->function_index[func] =
+        this->program.functions.size();
+
+    this->program.functions.emplace_back(
+        std::string(func->name.str), func);
+  }
+
+  FunctionState fs{&this->program.functions[0], true};
+
+  this->state = this->toplevel = &fs;
+
+  this->enter_scope();
+
+  for (auto&& item : root->list) {
+    if (item->kind == AST_Function) {
+      this->compile_function((AST::Function*)item);
+      continue;
+    }
+
+    this->compile_stmt(item);
+  }
+
+  this->emit(OP_Halt);
+
+  this->leave_scope();
+
+  this->state = this->toplevel = nullptr;
+
+  return std::move(this->program);
+}
+
+void Compiler::compile_function(AST::Function* ast)
+{
+  auto& func =
+      this->program.functions[this->function_index[ast]];
+
+  FunctionState fs{&func, false};
+
+  auto saved = this->state;
+  this->state = &fs;
+
+  this->enter_scope();
+
+  // 引数
+  for (auto&& arg : ast->args) {
+    this->declare(arg->name, this->alloc_reg(),
+                  type_of(arg->type));
+  }
+
+  func.num_args = ast->args.size();
+
+  if (ast->code->return_last_expr) {
+    auto result = this->alloc_reg();
+
+    this->compile_scope(ast->code, result);
+    this->emit(Instruction(OP_Return, result));
+  }
+  else {
+    this->compile_scope(ast->code, -1);
+    this->emit(OP_ReturnNone);
+  }
+
+  this->leave_scope();
+
+  this->state = saved;
+}
+
+void Compiler::compile_stmt(AST::Base* _ast)
+{
+  if (!_ast)
+    return;
+
+  auto mark = this->cur().free_reg;
+
+  switch (_ast->kind) {
+    case AST_None:
+    case AST_Struct:
+      break;
+
+    case AST_Let:
+      this->compile_let((AST::VariableDeclaration*)_ast);
+      return;
+
+    case AST_Assign:
+      this->compile_assign((AST::Assign*)_ast, -1);
+      break;
+
+    case AST_Scope:
+      this->compile_scope((AST::Scope*)_ast, -1);
+      break;
+
+    case AST_If:
+      this->compile_if((AST::If*)_ast, -1);
+      break;
+
+    case AST_Switch:
+      this->compile_switch((AST::Switch*)_ast, -1);
+      break;
+
+    case AST_For:
+      this->compile_for((AST::For*)_ast);
+      break;
+
+    case AST_While:
+      this->compile_while((AST::While*)_ast);
+      break;
+
+    case AST_DoWhile:
+      this->compile_do_while((AST::DoWhile*)_ast);
+      break;
+
+    case AST_Loop:
+      this->compile_loop((AST::Loop*)_ast);
+      break;
+
+    case AST_Return:
+      this->compile_return((AST::Return*)_ast);
+      break;
+
+    case AST_Break:
+      this->cur().loops.back().breaks.emplace_back(
+          this->emit(OP_Jmp));
+      break;
+
+    case AST_Continue:
+      this->cur().loops.back().continues.emplace_back(
+          this->emit(OP_Jmp));
+      break;
+
+    default:
+      this->compile_expr(_ast);
+  }
+
+  this->free_to(mark);
+}
+
+Compiler::Operand Compiler::compile_expr(AST::Base* _ast,
+                                         int32_t hint)
+{
+  auto target = [&]() {
+    return hint >= 0 ? hint : this->alloc_reg();
+  };
+
+  switch (_ast->kind) {
+    case AST_None: {
+      auto t = target();
+
+      this->emit(Instruction(OP_LoadNone, t));
+
+      return {t, true};
+    }
+
+    case AST_True:
+    case AST_False: {
+      auto t = target();
+
+      this->emit(Instruction(OP_LoadBool, t,
+                             _ast->kind == AST_True));
+
+      return {t, true};
+    }
+
+    //
+    // 即値・リテラル
+    case AST_Value: {
+      auto const& type = type_of(_ast);
+      auto str = std::string(_ast->token.str);
+
+      Register reg{};
+
+      switch (type.kind) {
+        case TYPE_Int:
+          reg.v_int = std::stoll(str);
+          break;
+
+        case TYPE_USize:
+          reg.v_usize = std::stoull(str);
+          break;
+
+        case TYPE_Float:
+          reg.v_float = std::stof(str);
+          break;
+
+        case TYPE_Char: {
+          auto ws = Utils::String::to_wstr(str);
+          reg.v_char = ws.length() >= 3 ? ws[1] : 0;
+          break;
+        }
+
+        case TYPE_String: {
+          auto ws = Utils::String::to_wstr(str);
+
+          // remove double quotation
+          ws.erase(ws.begin());
+          ws.pop_back();
+
+          auto obj = new ObjString(std::move(ws));
+
+          obj->no_delete = true;
+          reg.v_obj = obj;
+
+          this->program.constant_objects.emplace_back(obj);
+          break;
+        }
+
+        default:
+          todo_impl;
+      }
+
+      auto t = target();
+
+      this->emit(Instruction(OP_LoadK, t,
+                             this->add_constant(reg)));
+
+      // 文字列の定数は借りているだけ
+      return {t, !is_heap_type(type.kind)};
+    }
+
+    //
+    // 変数
+    case AST_Variable: {
+      astdef(Variable);
+
+      if (auto var = this->find_local(ast->name); var)
+        return {var->reg, false};
+
+      if (auto var = this->find_global(ast->name); var) {
+        auto t = target();
+
+        this->emit(Instruction(OP_GetGlobal, t, var->reg));
+
+        return {t, !is_heap_type(var->type.kind)};
+      }
+
+      Error(ast, "undefined variable name").emit().exit();
+    }
+
+    case AST_CallFunc:
+      return this->compile_call((AST::CallFunc*)_ast, hint);
+
+    case AST_IndexRef:
+      return this->compile_index((AST::IndexRef*)_ast, hint);
+
+    case AST_MemberAccess:
+      return this->compile_member((AST::IndexRef*)_ast, hint);
+
+    case AST_Cast:
+      return this->compile_cast((AST::Cast*)_ast, hint);
+
+    case AST_Expr:
+      return this->compile_arith((AST::Expr*)_ast, hint);
+
+    case AST_Compare:
+      return this->compile_compare((AST::Compare*)_ast,
+                                   hint);
+
+    case AST_UnaryPlus:
+      return this->compile_expr(((AST::UnaryOp*)_ast)->expr,
+                                hint);
+
+    case AST_UnaryMinus: {
+      astdef(UnaryOp);
+
+      auto opr = this->compile_expr(ast->expr);
+      auto t = target();
+
+      switch (type_of(ast->expr).kind) {
+        case TYPE_Int:
+          this->emit(Instruction(OP_NegI, t, opr.reg));
+          break;
+
+        case TYPE_Float:
+          this->emit(Instruction(OP_NegF, t, opr.reg));
+          break;
+
+        default:
+          this->emit(OP_Todo, ast);
+      }
+
+      return {t, true};
+    }
+
+    //
+    // Vector
+    case AST_Vector: {
+      astdef(Vector);
+
+      auto base = this->cur().free_reg;
+
+      for (auto&& elem : ast->elements) {
+        this->compile_to(this->alloc_reg(), elem);
+      }
+
+      if (ast->elements.empty())
+        this->alloc_reg();
+
+      this->emit(Instruction(OP_NewVector, base,
+                             ast->elements.size(),
+                             this->add_desc(type_of(ast))));
+
+      this->free_to(base + 1);
+
+      if (hint >= 0 && hint != base) {
+        this->emit(Instruction(OP_Move, hint, base));
+        return {hint, true};
+      }
+
+      return {base, true};
+    }
+
+    //
+    // Dictionary
+    case AST_Dict: {
+      astdef(Dict);
+
+      auto base = this->cur().free_reg;
+
+      for (auto&& elem : ast->elements) {
+        this->compile_to(this->alloc_reg(), elem.key);
+        this->compile_to(this->alloc_reg(), elem.value);
+      }
+
+      if (ast->elements.empty())
+        this->alloc_reg();
+
+      this->emit(Instruction(OP_NewDict, base,
+                             ast->elements.size(),
+                             this->add_desc(type_of(ast))));
+
+      this->free_to(base + 1);
+
+      if (hint >= 0 && hint != base) {
+        this->emit(Instruction(OP_Move, hint, base));
+        return {hint, true};
+      }
+
+      return {base, true};
+    }
+
+    //
+    // 構造体
+    case AST_TypeConstructor: {
+      astdef(TypeConstructor);
+
+      auto base = this->cur().free_reg;
+
+      for (auto&& elem : ast->elements) {
+        this->compile_to(this->alloc_reg(), elem.value);
+      }
+
+      this->emit(Instruction(OP_NewStruct, base,
+                             ast->elements.size(),
+                             this->add_desc(ast->typeinfo)));
+
+      this->free_to(base + 1);
+
+      if (hint >= 0 && hint != base) {
+        this->emit(Instruction(OP_Move, hint, base));
+        return {hint, true};
+      }
+
+      return {base, true};
+    }
+
+    //
+    // Range
+    case AST_Range: {
+      astdef(Range);
+
+      auto t = target();
+
+      auto begin = this->compile_expr(ast->begin);
+      auto end = this->compile_expr(ast->end);
+
+      this->emit(
+          Instruction(OP_NewRange, t, begin.reg, end.reg));
+
+      if (ast->step) {
+        auto step = this->compile_expr(ast->step);
+
+        this->emit(Instruction(OP_RangeStep, t, step.reg),
+                   ast->step);
+      }
+
+      return {t, true};
+    }
+
+    //
+    // 代入
+    case AST_Assign:
+      return this->compile_assign((AST::Assign*)_ast, hint);
+
+    //
+    // 値を持つ文
+    case AST_Scope: {
+      auto t = target();
+
+      this->compile_scope((AST::Scope*)_ast, t);
+
+      return {t, true};
+    }
+
+    case AST_If: {
+      auto t = target();
+
+      this->compile_if((AST::If*)_ast, t);
+
+      return {t, true};
+    }
+
+    case AST_Switch: {
+      auto t = target();
+
+      this->compile_switch((AST::Switch*)_ast, t);
+
+      return {t, true};
+    }
+  }
+
+  //
+  // 値を持たない文
+  this->compile_stmt(_ast);
+
+  auto t = target();
+
+  this->emit(Instruction(OP_LoadNone, t));
+
+  return {t, true};
+}
+
+void Compiler::compile_to(int32_t dest, AST::Base* ast)
+{
+  auto mark = std::max(this->cur().free_reg, dest + 1);
+
+  auto opr = this->compile_expr(ast, dest);
+
+  if (opr.reg != dest) {
+    if (!opr.is_temp && is_heap_type(type_of(ast).kind))
+      this->emit(Instruction(OP_Clone, dest, opr.reg));
+    else
+      this->emit(Instruction(OP_Move, dest, opr.reg));
+  }
+  else if (!opr.is_temp && is_heap_type(type_of(ast).kind)) {
+    this->emit(Instruction(OP_Clone, dest, dest));
+  }
+
+  this->free_to(mark);
+}
+
+//
+// 四則演算など
+Compiler::Operand Compiler::compile_arith(AST::Expr* ast,
+                                          int32_t hint)
+{
+  auto cur_kind = type_of(ast->first).kind;
+
+  //
+  // 文字列の連結
+  //  先頭を複製して、そこに追加していく
+  if (cur_kind == TYPE_String) {
+    auto t = hint >= 0 ? hint : this->alloc_reg();
+
+    this->compile_to(t, ast->first);
+
+    for (auto&& elem : ast->elements) {
+      auto mark = this->cur().free_reg;
+      auto rhs = this->compile_expr(elem.ast);
+
+      if (elem.kind == AST::EX_Add)
+        this->emit(Instruction(OP_Append, t, t, rhs.reg),
+                   elem.ast, &elem.op);
+      else
+        this->emit(OP_Todo, elem.ast, &elem.op);
+
+      this->free_to(mark);
+    }
+
+    return {t, true};
+  }
+
+  auto lhs = this->compile_expr(ast->first);
+
+  auto t = hint >= 0     ? hint
+           : lhs.is_temp ? lhs.reg
+                         : this->alloc_reg();
+
+  for (auto&& elem : ast->elements) {
+    auto mark = this->cur().free_reg;
+
+    //
+    // && と || は、左辺で決まれば右辺を評価しない
+    if (elem.kind == AST::EX_And || elem.kind == AST::EX_Or) {
+      if (lhs.reg != t)
+        this->emit(Instruction(OP_Move, t, lhs.reg));
+
+      auto jump = this->emit(Instruction(
+          elem.kind == AST::EX_And ? OP_JmpIfNot : OP_JmpIf, t));
+
+      this->compile_to(t, elem.ast);
+      this->patch(jump, this->here());
+
+      this->free_to(std::max(mark, t + 1));
+
+      lhs = {t, true};
+      continue;
+    }
+
+    auto rhs = this->compile_expr(elem.ast);
+    auto rhs_kind = type_of(elem.ast).kind;
+
+    //
+    // 結果の型 (Sema::is_valid_expr と同じ規則)
+    auto res_kind = cur_kind;
+
+    if (elem.kind == AST::EX_Sub &&
+        TypeInfo(cur_kind).is_numeric() &&
+        TypeInfo(rhs_kind).is_numeric()) {
+      res_kind = cur_kind == TYPE_Float ? cur_kind : rhs_kind;
+    }
+
+    lhs = this->convert(lhs, cur_kind, res_kind, elem.ast);
+    rhs = this->convert(rhs, rhs_kind, res_kind, elem.ast);
+
+    auto op = OP_Todo;
+
+    switch (res_kind) {
+      case TYPE_Int: {
+        static OpCode const table[]{
+            OP_AddI, OP_SubI, OP_MulI,  OP_DivI,
+            OP_ModI, OP_ShlI, OP_ShrI,  OP_BAndI,
+            OP_BXorI, OP_BOrI, OP_Todo, OP_Todo,
+        };
+
+        op = table[elem.kind];
+        break;
+      }
+
+      case TYPE_USize: {
+        static OpCode const table[]{
+            OP_AddU, OP_SubU, OP_MulU, OP_DivU,
+            OP_ModU, OP_Todo, OP_Todo, OP_Todo,
+            OP_Todo, OP_Todo, OP_Todo, OP_Todo,
+        };
+
+        op = table[elem.kind];
+        break;
+      }
+
+      case TYPE_Float: {
+        static OpCode const table[]{
+            OP_AddF, OP_SubF, OP_MulF, OP_DivF,
+            OP_Todo, OP_Todo, OP_Todo, OP_Todo,
+            OP_Todo, OP_Todo, OP_Todo, OP_Todo,
+        };
+
+        op = table[elem.kind];
+        break;
+      }
+    }
+
+    this->emit(Instruction(op, t, lhs.reg, rhs.reg),
+               elem.ast, &elem.op);
+
+    this->free_to(std::max(mark, t + 1));
+
+    lhs = {t, true};
+    cur_kind = res_kind;
+  }
+
+  return {t, true};
+}
+
+//
+// 比較式
+//  左から順に比較して、偽になった時点で終了する
+Compiler::Operand Compiler::compile_compare(AST::Compare* ast,
+                                            int32_t hint)
+{
+  auto t = hint >= 0 ? hint : this->alloc_reg();
+
+  auto lhs = this->compile_expr(ast->first);
+  auto lhs_kind = type_of(ast->first).kind;
+
+  std::vector<size_t> jumps;
+
+  for (auto&& elem : ast->elements) {
+    auto rhs = this->compile_expr(elem.ast);
+    auto rhs_kind = type_of(elem.ast).kind;
+
+    // 次の比較では変換する前の値を使う
+    auto next = rhs;
+
+    auto cmp_kind = lhs_kind;
+
+    if (lhs_kind != rhs_kind) {
+      //
+      // 数値どうしは float があれば float、
+      // int と usize は int にそろえる (Operators と同じ)
+      if (TypeInfo(lhs_kind).is_numeric() &&
+          TypeInfo(rhs_kind).is_numeric()) {
+        cmp_kind = lhs_kind == TYPE_Float || rhs_kind == TYPE_Float
+                       ? TYPE_Float
+                       : TYPE_Int;
+
+        lhs = this->convert(lhs, lhs_kind, cmp_kind, elem.ast);
+        rhs = this->convert(rhs, rhs_kind, cmp_kind, elem.ast);
+      }
+      else {
+        // 型の違うもの同士は等しくならない
+        this->emit(Instruction(OP_LoadBool, t,
+                               elem.kind == AST::CMP_NotEqual));
+        goto _next;
+      }
+    }
+
+    {
+      auto op = OP_CmpO;
+
+      switch (cmp_kind) {
+        case TYPE_Int:
+          op = OP_CmpI;
+          break;
+
+        case TYPE_USize:
+          op = OP_CmpU;
+          break;
+
+        case TYPE_Float:
+          op = OP_CmpF;
+          break;
+
+        case TYPE_Bool:
+          op = OP_CmpB;
+          break;
+
+        case TYPE_Char:
+          op = OP_CmpC;
+          break;
+      }
+
+      this->emit(
+          Instruction(op, t, lhs.reg, rhs.reg, elem.kind),
+          elem.ast, &elem.op);
+    }
+
+  _next:
+    if (&elem != &*ast->elements.rbegin())
+      jumps.emplace_back(
+          this->emit(Instruction(OP_JmpIfNot, t)));
+
+    lhs = next;
+    lhs_kind = rhs_kind;
+  }
+
+  for (auto&& j : jumps)
+    this->patch(j, this->here());
+
+  return {t, true};
+}
+
+//
+// 関数呼び出し
+//  引数は連続したレジスタに置き、結果は先頭に入る
+Compiler::Operand Compiler::compile_call(AST::CallFunc* ast,
+                                         int32_t hint)
+{
+  auto base = this->cur().free_reg;
+
+  auto passing = ast->is_builtin ? ast->builtin_func->arg_passing
+                                 : BuiltinFunc::ARG_Copy;
+
+  for (auto&& arg : ast->args) {
+    auto reg = this->alloc_reg();
+
+    // 複製せずに渡す
+    if (passing != BuiltinFunc::ARG_Copy) {
+      TypeInfo type;
+
+      auto opr = passing == BuiltinFunc::ARG_Ref && reg == base
+                     ? this->compile_container_ref(arg, type)
+                     : this->compile_expr(arg, reg);
+
+      if (opr.reg != reg)
+        this->emit(Instruction(OP_Move, reg, opr.reg));
+
+      this->free_to(reg + 1);
+    }
+    else
+      this->compile_to(reg, arg);
+  }
+
+  if (ast->args.empty())
+    this->alloc_reg();
+
+  if (ast->is_builtin) {
+    BuiltinCallSite site;
+
+    site.func = ast->builtin_func;
+    site.result_kind = type_of(ast).kind;
+
+    for (auto&& arg : ast->args)
+      site.arg_kinds.emplace_back(type_of(arg).kind);
+
+    this->emit(Instruction(OP_CallBuiltin, base,
+                           this->program.builtin_calls.size(),
+                           base),
+               ast);
+
+    this->program.builtin_calls.emplace_back(
+        std::move(site));
+  }
+  else {
+    this->emit(Instruction(OP_Call, base,
+                           this->function_index[ast->callee],
+                           base),
+               ast);
+  }
+
+  this->free_to(base + 1);
+
+  if (hint >= 0 && hint != base) {
+    this->emit(Instruction(OP_Move, hint, base));
+    return {hint, true};
+  }
+
+  return {base, true};
+}
+
+//
+// インデックス参照 (読み込み)
+Compiler::Operand Compiler::compile_index(AST::IndexRef* ast,
+                                          int32_t hint)
+{
+  auto obj = this->compile_expr(ast->expr);
+  auto type = type_of(ast->expr);
+
+  for (auto&& index : ast->indexes) {
+    auto idx = this->compile_expr(index);
+
+    auto t = index == *ast->indexes.rbegin() && hint >= 0
+                 ? hint
+                 : this->alloc_reg();
+
+    switch (type.kind) {
+      case TYPE_Vector: {
+        auto elem = type.type_params[0];
+
+        this->emit(Instruction(OP_GetIndexV, t, obj.reg,
+                               idx.reg, elem.kind),
+                   index);
+
+        type = std::move(elem);
+        break;
+      }
+
+      case TYPE_Dict: {
+        auto value = type.type_params[1];
+
+        this->emit(
+            Instruction(OP_GetIndexD, t, obj.reg, idx.reg,
+                        type.type_params[0].kind |
+                            (value.kind << 4)),
+            index);
+
+        type = std::move(value);
+        break;
+      }
+
+      default:
+        this->emit(OP_Todo, index);
+    }
+
+    // コンテナの要素は借りているだけ
+    obj = {t, !is_heap_type(type.kind)};
+  }
+
+  return obj;
+}
+
+//
+// メンバ参照 (読み込み)
+Compiler::Operand Compiler::compile_member(AST::IndexRef* ast,
+                                           int32_t hint)
+{
+  auto obj = this->compile_expr(ast->expr);
+  auto type = type_of(ast->expr);
+
+  for (auto&& member : ast->indexes) {
+    auto index = ((AST::Variable*)member)->index;
+
+    auto t = member == *ast->indexes.rbegin() && hint >= 0
+                 ? hint
+                 : this->alloc_reg();
+
+    auto mtype = type.members[index].second;
+
+    this->emit(Instruction(OP_GetMember, t, obj.reg, index,
+                           mtype.kind),
+               member);
+
+    type = std::move(mtype);
+    obj = {t, !is_heap_type(type.kind)};
+  }
+
+  return obj;
+}
+
+Compiler::Operand Compiler::compile_cast(AST::Cast* ast,
+                                         int32_t hint)
+{
+  auto from = type_of(ast->expr).kind;
+  auto to = type_of(ast->cast_to).kind;
+
+  auto opr = this->compile_expr(ast->expr);
+  auto res = this->convert(opr, from, to, ast);
+
+  if (hint >= 0 && res.reg != hint) {
+    this->emit(Instruction(OP_Move, hint, res.reg));
+    return {hint, true};
+  }
+
+  return res;
+}
+
+Compiler::Operand Compiler::convert(Operand opr, TypeKind from,
+                                    TypeKind to, AST::Base* ast)
+{
+  if (from == to)
+    return opr;
+
+  auto op = OP_Todo;
+
+  switch (from) {
+    case TYPE_Int:
+      switch (to) {
+        case TYPE_Float:
+          op = OP_IntToFloat;
+          break;
+
+        case TYPE_Bool:
+          op = OP_IntToBool;
+          break;
+
+        case TYPE_Char:
+          op = OP_IntToChar;
+          break;
+
+        case TYPE_USize:
+          op = OP_IntToUSize;
+          break;
+      }
+      break;
+
+    case TYPE_USize:
+      switch (to) {
+        case TYPE_Int:
+          op = OP_USizeToInt;
+          break;
+
+        case TYPE_Float:
+          op = OP_USizeToFloat;
+          break;
+      }
+      break;
+
+    case TYPE_Float:
+      switch (to) {
+        case TYPE_Int:
+          op = OP_FloatToInt;
+          break;
+
+        case TYPE_Bool:
+          op = OP_FloatToBool;
+          break;
+      }
+      break;
+
+    case TYPE_Bool:
+      switch (to) {
+        case TYPE_Int:
+          op = OP_BoolToInt;
+          break;
+
+        case TYPE_Float:
+          op = OP_BoolToFloat;
+          break;
+      }
+      break;
+  }
+
+  auto t = this->alloc_reg();
+
+  this->emit(Instruction(op, t, opr.reg), ast);
+
+  return {t, true};
+}
+
+//
+// 代入
+Compiler::Operand Compiler::compile_assign(AST::Assign* ast,
+                                           int32_t hint)
+{
+  auto dest = ast->dest;
+  auto type = type_of(ast->expr);
+
+  //
+  // 変数
+  if (dest->kind == AST_Variable) {
+    auto name = ((AST::Variable*)dest)->name;
+
+    if (auto var = this->find_local(name); var) {
+      auto mark = this->cur().free_reg;
+      auto opr = this->compile_expr(ast->expr);
+
+      if (opr.reg != var->reg) {
+        if (!opr.is_temp && is_heap_type(type.kind))
+          this->emit(Instruction(OP_Clone, var->reg, opr.reg));
+        else
+          this->emit(Instruction(OP_Move, var->reg, opr.reg));
+      }
+
+      this->free_to(mark);
+
+      if (hint >= 0) {
+        this->emit(Instruction(OP_Move, hint, var->reg));
+        return {hint, !is_heap_type(type.kind)};
+      }
+
+      return {var->reg, false};
+    }
+
+    auto var = this->find_global(name);
+
+    if (!var)
+      Error(dest, "undefined variable name").emit().exit();
+
+    auto t = hint >= 0 ? hint : this->alloc_reg();
+
+    this->compile_to(t, ast->expr);
+    this->emit(Instruction(OP_SetGlobal, var->reg, t));
+
+    return {t, !is_heap_type(type.kind)};
+  }
+
+  //
+  // コンテナの要素・メンバ
+  auto ref = (AST::IndexRef*)dest;
+  auto is_member = dest->kind == AST_MemberAccess;
+
+  TypeInfo cont_type;
+
+  auto cont = this->compile_container_ref(ref->expr, cont_type);
+
+  //
+  // 最後の一つ手前までたどる
+  for (auto it = ref->indexes.begin();
+       it != ref->indexes.end() - 1; it++) {
+    cont = this->compile_ref_step(cont, cont_type, *it,
+                                  is_member);
+  }
+
+  auto last = *ref->indexes.rbegin();
+
+  Operand idx;
+
+  if (!is_member)
+    idx = this->compile_expr(last);
+
+  auto value = hint >= 0 ? hint : this->alloc_reg();
+
+  this->compile_to(value, ast->expr);
+
+  if (is_member) {
+    this->emit(Instruction(OP_SetMember, cont.reg,
+                           ((AST::Variable*)last)->index,
+                           value, type.kind),
+               last);
+  }
+  else if (cont_type.kind == TYPE_Vector) {
+    this->emit(Instruction(OP_SetIndexV, cont.reg, idx.reg,
+                           value, type.kind),
+               last);
+  }
+  else {
+    this->emit(
+        Instruction(OP_SetIndexD, cont.reg, idx.reg, value,
+                    cont_type.type_params[0].kind |
+                        (type.kind << 4)),
+        last);
+  }
+
+  return {value, !is_heap_type(type.kind)};
+}
+
+//
+// 書き込み先のコンテナを求める
+//  複製せずに、元のオブジェクトを指すレジスタを返す
+//
+//  (Sema は左辺の型を保存しないので、型もここで求める)
+Compiler::Operand Compiler::compile_container_ref(
+    AST::Base* _ast, TypeInfo& type)
+{
+  switch (_ast->kind) {
+    case AST_Variable: {
+      astdef(Variable);
+
+      auto var = this->find_local(ast->name);
+
+      if (!var)
+        var = this->find_global(ast->name);
+
+      if (!var)
+        Error(ast, "undefined variable name").emit().exit();
+
+      type = var->type;
+
+      return this->compile_expr(_ast);
+    }
+
+    case AST_IndexRef:
+    case AST_MemberAccess: {
+      astdef(IndexRef);
+
+      auto cont = this->compile_container_ref(ast->expr, type);
+
+      for (auto&& index : ast->indexes) {
+        cont = this->compile_ref_step(
+            cont, type, index, _ast->kind == AST_MemberAccess);
+      }
+
+      return cont;
+    }
+  }
+
+  type = type_of(_ast);
+
+  return this->compile_expr(_ast);
+}
+
+//
+// コンテナの中の要素を一つたどる
+//  辞書にキーがなければ追加する
+Compiler::Operand Compiler::compile_ref_step(Operand cont,
+                                             TypeInfo& type,
+                                             AST::Base* index,
+                                             bool is_member)
+{
+  auto t = this->alloc_reg();
+
+  if (is_member) {
+    auto i = ((AST::Variable*)index)->index;
+
+    type = TypeInfo(type.members[i].second);
+
+    this->emit(
+        Instruction(OP_RefMember, t, cont.reg, i, type.kind),
+        index);
+  }
+  else if (type.kind == TYPE_Vector) {
+    auto idx = this->compile_expr(index);
+
+    type = TypeInfo(type.type_params[0]);
+
+    this->emit(Instruction(OP_RefIndexV, t, cont.reg, idx.reg,
+                           type.kind),
+               index);
+  }
+  else {
+    auto idx = this->compile_expr(index);
+    auto key_kind = type.type_params[0].kind;
+
+    type = TypeInfo(type.type_params[1]);
+
+    this->emit(Instruction(OP_RefIndexD, t, cont.reg, idx.reg,
+                           key_kind | (type.kind << 4)),
+               index);
+  }
+
+  return {t, false};
+}
+
+//
+// 変数定義
+void Compiler::compile_let(AST::VariableDeclaration* ast)
+{
+  auto type = ast->type ? type_of(ast->type)
+                        : type_of(ast->init);
+
+  auto reg = this->alloc_reg();
+
+  if (ast->init) {
+    this->compile_to(reg, ast->init);
+  }
+  else {
+    this->emit(
+        Instruction(OP_Default, reg, this->add_desc(type)));
+  }
+
+  this->free_to(reg + 1);
+
+  this->declare(ast->name, reg, type);
+}
+
+//
+// スコープ
+//  dest >= 0 なら最後の式の値を dest に入れる
+void Compiler::compile_scope(AST::Scope* ast, int32_t dest)
+{
+  if (ast->list.empty()) {
+    if (dest >= 0)
+      this->emit(Instruction(OP_LoadNone, dest));
+
+    return;
+  }
+
+  auto mark = this->cur().free_reg;
+
+  this->enter_scope();
+
+  for (auto&& item : ast->list) {
+    if (item == *ast->list.rbegin() && ast->return_last_expr &&
+        dest >= 0) {
+      this->compile_to(dest, item);
+      break;
+    }
+
+    this->compile_stmt(item);
+  }
+
+  if (!ast->return_last_expr && dest >= 0)
+    this->emit(Instruction(OP_LoadNone, dest));
+
+  this->leave_scope();
+
+  this->free_to(mark);
+}
+
+void Compiler::compile_if(AST::If* ast, int32_t dest)
+{
+  auto jump_false = this->compile_branch_if_false(ast->condition);
+
+  this->compile_scope((AST::Scope*)ast->if_true, dest);
+
+  if (!ast->if_false && dest < 0) {
+    this->patch(jump_false, this->here());
+    return;
+  }
+
+  auto jump_end = this->emit(OP_Jmp);
+
+  this->patch(jump_false, this->here());
+
+  if (!ast->if_false)
+    this->emit(Instruction(OP_LoadNone, dest));
+  else if (ast->if_false->kind == AST_If)
+    this->compile_if((AST::If*)ast->if_false, dest);
+  else
+    this->compile_scope((AST::Scope*)ast->if_false, dest);
+
+  this->patch(jump_end, this->here());
+}
+
+void Compiler::compile_switch(AST::Switch* ast, int32_t dest)
+{
+  auto mark = this->cur().free_reg;
+
+  auto item = this->compile_expr(ast->expr);
+  auto item_kind = type_of(ast->expr).kind;
+
+  std::vector<size_t> jumps_end;
+
+  for (auto&& c : ast->cases) {
+    auto case_mark = this->cur().free_reg;
+
+    std::vector<size_t> jumps_next;
+
+    auto cond = this->compile_expr(c->cond);
+    auto cond_kind = type_of(c->cond).kind;
+
+    if (cond_kind == TYPE_Bool)
+      jumps_next.emplace_back(
+          this->emit(Instruction(OP_JmpIfNot, cond.reg)));
+
+    auto t = this->alloc_reg();
+
+    //
+    // Object::equals と同じく、型が違えば一致しない
+    if (cond_kind != item_kind) {
+      this->emit(Instruction(OP_LoadBool, t, false));
+    }
+    else {
+      auto op = OP_CmpO;
+
+      switch (cond_kind) {
+        case TYPE_Int:
+        case TYPE_USize:
+          op = OP_CmpU;
+          break;
+
+        case TYPE_Float:
+          op = OP_CmpF;
+          break;
+
+        case TYPE_Bool:
+          op = OP_CmpB;
+          break;
+
+        case TYPE_Char:
+          op = OP_CmpC;
+          break;
+      }
+
+      this->emit(Instruction(op, t, cond.reg, item.reg,
+                             AST::CMP_Equal),
+                 c->cond);
+    }
+
+    jumps_next.emplace_back(
+        this->emit(Instruction(OP_JmpIfNot, t)));
+
+    this->free_to(case_mark);
+
+    this->compile_scope(c->scope, dest);
+
+    jumps_end.emplace_back(this->emit(OP_Jmp));
+
+    for (auto&& j : jumps_next)
+      this->patch(j, this->here());
+  }
+
+  if (dest >= 0)
+    this->emit(Instruction(OP_LoadNone, dest));
+
+  for (auto&& j : jumps_end)
+    this->patch(j, this->here());
+
+  this->free_to(mark);
+}
+
+void Compiler::compile_for(AST::For* ast)
+{
+  auto mark = this->cur().free_reg;
+  auto const& iterable_type = type_of(ast->iterable);
+
+  if (ast->iter->kind != AST_Variable) {
+    this->emit(OP_Todo, ast);
+    return;
+  }
+
+  switch (iterable_type.kind) {
+    case TYPE_Range:
+      break;
+
+    case TYPE_String:
+    case TYPE_Vector:
+    case TYPE_Dict:
+      this->compile_for_in(ast);
+      return;
+
+    default:
+      this->emit(OP_Todo, ast);
+      return;
+  }
+
+  this->enter_scope();
+
+  // iterator, end, step
+  auto iter = this->alloc_reg();
+  auto end = this->alloc_reg();
+  auto step = this->alloc_reg();
+
+  // by がなければ 1 ずつ増やす命令を使う
+  auto has_step = true;
+  AST::Base* step_ast = ast->iterable;
+
+  if (ast->iterable->kind == AST_Range) {
+    auto range = (AST::Range*)ast->iterable;
+
+    this->compile_to(iter, range->begin);
+    this->compile_to(end, range->end);
+
+    if (range->step) {
+      this->compile_to(step, range->step);
+      step_ast = range->step;
+    }
+    else {
+      has_step = false;
+    }
+  }
+  else {
+    auto obj = this->compile_expr(ast->iterable);
+
+    this->emit(Instruction(OP_UnpackRange, iter, obj.reg));
+    this->free_to(step + 1);
+  }
+
+  this->declare(((AST::Variable*)ast->iter)->name, iter,
+                TYPE_Int);
+
+  this->cur().loops.emplace_back();
+
+  auto prep = this->emit(
+      Instruction(has_step ? OP_ForPrepS : OP_ForPrep, iter),
+      step_ast);
+
+  auto body = this->here();
+
+  this->compile_scope((AST::Scope*)ast->code, -1);
+
+  auto loop = std::move(this->cur().loops.back());
+  this->cur().loops.pop_back();
+
+  for (auto&& j : loop.continues)
+    this->patch(j, this->here());
+
+  this->emit(Instruction(has_step ? OP_ForLoopS : OP_ForLoop,
+                         iter, 0, body));
+
+  this->patch(prep, this->here());
+
+  for (auto&& j : loop.breaks)
+    this->patch(j, this->here());
+
+  this->leave_scope();
+  this->free_to(mark);
+}
+
+//
+// for-in (vector, dict, string)
+//  コンテナは複製せずにレジスタに置き、
+//  要素もそのまま変数に入れる
+void Compiler::compile_for_in(AST::For* ast)
+{
+  auto mark = this->cur().free_reg;
+  auto const& iterable_type = type_of(ast->iterable);
+
+  this->enter_scope();
+
+  // container, index, version, element
+  auto obj = this->alloc_reg();
+
+  this->alloc_reg();
+  this->alloc_reg();
+
+  auto elem = this->alloc_reg();
+
+  auto opr = this->compile_expr(ast->iterable, obj);
+
+  if (opr.reg != obj)
+    this->emit(Instruction(OP_Move, obj, opr.reg));
+
+  this->free_to(elem + 1);
+
+  auto elem_type = iterable_type.kind == TYPE_String
+                       ? TypeInfo(TYPE_Char)
+                       : iterable_type.type_params[0];
+
+  elem_type.is_const = true;
+
+  this->declare(((AST::Variable*)ast->iter)->name, elem,
+                elem_type);
+
+  this->cur().loops.emplace_back();
+
+  auto prep = this->emit(Instruction(OP_IterPrep, obj));
+
+  auto body = this->here();
+
+  this->compile_scope((AST::Scope*)ast->code, -1);
+
+  auto loop = std::move(this->cur().loops.back());
+  this->cur().loops.pop_back();
+
+  for (auto&& j : loop.continues)
+    this->patch(j, this->here());
+
+  this->emit(Instruction(OP_IterLoop, obj, 0, body),
+             ast->iterable);
+
+  this->patch(prep, this->here());
+
+  for (auto&& j : loop.breaks)
+    this->patch(j, this->here());
+
+  this->leave_scope();
+  this->free_to(mark);
+}
+
+void Compiler::compile_while(AST::While* ast)
+{
+  this->cur().loops.emplace_back();
+
+  auto begin = this->here();
+
+  auto jump_end = this->compile_branch_if_false(ast->cond);
+
+  this->compile_scope(ast->code, -1);
+
+  auto loop = std::move(this->cur().loops.back());
+  this->cur().loops.pop_back();
+
+  for (auto&& j : loop.continues)
+    this->patch(j, begin);
+
+  this->emit(Instruction(OP_Jmp, 0, 0, begin));
+
+  this->patch(jump_end, this->here());
+
+  for (auto&& j : loop.breaks)
+    this->patch(j, this->here());
+}
+
+void Compiler::compile_do_while(AST::DoWhile* ast)
+{
+  this->cur().loops.emplace_back();
+
+  auto begin = this->here();
+
+  this->compile_scope(ast->code, -1);
+
+  auto loop = std::move(this->cur().loops.back());
+  this->cur().loops.pop_back();
+
+  for (auto&& j : loop.continues)
+    this->patch(j, this->here());
+
+  auto jump_end = this->compile_branch_if_false(ast->cond);
+
+  this->emit(Instruction(OP_Jmp, 0, 0, begin));
+
+  this->patch(jump_end, this->here());
+
+  for (auto&& j : loop.breaks)
+    this->patch(j, this->here());
+}
+
+void Compiler::compile_loop(AST::Loop* ast)
+{
+  this->cur().loops.emplace_back();
+
+  auto begin = this->here();
+
+  this->compile_scope((AST::Scope*)ast->code, -1);
+
+  auto loop = std::move(this->cur().loops.back());
+  this->cur().loops.pop_back();
+
+  for (auto&& j : loop.continues)
+    this->patch(j, begin);
+
+  this->emit(Instruction(OP_Jmp, 0, 0, begin));
+
+  for (auto&& j : loop.breaks)
+    this->patch(j, this->here());
+}
+
+void Compiler::compile_return(AST::Return* ast)
+{
+  if (!ast->expr) {
+    this->emit(OP_ReturnNone, ast);
+    return;
+  }
+
+  auto t = this->alloc_reg();
+
+  this->compile_to(t, ast->expr);
+
+  this->emit(Instruction(OP_Return, t), ast);
+}
+
+size_t Compiler::compile_branch_if_false(AST::Base* cond)
+{
+  auto mark = this->cur().free_reg;
+
+  //
+  // 整数同士の比較が一つだけなら、比較とジャンプをまとめる
+  if (cond->kind == AST_Compare) {
+    auto cmp = (AST::Compare*)cond;
+
+    if (cmp->elements.size() == 1 &&
+        type_of(cmp->first).kind == TYPE_Int &&
+        type_of(cmp->elements[0].ast).kind == TYPE_Int) {
+      auto& elem = cmp->elements[0];
+
+      auto lhs = this->compile_expr(cmp->first);
+      auto rhs = this->compile_expr(elem.ast);
+
+      auto ret = this->emit(Instruction(OP_JmpCmpI, lhs.reg,
+                                        rhs.reg, 0, elem.kind),
+                            elem.ast, &elem.op);
+
+      this->free_to(mark);
+
+      return ret;
+    }
+  }
+
+  auto opr = this->compile_expr(cond);
+
+  auto ret = this->emit(Instruction(OP_JmpIfNot, opr.reg));
+
+  this->free_to(mark);
+
+  return ret;
+}
+
+size_t Compiler::emit(Instruction const& inst,
+                      AST::Base const* ast, Token const* token)
+{
+  auto& func = *this->cur().func;
+
+  func.code.emplace_back(inst);
+  func.locations.emplace_back(ast, token);
+
+  return func.code.size() - 1;
+}
+
+void Compiler::patch(size_t at, size_t target)
+{
+  this->cur().func->code[at].c = target;
+}
+
+size_t Compiler::here() const
+{
+  return this->state->func->code.size();
+}
+
+int32_t Compiler::alloc_reg()
+{
+  auto& fs = this->cur();
+  auto reg = fs.free_reg++;
+
+  if ((size_t)fs.free_reg > fs.func->num_regs)
+    fs.func->num_regs = fs.free_reg;
+
+  return reg;
+}
+
+void Compiler::free_to(int32_t reg)
+{
+  this->cur().free_reg = reg;
+}
+
+int32_t Compiler::add_constant(Register reg)
+{
+  this->program.constants.emplace_back(reg);
+
+  return this->program.constants.size() - 1;
+}
+
+int32_t Compiler::add_desc(TypeInfo const& type)
+{
+  this->program.descs.emplace_back(TypeInfo::intern(type));
+
+  return this->program.descs.size() - 1;
+}
+
+void Compiler::enter_scope()
+{
+  this->cur().scopes.emplace_back();
+}
+
+void Compiler::leave_scope()
+{
+  this->cur().scopes.pop_back();
+}
+
+Compiler::LocalVar& Compiler::declare(std::string_view name,
+                                      int32_t reg,
+                                      TypeInfo const& type)
+{
+  return this->cur().scopes.back().emplace_back(
+      LocalVar{name, reg, type});
+}
+
+Compiler::LocalVar* Compiler::find_local(
+    std::string_view name)
+{
+  auto& scopes = this->cur().scopes;
+
+  for (auto s = scopes.rbegin(); s != scopes.rend(); s++) {
+    for (auto v = s->rbegin(); v != s->rend(); v++) {
+      if (v->name == name)
+        return &*v;
+    }
+  }
+
+  return nullptr;
+}
+
+Compiler::LocalVar* Compiler::find_global(
+    std::string_view name)
+{
+  if (this->state == this->toplevel)
+    return nullptr;
+
+  auto& globals = this->toplevel->scopes[0];
+
+  for (auto v = globals.rbegin(); v != globals.rend(); v++) {
+    if (v->name == name)
+      return &*v;
+  }
+
+  return nullptr;
+}
+
+TypeInfo const& Compiler::type_of(AST::Base* ast)
+{
+  //
+  // Sema は else 付きの if の型を保存しないので、
+  // then 側のスコープの型を使う
+  if (ast->kind == AST_If)
+    return Sema::value_type_cache[((AST::If*)ast)->if_true];
+
+  return Sema::value_type_cache[ast];
+}
+
+bool Compiler::is_heap_type(TypeKind kind)
+{
+  switch (kind) {
+    case TYPE_String:
+    case TYPE_Range:
+    case TYPE_Vector:
+    case TYPE_Dict:
+    case TYPE_UserDef:
+      return true;
+  }
+
+  return false;
+}
+
+}  // namespace VM
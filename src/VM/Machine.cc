@@ -0,0 +1,917 @@
+#include <cassert>
+
+#include "Utils.h"
+#include "debug/alert.h"
+
+#include "AST.h"
+#include "Arith.h"
+#include "Object.h"
+#include "BuiltinFunc.h"
+
+#include "Error.h"
+#include "VM.h"
+
+namespace VM {
+
+//
+// 呼び出しの深さの上限
+//  (レジスタを使い切る前にエラーにする)
+static constexpr size_t MAX_FRAMES = 10000;
+
+//
+// レジスタの値を Value にする
+//  (コンテナへの格納、組み込み関数の呼び出しで使う)
+static Value to_value(Register reg, TypeKind kind)
+{
+  if (Value::is_heap_kind(kind))
+    return reg.v_obj;
+
+  Value ret;
+
+  ret.kind = kind;
+  ret.v_int = reg.v_int;
+
+  return ret;
+}
+
+static Register to_register(Value const& value)
+{
+  Register reg;
+
+  reg.v_int = value.v_int;
+
+  return reg;
+}
+
+//
+// for-in で回すコンテナの要素数
+//  version には書き換えた回数を入れる
+static size_t get_iter_size(Object* obj, uint32_t& version)
+{
+  switch (obj->type->kind) {
+    case TYPE_String: {
+      auto str = (ObjString*)obj;
+
+      version = str->version;
+      return str->get_value().length();
+    }
+
+    case TYPE_Vector: {
+      auto vec = (ObjVector*)obj;
+
+      version = vec->version;
+      return vec->size();
+    }
+
+    case TYPE_Dict: {
+      auto dict = (ObjDict*)obj;
+
+      version = dict->version;
+      return dict->get_items().size();
+    }
+
+    default:
+      todo_impl;
+  }
+}
+
+//
+// for-in で回すコンテナの i 番目の要素
+//  (辞書はキー)
+static Value get_iter_elem(Object* obj, size_t i)
+{
+  switch (obj->type->kind) {
+    case TYPE_String:
+      return Value::from_char(
+          ((ObjString*)obj)->get_value()[i]);
+
+    case TYPE_Vector:
+      return ((ObjVector*)obj)->at(i);
+
+    case TYPE_Dict:
+      return ((ObjDict*)obj)->get_items()[i].key;
+
+    default:
+      todo_impl;
+  }
+}
+
+//
+// type は TypeInfo::intern で作ったもの
+static Value make_default(TypeInfo const* type)
+{
+  switch (type->kind) {
+    case TYPE_Int:
+      return Value::from_int(0);
+
+    case TYPE_USize:
+      return Value::from_usize(0);
+
+    case TYPE_Float:
+      return Value::from_float(0);
+
+    case TYPE_Bool:
+      return Value::from_bool(false);
+
+    case TYPE_Char:
+      return Value::from_char(0);
+
+    case TYPE_String:
+      return new ObjString;
+
+    case TYPE_Dict: {
+      auto ret = new ObjDict;
+
+      ret->type = type;
+
+      return ret;
+    }
+
+    case TYPE_Vector: {
+      return new ObjVector(type);
+    }
+
+    case TYPE_UserDef: {
+      auto ret = new ObjUserType(type);
+
+      for (auto&& member : type->members) {
+        ret->add_member(
+            make_default(TypeInfo::intern(member.second)));
+      }
+
+      return ret;
+    }
+  }
+
+  return {};
+}
+
+template <class T>
+static bool compare(uint8_t kind, T a, T b)
+{
+  switch (kind) {
+    case AST::CMP_LeftBigger:
+      return a > b;
+
+    case AST::CMP_RightBigger:
+      return a < b;
+
+    case AST::CMP_LeftBigOrEqual:
+      return a >= b;
+
+    case AST::CMP_RightBigOrEqual:
+      return a <= b;
+
+    case AST::CMP_Equal:
+      return a == b;
+
+    case AST::CMP_NotEqual:
+      return a != b;
+  }
+
+  return false;
+}
+
+Machine::Machine(Program& program)
+    : program(program),
+      gc_mark(GarbageCollector::get_mark())
+{
+}
+
+Machine::~Machine()
+{
+  this->release(0, this->owners.size());
+}
+
+void Machine::link(void* const* labels)
+{
+  for (auto&& func : this->program.functions) {
+    for (auto&& inst : func.code) {
+      inst.handler = labels[inst.op];
+    }
+  }
+
+  this->program.is_linked = true;
+}
+
+Register* Machine::ensure_registers(size_t base, size_t count)
+{
+  if (this->registers.size() < base + count) {
+    this->registers.resize((base + count) * 2);
+    this->owners.resize(this->registers.size());
+  }
+
+  return this->registers.data() + base;
+}
+
+void Machine::change_owner(size_t index, Object* obj)
+{
+  auto& owner = this->owners[index];
+
+  if (obj) {
+    obj->ref_count++;
+    GarbageCollector::write_barrier(obj);
+  }
+
+  if (owner && --owner->ref_count == 0)
+    GarbageCollector::add_zero(owner);
+
+  owner = obj;
+}
+
+void Machine::release(size_t begin, size_t end)
+{
+  for (auto i = begin; i < end; i++)
+    this->hold(i, nullptr);
+}
+
+void Machine::collect_garbage()
+{
+  //
+  // 前回から ZCT に入ったもののうち、レジスタにも
+  // コンテナにもないものを削除する
+  //  (残るのは no_delete の定数だけ)
+  if (GarbageCollector::get_mark() != this->gc_mark) {
+    GarbageCollector::collect(this->gc_mark, {});
+    this->gc_mark = GarbageCollector::get_mark();
+  }
+
+  if (!GarbageCollector::is_requested())
+    return;
+
+  if (GarbageCollector::is_roots_needed()) {
+    for (auto&& obj : this->owners) {
+      if (obj)
+        GarbageCollector::mark_root(obj);
+    }
+  }
+
+  GarbageCollector::execute();
+}
+
+void Machine::runtime_error(Function const* func,
+                            Instruction const* pc,
+                            std::string const& msg)
+{
+  auto const& loc = func->locations[pc - func->code.data()];
+
+  if (loc.token)
+    Error(*loc.token, msg).emit().exit();
+
+  Error(loc.ast, msg).emit().exit();
+}
+
+void Machine::run()
+{
+  static void* const labels[]{
+#define _VM_LABEL(name) &&_op_##name,
+      VM_OPCODE_LIST(_VM_LABEL)
+#undef _VM_LABEL
+  };
+
+  if (!this->program.is_linked)
+    this->link(labels);
+
+  auto const& constants = this->program.constants;
+  auto const& descs = this->program.descs;
+
+  Function const* func = &this->program.functions[0];
+
+  size_t base = 0;
+
+  auto R = this->ensure_registers(base, func->num_regs);
+  auto code = func->code.data();
+  auto pc = code;
+
+#define dispatch goto*(pc->handler)
+#define next \
+  ++pc;      \
+  dispatch
+
+#define A R[pc->a]
+#define B R[pc->b]
+#define C R[pc->c]
+
+  //
+  // オブジェクトを入れたレジスタは参照を持つ
+#define hold_a(obj) this->hold(base + pc->a, obj)
+#define hold_value(i, value) \
+  this->hold(base + (i),     \
+             (value).is_heap() ? (value).v_obj : nullptr)
+
+#define binop(name, field, op) \
+  _op_##name:                  \
+  A.field = B.field op C.field;  \
+  next;
+
+#define intop(name, fn)                    \
+  _op_##name:                              \
+  A.v_int = Arith::fn(B.v_int, C.v_int);   \
+  next;
+
+#define convop(name, from, to, T) \
+  _op_##name:                     \
+  A.to = (T)B.from;               \
+  next;
+
+  dispatch;
+
+_op_Nop:
+  next;
+
+_op_Todo:
+  this->runtime_error(func, pc, "not implemented in vm");
+
+_op_Halt:
+  return;
+
+_op_Move:
+  A = B;
+  hold_a(this->owners[base + pc->b]);
+  next;
+
+_op_Clone:
+  A.v_obj = B.v_obj->clone();
+  hold_a(A.v_obj);
+  next;
+
+_op_LoadK:
+  A = constants[pc->b];
+  next;
+
+_op_LoadBool:
+  A.v_bool = pc->b;
+  next;
+
+_op_LoadNone:
+  A.v_obj = nullptr;
+  next;
+
+_op_GetGlobal:
+  A = this->registers[pc->b];
+  hold_a(this->owners[pc->b]);
+  next;
+
+_op_SetGlobal:
+  this->registers[pc->a] = B;
+  this->hold(pc->a, this->owners[base + pc->b]);
+  next;
+
+  //
+  // int
+  //  (桁あふれなどは Arith と同じ)
+  intop(AddI, add);
+  intop(SubI, sub);
+  intop(MulI, mul);
+
+_op_DivI:
+  if (C.v_int == 0)
+    this->runtime_error(func, pc, "division by zero");
+
+  A.v_int = Arith::div(B.v_int, C.v_int);
+  next;
+
+_op_ModI:
+  if (C.v_int == 0)
+    this->runtime_error(func, pc, "division by zero");
+
+  A.v_int = Arith::mod(B.v_int, C.v_int);
+  next;
+
+  intop(ShlI, shl);
+  intop(ShrI, shr);
+  binop(BAndI, v_int, &);
+  binop(BXorI, v_int, ^);
+  binop(BOrI, v_int, |);
+
+  //
+  // usize
+  binop(AddU, v_usize, +);
+  binop(SubU, v_usize, -);
+  binop(MulU, v_usize, *);
+
+_op_DivU:
+  if (C.v_usize == 0)
+    this->runtime_error(func, pc, "division by zero");
+
+  A.v_usize = B.v_usize / C.v_usize;
+  next;
+
+_op_ModU:
+  if (C.v_usize == 0)
+    this->runtime_error(func, pc, "division by zero");
+
+  A.v_usize = B.v_usize % C.v_usize;
+  next;
+
+  //
+  // float
+  binop(AddF, v_float, +);
+  binop(SubF, v_float, -);
+  binop(MulF, v_float, *);
+
+_op_DivF:
+  if (C.v_float == 0)
+    this->runtime_error(func, pc, "division by zero");
+
+  A.v_float = B.v_float / C.v_float;
+  next;
+
+_op_Append:
+  ((ObjString*)B.v_obj)->get_mut_value() +=
+      ((ObjString*)C.v_obj)->get_value();
+
+  A = B;
+  hold_a(A.v_obj);
+  next;
+
+_op_NegI:
+  A.v_int = Arith::neg(B.v_int);
+  next;
+
+_op_NegF:
+  A.v_float = -B.v_float;
+  next;
+
+  convop(IntToFloat, v_int, v_float, float);
+  convop(FloatToInt, v_float, v_int, int64_t);
+  convop(IntToBool, v_int, v_bool, bool);
+  convop(BoolToInt, v_bool, v_int, int64_t);
+  convop(FloatToBool, v_float, v_bool, bool);
+  convop(BoolToFloat, v_bool, v_float, float);
+  convop(IntToChar, v_int, v_char, wchar_t);
+  convop(IntToUSize, v_int, v_usize, size_t);
+  convop(USizeToInt, v_usize, v_int, int64_t);
+  convop(USizeToFloat, v_usize, v_float, float);
+
+  //
+  // compare
+  //  int 同士の比較は、木の評価器と同じく float で行う
+_op_CmpI:
+  A.v_bool = compare(pc->kind, B.v_int, C.v_int);
+  next;
+
+_op_CmpU:
+  A.v_bool = compare(pc->kind, B.v_usize, C.v_usize);
+  next;
+
+_op_CmpF:
+  A.v_bool = compare(pc->kind, B.v_float, C.v_float);
+  next;
+
+_op_CmpB:
+  A.v_bool = compare(pc->kind, B.v_bool, C.v_bool);
+  next;
+
+_op_CmpC:
+  A.v_bool = compare(pc->kind, B.v_char, C.v_char);
+  next;
+
+_op_CmpO: {
+  auto eq = B.v_obj->equals(C.v_obj);
+
+  A.v_bool = pc->kind == AST::CMP_NotEqual ? !eq : eq;
+  next;
+}
+
+  //
+  // jump
+_op_Jmp:
+  // ループの後方ジャンプ
+  if (pc->c <= pc - code)
+    this->safepoint();
+
+  pc = code + pc->c;
+  dispatch;
+
+_op_JmpIf:
+  if (A.v_bool) {
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  next;
+
+_op_JmpIfNot:
+  if (!A.v_bool) {
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  next;
+
+_op_JmpCmpI:
+  if (!compare(pc->kind, A.v_int, B.v_int)) {
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  next;
+
+  //
+  // call
+_op_Call: {
+  this->safepoint();
+
+  if (this->frames.size() >= MAX_FRAMES)
+    this->runtime_error(func, pc, "stack overflow");
+
+  this->frames.emplace_back(Frame{func, pc + 1, base, pc->a});
+
+  base += pc->c;
+  func = &this->program.functions[pc->b];
+
+  R = this->ensure_registers(base, func->num_regs);
+  code = pc = func->code.data();
+
+  dispatch;
+}
+
+_op_Return:
+_op_ReturnNone: {
+  Register value;
+  Object* owner = nullptr;
+
+  if (pc->op == OP_Return) {
+    value = A;
+    owner = this->owners[base + pc->a];
+  }
+  else
+    value.v_obj = nullptr;
+
+  //
+  // 戻り値を残して、フレームの参照を手放す
+  //  (戻り値は ZCT に入り、呼び出し元のセーフポイントまで残る)
+  if (owner)
+    owner->ref_count++;
+
+  this->release(base, base + func->num_regs);
+
+  auto const& frame = this->frames.back();
+
+  func = frame.func;
+  base = frame.base;
+  pc = frame.return_pc;
+
+  R = this->registers.data() + base;
+  code = func->code.data();
+
+  R[frame.dest] = value;
+  this->hold(base + frame.dest, owner);
+
+  if (owner && --owner->ref_count == 0)
+    GarbageCollector::add_zero(owner);
+
+  this->frames.pop_back();
+
+  dispatch;
+}
+
+_op_CallBuiltin: {
+  auto const& site = this->program.builtin_calls[pc->b];
+
+  Value result;
+
+  //
+  // dispatch (computed goto) ではデストラクタが呼ばれないので、
+  // args はここで破棄する
+  {
+    std::vector<Value> args;
+
+    for (size_t i = 0; i < site.arg_kinds.size(); i++) {
+      args.emplace_back(
+          to_value(R[pc->c + i], site.arg_kinds[i]));
+    }
+
+    try {
+      result = site.func->impl(args);
+    }
+    catch (BuiltinFunc::RuntimeError const& err) {
+      this->runtime_error(func, pc, err.message);
+    }
+  }
+
+  A = to_register(result);
+  hold_value(pc->a, result);
+
+  next;
+}
+
+  //
+  // コンテナの作成
+_op_NewVector: {
+  auto desc = descs[pc->c];
+  auto kind = desc->type_params.empty()
+                  ? TYPE_None
+                  : desc->type_params[0].kind;
+
+  auto vec = new ObjVector(desc);
+
+  for (int32_t i = 0; i < pc->b; i++) {
+    vec->append(to_value(R[pc->a + i], kind));
+  }
+
+  A.v_obj = vec;
+  hold_a(vec);
+  next;
+}
+
+_op_NewDict: {
+  auto desc = descs[pc->c];
+
+  auto key_kind = desc->type_params[0].kind;
+  auto value_kind = desc->type_params[1].kind;
+
+  auto dict = new ObjDict;
+
+  dict->type = desc;
+
+  for (int32_t i = 0; i < pc->b; i++) {
+    dict->append(to_value(R[pc->a + i * 2], key_kind),
+                 to_value(R[pc->a + i * 2 + 1], value_kind));
+  }
+
+  A.v_obj = dict;
+  hold_a(dict);
+  next;
+}
+
+_op_NewStruct: {
+  auto desc = descs[pc->c];
+
+  auto obj = new ObjUserType(desc);
+
+  for (int32_t i = 0; i < pc->b; i++) {
+    obj->add_member(
+        to_value(R[pc->a + i], desc->members[i].second.kind));
+  }
+
+  A.v_obj = obj;
+  hold_a(obj);
+  next;
+}
+
+_op_NewRange:
+  A.v_obj = new ObjRange(B.v_int, C.v_int);
+  hold_a(A.v_obj);
+  next;
+
+_op_Default: {
+  auto value = make_default(descs[pc->b]);
+
+  A = to_register(value);
+  hold_value(pc->a, value);
+  next;
+}
+
+_op_RangeStep:
+  if (B.v_int == 0)
+    this->runtime_error(func, pc, "range step must not be zero");
+
+  ((ObjRange*)A.v_obj)->step = B.v_int;
+  next;
+
+_op_UnpackRange: {
+  auto range = (ObjRange*)B.v_obj;
+
+  A.v_int = range->begin;
+  R[pc->a + 1].v_int = range->end;
+  R[pc->a + 2].v_int = range->step;
+
+  next;
+}
+
+  //
+  // index, member
+_op_GetIndexV: {
+  auto vec = (ObjVector*)B.v_obj;
+
+  if (C.v_usize >= vec->size())
+    this->runtime_error(func, pc, "index out of range");
+
+  auto const& value = vec->at(C.v_usize);
+
+  A = to_register(value);
+  hold_value(pc->a, value);
+  next;
+}
+
+  //
+  // 書き込み先をたどる
+  //  中身を共有していれば、ここで複製する
+_op_RefIndexV: {
+  auto& elements = ((ObjVector*)B.v_obj)->get_mut_elements();
+
+  if (C.v_usize >= elements.size())
+    this->runtime_error(func, pc, "index out of range");
+
+  A = to_register(elements[C.v_usize]);
+  hold_value(pc->a, elements[C.v_usize]);
+  next;
+}
+
+_op_GetIndexD:
+_op_RefIndexD: {
+  auto dict = (ObjDict*)B.v_obj;
+
+  auto key = to_value(C, (TypeKind)(pc->kind & 15));
+
+  if (pc->op == OP_RefIndexD) {
+    if (auto value = dict->find_mut(key); value) {
+      A = to_register(*value);
+      hold_value(pc->a, *value);
+      next;
+    }
+  }
+  else if (auto item = dict->find(key); item) {
+    A = to_register(item->value);
+    hold_value(pc->a, item->value);
+    next;
+  }
+
+  //
+  // 見つからない場合はデフォルト値
+  //  (参照の場合は追加する)
+  auto value =
+      make_default(TypeInfo::intern(dict->type->type_params[1]));
+
+  if (pc->op == OP_RefIndexD)
+    dict->append(key, value);
+
+  A = to_register(value);
+  hold_value(pc->a, value);
+  next;
+}
+
+_op_SetIndexV: {
+  auto vec = (ObjVector*)A.v_obj;
+
+  if (B.v_usize >= vec->size())
+    this->runtime_error(func, pc, "index out of range");
+
+  vec->set(B.v_usize, to_value(C, (TypeKind)pc->kind));
+  next;
+}
+
+_op_SetIndexD: {
+  auto dict = (ObjDict*)A.v_obj;
+
+  auto key = to_value(B, (TypeKind)(pc->kind & 15));
+  auto value = to_value(C, (TypeKind)(pc->kind >> 4));
+
+  if (auto item = dict->find_mut(key); item) {
+    item->dec_ref();
+
+    *item = value;
+    item->inc_ref();
+
+    next;
+  }
+
+  dict->append(key, value);
+  next;
+}
+
+_op_GetMember: {
+  auto const& value =
+      ((ObjUserType*)B.v_obj)->get_members()[pc->c];
+
+  A = to_register(value);
+  hold_value(pc->a, value);
+  next;
+}
+
+_op_RefMember: {
+  auto const& value =
+      ((ObjUserType*)B.v_obj)->get_mut_members()[pc->c];
+
+  A = to_register(value);
+  hold_value(pc->a, value);
+  next;
+}
+
+_op_SetMember: {
+  auto& member =
+      ((ObjUserType*)A.v_obj)->get_mut_members()[pc->b];
+
+  member.dec_ref();
+
+  member = to_value(C, (TypeKind)pc->kind);
+  member.inc_ref();
+
+  next;
+}
+
+  //
+  // for-range
+  //  a: iterator, a+1: end
+_op_ForPrep:
+  if (!(A.v_int < R[pc->a + 1].v_int)) {
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  next;
+
+_op_ForLoop:
+  // ループ中に i が代入されても桁あふれしないよう先に比べる
+  if (A.v_int < R[pc->a + 1].v_int &&
+      ++A.v_int < R[pc->a + 1].v_int) {
+    this->safepoint();
+
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  next;
+
+  //
+  // for-range (by)
+  //  a+2: step (負なら減らしていく)
+_op_ForPrepS: {
+  auto step = R[pc->a + 2].v_int;
+
+  if (step == 0)
+    this->runtime_error(func, pc, "range step must not be zero");
+
+  if (step > 0 ? !(A.v_int < R[pc->a + 1].v_int)
+               : !(A.v_int > R[pc->a + 1].v_int)) {
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  next;
+}
+
+_op_ForLoopS:
+  if (Arith::range_next(A.v_int, R[pc->a + 1].v_int,
+                        R[pc->a + 2].v_int)) {
+    this->safepoint();
+
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  next;
+
+  //
+  // for-in
+  //  a: コンテナ, a+1: 位置, a+2: version, a+3: 要素
+  //  要素は複製せずにそのまま入れる
+_op_IterPrep: {
+  uint32_t version;
+
+  if (get_iter_size(A.v_obj, version) == 0) {
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  auto elem = get_iter_elem(A.v_obj, 0);
+
+  R[pc->a + 1].v_usize = 0;
+  R[pc->a + 2].v_usize = version;
+  R[pc->a + 3] = to_register(elem);
+
+  hold_value(pc->a + 3, elem);
+  next;
+}
+
+_op_IterLoop: {
+  uint32_t version;
+
+  auto size = get_iter_size(A.v_obj, version);
+  auto& index = R[pc->a + 1].v_usize;
+
+  if (version != R[pc->a + 2].v_usize) {
+    this->runtime_error(func, pc,
+                        "container modified during iteration");
+  }
+
+  if (++index < size) {
+    auto elem = get_iter_elem(A.v_obj, index);
+
+    R[pc->a + 3] = to_register(elem);
+    hold_value(pc->a + 3, elem);
+
+    this->safepoint();
+
+    pc = code + pc->c;
+    dispatch;
+  }
+
+  next;
+}
+
+#undef dispatch
+#undef next
+#undef A
+#undef B
+#undef C
+#undef hold_a
+#undef hold_value
+#undef binop
+#undef intop
+#undef convop
+}
+
+}  // namespace VM
@@ -0,0 +1,57 @@
+#include "Utils.h"
+#include "Object.h"
+#include "VM.h"
+
+namespace VM {
+
+char const* Instruction::get_name(OpCode op)
+{
+  static char const* const names[]{
+#define _VM_OPCODE_NAME(name) #name,
+      VM_OPCODE_LIST(_VM_OPCODE_NAME)
+#undef _VM_OPCODE_NAME
+  };
+
+  return op < OP_Max ? names[op] : "(invalid)";
+}
+
+std::string Instruction::to_string() const
+{
+  return Utils::format("%-12s %4d %4d %4d  (kind=%d)",
+                       Instruction::get_name(this->op), this->a,
+                       this->b, this->c, this->kind);
+}
+
+std::string Function::dump() const
+{
+  auto ret = Utils::format(
+      "function %s (args=%zu, regs=%zu)\n", this->name.c_str(),
+      this->num_args, this->num_regs);
+
+  for (size_t i = 0; i < this->code.size(); i++) {
+    ret += Utils::format("  %04zu  ", i) +
+           this->code[i].to_string() + "\n";
+  }
+
+  return ret;
+}
+
+Program::~Program()
+{
+  for (auto&& obj : this->constant_objects) {
+    delete obj;
+  }
+}
+
+std::string Program::dump() const
+{
+  std::string ret;
+
+  for (auto&& func : this->functions) {
+    ret += func.dump() + "\n";
+  }
+
+  return ret;
+}
+
+}  // namespace VM
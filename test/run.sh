@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+#
+# run.sh
+#   test/*.metro を全てのエンジンで実行して、
+#   同じ名前の .expected と出力を比べる
+#
+#   usage: test/run.sh [metro] [test.metro...]
+#
+#   比べるのは標準出力 (エラーの見出しも含む) で、
+#   色は取り除く。エラーの位置 (標準エラー出力) は比べない。
+#   回すエンジンは ENGINES で変えられる (jit は -jit をつけた ast)。
+#
+
+METRO=${1:-./metro}
+shift
+
+DIR=$(dirname "$0")
+ENGINES=${ENGINES:-ast vm closure ir jit}
+
+if (($# == 0)); then
+  set -- "$DIR"/*.metro
+fi
+
+run() {
+  local engine=$1 file=$2 opt
+
+  if [ "$engine" = jit ]; then
+    opt=-jit
+  else
+    opt=-engine=$engine
+  fi
+
+  # エラーの見出しは改行なしで終わるので、awk で閉じる
+  "$METRO" "$opt" "$file" 2> /dev/null |
+    sed 's/\x1b\[[0-9;]*m//g' | awk '{ print }'
+}
+
+fail=0
+
+for file in "$@"; do
+  expected=${file%.metro}.expected
+
+  if [ ! -f "$expected" ]; then
+    continue
+  fi
+
+  for engine in $ENGINES; do
+    if ! diff -u "$expected" <(run "$engine" "$file") \
+      > /dev/null; then
+      echo "FAIL $engine $file"
+      fail=$((fail + 1))
+    fi
+  done
+done
+
+echo "failed: $fail"
+((fail == 0))